@@ -5,6 +5,7 @@ struct ObjectData
 {
     mat4 model;
     uint texture_index;
+    mat4 normal_matrix;
 };
 
 layout(set = 0, binding = 0) uniform ShadowMapBuffer{
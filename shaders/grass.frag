@@ -1,10 +1,6 @@
 #version 460
 #extension GL_EXT_nonuniform_qualifier : require
 
-layout(  push_constant ) uniform UniformBufferObject {
-    mat4 model;
-} ubo;
-
 layout(set = 0, binding = 0) uniform sampler2D texSampler[];
 layout(location = 0) out vec4 out_color;
 
@@ -1,28 +1,34 @@
 #version 460
 #extension GL_EXT_nonuniform_qualifier : require
 
+// One instance per blade scattered by grass_scatter.comp. The blade mesh is one
+// unit high in y and flat in x, it is turned to the facing of the blade, scaled
+// to its height and bent away from the facing towards the tip.
+
 layout(set = 1, binding = 0) uniform WorldBuffer{
     mat4 view;
     mat4 proj;
 } world;
 
-struct ObjectData
-{
-    mat4 model;
-    uint texture_index;
-};
-
-layout(std140,set = 2, binding = 0) readonly buffer ObjectBuffer{
-    ObjectData objects[];
-} ubo2;
+// xyz is the root of the blade in world space, w the facing angle and the height
+// scale as two halfs.
+layout(std430, set = 2, binding = 0) readonly buffer GrassBlades{
+    vec4 blades[];
+} grass;
 
 layout(location = 0) in vec3 inPosition;
 
 layout(location = 0) out float height;
 
 void main() {
-    ObjectData ubo = ubo2.objects[gl_InstanceIndex];
-    gl_Position = world.proj * world.view * ubo.model * vec4(inPosition, 1.0);
+    vec4 blade = grass.blades[gl_InstanceIndex];
+    vec2 facing_height = unpackHalf2x16(floatBitsToUint(blade.w));
+
+    vec2 across = vec2(cos(facing_height.x), sin(facing_height.x));
+    vec2 bend = vec2(-across.y, across.x) * 0.3 * inPosition.y * inPosition.y;
+
+    vec3 offset = vec3(across.x * inPosition.x + bend.x, inPosition.y, across.y * inPosition.x + bend.y) * facing_height.y;
+    gl_Position = world.proj * world.view * vec4(blade.xyz + offset, 1.0);
 
-    height = inPosition.y / 0.60;
+    height = inPosition.y;
 }
@@ -0,0 +1,216 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+
+// CDLOD terrain, see Terrain.h. Every instance is one patch of the quadtree. The
+// patch is a grid over [0, 1] in x and z that is placed and scaled to the patch,
+// displaced by the height map of the material and morphed into the grid of the
+// next coarser level as the distance to the camera reaches the end of the level.
+//
+// With a streamed height field, see HeightField.h, the heights come from the
+// resident tiles instead. Tiles that are not resident yet fall back to the
+// overview of the height field, a filtered version of the whole map.
+
+const int DisplacementMap = 1 << 0;
+const int DisplacementNormalMap = 1 << 1;
+
+int UvSampling = 1;
+
+layout(set = 0, binding = 0) uniform sampler2D texSampler[];
+
+struct LightBufferData
+{
+    vec3 position;
+    vec3 light_color;
+    vec3 sun_pos;
+    float strength;
+    float time_of_the_day;
+};
+layout(set = 1, binding = 0) uniform UniformWorld{
+    mat4 view;
+    mat4 proj;
+    vec3 pos;
+    LightBufferData light;
+} world;
+
+struct ObjectData
+{
+    mat4 model;
+    uint texture_index;
+    mat4 normal_matrix;
+};
+
+layout(std430,set = 2, binding = 0) readonly buffer ObjectBuffer{
+    ObjectData objects[];
+} ubo2;
+
+struct MaterialData
+{
+    int material_features;
+    int sampling_mode;
+    int shade_mode;
+    int displacement_map;
+    int displacement_normal_map;
+    float displacement_y;
+    float shininess;
+    float specular_strength;
+    int base_color_texture;
+    int base_color_normal_texture;
+    int roughness_texture;
+    int metallic_texture;
+    int ao_texture;
+    float texture_scale;
+    float roughness;
+    float metallic;
+    float ao;
+};
+
+layout(std430, set = 3, binding = 0) readonly buffer MaterialBufferObject{
+    MaterialData objects[];
+} materials;
+
+struct TerrainPatch
+{
+    vec2 offset;
+    float size;
+    float lod;
+    vec2 morph;
+    float patch_resolution;
+    float terrain_size;
+};
+
+layout(std430, set = 7, binding = 0) readonly buffer TerrainPatchBuffer{
+    TerrainPatch patches[];
+} terrain;
+
+layout(set = 8, binding = 0) uniform sampler2DArray height_tiles;
+
+// HeightFieldTableHeader followed by the slot of every tile.
+layout(std430, set = 9, binding = 0) readonly buffer HeightFieldTable{
+    int streamed;
+    int tiles_x;
+    int tiles_y;
+    int tile_size;
+    int width;
+    int height;
+    int overview;
+    int reserved;
+    int slots[];
+} height_field;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 in_tex_coord;
+layout(location = 2) in vec3 in_normal;
+layout(location = 3) in vec2 in_normal_coord;
+layout(location = 4) in vec3 in_tangent;
+layout(location = 5) in vec3 in_bitangent;
+
+layout(location = 0) out vec3 position_worldspace;
+layout(location = 1) out vec3 out_normal;
+layout(location = 2) out mat3 TBN;
+layout(location = 8) out vec2 uv_tex;
+layout(location = 9) out vec2 uv_normal;
+layout(location = 10) out int instance;
+
+MaterialData material;
+TerrainPatch node;
+
+// Height map coordinate of a position of the terrain, same as createFlatGround.
+vec2 heightCoord(vec2 xz)
+{
+    vec2 uv = (xz + node.terrain_size / 2) / node.terrain_size;
+    return vec2(uv.x, 1.0 - uv.y);
+}
+
+// Height of the resident tile, or of the overview when the tile is not resident.
+// The same texel centers as sampling the whole map, a tile holds the border to
+// the next.
+float streamedHeight(vec2 uv)
+{
+    vec2 size = vec2(height_field.width, height_field.height);
+    vec2 texel = clamp(uv * size - 0.5, vec2(0), size - 1);
+
+    ivec2 tile = min(ivec2(texel / height_field.tile_size), ivec2(height_field.tiles_x, height_field.tiles_y) - 1);
+    int slot = height_field.slots[tile.y * height_field.tiles_x + tile.x];
+    if (slot < 0)
+    {
+        return textureLod(height_tiles, vec3(uv, height_field.overview), 0).r;
+    }
+
+    vec2 local = texel - vec2(tile * height_field.tile_size);
+    vec2 tile_uv = (local + 0.5) / float(height_field.tile_size + 1);
+    return textureLod(height_tiles, vec3(tile_uv, slot), 0).r;
+}
+
+float height(vec2 xz)
+{
+    if ((material.material_features & DisplacementMap) == 0)
+    {
+        return 0.0;
+    }
+
+    vec2 uv = heightCoord(xz);
+    if (height_field.streamed != 0)
+    {
+        return streamedHeight(uv) * material.displacement_y;
+    }
+    return textureLod(texSampler[material.displacement_map], uv, 0).r * material.displacement_y;
+}
+
+void main()
+{
+    ObjectData ubo = ubo2.objects[gl_BaseInstance];
+    material = materials.objects[gl_BaseInstance];
+    node = terrain.patches[gl_InstanceIndex - gl_BaseInstance];
+
+    vec3 camera_pos = (inverse(ubo.model) * vec4(world.pos, 1)).xyz;
+
+    // Morph factor from the distance of the undisplaced grid position.
+    vec2 xz = node.offset + inPosition.xz * node.size;
+    float camera_distance = length(camera_pos - vec3(xz.x, height(xz), xz.y));
+    float morph = 1.0 - clamp(node.morph.x - camera_distance * node.morph.y, 0.0, 1.0);
+
+    // Odd grid vertices move onto the even ones, which is the grid of the next level.
+    vec2 odd = mod(round(inPosition.xz * node.patch_resolution), 2.0) / node.patch_resolution;
+    xz = node.offset + (inPosition.xz - odd * morph) * node.size;
+
+    vec3 pos = vec3(xz.x, height(xz), xz.y);
+    vec2 uv = heightCoord(xz);
+
+    vec3 normal;
+    if ((material.material_features & DisplacementNormalMap) != 0)
+    {
+        normal = normalize(2*textureLod(texSampler[material.displacement_normal_map], uv, 0).rbg-1.0);
+    }
+    else
+    {
+        // Central differences over one grid step of the patch.
+        float step = node.size / node.patch_resolution;
+        float dx = height(xz + vec2(step, 0)) - height(xz - vec2(step, 0));
+        float dz = height(xz + vec2(0, step)) - height(xz - vec2(0, step));
+        normal = normalize(vec3(-dx, 2*step, -dz));
+    }
+
+    // The inverse transpose model matrix is used for putting the vertex normal into model space
+    mat3 inv_trans = mat3(ubo.normal_matrix);
+
+    if (material.sampling_mode == UvSampling)
+    {
+        vec3 T = normalize(vec3(ubo.model * vec4(1, 0, 0, 0)));
+        vec3 B = normalize(vec3(ubo.model * vec4(0, 0, -1, 0)));
+        vec3 N = normalize(inv_trans * vec3(0, 1, 0));
+        TBN = mat3(T, B, N);
+    }
+    else
+    {
+        TBN = mat3(1.0f);
+    }
+
+    gl_Position = world.proj * world.view * ubo.model * vec4(pos, 1.0);
+    position_worldspace = (ubo.model * vec4(pos,1)).xyz;
+
+    out_normal = (inv_trans * normal);
+    // One texture repeat per unit of the terrain.
+    uv_tex = xz;
+    uv_normal = xz;
+    instance = gl_BaseInstance;
+}
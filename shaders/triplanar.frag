@@ -40,6 +40,7 @@ struct ObjectData
 {
     mat4 model;
     uint texture_index;
+    mat4 normal_matrix;
 };
 
 layout(std430, set = 2, binding = 0) readonly buffer ObjectBuffer{
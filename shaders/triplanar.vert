@@ -37,6 +37,7 @@ struct ObjectData
 {
     mat4 model;
     uint texture_index;
+    mat4 normal_matrix;
 };
 
 layout(std430,set = 2, binding = 0) readonly buffer ObjectBuffer{
@@ -68,12 +69,35 @@ layout(std430, set = 3, binding = 0) readonly buffer MaterialBufferObject{
     MaterialData objects[];
 } materials;
 
+#ifdef PACKED_VERTEX
+// PackedVertex: octahedral normal and a tangent with the bitangent sign in w.
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 in_tex_coord;
+layout(location = 2) in vec2 in_normal_oct;
+layout(location = 3) in vec2 in_normal_coord;
+layout(location = 4) in vec4 in_tangent_sign;
+
+vec3 in_normal;
+vec3 in_tangent;
+vec3 in_bitangent;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 in_tex_coord;
 layout(location = 2) in vec3 in_normal;
 layout(location = 3) in vec2 in_normal_coord;
 layout(location = 4) in vec3 in_tangent;
 layout(location = 5) in vec3 in_bitangent;
+#endif
 
 layout(location = 0) out vec3 position_worldspace;
 layout(location = 1) out vec3 out_normal;
@@ -86,12 +110,19 @@ MaterialData material;
 
 void main()
 {
+#ifdef PACKED_VERTEX
+    in_normal = octDecode(in_normal_oct);
+    in_tangent = in_tangent_sign.xyz;
+    in_bitangent = cross(in_normal, in_tangent) * in_tangent_sign.w;
+#endif
+
     ObjectData ubo = ubo2.objects[gl_BaseInstance];
     material = materials.objects[gl_BaseInstance];
 
     vec3 pos = inPosition;
     
-    // Displace the vertex if a vertex map is included
+    // Displace the vertex if a vertex map is included. Objects with baked
+    // displacement have both displacement features cleared, see displace.comp.
     if ((material.material_features & DisplacementMap) != 0)
     {
         vec4 displace = texture(texSampler[material.displacement_map], in_normal_coord);
@@ -108,7 +139,7 @@ void main()
     }
 
     // The inverse transpose model matrix is used for putting the vertex normal into model space
-    mat3 inv_trans = inverse(transpose(mat3(ubo.model)));
+    mat3 inv_trans = mat3(ubo.normal_matrix);
 
     // For UV sampling we require the tangent and bitangent to be present and generate the TBN output
     if (material.sampling_mode == UvSampling)
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Textures.h"
+#include "TextureStreaming.h"
+#include "DisplacementBake.h"
+#include "Grass.h"
 #include "Mesh.h"
 #include "Program.h"
 #include "Scene.h"
@@ -19,6 +22,8 @@
 struct Application
 {
     Textures textures;
+    // Every reference the application has to textures, see gui::reloadApplicationTexture.
+    std::vector<TextureHandle> texture_handles;
     Models models;
     Meshes meshes;
     std::vector<std::unique_ptr<Program>> programs;
@@ -27,4 +32,7 @@ struct Application
     SceneRenderPass scene_render_pass;
     PostProcessing ppp;
     CascadedShadowMap shadow_map;
+    DisplacementBake displacement_bake;
+    GrassScatter grass_scatter;
+    TextureStream texture_stream;
 };
\ No newline at end of file
@@ -0,0 +1,434 @@
+#include "BlockCompression.h"
+#include "JobSystem.h"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using Color = std::array<float, 4>;
+
+static float distanceSquared(Color const& a, Color const& b, int channels)
+{
+    float sum = 0.0f;
+    for (int c = 0; c < channels; ++c)
+    {
+        sum += (a[c] - b[c]) * (a[c] - b[c]);
+    }
+    return sum;
+}
+
+// Endpoints of the texels on the line through their mean along the direction
+// they vary the most in, from a few rounds of power iteration on the covariance.
+static std::array<Color, 2> fitEndpoints(std::array<Color, 16> const& texels, int channels)
+{
+    Color mean{};
+    for (auto const& texel : texels)
+    {
+        for (int c = 0; c < channels; ++c)
+        {
+            mean[c] += texel[c] / 16.0f;
+        }
+    }
+
+    std::array<std::array<float, 4>, 4> covariance{};
+    for (auto const& texel : texels)
+    {
+        for (int i = 0; i < channels; ++i)
+        {
+            for (int j = 0; j < channels; ++j)
+            {
+                covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+            }
+        }
+    }
+
+    Color axis{1.0f, 1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        Color next{};
+        float length = 0.0f;
+        for (int i = 0; i < channels; ++i)
+        {
+            for (int j = 0; j < channels; ++j)
+            {
+                next[i] += covariance[i][j] * axis[j];
+            }
+            length = std::max(length, std::abs(next[i]));
+        }
+
+        if (length < 1e-6f)
+        {
+            break;
+        }
+        for (int i = 0; i < channels; ++i)
+        {
+            axis[i] = next[i] / length;
+        }
+    }
+
+    float length = 0.0f;
+    for (int c = 0; c < channels; ++c)
+    {
+        length += axis[c] * axis[c];
+    }
+    length = std::sqrt(length);
+
+    float min_t = std::numeric_limits<float>::max();
+    float max_t = std::numeric_limits<float>::lowest();
+    for (auto const& texel : texels)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c)
+        {
+            t += (texel[c] - mean[c]) * axis[c] / length;
+        }
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+
+    std::array<Color, 2> endpoints{};
+    for (int c = 0; c < channels; ++c)
+    {
+        endpoints[0][c] = std::clamp(mean[c] + axis[c] / length * min_t, 0.0f, 255.0f);
+        endpoints[1][c] = std::clamp(mean[c] + axis[c] / length * max_t, 0.0f, 255.0f);
+    }
+    return endpoints;
+}
+
+template<size_t N>
+static uint32_t closest(Color const& texel, std::array<Color, N> const& palette, int channels)
+{
+    uint32_t best = 0;
+    float best_error = std::numeric_limits<float>::max();
+    for (uint32_t i = 0; i < N; ++i)
+    {
+        float const error = distanceSquared(texel, palette[i], channels);
+        if (error < best_error)
+        {
+            best = i;
+            best_error = error;
+        }
+    }
+    return best;
+}
+
+static uint16_t packRgb565(Color const& color)
+{
+    auto const r = static_cast<uint16_t>(std::lround(color[0] * 31.0f / 255.0f));
+    auto const g = static_cast<uint16_t>(std::lround(color[1] * 63.0f / 255.0f));
+    auto const b = static_cast<uint16_t>(std::lround(color[2] * 31.0f / 255.0f));
+    return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+static Color unpackRgb565(uint16_t packed)
+{
+    uint32_t const r = packed >> 11 & 31;
+    uint32_t const g = packed >> 5 & 63;
+    uint32_t const b = packed & 31;
+    return {float(r << 3 | r >> 2), float(g << 2 | g >> 4), float(b << 3 | b >> 2), 255.0f};
+}
+
+static void encodeBC1(std::array<Color, 16> const& texels, uint8_t* out)
+{
+    auto const endpoints = fitEndpoints(texels, 3);
+    uint16_t c0 = packRgb565(endpoints[1]);
+    uint16_t c1 = packRgb565(endpoints[0]);
+
+    // c0 > c1 selects the four color mode, the equal endpoints of a flat block
+    // only use index 0.
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        auto const a = unpackRgb565(c0);
+        auto const b = unpackRgb565(c1);
+        std::array<Color, 4> palette{a, b};
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2.0f * a[c] + b[c]) / 3.0f;
+            palette[3][c] = (a[c] + 2.0f * b[c]) / 3.0f;
+        }
+
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            indices |= closest(texels[i], palette, 3) << (2 * i);
+        }
+    }
+
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+// One channel in the eight value mode, the first endpoint is the larger one.
+static void encodeBC4(std::array<Color, 16> const& texels, int channel, uint8_t* out)
+{
+    float low = 255.0f;
+    float high = 0.0f;
+    for (auto const& texel : texels)
+    {
+        low = std::min(low, texel[channel]);
+        high = std::max(high, texel[channel]);
+    }
+
+    auto const a0 = static_cast<uint8_t>(std::lround(high));
+    auto const a1 = static_cast<uint8_t>(std::lround(low));
+
+    std::array<Color, 8> palette{};
+    palette[0][0] = a0;
+    palette[1][0] = a1;
+    for (int i = 2; i < 8; ++i)
+    {
+        palette[i][0] = ((8 - i) * a0 + (i - 1) * a1) / 7.0f;
+    }
+
+    uint64_t indices = 0;
+    if (a0 != a1)
+    {
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            Color const value{texels[i][channel]};
+            indices |= uint64_t(closest(value, palette, 1)) << (3 * i);
+        }
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (int i = 0; i < 6; ++i)
+    {
+        out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+struct BitWriter
+{
+    uint8_t* out;
+    uint32_t bit{};
+
+    void write(uint32_t value, uint32_t bits)
+    {
+        for (uint32_t i = 0; i < bits; ++i, ++bit)
+        {
+            if (value >> i & 1)
+            {
+                out[bit / 8] |= static_cast<uint8_t>(1 << bit % 8);
+            }
+        }
+    }
+};
+
+// Mode 6: 7 bit RGBA endpoints with one shared lowest bit each, 4 bit indices.
+static void encodeBC7(std::array<Color, 16> const& texels, uint8_t* out)
+{
+    constexpr std::array<uint32_t, 16> weights{0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    auto const endpoints = fitEndpoints(texels, 4);
+
+    // The lowest bit that gets an endpoint closest after quantization.
+    std::array<std::array<uint32_t, 4>, 2> quantized{};
+    std::array<uint32_t, 2> p_bits{};
+    std::array<Color, 2> decoded{};
+    for (int e = 0; e < 2; ++e)
+    {
+        float best_error = std::numeric_limits<float>::max();
+        for (uint32_t p = 0; p < 2; ++p)
+        {
+            std::array<uint32_t, 4> q{};
+            Color value{};
+            for (int c = 0; c < 4; ++c)
+            {
+                q[c] = static_cast<uint32_t>(std::clamp<long>(std::lround((endpoints[e][c] - p) / 2.0f), 0, 127));
+                value[c] = float(q[c] << 1 | p);
+            }
+
+            float const error = distanceSquared(endpoints[e], value, 4);
+            if (error < best_error)
+            {
+                best_error = error;
+                quantized[e] = q;
+                p_bits[e] = p;
+                decoded[e] = value;
+            }
+        }
+    }
+
+    std::array<Color, 16> palette{};
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            palette[i][c] = float(((64 - weights[i]) * uint32_t(decoded[0][c]) + weights[i] * uint32_t(decoded[1][c]) + 32) >> 6);
+        }
+    }
+
+    std::array<uint32_t, 16> indices{};
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        indices[i] = closest(texels[i], palette, 4);
+    }
+
+    // The index of the first texel is stored without its highest bit, swapping
+    // the endpoints makes it 0.
+    if (indices[0] >= 8)
+    {
+        std::swap(quantized[0], quantized[1]);
+        std::swap(p_bits[0], p_bits[1]);
+        for (auto& index : indices)
+        {
+            index = 15 - index;
+        }
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer{out};
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        writer.write(quantized[0][c], 7);
+        writer.write(quantized[1][c], 7);
+    }
+    writer.write(p_bits[0], 1);
+    writer.write(p_bits[1], 1);
+    writer.write(indices[0], 3);
+    for (uint32_t i = 1; i < 16; ++i)
+    {
+        writer.write(indices[i], 4);
+    }
+}
+
+void encodeBlock(BlockFormat format, std::span<uint8_t const, 64> texels, uint8_t* out)
+{
+    std::array<Color, 16> colors{};
+    for (size_t i = 0; i < 16; ++i)
+    {
+        for (size_t c = 0; c < 4; ++c)
+        {
+            colors[i][c] = texels[i * 4 + c];
+        }
+    }
+
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        encodeBC1(colors, out);
+        break;
+    case BlockFormat::BC4:
+        encodeBC4(colors, 0, out);
+        break;
+    case BlockFormat::BC5:
+        encodeBC4(colors, 0, out);
+        encodeBC4(colors, 1, out + 8);
+        break;
+    case BlockFormat::BC7:
+        encodeBC7(colors, out);
+        break;
+    }
+}
+
+std::vector<uint8_t> compressImage(BlockFormat format, std::span<uint8_t const> rgba, uint32_t width, uint32_t height)
+{
+    uint32_t const blocks_x = blocksFor(width);
+    uint32_t const blocks_y = blocksFor(height);
+    uint32_t const block_bytes = blockBytes(format);
+
+    if (rgba.size() < size_t(width) * height * 4)
+    {
+        return {};
+    }
+
+    std::vector<uint8_t> blocks(size_t(blocks_x) * blocks_y * block_bytes);
+
+    jobSystem().parallelFor(blocks_y, [&](size_t begin, size_t end)
+    {
+        std::array<uint8_t, 64> texels{};
+        for (size_t by = begin; by < end; ++by)
+        {
+            for (uint32_t bx = 0; bx < blocks_x; ++bx)
+            {
+                for (uint32_t y = 0; y < 4; ++y)
+                {
+                    for (uint32_t x = 0; x < 4; ++x)
+                    {
+                        size_t const px = std::min(bx * 4 + x, width - 1);
+                        size_t const py = std::min<size_t>(by * 4 + y, height - 1);
+                        std::memcpy(&texels[(y * 4 + x) * 4], &rgba[(py * width + px) * 4], 4);
+                    }
+                }
+                encodeBlock(format, texels, &blocks[(by * blocks_x + bx) * block_bytes]);
+            }
+        }
+    }, 4);
+
+    return blocks;
+}
+
+static float srgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+std::vector<std::vector<uint8_t>> generateMipChain(std::span<uint8_t const> rgba, uint32_t width, uint32_t height, bool srgb)
+{
+    std::array<float, 256> to_linear{};
+    for (int i = 0; i < 256; ++i)
+    {
+        to_linear[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+    }
+
+    std::vector<std::vector<uint8_t>> levels;
+    levels.emplace_back(rgba.begin(), rgba.begin() + std::min(rgba.size(), size_t(width) * height * 4));
+
+    while (width > 1 || height > 1)
+    {
+        auto const& source = levels.back();
+        uint32_t const next_width = std::max(1u, width / 2);
+        uint32_t const next_height = std::max(1u, height / 2);
+
+        // The source texels of an odd last row or column are left out, like the
+        // blits of the uncooked textures do.
+        std::vector<uint8_t> level(size_t(next_width) * next_height * 4);
+        jobSystem().parallelFor(next_height, [&](size_t begin, size_t end)
+        {
+            for (size_t y = begin; y < end; ++y)
+            {
+                for (size_t x = 0; x < next_width; ++x)
+                {
+                    std::array<size_t, 4> const texels{
+                        (std::min<size_t>(y * 2, height - 1) * width + std::min<size_t>(x * 2, width - 1)) * 4,
+                        (std::min<size_t>(y * 2, height - 1) * width + std::min<size_t>(x * 2 + 1, width - 1)) * 4,
+                        (std::min<size_t>(y * 2 + 1, height - 1) * width + std::min<size_t>(x * 2, width - 1)) * 4,
+                        (std::min<size_t>(y * 2 + 1, height - 1) * width + std::min<size_t>(x * 2 + 1, width - 1)) * 4,
+                    };
+
+                    for (size_t c = 0; c < 4; ++c)
+                    {
+                        float sum = 0.0f;
+                        for (auto const texel : texels)
+                        {
+                            sum += c < 3 ? to_linear[source[texel + c]] : source[texel + c] / 255.0f;
+                        }
+
+                        float const value = c < 3 && srgb ? linearToSrgb(sum / 4.0f) : sum / 4.0f;
+                        level[(y * next_width + x) * 4 + c] = static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+                    }
+                }
+            }
+        }, 16);
+
+        levels.push_back(std::move(level));
+        width = next_width;
+        height = next_height;
+    }
+
+    return levels;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Block compression of RGBA8 images on the CPU, for the texture cooker. Every
+// format stores 4x4 texels in one block, the GPU samples them without decoding.
+//
+// BC1 is RGB at 4 bits per texel, BC4 one channel and BC5 two channels at 4 and
+// 8 bits per texel. BC7 is RGBA at 8 bits per texel, only mode 6 is encoded:
+// one pair of RGBA endpoints and 16 steps between them for the whole block. It
+// is lower quality than a full BC7 encoder on blocks with more than one color
+// gradient, and much faster.
+enum class BlockFormat
+{
+    BC1,
+    BC4,
+    BC5,
+    BC7
+};
+
+inline uint32_t blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+inline uint32_t blocksFor(uint32_t texels)
+{
+    return (texels + 3) / 4;
+}
+
+// A block from 16 RGBA8 texels, row by row. out holds blockBytes of the format.
+// BC4 takes red, BC5 red and green, BC1 ignores alpha.
+void encodeBlock(BlockFormat format, std::span<uint8_t const, 64> texels, uint8_t* out);
+
+// Blocks of a width x height RGBA8 image, row by row. The edge texels are
+// repeated into the blocks that stick out of the image. Rows of blocks are
+// split across the job system.
+std::vector<uint8_t> compressImage(BlockFormat format,
+                                   std::span<uint8_t const> rgba,
+                                   uint32_t width,
+                                   uint32_t height);
+
+// Levels of the full mip chain of a width x height RGBA8 image down to 1x1,
+// level 0 is a copy of the image. Every level is a 2x2 box filter of the one
+// before. Color is averaged in linear space when srgb is set, alpha always is.
+std::vector<std::vector<uint8_t>> generateMipChain(std::span<uint8_t const> rgba,
+                                                   uint32_t width,
+                                                   uint32_t height,
+                                                   bool srgb);
+
+inline uint32_t mipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+    {
+        ++levels;
+    }
+    return levels;
+}
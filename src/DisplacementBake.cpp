@@ -0,0 +1,228 @@
+#include "DisplacementBake.h"
+
+#include "Material.h"
+#include "Object.h"
+#include "TypeLayer.h"
+#include "descriptor_set.h"
+
+#include "Pipelines/Pipeline.h"
+
+#include <cstddef>
+
+static constexpr uint32_t work_group_size = 64;
+static constexpr int displacement_features = MaterialFeatureFlag::DisplacementMap | MaterialFeatureFlag::DisplacementNormalMap;
+
+static Pipeline createDisplacementBakeProgram(RenderingState const& state)
+{
+    layer_types::Program program_desc;
+    program_desc.compute_shader = {("./shaders/displace.spv")};
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"texture_buffer"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding textures"}},
+            .binding = 0,
+            .type = layer_types::BindingType::TextureSampler,
+            .size = max_textures,
+            .compute = true
+        }
+    }});
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"source vertices"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding source vertices"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Storage,
+            .size = 1,
+            .compute = true
+        }
+    }});
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"baked vertices"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding baked vertices"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Storage,
+            .size = 1,
+            .compute = true
+        }
+    }});
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"displacement parameters"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding displacement parameters"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Uniform,
+            .size = 1,
+            .compute = true
+        }
+    }});
+
+    auto pipeline_data = createPipelineData(state, program_desc);
+    auto [pipeline, pipeline_layout] = createComputePipeline2(pipeline_data, state.device);
+
+    return bindPipeline(pipeline_data, pipeline, pipeline_layout);
+}
+
+DisplacementBake createDisplacementBake(RenderingState const& state, Textures& textures)
+{
+    DisplacementBake bake{
+        .program = createDisplacementBakeProgram(state),
+        .parameter_buffer = createUniformBuffers<DisplacementBakeBufferObject>(state)
+    };
+
+    auto const& sets = bake.program.descriptor_sets;
+    bindTextures(state.device, textures, sets[0].set, sets[0].layout_bindings[0]);
+    updateUniformBuffer<DisplacementBakeBufferObject>(state.device, bake.parameter_buffer, sets[3].set, sets[3].layout_bindings[0], 1);
+
+    return bake;
+}
+
+static bool bakeable(Object const& object)
+{
+    return object.object_type == ObjectType::STANDARD
+        && object.vertex_stride == sizeof(Vertex)
+        && object.vertex_count > 0
+        && (object.material.shader_data.material_features & displacement_features) != 0;
+}
+
+static DisplacementBakeBufferObject bakeParameters(Object const& object)
+{
+    auto const& material = object.material.shader_data;
+    return DisplacementBakeBufferObject{
+        .material_features = material.material_features & displacement_features,
+        .displacement_map = material.displacement_map_texture,
+        .displacement_normal_map = material.normal_map_texture,
+        .displacement_y = material.displacement_y,
+        .vertex_count = object.vertex_count,
+        .vertex_stride = sizeof(Vertex) / sizeof(float),
+        .position_offset = offsetof(Vertex, pos) / sizeof(float),
+        .normal_offset = offsetof(Vertex, normal) / sizeof(float),
+        .normal_coord_offset = offsetof(Vertex, normal_coord) / sizeof(float)
+    };
+}
+
+static void writeStorageBuffer(vk::Device const& device, vk::DescriptorSet set, vk::DescriptorSetLayoutBinding const& binding, vk::Buffer buffer)
+{
+    vk::DescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = VK_WHOLE_SIZE;
+
+    vk::WriteDescriptorSet desc_writes{};
+    desc_writes.sType = vk::StructureType::eWriteDescriptorSet;
+    desc_writes.setDstSet(set);
+    desc_writes.dstBinding = binding.binding;
+    desc_writes.dstArrayElement = 0;
+    desc_writes.descriptorType = binding.descriptorType;
+    desc_writes.descriptorCount = 1;
+    desc_writes.setBufferInfo(buffer_info);
+
+    device.updateDescriptorSets(desc_writes, nullptr);
+}
+
+static void recordBake(vk::CommandBuffer const& cmd_buffer, DisplacementBake const& bake, BakedDisplacement const& baked, uint32_t frame)
+{
+    auto const& program = bake.program;
+
+    vk::BufferMemoryBarrier barrier{};
+    barrier.sType = vk::StructureType::eBufferMemoryBarrier;
+    barrier.buffer = *baked.vertices.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+    // The previous frame may still draw with the vertices baked before.
+    barrier.srcAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+    cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eComputeShader,
+                               vk::DependencyFlags{}, {}, barrier, {});
+
+    cmd_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, program.pipeline);
+    for (size_t i = 0; i < program.descriptor_sets.size(); ++i)
+    {
+        auto desc_type = program.descriptor_sets[i].layout_bindings[0].descriptorType;
+        if (desc_type == vk::DescriptorType::eUniformBufferDynamic)
+        {
+            uint32_t offset = 0;
+            cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, program.pipeline_layout, i, 1, &program.descriptor_sets[i].set[frame], 1, &offset);
+        }
+        else
+        {
+            cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, program.pipeline_layout, i, 1, &program.descriptor_sets[i].set[frame], 0, nullptr);
+        }
+    }
+
+    cmd_buffer.dispatch((baked.parameters->vertex_count + work_group_size - 1) / work_group_size, 1, 1);
+
+    barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+    cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eVertexInput,
+                               vk::DependencyFlags{}, {}, barrier, {});
+}
+
+void recordDisplacementBakes(RenderingState const& state,
+                             vk::CommandBuffer const& cmd_buffer,
+                             DisplacementBake& bake,
+                             Scene& scene,
+                             uint32_t frame)
+{
+    // The source and baked vertex sets of the frame are written for the bake,
+    // so there is room for one bake per frame.
+    bool recorded = false;
+
+    for (auto& object : scene.objs)
+    {
+        auto entry = bake.objects.find(object.id);
+        auto* baked = entry != bake.objects.end() ? entry->second.get() : nullptr;
+
+        if (object.displacement_baked)
+        {
+            auto const parameters = bakeParameters(object);
+            if (bakeable(object) && baked->parameters == parameters)
+            {
+                continue;
+            }
+
+            // Displaced by the vertex shader again until it is baked with the new parameters.
+            object.vertex_buffer = baked->source;
+            object.displacement_baked = false;
+            baked->parameters.reset();
+        }
+
+        if (recorded || !bakeable(object))
+        {
+            continue;
+        }
+
+        if (!baked)
+        {
+            vk::DeviceSize const size = vk::DeviceSize(object.vertex_count) * sizeof(Vertex);
+            baked = bake.objects.emplace(object.id, std::make_unique<BakedDisplacement>(
+                createBuffer(state, size, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+                             vk::MemoryPropertyFlagBits::eDeviceLocal))).first->second.get();
+        }
+
+        baked->source = object.vertex_buffer;
+        baked->parameters = bakeParameters(object);
+        writeBuffer(*bake.parameter_buffer[frame], *baked->parameters);
+
+        auto const& sets = bake.program.descriptor_sets;
+        writeStorageBuffer(state.device, sets[1].set[frame], sets[1].layout_bindings[0], baked->source);
+        writeStorageBuffer(state.device, sets[2].set[frame], sets[2].layout_bindings[0], *baked->vertices.buffer);
+
+        recordBake(cmd_buffer, bake, *baked, frame);
+        recorded = true;
+
+        object.vertex_buffer = *baked->vertices.buffer;
+        object.displacement_baked = true;
+    }
+}
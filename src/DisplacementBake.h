@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Program.h"
+#include "Scene.h"
+#include "Textures.h"
+#include "VulkanRenderSystem.h"
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Parameters of displace.comp. They are also what a bake depends on, the
+// vertices are baked again when any of them changes. Offsets and the stride are
+// in floats into the Vertex struct.
+struct DisplacementBakeBufferObject
+{
+    int material_features{};
+    int displacement_map{};
+    int displacement_normal_map{};
+    float displacement_y{};
+    uint32_t vertex_count{};
+    uint32_t vertex_stride{};
+    uint32_t position_offset{};
+    uint32_t normal_offset{};
+    uint32_t normal_coord_offset{};
+
+    bool operator==(DisplacementBakeBufferObject const&) const = default;
+};
+
+// Copy of the vertices of an object with the displacement of its material applied.
+struct BakedDisplacement
+{
+    Buffer vertices;
+
+    // Weak handle to the vertex buffer of the mesh the copy is made from.
+    vk::Buffer source;
+
+    // What the vertices were last baked with, nothing is baked while it is empty.
+    std::optional<DisplacementBakeBufferObject> parameters;
+};
+
+// Bakes the displacement map and displacement normal map of standard objects
+// into their vertices with a compute pass, instead of sampling both maps for
+// every vertex in every pass and frame. The CDLOD and tessellated terrain still
+// displace in their shaders, their vertices are shared by every patch.
+struct DisplacementBake
+{
+    Pipeline program;
+    std::vector<std::unique_ptr<UniformBuffer>> parameter_buffer;
+
+    // Per object id.
+    std::map<int, std::unique_ptr<BakedDisplacement>> objects;
+};
+
+DisplacementBake createDisplacementBake(RenderingState const& state, Textures& textures);
+
+// Records the bakes of objects whose displacement changed and points the objects
+// at their baked vertices. One bake is recorded per frame, an object waiting for
+// its bake is displaced by the vertex shader meanwhile. Before the scene buffers
+// are written and outside of any render pass.
+void recordDisplacementBakes(RenderingState const& state,
+                             vk::CommandBuffer const& cmd_buffer,
+                             DisplacementBake& bake,
+                             Scene& scene,
+                             uint32_t frame);
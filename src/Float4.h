@@ -0,0 +1,106 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+// Four floats processed together. SSE when available, otherwise plain loops with
+// the same operation order so both give bit identical results.
+#if defined(__SSE__) || defined(_M_X64)
+struct Float4
+{
+    __m128 v;
+};
+
+inline Float4 load4(float const* p) { return {_mm_loadu_ps(p)}; }
+inline void store4(float* p, Float4 a) { _mm_storeu_ps(p, a.v); }
+inline Float4 splat4(float a) { return {_mm_set1_ps(a)}; }
+inline Float4 ramp4(float first) { return {_mm_setr_ps(first, first + 1, first + 2, first + 3)}; }
+inline Float4 operator+(Float4 a, Float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline Float4 operator-(Float4 a, Float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Float4 operator*(Float4 a, Float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline Float4 operator/(Float4 a, Float4 b) { return {_mm_div_ps(a.v, b.v)}; }
+inline Float4 sqrt4(Float4 a) { return {_mm_sqrt_ps(a.v)}; }
+inline Float4 abs4(Float4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+inline Float4 min4(Float4 a, Float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline Float4 max4(Float4 a, Float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+inline Float4 less4(Float4 a, Float4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline Float4 and4(Float4 a, Float4 b) { return {_mm_and_ps(a.v, b.v)}; }
+inline Float4 andNot4(Float4 a, Float4 b) { return {_mm_andnot_ps(a.v, b.v)}; }
+inline Float4 select4(Float4 mask, Float4 a, Float4 b) { return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))}; }
+#else
+struct Float4
+{
+    float v[4];
+};
+
+template<typename F>
+inline Float4 map4(F const& f)
+{
+    Float4 r;
+    for (int i = 0; i < 4; ++i)
+    {
+        r.v[i] = f(i);
+    }
+    return r;
+}
+
+inline Float4 load4(float const* p) { return map4([&](int i) { return p[i]; }); }
+inline void store4(float* p, Float4 a) { std::copy(a.v, a.v + 4, p); }
+inline Float4 splat4(float a) { return map4([&](int) { return a; }); }
+inline Float4 ramp4(float first) { return map4([&](int i) { return first + i; }); }
+inline Float4 operator+(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] + b.v[i]; }); }
+inline Float4 operator-(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] - b.v[i]; }); }
+inline Float4 operator*(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] * b.v[i]; }); }
+inline Float4 operator/(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] / b.v[i]; }); }
+inline Float4 sqrt4(Float4 a) { return map4([&](int i) { return std::sqrt(a.v[i]); }); }
+inline Float4 abs4(Float4 a) { return map4([&](int i) { return std::abs(a.v[i]); }); }
+inline Float4 min4(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] < b.v[i] ? a.v[i] : b.v[i]; }); }
+inline Float4 max4(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] > b.v[i] ? a.v[i] : b.v[i]; }); }
+inline Float4 less4(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] < b.v[i] ? 1.0f : 0.0f; }); }
+inline Float4 and4(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] != 0 && b.v[i] != 0 ? 1.0f : 0.0f; }); }
+inline Float4 andNot4(Float4 a, Float4 b) { return map4([&](int i) { return a.v[i] == 0 && b.v[i] != 0 ? 1.0f : 0.0f; }); }
+inline Float4 select4(Float4 mask, Float4 a, Float4 b) { return map4([&](int i) { return mask.v[i] != 0 ? a.v[i] : b.v[i]; }); }
+#endif
+
+struct Vec3x4
+{
+    Float4 x, y, z;
+};
+
+inline Vec3x4 operator+(Vec3x4 const& a, Vec3x4 const& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Vec3x4 operator-(Vec3x4 const& a, Vec3x4 const& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+
+// Same expressions as glm::cross, glm::dot and glm::normalize.
+inline Vec3x4 cross4(Vec3x4 const& a, Vec3x4 const& b)
+{
+    return {a.y * b.z - b.y * a.z,
+            a.z * b.x - b.z * a.x,
+            a.x * b.y - b.x * a.y};
+}
+
+inline Float4 dot4(Vec3x4 const& a, Vec3x4 const& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Vec3x4 normalize4(Vec3x4 const& a)
+{
+    auto const inverse_length = splat4(1.0f) / sqrt4(dot4(a, a));
+    return {a.x * inverse_length, a.y * inverse_length, a.z * inverse_length};
+}
+
+inline Vec3x4 select4(Float4 mask, Vec3x4 const& a, Vec3x4 const& b)
+{
+    return {select4(mask, a.x, b.x), select4(mask, a.y, b.y), select4(mask, a.z, b.z)};
+}
+
+inline Vec3x4 splat4(glm::vec3 const& a)
+{
+    return {splat4(a.x), splat4(a.y), splat4(a.z)};
+}
@@ -0,0 +1,226 @@
+#include "Grass.h"
+
+#include "Material.h"
+#include "Object.h"
+#include "Scene.h"
+#include "TypeLayer.h"
+#include "descriptor_set.h"
+
+#include "Pipelines/Pipeline.h"
+
+#include <cmath>
+
+GrassField createGrassField(RenderingState const& state)
+{
+    GrassField grass;
+    for (int i = 0; i < 2; ++i)
+    {
+        grass.blades.push_back(createBuffer(state, vk::DeviceSize(max_grass_blades) * sizeof(glm::vec4),
+                                            vk::BufferUsageFlagBits::eStorageBuffer,
+                                            vk::MemoryPropertyFlagBits::eDeviceLocal));
+        grass.draw.push_back(createBuffer(state, sizeof(vk::DrawIndexedIndirectCommand),
+                                          vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+                                          | vk::BufferUsageFlagBits::eTransferDst,
+                                          vk::MemoryPropertyFlagBits::eDeviceLocal));
+    }
+    return grass;
+}
+
+Model createGrassBlade()
+{
+    // Pairs of vertices from the root up, and the tip.
+    constexpr std::array<std::array<float, 2>, 4> rows{{
+        {0.05f, 0.0f},
+        {0.04f, 0.35f},
+        {0.025f, 0.7f},
+        {0.0f, 1.0f},
+    }};
+
+    Model model;
+    for (auto const& [half_width, y] : rows)
+    {
+        model.vertices.push_back(Vertex{.pos = {-half_width, y, 0}, .tex_coord = {0, y}, .normal = {0, 0, 1}});
+        if (half_width > 0)
+        {
+            model.vertices.push_back(Vertex{.pos = {half_width, y, 0}, .tex_coord = {1, y}, .normal = {0, 0, 1}});
+        }
+    }
+
+    auto const both_sides = [&model](uint32_t a, uint32_t b, uint32_t c)
+    {
+        model.indices.insert(model.indices.end(), {a, b, c, c, b, a});
+    };
+
+    for (uint32_t row = 0; row + 2 < rows.size(); ++row)
+    {
+        uint32_t const first = row * 2;
+        both_sides(first, first + 1, first + 3);
+        both_sides(first + 3, first + 2, first);
+    }
+    uint32_t const last = (rows.size() - 2) * 2;
+    both_sides(last, last + 1, last + 2);
+
+    model.bounds = computeBounds(model.vertices);
+    return model;
+}
+
+static Pipeline createGrassScatterProgram(RenderingState const& state)
+{
+    layer_types::Program program_desc;
+    program_desc.compute_shader = {("./shaders/grass_scatter.spv")};
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"texture_buffer"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding textures"}},
+            .binding = 0,
+            .type = layer_types::BindingType::TextureSampler,
+            .size = max_textures,
+            .compute = true
+        }
+    }});
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"grass scatter"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding grass scatter"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Uniform,
+            .size = 1,
+            .compute = true
+        }
+    }});
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"grass blades"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding grass blades"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Storage,
+            .size = 1,
+            .compute = true
+        }
+    }});
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"grass draw"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding grass draw"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Storage,
+            .size = 1,
+            .compute = true
+        }
+    }});
+
+    auto pipeline_data = createPipelineData(state, program_desc);
+    auto [pipeline, pipeline_layout] = createComputePipeline2(pipeline_data, state.device);
+
+    return bindPipeline(pipeline_data, pipeline, pipeline_layout);
+}
+
+GrassScatter createGrassScatter(RenderingState const& state, Textures& textures, GrassField const& grass)
+{
+    GrassScatter scatter{
+        .program = createGrassScatterProgram(state),
+        .parameter_buffer = createUniformBuffers<GrassScatterBufferObject>(state)
+    };
+
+    auto const& sets = scatter.program.descriptor_sets;
+    bindTextures(state.device, textures, sets[0].set, sets[0].layout_bindings[0]);
+    updateUniformBuffer<GrassScatterBufferObject>(state.device, scatter.parameter_buffer, sets[1].set, sets[1].layout_bindings[0], 1);
+    updateStorageBuffer(state.device, grass.blades, sets[2].set, sets[2].layout_bindings[0]);
+    updateStorageBuffer(state.device, grass.draw, sets[3].set, sets[3].layout_bindings[0]);
+
+    return scatter;
+}
+
+static Object const* grassObject(Scene const& scene)
+{
+    for (auto const& obj : scene.objs)
+    {
+        if (obj.object_type == ObjectType::GRASS && obj.visible)
+        {
+            return &obj;
+        }
+    }
+    return nullptr;
+}
+
+void recordGrassScatter(vk::CommandBuffer const& cmd_buffer, GrassScatter const& scatter, Scene const& scene, uint32_t frame)
+{
+    auto const& grass = scene.grass;
+    auto const* blade = grassObject(scene);
+    auto const* terrain = visibleTerrain(scene);
+
+    vk::DrawIndexedIndirectCommand draw{};
+    draw.indexCount = blade ? blade->indices_size : 0;
+    cmd_buffer.updateBuffer(*grass.draw[frame].buffer, 0, sizeof(draw), &draw);
+
+    vk::MemoryBarrier barrier{};
+    barrier.sType = vk::StructureType::eMemoryBarrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+                               vk::DependencyFlags{}, barrier, {}, {});
+
+    auto const& settings = grass.settings;
+    if (blade && terrain && settings.enabled && settings.tile_size > 0.0f)
+    {
+        auto const& material = terrain->material.shader_data;
+        auto const model = objectTransform(*terrain);
+        auto const view = glm::lookAt(scene.camera.pos, scene.camera.pos + scene.camera.camera_front, scene.camera.up);
+        auto const camera_pos = glm::vec3(glm::inverse(model) * glm::vec4(scene.camera.pos, 1.0f));
+
+        // Enough tiles around the one of the camera to reach density_end.
+        auto const radius = static_cast<int>(std::ceil(settings.density_end / settings.tile_size));
+        auto const camera_tile = glm::ivec2(glm::floor(glm::vec2(camera_pos.x, camera_pos.z) / settings.tile_size));
+        auto const tiles = static_cast<uint32_t>(2 * radius + 1);
+
+        GrassScatterBufferObject parameters{
+            .model = model,
+            .frustum_planes = extractFrustum(scene.camera.proj * view * model).planes,
+            .camera_pos = glm::vec4(camera_pos, 1.0f),
+            .first_tile = camera_tile - radius,
+            .tiles = tiles,
+            .max_blades = max_grass_blades,
+            .tile_size = settings.tile_size,
+            .terrain_size = scene.terrain_quadtree.size,
+            .max_height = material.displacement_y,
+            .displacement_map = (material.material_features & MaterialFeatureFlag::DisplacementMap) ? material.displacement_map_texture : -1,
+            .density_start = settings.density_start,
+            .density_end = settings.density_end,
+            .blade_height = settings.blade_height
+        };
+        writeBuffer(*scatter.parameter_buffer[frame], parameters);
+
+        auto const& program = scatter.program;
+        cmd_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, program.pipeline);
+        for (size_t i = 0; i < program.descriptor_sets.size(); ++i)
+        {
+            auto desc_type = program.descriptor_sets[i].layout_bindings[0].descriptorType;
+            if (desc_type == vk::DescriptorType::eUniformBufferDynamic)
+            {
+                uint32_t offset = 0;
+                cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, program.pipeline_layout, i, 1, &program.descriptor_sets[i].set[frame], 1, &offset);
+            }
+            else
+            {
+                cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, program.pipeline_layout, i, 1, &program.descriptor_sets[i].set[frame], 0, nullptr);
+            }
+        }
+
+        cmd_buffer.dispatch(tiles, tiles, 1);
+    }
+
+    // The scene render pass reads the blades in the vertex shader and the count as the draw.
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndirectCommandRead;
+    cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+                               vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader,
+                               vk::DependencyFlags{}, barrier, {}, {});
+}
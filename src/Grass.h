@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Model.h"
+#include "Program.h"
+#include "Textures.h"
+#include "VulkanRenderSystem.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct Scene;
+
+// Grass on the terrain, scattered on the GPU every frame by grass_scatter.comp
+// and drawn with a single indirect draw of the blade mesh, see grass.vert.
+//
+// The terrain around the camera is split into tiles of tile_size on a grid in
+// the space of the terrain, so blades stay in place while the camera moves. A
+// tile has grass_tile_cells x grass_tile_cells cells with one candidate blade
+// each, jittered within the cell. Blades thin out between density_start and
+// density_end from the camera and none are scattered further away.
+struct GrassSettings
+{
+    bool enabled = true;
+    float tile_size{2.0f};
+    float density_start{8.0f};
+    float density_end{40.0f};
+    float blade_height{0.6f};
+};
+
+// Cells along an edge of a tile, the work group size of grass_scatter.comp.
+constexpr uint32_t grass_tile_cells = 16;
+
+// Blades in the buffer of a frame. A blade is one vec4, see grass_scatter.comp.
+constexpr uint32_t max_grass_blades = 1 << 21;
+
+// The blades of the frame and the indirect draw of them, one of each per frame.
+// Device local, only the GPU writes and reads them.
+struct GrassField
+{
+    GrassSettings settings;
+    std::vector<Buffer> blades;
+    std::vector<Buffer> draw;
+};
+
+GrassField createGrassField(RenderingState const& state);
+
+// Blade mesh one unit high, flat in x and tapering to the tip. Both sides have
+// triangles, the pipeline culls back faces.
+Model createGrassBlade();
+
+// Set 1 of grass_scatter.comp. The frustum and the camera are in the space of the
+// terrain, model takes the blades to world space.
+struct alignas(16) GrassScatterBufferObject
+{
+    glm::mat4 model;
+    std::array<glm::vec4, 6> frustum_planes;
+    glm::vec4 camera_pos;
+    glm::ivec2 first_tile;
+    uint32_t tiles;
+    uint32_t max_blades;
+    float tile_size;
+    float terrain_size;
+    float max_height;
+    int displacement_map;
+    float density_start;
+    float density_end;
+    float blade_height;
+};
+
+struct GrassScatter
+{
+    Pipeline program;
+    std::vector<std::unique_ptr<UniformBuffer>> parameter_buffer;
+};
+
+GrassScatter createGrassScatter(RenderingState const& state, Textures& textures, GrassField const& grass);
+
+// Records the scatter of the grass of the ObjectType::GRASS object over the
+// visible terrain, and the indirect draw of it. The draw has no instances when
+// there is no grass, no terrain or the grass is disabled. Outside of any render
+// pass, before the scene render pass.
+void recordGrassScatter(vk::CommandBuffer const& cmd_buffer, GrassScatter const& scatter, Scene const& scene, uint32_t frame);
@@ -50,7 +50,7 @@ void createModel(RenderingState const& state, Models& models)
             {
                 Model m = createFlatGround(boxes_per_row, size, texture_size);
                 m.path = name.data();
-                models.models.insert({m.id, m});
+                models.addModel(std::move(m));
             }
 
             item_current = 0;
@@ -97,7 +97,7 @@ void createMesh(RenderingState const& core, Application& app)
 
         if (ImGui::Button("Create mesh"))
         {
-            app.meshes.loadMesh(core,app.models.models[current_id], name.data());
+            app.meshes.loadMesh(core, app.models, current_id, name.data());
             name = {{}};
             ImGui::CloseCurrentPopup();
         }
@@ -113,7 +113,7 @@ void comboMeshes(Application& app, int& current_id)
 template<typename T, typename GetLabel, typename Inx>
 void ComboBoxName(std::vector<T> const& programs, char const label[], Inx& current_inx, GetLabel c)
 {
-    if (ImGui::BeginCombo(label, c(programs[current_inx])))
+    if (ImGui::BeginCombo(label, static_cast<size_t>(current_inx) < programs.size() ? c(programs[current_inx]) : ""))
     {
         for (size_t i = 0; i < programs.size(); ++i)
         {
@@ -131,6 +131,12 @@ void ComboBoxName(std::vector<T> const& programs, char const label[], Inx& curre
     }
 }
 
+// A released slot has no texture.
+char const* textureName(std::unique_ptr<Texture> const& texture)
+{
+    return texture ? texture->name.c_str() : "(released)";
+}
+
 void createMaterial(Application& app)
 {
     // TODO: Support for creating material
@@ -269,8 +275,19 @@ void showModelTree(Model& model)
     if (ImGui::TreeNode((model.path + std::to_string(model.id)).c_str()))
     {
         ImGui::Text("Path: %s", model.path.c_str());
-        ImGui::Text("Vertices: %d", model.vertices.size());
-        ImGui::Text("Indices: %d", model.indices.size());
+        if (model.resident)
+        {
+            ImGui::Text("Vertices: %d", model.vertices.size());
+            ImGui::Text("Indices: %d", model.indices.size());
+        }
+        else if (model.mapped)
+        {
+            ImGui::Text("Mapped from the mesh cache, copied when needed");
+        }
+        else
+        {
+            ImGui::Text("Evicted, reloaded from the mesh cache when needed");
+        }
 
         ImGui::TreePop();
     }
@@ -459,8 +476,8 @@ void showObject(Object& obj, Application& app)
 
         if (has_displacement)
         {
-            ComboBoxName(app.textures.textures, "Displacement texture", i.displacement_map_texture, [](auto& text){return text->name.c_str();});
-            ComboBoxName(app.textures.textures, "Normal map texture", i.normal_map_texture, [](auto& text){return text->name.c_str();});
+            ComboBoxName(app.textures.textures, "Displacement texture", i.displacement_map_texture, textureName);
+            ComboBoxName(app.textures.textures, "Normal map texture", i.normal_map_texture, textureName);
             ImGui::InputFloat("Displacement Y", &i.displacement_y, 0.5f, 2.0f);
         }
 
@@ -490,7 +507,7 @@ void showObject(Object& obj, Application& app)
             }
             if (has_roughness)
             {
-                ComboBoxName(app.textures.textures, "Roughness textures", i.roughness_texture, [](auto& text){return text->name.c_str();});
+                ComboBoxName(app.textures.textures, "Roughness textures", i.roughness_texture, textureName);
             }
             else
             {
@@ -515,7 +532,7 @@ void showObject(Object& obj, Application& app)
             }
             if (has_metalness)
             {
-                ComboBoxName(app.textures.textures, "Metallic textures", i.metallic_texture, [](auto& text){return text->name.c_str();});
+                ComboBoxName(app.textures.textures, "Metallic textures", i.metallic_texture, textureName);
             }
             else
             {
@@ -539,7 +556,7 @@ void showObject(Object& obj, Application& app)
             }
             if (has_ao)
             {
-                ComboBoxName(app.textures.textures, "AO textures",i.ao_texture, [](auto& text){return text->name.c_str();});
+                ComboBoxName(app.textures.textures, "AO textures",i.ao_texture, textureName);
             }
             else
             {
@@ -548,8 +565,8 @@ void showObject(Object& obj, Application& app)
             }
         }
 
-        ComboBoxName(app.textures.textures, "Color texture", i.base_color_texture, [](auto& text){return text->name.c_str();});
-        ComboBoxName(app.textures.textures, "Normal texture", i.base_color_normal_texture, [](auto& text){return text->name.c_str();});
+        ComboBoxName(app.textures.textures, "Color texture", i.base_color_texture, textureName);
+        ComboBoxName(app.textures.textures, "Normal texture", i.base_color_normal_texture, textureName);
         ImGui::DragFloat("Textures scale", &i.scaling_factor, 0.1, 0.1, 10.0f);
         ImGui::EndPopup();
     }
@@ -641,6 +658,77 @@ void showScene(Application& app, Scene& scene, Models& models)
     ImGui::DragFloat("Lod max", &app.scene.terrain.lod_max, 1.0f, app.scene.terrain.lod_min, 11.0f);
     ImGui::DragFloat("Lod weight", &app.scene.terrain.weight, 1.0f, 0, 2000);
 
+    ImGui::Text("CDLOD terrain: %zu patches", app.scene.terrain_patches.size());
+    ImGui::DragFloat("Lod distance", &app.scene.terrain_quadtree.lod_distance, 0.1f, 3.0f, 10.0f);
+    ImGui::DragFloat("Morph start", &app.scene.terrain_quadtree.morph_start, 0.01f, 0.7f, 0.95f);
+
+    if (app.scene.height_field_stream)
+    {
+        auto& stream = *app.scene.height_field_stream;
+        ImGui::Text("Height tiles: %u/%u resident, %u in range, %u loading", stream.stats.resident, stream.slot_count,
+                    stream.stats.wanted, stream.stats.loading);
+        ImGui::Text("Height tiles: %llu loaded, %llu evicted", (unsigned long long)stream.stats.loaded,
+                    (unsigned long long)stream.stats.evicted);
+        ImGui::DragFloat("Stream radius", &stream.settings.radius, 8.0f, 0.0f, 8192.0f);
+    }
+
+    if (app.scene.height_pyramid)
+    {
+        auto const& camera = app.scene.camera;
+        if (auto ground = groundHeight(app.scene, camera.pos))
+        {
+            ImGui::Text("Ground below camera: %.2f", *ground);
+        }
+        if (auto hit = castTerrainRay(app.scene, camera.pos, camera.camera_front))
+        {
+            ImGui::Text("Looking at: %.1f %.1f %.1f, %.1f away", hit->position.x, hit->position.y, hit->position.z, hit->distance);
+        }
+
+        bool clamp_camera = app.scene.camera_ground_clearance.has_value();
+        if (ImGui::Checkbox("Keep camera above ground", &clamp_camera))
+        {
+            app.scene.camera_ground_clearance = clamp_camera ? std::optional<float>(1.0f) : std::nullopt;
+        }
+        if (app.scene.camera_ground_clearance)
+        {
+            ImGui::DragFloat("Ground clearance", &*app.scene.camera_ground_clearance, 0.05f, 0.0f, 50.0f);
+        }
+    }
+
+    bool tessellated = false;
+    for (auto const& obj : scene.objs)
+    {
+        tessellated |= obj.object_type == ObjectType::TESSELLATED_TERRAIN && obj.visible;
+    }
+    if (ImGui::Checkbox("Tessellated terrain", &tessellated))
+    {
+        for (auto& obj : scene.objs)
+        {
+            if (obj.object_type == ObjectType::TERRAIN || obj.object_type == ObjectType::TESSELLATED_TERRAIN)
+            {
+                obj.visible = (obj.object_type == ObjectType::TESSELLATED_TERRAIN) == tessellated;
+            }
+        }
+    }
+    ImGui::Text("Estimated %zu triangles, %.1f pixels per edge",
+                app.scene.terrain_tessellation_budget.triangles,
+                app.scene.terrain_tessellation_budget.pixels_per_edge);
+    ImGui::DragFloat("Pixels per edge", &app.scene.terrain_tessellation.pixels_per_edge, 0.1f, 1.0f, 64.0f);
+    ImGui::DragFloat("Max level", &app.scene.terrain_tessellation.max_level, 1.0f, 1.0f, 64.0f);
+    int triangle_budget = static_cast<int>(app.scene.terrain_tessellation.triangle_budget);
+    if (ImGui::DragInt("Triangle budget", &triangle_budget, 1000.0f, 10000, 20'000'000))
+    {
+        app.scene.terrain_tessellation.triangle_budget = static_cast<uint32_t>(triangle_budget);
+    }
+
+    ImGui::Text("Grass");
+    auto& grass = app.scene.grass.settings;
+    ImGui::Checkbox("Grass enabled", &grass.enabled);
+    ImGui::DragFloat("Grass tile size", &grass.tile_size, 0.05f, 0.5f, 8.0f);
+    ImGui::DragFloat("Grass density start", &grass.density_start, 0.5f, 0.0f, grass.density_end);
+    ImGui::DragFloat("Grass density end", &grass.density_end, 0.5f, grass.density_start, 200.0f);
+    ImGui::DragFloat("Blade height", &grass.blade_height, 0.01f, 0.05f, 3.0f);
+
     ImGui::Text("Fog");
     bool fog_enabled = scene.fog.volumetric_fog_enabled == 1;
     if (ImGui::Checkbox("Volumetric Fog Enabled", &fog_enabled))
@@ -681,17 +769,120 @@ void showMaterial(Application& application)
 
 }
 
-void showTextures(Application& application)
+void moveTexture(int& texture, int from, int to)
 {
+    if (texture == from)
+    {
+        texture = to;
+    }
+}
+
+// Loads the texture in slot again from its file, see reloadTexture. Every handle
+// of the application to it and the materials of the objects are moved to the
+// new slot. When it can not be loaded they keep the old texture.
+void reloadApplicationTexture(RenderingState const& core, Application& app, uint32_t slot)
+{
+    auto& textures = app.textures;
+    std::vector<size_t> held;
+    for (size_t i = 0; i < app.texture_handles.size(); ++i)
+    {
+        if (app.texture_handles[i].slot == slot && isTextureLoaded(textures, app.texture_handles[i]))
+        {
+            held.push_back(i);
+        }
+    }
+    if (held.empty() || held.size() != textures.references[slot])
+    {
+        spdlog::warn("{} has references the application does not hold, it is not reloaded", textures.textures[slot]->name);
+        return;
+    }
+
+    auto const reloaded = reloadTexture(core, textures, app.texture_handles[held.front()], true);
+    if (!isTextureLoaded(textures, reloaded))
+    {
+        spdlog::warn("{} could not be loaded again, the old texture is kept", textures.textures[slot]->name);
+        return;
+    }
+
+    for (auto const i : held)
+    {
+        app.texture_handles[i] = reloaded;
+    }
+
+    int const from = static_cast<int>(slot);
+    int const to = static_cast<int>(reloaded.slot);
+    for (auto& obj : app.scene.objs)
+    {
+        auto& data = obj.material.shader_data;
+        moveTexture(data.displacement_map_texture, from, to);
+        moveTexture(data.normal_map_texture, from, to);
+        moveTexture(data.base_color_texture, from, to);
+        moveTexture(data.base_color_normal_texture, from, to);
+        moveTexture(data.roughness_texture, from, to);
+        moveTexture(data.metallic_texture, from, to);
+        moveTexture(data.ao_texture, from, to);
+    }
+}
+
+void showTextures(RenderingState const& core, Application& application)
+{
+    auto& stream = application.texture_stream;
+    ImGui::Text("Streamed textures: %zu, %llu MB resident, %llu MB wanted, %u loading", stream.textures.size(),
+                (unsigned long long)stream.stats.resident_bytes / (1024 * 1024),
+                (unsigned long long)stream.stats.target_bytes / (1024 * 1024), stream.stats.loading);
+    ImGui::Text("Streamed textures: %llu loaded, %llu dropped", (unsigned long long)stream.stats.loaded,
+                (unsigned long long)stream.stats.dropped);
+
+    auto const& registry = application.textures.registry_stats;
+    ImGui::Text("Texture requests: %llu loaded, %llu shared, %llu MB saved", (unsigned long long)registry.misses,
+                (unsigned long long)registry.hits, (unsigned long long)registry.bytes_saved / (1024 * 1024));
+    ImGui::Text("Texture slots: %zu of %u, %zu free, %zu retired", application.textures.textures.size(), max_textures,
+                application.textures.free_slots.size(), application.textures.retired.size());
+
+    int budget = static_cast<int>(stream.settings.memory_budget / (1024 * 1024));
+    if (ImGui::DragInt("Texture budget (MB)", &budget, 4.0f, 16, 4096))
+    {
+        stream.settings.memory_budget = size_t(budget) * 1024 * 1024;
+    }
+    ImGui::DragFloat("Texture lod bias", &stream.settings.lod_bias, 0.05f, -2.0f, 4.0f);
+
     ImGui::BeginChild("Textures", ImVec2(-1, 300), true, ImGuiWindowFlags_HorizontalScrollbar);
 
-    for (auto& texture : application.textures.textures)
+    // Reloaded after the list, it changes the slots.
+    std::optional<uint32_t> reload;
+    auto const& textures = application.textures;
+    for (size_t slot = 0; slot < textures.textures.size(); ++slot)
     {
-        ImGui::Text("%s", texture->name.c_str());
+        auto const& texture = textures.textures[slot];
+        if (!texture)
+        {
+            continue;
+        }
+
+        ImGui::PushID(static_cast<int>(slot));
+        if (ImGui::SmallButton("Reload"))
+        {
+            reload = static_cast<uint32_t>(slot);
+        }
+        ImGui::PopID();
+        ImGui::SameLine();
+
+        if (texture->cooked)
+        {
+            ImGui::Text("%zu: %s, %u refs (from level %u)", slot, texture->name.c_str(), textures.references[slot], texture->first_level);
+        }
+        else
+        {
+            ImGui::Text("%zu: %s, %u refs", slot, texture->name.c_str(), textures.references[slot]);
+        }
     }
 
     ImGui::EndChild();
 
+    if (reload)
+    {
+        reloadApplicationTexture(core, application, *reload);
+    }
 }
 
 void createGui(RenderingState const& core, Application& application)
@@ -715,7 +906,7 @@ void createGui(RenderingState const& core, Application& application)
     }
     if (ImGui::CollapsingHeader("Textures"))
     {
-        showTextures(application);
+        showTextures(core, application);
     }
 
     ImGui::End();
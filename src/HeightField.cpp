@@ -0,0 +1,359 @@
+#include "HeightField.h"
+#include "JobSystem.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static constexpr uint32_t height_field_magic = 0x444c4648; // "HFLD"
+static constexpr uint32_t height_field_version = 2;
+static constexpr uint64_t height_field_page = 4096;
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Tiles needed to cover the samples, the last sample of a tile is the first of the next.
+static uint32_t tilesFor(uint32_t samples, uint32_t tile_size)
+{
+    return std::max(1u, (samples - 1 + tile_size - 1) / tile_size);
+}
+
+// Box filters the map down to samples x samples, each overview sample averages
+// the map samples whose centers fall into it.
+static std::vector<uint16_t> overviewHeights(std::span<uint16_t const> heights, uint32_t width, uint32_t height, uint32_t samples)
+{
+    auto span = [&](uint32_t i, uint32_t size)
+    {
+        uint32_t const begin = uint32_t(uint64_t(i) * size / samples);
+        uint32_t const end = std::max(begin + 1, uint32_t(uint64_t(i + 1) * size / samples));
+        return std::pair{begin, std::min(end, size)};
+    };
+
+    std::vector<uint16_t> overview(size_t(samples) * samples);
+    for (uint32_t y = 0; y < samples; ++y)
+    {
+        auto const [row_begin, row_end] = span(y, height);
+        for (uint32_t x = 0; x < samples; ++x)
+        {
+            auto const [column_begin, column_end] = span(x, width);
+
+            uint64_t sum = 0;
+            for (uint32_t row = row_begin; row < row_end; ++row)
+            {
+                for (uint32_t column = column_begin; column < column_end; ++column)
+                {
+                    sum += heights[size_t(row) * width + column];
+                }
+            }
+            uint64_t const count = uint64_t(row_end - row_begin) * (column_end - column_begin);
+            overview[size_t(y) * samples + x] = static_cast<uint16_t>((sum + count / 2) / count);
+        }
+    }
+    return overview;
+}
+
+bool writeHeightField(std::string const& path,
+                      std::span<uint16_t const> heights,
+                      uint32_t width,
+                      uint32_t height,
+                      uint32_t tile_size)
+{
+    if (width == 0 || height == 0 || tile_size == 0 || heights.size() < size_t(width) * height)
+    {
+        return false;
+    }
+
+    HeightFieldHeader header{};
+    header.magic = height_field_magic;
+    header.version = height_field_version;
+    header.width = width;
+    header.height = height;
+    header.tile_size = tile_size;
+    header.tiles_x = tilesFor(width, tile_size);
+    header.tiles_y = tilesFor(height, tile_size);
+
+    uint32_t const samples = heightFieldTileSamples(header);
+    header.tile_offset = alignOffset(sizeof(HeightFieldHeader), height_field_page);
+    header.tile_stride = alignOffset(uint64_t(samples) * samples * sizeof(uint16_t), height_field_page);
+    header.overview_offset = header.tile_offset + uint64_t(heightFieldTileCount(header)) * header.tile_stride;
+
+    auto const tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            spdlog::warn("Could not write height field: {}", path);
+            return false;
+        }
+
+        std::vector<char> padding(height_field_page, 0);
+        auto pad_to = [&](uint64_t offset)
+        {
+            out.write(padding.data(), offset - static_cast<uint64_t>(out.tellp()));
+        };
+
+        out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+        std::vector<uint16_t> tile(size_t(samples) * samples);
+        for (uint32_t ty = 0; ty < header.tiles_y; ++ty)
+        {
+            for (uint32_t tx = 0; tx < header.tiles_x; ++tx)
+            {
+                for (uint32_t y = 0; y < samples; ++y)
+                {
+                    size_t const row = std::min(ty * tile_size + y, height - 1);
+                    for (uint32_t x = 0; x < samples; ++x)
+                    {
+                        size_t const column = std::min(tx * tile_size + x, width - 1);
+                        tile[size_t(y) * samples + x] = heights[row * width + column];
+                    }
+                }
+
+                pad_to(header.tile_offset + (uint64_t(ty) * header.tiles_x + tx) * header.tile_stride);
+                out.write(reinterpret_cast<char const*>(tile.data()), tile.size() * sizeof(uint16_t));
+            }
+        }
+
+        // The last tile is padded as well, every tile is a whole number of pages.
+        pad_to(header.overview_offset);
+
+        auto const overview = overviewHeights(heights, width, height, samples);
+        out.write(reinterpret_cast<char const*>(overview.data()), overview.size() * sizeof(uint16_t));
+
+        if (!out)
+        {
+            return false;
+        }
+    }
+
+    // Rename last so a crash never leaves a half written height field behind.
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        spdlog::warn("Could not write height field: {}", path);
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<MappedHeightField> mapHeightField(std::string const& path)
+{
+    auto file = mapFile(path);
+    if (!file || file->size < sizeof(HeightFieldHeader))
+    {
+        return {};
+    }
+
+    HeightFieldHeader header;
+    std::memcpy(&header, file->data, sizeof(header));
+
+    if (   header.magic != height_field_magic
+        || header.version != height_field_version
+        || header.width == 0
+        || header.height == 0
+        || header.tile_size == 0
+        || header.tiles_x != tilesFor(header.width, header.tile_size)
+        || header.tiles_y != tilesFor(header.height, header.tile_size))
+    {
+        spdlog::warn("Invalid height field: {}", path);
+        return {};
+    }
+
+    uint64_t const samples = heightFieldTileSamples(header);
+    if (   header.tile_stride < samples * samples * sizeof(uint16_t)
+        || header.tile_offset + uint64_t(heightFieldTileCount(header)) * header.tile_stride > header.overview_offset
+        || header.overview_offset > file->size
+        || samples * samples * sizeof(uint16_t) > file->size - header.overview_offset)
+    {
+        spdlog::warn("Truncated height field: {}", path);
+        return {};
+    }
+
+#ifdef __linux__
+    // Tiles are read in any order, read ahead past a tile only costs memory.
+    if (file->size > 0)
+    {
+        madvise(const_cast<void*>(file->data), file->size, MADV_RANDOM);
+    }
+#endif
+
+    return MappedHeightField{std::move(*file), header};
+}
+
+std::span<uint16_t const> heightFieldTile(MappedHeightField const& height_field, uint32_t tile)
+{
+    auto const& header = height_field.header;
+    auto const samples = heightFieldTileSamples(header);
+    auto const* base = static_cast<std::byte const*>(height_field.file.data) + header.tile_offset + tile * header.tile_stride;
+    return {reinterpret_cast<uint16_t const*>(base), size_t(samples) * samples};
+}
+
+std::span<uint16_t const> heightFieldOverview(MappedHeightField const& height_field)
+{
+    auto const& header = height_field.header;
+    auto const samples = heightFieldTileSamples(header);
+    auto const* base = static_cast<std::byte const*>(height_field.file.data) + header.overview_offset;
+    return {reinterpret_cast<uint16_t const*>(base), size_t(samples) * samples};
+}
+
+glm::vec2 heightFieldSample(HeightFieldHeader const& header, glm::vec2 xz, float terrain_size)
+{
+    glm::vec2 uv = (xz + terrain_size / 2) / terrain_size;
+    uv.y = 1.0f - uv.y;
+    return uv * glm::vec2(header.width, header.height) - 0.5f;
+}
+
+HeightFieldStream createHeightFieldStream(MappedHeightField height_field, HeightFieldStreamSettings const& settings)
+{
+    HeightFieldStream stream;
+    stream.settings = settings;
+
+    auto const& header = height_field.header;
+    auto const samples = heightFieldTileSamples(header);
+    size_t const tile_bytes = size_t(samples) * samples * sizeof(uint16_t);
+    auto const tile_count = heightFieldTileCount(header);
+
+    // More slots than tiles are never used.
+    stream.slot_count = static_cast<uint32_t>(std::clamp<size_t>(settings.memory_budget / tile_bytes, 1, tile_count));
+    stream.tile_slots.assign(tile_count, -1);
+    stream.slot_tiles.assign(stream.slot_count, -1);
+    stream.tile_used.assign(tile_count, 0);
+
+    stream.height_field = std::make_shared<MappedHeightField const>(std::move(height_field));
+    return stream;
+}
+
+void updateHeightFieldStream(HeightFieldStream& stream, glm::vec2 camera_sample)
+{
+    ++stream.frame;
+    auto const& header = stream.height_field->header;
+
+    for (auto it = stream.loading.begin(); it != stream.loading.end();)
+    {
+        if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+
+        stream.ready.push_back(it->second.get());
+        ++stream.stats.loaded;
+        it = stream.loading.erase(it);
+    }
+
+    // Tiles overlapping the circle around the camera.
+    float const tile_size = float(header.tile_size);
+    float const radius = stream.settings.radius;
+    auto const first = glm::clamp(glm::floor((camera_sample - radius) / tile_size), glm::vec2(0), glm::vec2(header.tiles_x - 1, header.tiles_y - 1));
+    auto const last = glm::clamp(glm::floor((camera_sample + radius) / tile_size), glm::vec2(0), glm::vec2(header.tiles_x - 1, header.tiles_y - 1));
+
+    std::vector<std::pair<float, uint32_t>> in_range;
+    for (auto ty = uint32_t(first.y); ty <= uint32_t(last.y); ++ty)
+    {
+        for (auto tx = uint32_t(first.x); tx <= uint32_t(last.x); ++tx)
+        {
+            auto const min = glm::vec2(tx, ty) * tile_size;
+            auto const closest = glm::clamp(camera_sample, min, min + tile_size);
+            float const distance = glm::length(closest - camera_sample);
+            if (distance <= radius)
+            {
+                in_range.push_back({distance, ty * header.tiles_x + tx});
+            }
+        }
+    }
+
+    // Nearest first, and no more than the cache holds or the tiles would keep
+    // evicting each other.
+    std::sort(in_range.begin(), in_range.end());
+    in_range.resize(std::min<size_t>(in_range.size(), stream.slot_count));
+    stream.stats.wanted = static_cast<uint32_t>(in_range.size());
+
+    for (auto const& [distance, tile] : in_range)
+    {
+        stream.tile_used[tile] = stream.frame;
+
+        if (   stream.tile_slots[tile] >= 0
+            || stream.loading.contains(tile)
+            || std::any_of(stream.ready.begin(), stream.ready.end(), [tile](auto const& data) { return data.tile == tile; })
+            || stream.loading.size() >= stream.settings.max_loads)
+        {
+            continue;
+        }
+
+        stream.loading.emplace(tile, jobSystem().submit([height_field = stream.height_field, tile]
+        {
+            auto const samples = heightFieldTile(*height_field, tile);
+            return HeightFieldTileData{tile, {samples.begin(), samples.end()}};
+        }));
+    }
+
+    stream.stats.loading = static_cast<uint32_t>(stream.loading.size());
+}
+
+// A free slot, else the one with the least recently used tile. -1 when every
+// tile in the cache is still in range.
+static int32_t findSlot(HeightFieldStream const& stream)
+{
+    int32_t best = -1;
+    uint64_t best_used = stream.frame;
+    for (uint32_t slot = 0; slot < stream.slot_count; ++slot)
+    {
+        auto const tile = stream.slot_tiles[slot];
+        if (tile < 0)
+        {
+            return static_cast<int32_t>(slot);
+        }
+
+        if (stream.tile_used[tile] < best_used)
+        {
+            best_used = stream.tile_used[tile];
+            best = static_cast<int32_t>(slot);
+        }
+    }
+    return best;
+}
+
+std::vector<HeightFieldUpload> takeHeightFieldUploads(HeightFieldStream& stream)
+{
+    std::vector<HeightFieldUpload> uploads;
+
+    auto it = stream.ready.begin();
+    while (it != stream.ready.end() && uploads.size() < stream.settings.max_uploads)
+    {
+        // The camera moved on while it was loading.
+        if (stream.tile_used[it->tile] != stream.frame)
+        {
+            it = stream.ready.erase(it);
+            continue;
+        }
+
+        auto const slot = findSlot(stream);
+        if (slot < 0)
+        {
+            break;
+        }
+
+        if (auto const evicted = stream.slot_tiles[slot]; evicted >= 0)
+        {
+            stream.tile_slots[evicted] = -1;
+            ++stream.stats.evicted;
+        }
+        stream.slot_tiles[slot] = static_cast<int32_t>(it->tile);
+        stream.tile_slots[it->tile] = slot;
+
+        uploads.push_back({static_cast<uint32_t>(slot), std::move(*it)});
+        it = stream.ready.erase(it);
+    }
+
+    stream.stats.resident = static_cast<uint32_t>(std::count_if(stream.slot_tiles.begin(), stream.slot_tiles.end(), [](auto tile) { return tile >= 0; }));
+    return uploads;
+}
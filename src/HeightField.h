@@ -0,0 +1,154 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tiled height field on disk, for terrains larger than the height map texture and
+// the expanded mesh can hold in memory. The heights are 16 bit and split into
+// tiles of tile_size x tile_size samples. Every tile also stores the first row and
+// column of the next tiles, so a tile can be filtered on its own without seams.
+// Tiles start on a page boundary, reading one through the mapping only touches
+// the pages of that tile.
+//
+// After the tiles follows an overview, the whole map filtered down to the size of
+// one tile. It is always resident and stands in for the tiles that are not.
+struct HeightFieldHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint32_t reserved;
+
+    // Tile y * tiles_x + x starts at tile_offset + that index * tile_stride.
+    uint64_t tile_offset;
+    uint64_t tile_stride;
+
+    // heightFieldTileSamples squared samples covering the whole map.
+    uint64_t overview_offset;
+};
+
+struct MappedHeightField
+{
+    MappedFile file;
+    HeightFieldHeader header;
+};
+
+// Samples along an edge of a stored tile, tile_size plus the border.
+inline uint32_t heightFieldTileSamples(HeightFieldHeader const& header)
+{
+    return header.tile_size + 1;
+}
+
+inline uint32_t heightFieldTileCount(HeightFieldHeader const& header)
+{
+    return header.tiles_x * header.tiles_y;
+}
+
+// Writes width x height samples, row by row, as a tiled height field. The border
+// of the last row and column of tiles repeats the edge of the map. Every overview
+// sample is the average of the samples it covers.
+bool writeHeightField(std::string const& path,
+                      std::span<uint16_t const> heights,
+                      uint32_t width,
+                      uint32_t height,
+                      uint32_t tile_size = 256);
+
+std::optional<MappedHeightField> mapHeightField(std::string const& path);
+
+// Samples of a tile, heightFieldTileSamples squared, row by row. Points into the
+// mapping, the first read of it may block on the disk.
+std::span<uint16_t const> heightFieldTile(MappedHeightField const& height_field, uint32_t tile);
+
+// The overview, heightFieldTileSamples squared, row by row. Texel centers are
+// spread evenly over the map, sample it with a coordinate of the whole map.
+std::span<uint16_t const> heightFieldOverview(MappedHeightField const& height_field);
+
+// Position in samples of the height field for a position of the terrain. The
+// terrain is a square of terrain_size centered on the origin, mapped to the
+// height field like createFlatGround maps it to the height map texture.
+glm::vec2 heightFieldSample(HeightFieldHeader const& header, glm::vec2 xz, float terrain_size);
+
+struct HeightFieldStreamSettings
+{
+    // Tiles closer than this to the camera, in samples, are kept resident.
+    float radius{512.0f};
+
+    // Size of the tile cache on the GPU. The least recently needed tile is
+    // evicted when a new one does not fit.
+    size_t memory_budget{16 * 1024 * 1024};
+
+    // Tiles read at the same time on the job system, and uploaded per frame.
+    uint32_t max_loads{8};
+    uint32_t max_uploads{4};
+};
+
+// A tile read from the mapping, waiting for a slot of the cache.
+struct HeightFieldTileData
+{
+    uint32_t tile;
+    std::vector<uint16_t> heights;
+};
+
+// A tile to copy into slot of the cache this frame.
+struct HeightFieldUpload
+{
+    uint32_t slot;
+    HeightFieldTileData data;
+};
+
+struct HeightFieldStreamStats
+{
+    uint32_t resident{};
+    uint32_t loading{};
+    uint32_t wanted{};
+    uint64_t loaded{};
+    uint64_t evicted{};
+};
+
+// Streams the tiles around the camera into a cache of slot_count slots. Tiles are
+// read on the job system, the frame only picks up the ones that are done.
+struct HeightFieldStream
+{
+    // Shared with the loads in flight.
+    std::shared_ptr<MappedHeightField const> height_field;
+    HeightFieldStreamSettings settings;
+    uint32_t slot_count{};
+
+    // Slot of every tile, -1 when the tile is not resident.
+    std::vector<int32_t> tile_slots;
+    // Tile in every slot, -1 when the slot is free.
+    std::vector<int32_t> slot_tiles;
+    // Last frame every tile was in range, the slot of the smallest is evicted.
+    std::vector<uint64_t> tile_used;
+    uint64_t frame{};
+
+    std::unordered_map<uint32_t, std::future<HeightFieldTileData>> loading;
+    std::vector<HeightFieldTileData> ready;
+
+    HeightFieldStreamStats stats;
+};
+
+HeightFieldStream createHeightFieldStream(MappedHeightField height_field, HeightFieldStreamSettings const& settings = {});
+
+// Once a frame. Picks up finished loads and starts loading the missing tiles in
+// range of camera_sample, see heightFieldSample, nearest first.
+void updateHeightFieldStream(HeightFieldStream& stream, glm::vec2 camera_sample);
+
+// Gives the loaded tiles that are still in range a slot, evicting the least
+// recently used tiles that are out of range, at most max_uploads a frame. The
+// tile slots are updated as if the uploads were done.
+std::vector<HeightFieldUpload> takeHeightFieldUploads(HeightFieldStream& stream);
@@ -0,0 +1,190 @@
+#include "HeightFieldTexture.h"
+
+#include <cstring>
+
+static constexpr vk::Format height_field_format = vk::Format::eR16Unorm;
+
+static std::vector<int32_t> tileTable(HeightFieldStream const* stream)
+{
+    HeightFieldTableHeader header{.overview = -1};
+    std::vector<int32_t> slots{-1};
+    if (stream)
+    {
+        auto const& field = stream->height_field->header;
+        header = HeightFieldTableHeader{
+            .streamed = 1,
+            .tiles_x = int32_t(field.tiles_x),
+            .tiles_y = int32_t(field.tiles_y),
+            .tile_size = int32_t(field.tile_size),
+            .width = int32_t(field.width),
+            .height = int32_t(field.height),
+            .overview = int32_t(stream->slot_count)};
+        slots = stream->tile_slots;
+    }
+
+    std::vector<int32_t> table(sizeof(HeightFieldTableHeader) / sizeof(int32_t));
+    std::memcpy(table.data(), &header, sizeof(header));
+    table.insert(table.end(), slots.begin(), slots.end());
+    return table;
+}
+
+static void writeTileTable(UniformBuffer& buffer, std::vector<int32_t> const& table)
+{
+    std::memcpy(buffer.uniform_buffers_mapped, table.data(), table.size() * sizeof(int32_t));
+}
+
+// Copies the overview into its layer, the image is in transfer layout.
+static void uploadOverview(RenderingState const& state, HeightFieldTexture const& texture, HeightFieldStream const& stream)
+{
+    auto const overview = heightFieldOverview(*stream.height_field);
+    vk::DeviceSize const size = overview.size_bytes();
+
+    auto [buffer, buffer_memory] = createBuffer(state, size, vk::BufferUsageFlagBits::eTransferSrc,
+                                                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    auto* mapped = buffer_memory.mapMemory(0, size);
+    std::memcpy(mapped, overview.data(), size);
+    buffer_memory.unmapMemory();
+
+    vk::BufferImageCopy region{};
+    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = stream.slot_count;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = vk::Offset3D(0, 0, 0);
+    region.imageExtent = vk::Extent3D(texture.tile_samples, texture.tile_samples, 1);
+
+    auto cmd_buffer = beginSingleTimeCommands(state);
+    cmd_buffer.copyBufferToImage(*buffer, *texture.image, vk::ImageLayout::eTransferDstOptimal, region);
+    endSingleTimeCommands(state, cmd_buffer);
+}
+
+HeightFieldTexture createHeightFieldTexture(RenderingState const& state, HeightFieldStream const* stream)
+{
+    HeightFieldTexture texture;
+    texture.tile_samples = stream ? heightFieldTileSamples(stream->height_field->header) : 2;
+    // The slots of the cache and the overview after them.
+    uint32_t const layer_count = stream ? stream->slot_count + 1 : 1;
+
+    auto [image, memory] = createImage(state, texture.tile_samples, texture.tile_samples, 1, height_field_format,
+                                       vk::ImageTiling::eOptimal,
+                                       vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+                                       vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                       vk::SampleCountFlagBits::e1, layer_count);
+    texture.image = std::move(image);
+    texture.memory = std::move(memory);
+
+    // Every slot starts out readable, an empty slot is never sampled.
+    transitionImageLayout(state, *texture.image, height_field_format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1, layer_count);
+    if (stream)
+    {
+        uploadOverview(state, texture, *stream);
+    }
+    transitionImageLayout(state, *texture.image, height_field_format, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, 1, layer_count);
+
+    texture.view = createImageView(state.device, *texture.image, height_field_format, vk::ImageAspectFlagBits::eColor, 1,
+                                   vk::ImageViewType::e2DArray, layer_count);
+    texture.sampler = createTextureSampler(state, false);
+
+    auto const table = tileTable(stream);
+    texture.table_size = static_cast<uint32_t>(table.size());
+    texture.tile_table = createStorageBuffers<int32_t>(state, texture.table_size);
+    for (auto const& buffer : texture.tile_table)
+    {
+        writeTileTable(*buffer, table);
+    }
+
+    if (stream)
+    {
+        // Room for the uploads of one frame, max_uploads of the stream is fixed from here on.
+        vk::DeviceSize const staging_size = vk::DeviceSize(texture.tile_samples) * texture.tile_samples * sizeof(uint16_t)
+                                          * std::max(stream->settings.max_uploads, 1u);
+
+        size_t const max_frames_in_flight = 2;
+        for (size_t i = 0; i < max_frames_in_flight; ++i)
+        {
+            auto [buffer, buffer_memory] = createBuffer(state, staging_size, vk::BufferUsageFlagBits::eTransferSrc,
+                                                        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+            auto mapped = buffer_memory.mapMemory(0, staging_size);
+            texture.staging.push_back(std::make_unique<UniformBuffer>(std::move(buffer), std::move(buffer_memory), mapped));
+        }
+    }
+
+    return texture;
+}
+
+static vk::ImageMemoryBarrier slotBarrier(vk::Image image, uint32_t slot,
+                                          vk::ImageLayout old_layout, vk::ImageLayout new_layout,
+                                          vk::AccessFlags src_access, vk::AccessFlags dst_access)
+{
+    vk::ImageMemoryBarrier barrier{};
+    barrier.sType = vk::StructureType::eImageMemoryBarrier;
+    barrier.image = image;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = slot;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+void recordHeightFieldUploads(vk::CommandBuffer const& cmd_buffer,
+                              HeightFieldTexture& texture,
+                              HeightFieldStream* stream,
+                              uint32_t frame)
+{
+    if (!stream)
+    {
+        return;
+    }
+
+    auto const uploads = takeHeightFieldUploads(*stream);
+    if (!uploads.empty())
+    {
+        size_t const tile_bytes = size_t(texture.tile_samples) * texture.tile_samples * sizeof(uint16_t);
+        auto* staging = static_cast<std::byte*>(texture.staging[frame]->uniform_buffers_mapped);
+
+        std::vector<vk::BufferImageCopy> regions;
+        std::vector<vk::ImageMemoryBarrier> to_transfer;
+        std::vector<vk::ImageMemoryBarrier> to_shader;
+        for (size_t i = 0; i < uploads.size(); ++i)
+        {
+            auto const& upload = uploads[i];
+            std::memcpy(staging + i * tile_bytes, upload.data.heights.data(), tile_bytes);
+
+            vk::BufferImageCopy region{};
+            region.bufferOffset = i * tile_bytes;
+            region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = upload.slot;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = vk::Offset3D(0, 0, 0);
+            region.imageExtent = vk::Extent3D(texture.tile_samples, texture.tile_samples, 1);
+            regions.push_back(region);
+
+            // The evicted tile is thrown away.
+            to_transfer.push_back(slotBarrier(*texture.image, upload.slot,
+                                              vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                                              vk::AccessFlags{}, vk::AccessFlagBits::eTransferWrite));
+            to_shader.push_back(slotBarrier(*texture.image, upload.slot,
+                                            vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                                            vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead));
+        }
+
+        // The previous frame may still be drawing with the evicted tiles. The
+        // barrier also orders against the commands submitted before this one.
+        cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eVertexShader, vk::PipelineStageFlagBits::eTransfer,
+                                   vk::DependencyFlags{}, {}, {}, to_transfer);
+        cmd_buffer.copyBufferToImage(*texture.staging[frame]->uniform_buffers, *texture.image,
+                                     vk::ImageLayout::eTransferDstOptimal, regions);
+        cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexShader,
+                                   vk::DependencyFlags{}, {}, {}, to_shader);
+    }
+
+    writeTileTable(*texture.tile_table[frame], tileTable(stream));
+}
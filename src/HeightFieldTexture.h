@@ -0,0 +1,52 @@
+#pragma once
+
+#include "HeightField.h"
+#include "VulkanRenderSystem.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Start of the tile table read by terrain_cdlod.vert, followed by the slot of
+// every tile, -1 when the tile is not resident. overview is the layer holding
+// the overview of the height field, -1 without one.
+struct HeightFieldTableHeader
+{
+    int32_t streamed;
+    int32_t tiles_x;
+    int32_t tiles_y;
+    int32_t tile_size;
+    int32_t width;
+    int32_t height;
+    int32_t overview;
+    int32_t reserved;
+};
+
+// The GPU side of a HeightFieldStream. Every slot of the cache is a layer of a
+// 2D array texture, the overview is uploaded once into the layer after them. Uploads are recorded into the command buffer of the frame,
+// after the frames that still read an evicted slot on the same queue.
+struct HeightFieldTexture
+{
+    vk::raii::Image image{nullptr};
+    vk::raii::DeviceMemory memory{nullptr};
+    vk::raii::ImageView view{nullptr};
+    vk::raii::Sampler sampler{nullptr};
+
+    // Per frame in flight.
+    std::vector<std::unique_ptr<UniformBuffer>> staging;
+    std::vector<std::unique_ptr<UniformBuffer>> tile_table;
+
+    uint32_t tile_samples{};
+    uint32_t table_size{};
+};
+
+// Without a stream the texture is a single empty tile and the table says the
+// heights are not streamed, the terrain then uses the displacement map only.
+HeightFieldTexture createHeightFieldTexture(RenderingState const& state, HeightFieldStream const* stream);
+
+// Records the copies of the uploads of the frame and writes its tile table.
+// Before the render passes, outside of any render pass.
+void recordHeightFieldUploads(vk::CommandBuffer const& cmd_buffer,
+                              HeightFieldTexture& texture,
+                              HeightFieldStream* stream,
+                              uint32_t frame);
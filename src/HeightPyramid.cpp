@@ -0,0 +1,360 @@
+#include "HeightPyramid.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+// Sample coordinates of a position of the terrain are scale * xz + offset, see
+// heightFieldSample. Rows go towards -z, so the scale of z is negative.
+static glm::vec2 sampleScale(HeightPyramid const& pyramid)
+{
+    return glm::vec2(pyramid.width, -float(pyramid.height)) / pyramid.terrain_size;
+}
+
+static glm::vec2 sampleOffset(HeightPyramid const& pyramid)
+{
+    return glm::vec2(pyramid.width, pyramid.height) * 0.5f - 0.5f;
+}
+
+static float sampleHeight(HeightPyramid const& pyramid, uint32_t x, uint32_t z)
+{
+    return pyramid.heights[size_t(z) * pyramid.width + x];
+}
+
+HeightPyramid createHeightPyramid(std::span<float const> heights,
+                                  uint32_t width,
+                                  uint32_t height,
+                                  float terrain_size,
+                                  float max_height)
+{
+    HeightPyramid pyramid;
+    pyramid.terrain_size = terrain_size;
+    pyramid.max_height = max_height;
+    if (width < 2 || height < 2 || heights.size() < size_t(width) * height)
+    {
+        return pyramid;
+    }
+
+    pyramid.width = width;
+    pyramid.height = height;
+    pyramid.heights.resize(size_t(width) * height);
+
+    HeightPyramidLevel cells{width - 1, height - 1};
+    cells.min.resize(size_t(cells.width) * cells.height);
+    cells.max.resize(cells.min.size());
+
+    // The finest level is most of the work, its rows are split across the job system.
+    jobSystem().parallelFor(height, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t z = begin; z < end; ++z)
+        {
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                pyramid.heights[z * width + x] = heights[z * width + x] * max_height;
+            }
+        }
+    }, 64);
+
+    jobSystem().parallelFor(cells.height, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t z = begin; z < end; ++z)
+        {
+            float const* top = pyramid.heights.data() + z * width;
+            float const* bottom = top + width;
+            for (std::size_t x = 0; x < cells.width; ++x)
+            {
+                size_t const cell = z * cells.width + x;
+                cells.min[cell] = std::min(std::min(top[x], top[x + 1]), std::min(bottom[x], bottom[x + 1]));
+                cells.max[cell] = std::max(std::max(top[x], top[x + 1]), std::max(bottom[x], bottom[x + 1]));
+            }
+        }
+    }, 64);
+    pyramid.levels.push_back(std::move(cells));
+
+    while (pyramid.levels.back().width > 1 || pyramid.levels.back().height > 1)
+    {
+        auto const& below = pyramid.levels.back();
+
+        HeightPyramidLevel level{(below.width + 1) / 2, (below.height + 1) / 2};
+        level.min.assign(size_t(level.width) * level.height, std::numeric_limits<float>::max());
+        level.max.assign(level.min.size(), std::numeric_limits<float>::lowest());
+        for (uint32_t z = 0; z < below.height; ++z)
+        {
+            for (uint32_t x = 0; x < below.width; ++x)
+            {
+                size_t const cell = size_t(z / 2) * level.width + x / 2;
+                level.min[cell] = std::min(level.min[cell], below.min[size_t(z) * below.width + x]);
+                level.max[cell] = std::max(level.max[cell], below.max[size_t(z) * below.width + x]);
+            }
+        }
+        pyramid.levels.push_back(std::move(level));
+    }
+
+    return pyramid;
+}
+
+// Cell of level 0 holding a sample position clamped to the terrain, and the
+// position within it.
+struct CellPosition
+{
+    uint32_t x;
+    uint32_t z;
+    glm::vec2 local;
+    // The position was outside the terrain along x or z, the height is constant along that axis there.
+    bool clamped_x;
+    bool clamped_z;
+};
+
+static CellPosition cellPosition(HeightPyramid const& pyramid, glm::vec2 xz)
+{
+    auto const sample = xz * sampleScale(pyramid) + sampleOffset(pyramid);
+    auto const last = glm::vec2(pyramid.width - 1, pyramid.height - 1);
+    auto const clamped = glm::clamp(sample, glm::vec2(0.0f), last);
+
+    uint32_t const x = std::min(static_cast<uint32_t>(clamped.x), pyramid.width - 2);
+    uint32_t const z = std::min(static_cast<uint32_t>(clamped.y), pyramid.height - 2);
+    return CellPosition{x, z, clamped - glm::vec2(x, z), sample.x != clamped.x, sample.y != clamped.y};
+}
+
+float terrainHeight(HeightPyramid const& pyramid, glm::vec2 xz)
+{
+    if (pyramid.levels.empty())
+    {
+        return 0.0f;
+    }
+
+    auto const cell = cellPosition(pyramid, xz);
+    float const top = glm::mix(sampleHeight(pyramid, cell.x, cell.z), sampleHeight(pyramid, cell.x + 1, cell.z), cell.local.x);
+    float const bottom = glm::mix(sampleHeight(pyramid, cell.x, cell.z + 1), sampleHeight(pyramid, cell.x + 1, cell.z + 1), cell.local.x);
+    return glm::mix(top, bottom, cell.local.y);
+}
+
+glm::vec3 terrainNormal(HeightPyramid const& pyramid, glm::vec2 xz)
+{
+    if (pyramid.levels.empty())
+    {
+        return glm::vec3(0, 1, 0);
+    }
+
+    auto const cell = cellPosition(pyramid, xz);
+    float const h00 = sampleHeight(pyramid, cell.x, cell.z);
+    float const h10 = sampleHeight(pyramid, cell.x + 1, cell.z);
+    float const h01 = sampleHeight(pyramid, cell.x, cell.z + 1);
+    float const h11 = sampleHeight(pyramid, cell.x + 1, cell.z + 1);
+
+    // Slope per sample, then per unit of the terrain.
+    glm::vec2 slope(glm::mix(h10 - h00, h11 - h01, cell.local.y),
+                    glm::mix(h01 - h00, h11 - h10, cell.local.x));
+    slope *= sampleScale(pyramid);
+    slope.x = cell.clamped_x ? 0.0f : slope.x;
+    slope.y = cell.clamped_z ? 0.0f : slope.y;
+
+    return glm::normalize(glm::vec3(-slope.x, 1.0f, -slope.y));
+}
+
+namespace
+{
+
+// The ray in sample coordinates, x and z in samples and y in the units of the terrain.
+struct SampleRay
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+
+    glm::vec3 at(float t) const { return origin + direction * t; }
+};
+
+struct Interval
+{
+    float begin;
+    float end;
+
+    bool empty() const { return begin > end; }
+};
+
+}
+
+// Part of the ray over the samples from lo to hi, along one axis.
+static Interval clip(Interval t, float lo, float hi, float origin, float direction)
+{
+    if (direction == 0.0f)
+    {
+        return origin < lo || origin > hi ? Interval{1.0f, 0.0f} : t;
+    }
+
+    float enter = (lo - origin) / direction;
+    float exit = (hi - origin) / direction;
+    if (enter > exit)
+    {
+        std::swap(enter, exit);
+    }
+    return Interval{std::max(t.begin, enter), std::min(t.end, exit)};
+}
+
+static Interval clipToCell(HeightPyramid const& pyramid, SampleRay const& ray, Interval t, uint32_t level, uint32_t x, uint32_t z)
+{
+    float const x0 = float(x << level);
+    float const z0 = float(z << level);
+    float const x1 = std::min(float((x + 1) << level), float(pyramid.width - 1));
+    float const z1 = std::min(float((z + 1) << level), float(pyramid.height - 1));
+
+    t = clip(t, x0, x1, ray.origin.x, ray.direction.x);
+    return clip(t, z0, z1, ray.origin.z, ray.direction.z);
+}
+
+// The ray against the bilinear surface of a cell of level 0. Ray height minus
+// surface height is a quadratic in t, its first root within t is the hit.
+static std::optional<float> intersectCell(HeightPyramid const& pyramid, SampleRay const& ray, Interval t, uint32_t x, uint32_t z)
+{
+    double const h00 = sampleHeight(pyramid, x, z);
+    double const a = h00;
+    double const b = sampleHeight(pyramid, x + 1, z) - h00;
+    double const c = sampleHeight(pyramid, x, z + 1) - h00;
+    double const d = h00 - sampleHeight(pyramid, x + 1, z) - sampleHeight(pyramid, x, z + 1) + sampleHeight(pyramid, x + 1, z + 1);
+
+    double const u0 = double(ray.origin.x) - x;
+    double const v0 = double(ray.origin.z) - z;
+    double const du = ray.direction.x;
+    double const dv = ray.direction.z;
+
+    double const qa = -d * du * dv;
+    double const qb = ray.direction.y - b * du - c * dv - d * (u0 * dv + v0 * du);
+    double const qc = ray.origin.y - a - b * u0 - c * v0 - d * u0 * v0;
+
+    // Roots on the border of two cells may land in either one. The slack is
+    // relative to the root, t.end is max_distance when the ray does not leave
+    // the cell sideways.
+    auto inside = [&](double root)
+    {
+        double const epsilon = 1e-5 * std::max(1.0, std::abs(root));
+        return root >= t.begin - epsilon && root <= t.end + epsilon;
+    };
+
+    std::array<double, 2> roots{-1.0, -1.0};
+    size_t count = 0;
+    if (std::abs(qa) < 1e-12)
+    {
+        if (qb == 0.0)
+        {
+            return std::nullopt;
+        }
+        roots[count++] = -qc / qb;
+    }
+    else
+    {
+        double const discriminant = qb * qb - 4.0 * qa * qc;
+        if (discriminant < 0.0)
+        {
+            return std::nullopt;
+        }
+
+        // The root that does not cancel, then the other one from their product.
+        double const q = -0.5 * (qb + std::copysign(std::sqrt(discriminant), qb));
+        roots[count++] = q / qa;
+        if (q != 0.0)
+        {
+            roots[count++] = qc / q;
+        }
+        if (count == 2 && roots[1] < roots[0])
+        {
+            std::swap(roots[0], roots[1]);
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (inside(roots[i]))
+        {
+            return std::clamp(float(roots[i]), t.begin, t.end);
+        }
+    }
+    return std::nullopt;
+}
+
+static std::optional<float> traverse(HeightPyramid const& pyramid, SampleRay const& ray, Interval t, uint32_t level, uint32_t x, uint32_t z)
+{
+    auto const& cells = pyramid.levels[level];
+    size_t const cell = size_t(z) * cells.width + x;
+
+    float const y0 = ray.at(t.begin).y;
+    float const y1 = ray.at(t.end).y;
+    if (std::min(y0, y1) > cells.max[cell] || std::max(y0, y1) < cells.min[cell])
+    {
+        return std::nullopt;
+    }
+
+    if (level == 0)
+    {
+        return intersectCell(pyramid, ray, t, x, z);
+    }
+
+    // The children the ray passes, in the order it enters them. Their parts of
+    // the ray do not overlap, the first hit in that order is the closest.
+    struct Child
+    {
+        uint32_t x;
+        uint32_t z;
+        Interval t;
+    };
+    std::array<Child, 4> children;
+    size_t count = 0;
+
+    auto const& below = pyramid.levels[level - 1];
+    for (uint32_t child_z = z * 2; child_z < std::min(z * 2 + 2, below.height); ++child_z)
+    {
+        for (uint32_t child_x = x * 2; child_x < std::min(x * 2 + 2, below.width); ++child_x)
+        {
+            auto const child_t = clipToCell(pyramid, ray, t, level - 1, child_x, child_z);
+            if (!child_t.empty())
+            {
+                children[count++] = Child{child_x, child_z, child_t};
+            }
+        }
+    }
+    std::sort(children.begin(), children.begin() + count,
+              [](Child const& lhs, Child const& rhs) { return lhs.t.begin < rhs.t.begin; });
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (auto hit = traverse(pyramid, ray, children[i].t, level - 1, children[i].x, children[i].z))
+        {
+            return hit;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<TerrainHit> castRay(HeightPyramid const& pyramid,
+                                  glm::vec3 const& origin,
+                                  glm::vec3 const& direction,
+                                  float max_distance)
+{
+    if (pyramid.levels.empty())
+    {
+        return std::nullopt;
+    }
+
+    auto const scale = sampleScale(pyramid);
+    auto const offset = sampleOffset(pyramid);
+    SampleRay const ray{
+        glm::vec3(origin.x * scale.x + offset.x, origin.y, origin.z * scale.y + offset.y),
+        glm::vec3(direction.x * scale.x, direction.y, direction.z * scale.y)
+    };
+
+    uint32_t const top = static_cast<uint32_t>(pyramid.levels.size() - 1);
+    auto const t = clipToCell(pyramid, ray, Interval{0.0f, max_distance}, top, 0, 0);
+    if (t.empty())
+    {
+        return std::nullopt;
+    }
+
+    auto const distance = traverse(pyramid, ray, t, top, 0, 0);
+    if (!distance)
+    {
+        return std::nullopt;
+    }
+
+    auto const position = origin + direction * *distance;
+    return TerrainHit{*distance, position, terrainNormal(pyramid, glm::vec2(position.x, position.z))};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Min-max mip pyramid over the heights of a terrain, for height queries and ray
+// casts on the CPU without the mesh. The terrain is a square of terrain_size
+// centered on the origin with heights from 0 to max_height, mapped to the raster
+// like the CDLOD terrain maps it to the displacement map: image rows go towards
+// -z and the height between the sample centers is bilinear, as sampled by the GPU.
+//
+// A cell of level 0 lies between four neighbouring samples, a cell of the next
+// level covers 2x2 cells of the level below. The half sample along the edges of
+// the terrain, outside the outermost sample centers, is left out of ray casts.
+struct HeightPyramidLevel
+{
+    uint32_t width{};
+    uint32_t height{};
+
+    // Per cell, row by row.
+    std::vector<float> min;
+    std::vector<float> max;
+};
+
+struct HeightPyramid
+{
+    uint32_t width{};
+    uint32_t height{};
+    float terrain_size{100.0f};
+    float max_height{7.0f};
+
+    // The samples scaled to max_height, row by row.
+    std::vector<float> heights;
+
+    // levels[0] are the cells between the samples, the last level is a single cell.
+    std::vector<HeightPyramidLevel> levels;
+};
+
+// Pyramid of a width x height raster of heights in [0, 1]. At least 2 x 2
+// samples, the pyramid is left empty otherwise.
+HeightPyramid createHeightPyramid(std::span<float const> heights,
+                                  uint32_t width,
+                                  uint32_t height,
+                                  float terrain_size,
+                                  float max_height);
+
+// Height of the terrain at xz, in the space of the terrain. Clamped to the
+// edge outside of the terrain.
+float terrainHeight(HeightPyramid const& pyramid, glm::vec2 xz);
+
+// Surface normal at xz, from the slope of the bilinear surface.
+glm::vec3 terrainNormal(HeightPyramid const& pyramid, glm::vec2 xz);
+
+struct TerrainHit
+{
+    // Along the direction, in units of its length.
+    float distance;
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+// First point where the ray meets the surface within max_distance, in the space
+// of the terrain. The direction does not have to be normalized. Only cells whose
+// height range overlaps the ray are visited, from the top level down, in the
+// order the ray passes them.
+std::optional<TerrainHit> castRay(HeightPyramid const& pyramid,
+                                  glm::vec3 const& origin,
+                                  glm::vec3 const& direction,
+                                  float max_distance = std::numeric_limits<float>::max());
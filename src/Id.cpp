@@ -1,7 +1,10 @@
 #include "Id.h"
 
+#include <atomic>
+
 int Id()
 {
-    static int id = 0;
+    // Models and meshes are created on the loader threads as well.
+    static std::atomic<int> id = 0;
     return id++;
-}
\ No newline at end of file
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed pool of worker threads running jobs in submission order.
+struct JobSystem
+{
+    explicit JobSystem(size_t thread_count = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (size_t i = 0; i < thread_count; ++i)
+        {
+            workers.emplace_back([this]{ run(); });
+        }
+    }
+
+    JobSystem(JobSystem const&) = delete;
+    JobSystem& operator=(JobSystem const&) = delete;
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    template<typename F>
+    auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+    {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+
+        std::packaged_task<Result()> task(std::forward<F>(f));
+        auto future = task.get_future();
+        {
+            std::lock_guard lock(mutex);
+            jobs.emplace(std::move(task));
+        }
+        condition.notify_one();
+
+        return future;
+    }
+
+    // Calls f(begin, end) for contiguous ranges of [0, count) and waits for them.
+    // The calling thread takes ranges as well, so this can be used from inside a
+    // job even when every worker is busy. f must not throw.
+    template<typename F>
+    void parallelFor(size_t count, F const& f, size_t min_range = 1)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        size_t const ranges = std::max<size_t>(1, std::min(workers.size() + 1, count / std::max<size_t>(min_range, 1)));
+        size_t const range_size = (count + ranges - 1) / ranges;
+        size_t const range_count = (count + range_size - 1) / range_size;
+
+        // Helpers that only start after everything is done find no range left and
+        // never touch f, the shared state keeps the counters alive for them.
+        struct State
+        {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<State>();
+
+        auto work = [state, &f, count, range_size, range_count]
+        {
+            for (size_t range = state->next++; range < range_count; range = state->next++)
+            {
+                size_t const begin = range * range_size;
+                f(begin, std::min(count, begin + range_size));
+
+                if (++state->done == range_count)
+                {
+                    std::lock_guard lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+
+        for (size_t i = 1; i < range_count; ++i)
+        {
+            submit(work);
+        }
+        work();
+
+        std::unique_lock lock(state->mutex);
+        state->finished.wait(lock, [&]{ return state->done == range_count; });
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+private:
+    void run()
+    {
+        while (true)
+        {
+            std::move_only_function<void()> job;
+            {
+                std::unique_lock lock(mutex);
+                condition.wait(lock, [this]{ return stopping || !jobs.empty(); });
+
+                if (jobs.empty())
+                {
+                    return;
+                }
+
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::queue<std::move_only_function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};
+
+// Shared pool for loading and baking work, sized to the number of cores.
+inline JobSystem& jobSystem()
+{
+    static JobSystem jobs;
+    return jobs;
+}
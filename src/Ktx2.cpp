@@ -0,0 +1,267 @@
+#include "Ktx2.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+
+static constexpr std::array<uint8_t, 12> ktx2_identifier{
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+// VkFormat values of the block formats.
+static constexpr uint32_t vk_format_bc1_rgb_unorm = 131;
+static constexpr uint32_t vk_format_bc1_rgb_srgb = 132;
+static constexpr uint32_t vk_format_bc4_unorm = 139;
+static constexpr uint32_t vk_format_bc5_unorm = 141;
+static constexpr uint32_t vk_format_bc7_unorm = 145;
+static constexpr uint32_t vk_format_bc7_srgb = 146;
+
+// Data format descriptor color models and transfer functions, khr_df.h.
+static constexpr uint8_t df_model_bc1a = 128;
+static constexpr uint8_t df_model_bc4 = 131;
+static constexpr uint8_t df_model_bc5 = 132;
+static constexpr uint8_t df_model_bc7 = 134;
+static constexpr uint8_t df_primaries_bt709 = 1;
+static constexpr uint8_t df_transfer_linear = 1;
+static constexpr uint8_t df_transfer_srgb = 2;
+
+// Levels start on a multiple of the block size, 16 covers every format.
+static constexpr uint64_t ktx2_level_alignment = 16;
+
+struct Ktx2Index
+{
+    uint32_t dfd_offset;
+    uint32_t dfd_size;
+    uint32_t kvd_offset;
+    uint32_t kvd_size;
+    uint64_t sgd_offset;
+    uint64_t sgd_size;
+};
+
+static constexpr size_t ktx2_levels_offset = sizeof(ktx2_identifier) + sizeof(Ktx2Header) + sizeof(Ktx2Index);
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+uint32_t ktx2Format(BlockFormat format, bool srgb)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        return srgb ? vk_format_bc1_rgb_srgb : vk_format_bc1_rgb_unorm;
+    case BlockFormat::BC4:
+        return vk_format_bc4_unorm;
+    case BlockFormat::BC5:
+        return vk_format_bc5_unorm;
+    case BlockFormat::BC7:
+        return srgb ? vk_format_bc7_srgb : vk_format_bc7_unorm;
+    }
+    return 0;
+}
+
+bool ktx2FormatIsSrgb(uint32_t vk_format)
+{
+    return vk_format == vk_format_bc1_rgb_srgb || vk_format == vk_format_bc7_srgb;
+}
+
+static bool ktx2FormatIsSupported(uint32_t vk_format)
+{
+    return vk_format == vk_format_bc1_rgb_unorm || vk_format == vk_format_bc1_rgb_srgb
+        || vk_format == vk_format_bc4_unorm || vk_format == vk_format_bc5_unorm
+        || vk_format == vk_format_bc7_unorm || vk_format == vk_format_bc7_srgb;
+}
+
+// A basic data format descriptor block with one sample per channel of the format.
+static std::vector<uint32_t> dataFormatDescriptor(BlockFormat format, bool srgb)
+{
+    struct Sample
+    {
+        uint8_t channel;
+        uint16_t bit_offset;
+        uint8_t bit_length;
+    };
+
+    uint8_t model{};
+    std::vector<Sample> samples;
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        model = df_model_bc1a;
+        samples = {{0, 0, 64}};
+        break;
+    case BlockFormat::BC4:
+        model = df_model_bc4;
+        samples = {{0, 0, 64}};
+        break;
+    case BlockFormat::BC5:
+        model = df_model_bc5;
+        samples = {{0, 0, 64}, {1, 64, 64}};
+        break;
+    case BlockFormat::BC7:
+        model = df_model_bc7;
+        samples = {{0, 0, 128}};
+        break;
+    }
+
+    uint32_t const block_size = 24 + 16 * static_cast<uint32_t>(samples.size());
+    std::vector<uint32_t> words;
+    words.push_back(4 + block_size);
+    words.push_back(0);
+    words.push_back(2 | block_size << 16);
+    words.push_back(model | df_primaries_bt709 << 8 | (srgb ? df_transfer_srgb : df_transfer_linear) << 16);
+    words.push_back(3 | 3 << 8);
+    words.push_back(blockBytes(format));
+    words.push_back(0);
+
+    for (auto const& sample : samples)
+    {
+        words.push_back(sample.bit_offset | uint32_t(sample.bit_length - 1) << 16 | uint32_t(sample.channel) << 24);
+        words.push_back(0);
+        words.push_back(0);
+        words.push_back(0xFFFFFFFF);
+    }
+    return words;
+}
+
+bool writeKtx2(std::string const& path,
+               BlockFormat format,
+               bool srgb,
+               uint32_t width,
+               uint32_t height,
+               std::vector<std::vector<uint8_t>> const& levels)
+{
+    if (width == 0 || height == 0 || levels.empty())
+    {
+        return false;
+    }
+
+    // BC4 and BC5 have no sRGB variant.
+    srgb = ktx2FormatIsSrgb(ktx2Format(format, srgb));
+
+    Ktx2Header header{
+        .vk_format = ktx2Format(format, srgb),
+        .type_size = 1,
+        .width = width,
+        .height = height,
+        .depth = 0,
+        .layer_count = 0,
+        .face_count = 1,
+        .level_count = static_cast<uint32_t>(levels.size()),
+        .supercompression_scheme = 0
+    };
+
+    auto const dfd = dataFormatDescriptor(format, srgb);
+    Ktx2Index index{};
+    index.dfd_offset = static_cast<uint32_t>(ktx2_levels_offset + levels.size() * sizeof(Ktx2Level));
+    index.dfd_size = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+    // The smallest level is stored first, the level index still starts with level 0.
+    std::vector<Ktx2Level> level_index(levels.size());
+    uint64_t offset = index.dfd_offset + index.dfd_size;
+    for (size_t level = levels.size(); level-- > 0;)
+    {
+        offset = alignOffset(offset, ktx2_level_alignment);
+        level_index[level] = {offset, levels[level].size(), levels[level].size()};
+        offset += levels[level].size();
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+
+    file.write(reinterpret_cast<char const*>(ktx2_identifier.data()), ktx2_identifier.size());
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const*>(&index), sizeof(index));
+    file.write(reinterpret_cast<char const*>(level_index.data()), level_index.size() * sizeof(Ktx2Level));
+    file.write(reinterpret_cast<char const*>(dfd.data()), index.dfd_size);
+
+    std::array<char, ktx2_level_alignment> const padding{};
+    for (size_t level = levels.size(); level-- > 0;)
+    {
+        file.write(padding.data(), level_index[level].offset - static_cast<uint64_t>(file.tellp()));
+        file.write(reinterpret_cast<char const*>(levels[level].data()), levels[level].size());
+    }
+
+    return static_cast<bool>(file);
+}
+
+std::optional<MappedKtx2> mapKtx2(std::string const& path)
+{
+    auto file = mapFile(path);
+    if (!file)
+    {
+        return {};
+    }
+
+    auto const bytes = file->bytes();
+    if (bytes.size() < ktx2_levels_offset || std::memcmp(bytes.data(), ktx2_identifier.data(), ktx2_identifier.size()) != 0)
+    {
+        spdlog::warn("{} is not a KTX2 file", path);
+        return {};
+    }
+
+    MappedKtx2 ktx{};
+    std::memcpy(&ktx.header, bytes.data() + ktx2_identifier.size(), sizeof(Ktx2Header));
+
+    auto const& header = ktx.header;
+    if (!ktx2FormatIsSupported(header.vk_format) || header.supercompression_scheme != 0 || header.face_count != 1
+        || header.layer_count > 1 || header.depth > 1 || header.width == 0 || header.height == 0
+        || header.level_count == 0 || header.level_count > mipLevelCount(header.width, header.height))
+    {
+        spdlog::warn("{} is not a block compressed 2D texture (format {}, {} levels)", path, header.vk_format, header.level_count);
+        return {};
+    }
+
+    if (bytes.size() < ktx2_levels_offset + header.level_count * sizeof(Ktx2Level))
+    {
+        spdlog::warn("{} is truncated", path);
+        return {};
+    }
+
+    ktx.levels.resize(header.level_count);
+    std::memcpy(ktx.levels.data(), bytes.data() + ktx2_levels_offset, header.level_count * sizeof(Ktx2Level));
+
+    BlockFormat const format = header.vk_format == vk_format_bc1_rgb_unorm || header.vk_format == vk_format_bc1_rgb_srgb ? BlockFormat::BC1
+                             : header.vk_format == vk_format_bc4_unorm ? BlockFormat::BC4
+                             : header.vk_format == vk_format_bc5_unorm ? BlockFormat::BC5
+                             : BlockFormat::BC7;
+
+    for (uint32_t level = 0; level < header.level_count; ++level)
+    {
+        auto const& entry = ktx.levels[level];
+        uint32_t const width = std::max(1u, header.width >> level);
+        uint32_t const height = std::max(1u, header.height >> level);
+        uint64_t const expected = uint64_t(blocksFor(width)) * blocksFor(height) * blockBytes(format);
+
+        // Smaller levels come first in the file, see writeKtx2, ktx2Levels needs that.
+        bool const ordered = level == 0 || entry.offset + entry.size <= ktx.levels[level - 1].offset;
+        if (entry.size != expected || !ordered || entry.offset > bytes.size() || bytes.size() - entry.offset < entry.size)
+        {
+            spdlog::warn("{} has a broken level {}", path, level);
+            return {};
+        }
+    }
+
+    ktx.file = std::move(*file);
+    return ktx;
+}
+
+std::span<std::byte const> ktx2Level(MappedKtx2 const& ktx, uint32_t level)
+{
+    auto const& entry = ktx.levels[level];
+    return ktx.file.bytes().subspan(entry.offset, entry.size);
+}
+
+std::span<std::byte const> ktx2Levels(MappedKtx2 const& ktx, uint32_t first_level)
+{
+    auto const& first = ktx.levels[first_level];
+    auto const begin = ktx.levels.back().offset;
+    return ktx.file.bytes().subspan(begin, first.offset + first.size - begin);
+}
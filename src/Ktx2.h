@@ -0,0 +1,68 @@
+#pragma once
+
+#include "BlockCompression.h"
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Block compressed 2D textures with their mip levels in the KTX2 container, as
+// written by the texture cooker. Only what the cooker writes is read back: one
+// layer, one face and no supercompression. vk_format is a VkFormat, the level
+// data is in the layout vkCmdCopyBufferToImage takes for that format.
+struct Ktx2Header
+{
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+};
+
+struct Ktx2Level
+{
+    uint64_t offset;
+    uint64_t size;
+    uint64_t uncompressed_size;
+};
+
+struct MappedKtx2
+{
+    MappedFile file;
+    Ktx2Header header;
+
+    // Level 0, the full size, first.
+    std::vector<Ktx2Level> levels;
+};
+
+// The VkFormat of a block format, the UNORM or SRGB variant. BC1 is stored
+// without alpha, BC4 and BC5 have no sRGB variant.
+uint32_t ktx2Format(BlockFormat format, bool srgb);
+
+bool ktx2FormatIsSrgb(uint32_t vk_format);
+
+// Writes the levels of a width x height texture, level 0 first, each one the
+// compressImage blocks of that level.
+bool writeKtx2(std::string const& path,
+               BlockFormat format,
+               bool srgb,
+               uint32_t width,
+               uint32_t height,
+               std::vector<std::vector<uint8_t>> const& levels);
+
+std::optional<MappedKtx2> mapKtx2(std::string const& path);
+
+// Blocks of a level. Points into the mapping.
+std::span<std::byte const> ktx2Level(MappedKtx2 const& ktx, uint32_t level);
+
+// The levels from first_level to the smallest one, next to each other in the
+// file. Level i starts at its offset minus the offset of the smallest level.
+std::span<std::byte const> ktx2Levels(MappedKtx2 const& ktx, uint32_t first_level);
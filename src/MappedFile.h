@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. Uses mmap on Linux and falls back to reading
+// the file into memory on other platforms.
+struct MappedFile
+{
+    MappedFile() = default;
+
+    MappedFile(MappedFile&& other) noexcept
+        : data(std::exchange(other.data, nullptr))
+        , size(std::exchange(other.size, 0))
+        , fallback(std::move(other.fallback))
+    {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            data = std::exchange(other.data, nullptr);
+            size = std::exchange(other.size, 0);
+            fallback = std::move(other.fallback);
+        }
+        return *this;
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    ~MappedFile()
+    {
+        release();
+    }
+
+    std::span<std::byte const> bytes() const
+    {
+        return {static_cast<std::byte const*>(data), size};
+    }
+
+    char const* chars() const
+    {
+        return static_cast<char const*>(data);
+    }
+
+    void const* data{nullptr};
+    std::size_t size{0};
+
+private:
+    void release()
+    {
+#ifdef __linux__
+        if (data && fallback.empty())
+        {
+            munmap(const_cast<void*>(data), size);
+        }
+#endif
+        data = nullptr;
+        size = 0;
+        fallback.clear();
+    }
+
+    std::vector<char> fallback;
+
+    friend std::optional<MappedFile> mapFile(std::string const& path);
+};
+
+inline std::optional<MappedFile> mapFile(std::string const& path)
+{
+    MappedFile file;
+
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return {};
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return {};
+    }
+
+    // mmap does not accept empty mappings, keep the empty file as a valid view.
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        return file;
+    }
+
+    void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (ptr == MAP_FAILED)
+    {
+        return {};
+    }
+
+    madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+
+    file.data = ptr;
+    file.size = st.st_size;
+#else
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream)
+    {
+        return {};
+    }
+
+    file.fallback.resize(static_cast<std::size_t>(stream.tellg()));
+    stream.seekg(0);
+    stream.read(file.fallback.data(), file.fallback.size());
+
+    file.data = file.fallback.data();
+    file.size = file.fallback.size();
+#endif
+
+    return file;
+}
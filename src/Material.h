@@ -25,8 +25,9 @@ struct PbrParameters
 
 struct Lod
 {
-    float lod_base_distance = 10.0f;
-    float lod_scale_factor = 0.5f;
+    // Largest error of a level on screen as a fraction of the viewport height,
+    // about one pixel at 1080p.
+    float max_screen_error = 0.001f;
 };
 
 // Specifies what maps are available and should be used.
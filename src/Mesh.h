@@ -10,6 +10,9 @@
 #include <string>
 
 #include "Id.h"
+#include "MeshCache.h"
+
+#include <spdlog/spdlog.h>
 
 struct DrawableMesh
 {
@@ -18,22 +21,55 @@ struct DrawableMesh
 
     Buffer vertex_buffer;
     Buffer index_buffer;
+    vk::IndexType index_type = vk::IndexType::eUint32;
     uint32_t indices_size{};
+    uint32_t vertex_count{};
+    VertexFormat vertex_format = VertexFormat::Full;
+    std::vector<SubMesh> submeshes;
+    // Every submesh is drawn on its own with its vertex offset, see Model::local_indices.
+    bool local_indices = false;
+    std::vector<LodRange> lods;
+    // Bounds and normal cones of the full detail clusters, for cluster culling.
+    std::vector<Meshlet> meshlets;
+    Bounds bounds;
     int id = Id();
 };
 
+// Uploads the indices as 16 bit when every vertex they reference fits, which
+// halves the index memory and bandwidth of most meshes.
+inline std::pair<Buffer, vk::IndexType> createMeshIndexBuffer(RenderingState const& state, std::span<uint32_t const> indices, size_t vertex_count)
+{
+    if (fitsIndex16(vertex_count))
+    {
+        return {createIndexBuffer(state, narrowIndices(indices)), vk::IndexType::eUint16};
+    }
+
+    return {createIndexBuffer(state, indices), vk::IndexType::eUint32};
+}
+
 struct Meshes
 {
     std::map<int, DrawableMesh> meshes;
 
-    int loadMesh(RenderingState const& state, Model const& model, std::string const& name = "<noname>")
+    int loadMesh(RenderingState const& state, Model const& model, std::string const& name = "<noname>", VertexFormat format = VertexFormat::Full)
     {
+        auto [index_buffer, index_type] = createMeshIndexBuffer(state, lodIndices(model), indexedVertexCount(model));
+
         DrawableMesh mesh{
             .name = name,
             .model_id = model.id,
-            .vertex_buffer = createVertexBuffer(state, model.vertices),
-            .index_buffer = createIndexBuffer(state, model.indices),
-            .indices_size = model.indices.size()
+            .vertex_buffer = format == VertexFormat::Packed ? createVertexBuffer(state, packVertices(model.vertices))
+                                                             : createVertexBuffer(state, model.vertices),
+            .index_buffer = std::move(index_buffer),
+            .index_type = index_type,
+            .indices_size = model.indices.size(),
+            .vertex_count = static_cast<uint32_t>(model.vertices.size()),
+            .vertex_format = format,
+            .submeshes = model.submeshes,
+            .local_indices = model.local_indices,
+            .lods = lodRanges(model),
+            .meshlets = model.meshlets,
+            .bounds = model.bounds
         };
 
         meshes.insert({mesh.id, std::move(mesh)});
@@ -41,13 +77,70 @@ struct Meshes
         return mesh.id;
     }
 
+    // Uploads a model owned by models and applies its residency policy afterwards.
+    // A model that only maps its cooked mesh is uploaded from the mapping, an
+    // evicted model is reloaded from the mesh cache first.
+    int loadMesh(RenderingState const& state, Models& models, int model_id, std::string const& name = "<noname>", VertexFormat format = VertexFormat::Full)
+    {
+        if (auto it = models.models.find(model_id); it != models.models.end() && !it->second.resident && it->second.mapped)
+        {
+            auto const id = loadMesh(state, *it->second.mapped, name, format);
+            meshes.at(id).model_id = model_id;
+            models.uploaded(model_id);
+            return id;
+        }
+
+        auto* model = models.acquire(model_id);
+        if (!model)
+        {
+            spdlog::warn("Could not load mesh {}, model {} is not available", name, model_id);
+            return -1;
+        }
+
+        auto const id = loadMesh(state, *model, name, format);
+        models.uploaded(model_id);
+        return id;
+    }
+
+    // Upload a cooked mesh straight from the file mapping into the staging buffers.
+    // Only 16 bit indices and packed vertices need an intermediate copy.
+    int loadMesh(RenderingState const& state, MappedMesh const& cooked, std::string const& name = "<noname>", VertexFormat format = VertexFormat::Full)
+    {
+        auto [index_buffer, index_type] = createMeshIndexBuffer(state, cooked.indices, cooked.vertices.size());
+
+        DrawableMesh mesh{
+            .name = name,
+            .vertex_buffer = format == VertexFormat::Packed ? createVertexBuffer(state, packVertices(cooked.vertices))
+                                                             : createVertexBuffer(state, cooked.vertices),
+            .index_buffer = std::move(index_buffer),
+            .index_type = index_type,
+            .indices_size = cooked.lods.empty() ? static_cast<uint32_t>(cooked.indices.size()) : cooked.lods[0].index_count,
+            .vertex_count = static_cast<uint32_t>(cooked.vertices.size()),
+            .vertex_format = format,
+            .submeshes = {cooked.submeshes.begin(), cooked.submeshes.end()},
+            .lods = {cooked.lods.begin(), cooked.lods.end()},
+            .meshlets = {cooked.meshlets.begin(), cooked.meshlets.end()},
+            .bounds = computeBounds(cooked.vertices)
+        };
+
+        auto id = mesh.id;
+
+        meshes.insert({mesh.id, std::move(mesh)});
+        return id;
+    }
+
     bool loadMesh(RenderingState const& state, std::vector<Vertex> const& vertices, std::vector<uint32_t> const& indices, std::string const& name = "<noname>")
     {
+        auto [index_buffer, index_type] = createMeshIndexBuffer(state, indices, vertices.size());
+
         DrawableMesh mesh{
             .name = name,
             .vertex_buffer = createVertexBuffer(state, vertices),
-            .index_buffer = createIndexBuffer(state, indices),
-            .indices_size = indices.size()
+            .index_buffer = std::move(index_buffer),
+            .index_type = index_type,
+            .indices_size = indices.size(),
+            .vertex_count = static_cast<uint32_t>(vertices.size()),
+            .bounds = computeBounds(vertices)
         };
 
         auto id = mesh.id;
@@ -0,0 +1,261 @@
+#include "MeshCache.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+static constexpr uint32_t mesh_cache_magic = 0x4853454d; // "MESH"
+static constexpr uint32_t mesh_cache_version = 7;
+static constexpr char const* mesh_cache_dir = "./cache/meshes";
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment = 16)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+uint64_t hashBytes(std::span<std::byte const> bytes, uint64_t seed)
+{
+    // FNV-1a
+    uint64_t hash = seed;
+    for (auto b : bytes)
+    {
+        hash ^= static_cast<uint64_t>(b);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t hashString(std::string const& str)
+{
+    return hashBytes(std::as_bytes(std::span(str.data(), str.size())));
+}
+
+std::string meshCachePath(std::string const& source_path)
+{
+    auto const key = hashString(std::filesystem::path(source_path).lexically_normal().string());
+    return fmt::format("{}/{:016x}.mesh", mesh_cache_dir, key);
+}
+
+struct SourceInfo
+{
+    int64_t mtime{};
+    uint64_t size{};
+};
+
+static std::optional<SourceInfo> sourceInfo(std::string const& path)
+{
+    std::error_code ec;
+    auto const time = std::filesystem::last_write_time(path, ec);
+    if (ec)
+    {
+        return {};
+    }
+
+    auto const size = std::filesystem::file_size(path, ec);
+    if (ec)
+    {
+        return {};
+    }
+
+    return SourceInfo{time.time_since_epoch().count(), size};
+}
+
+static std::optional<uint64_t> hashFile(std::string const& path)
+{
+    auto file = mapFile(path);
+    if (!file)
+    {
+        return {};
+    }
+
+    return hashBytes(file->bytes());
+}
+
+std::optional<MappedMesh> mapCachedMesh(std::string const& source_path)
+{
+    auto const cache_path = meshCachePath(source_path);
+    auto file = mapFile(cache_path);
+    if (!file || file->size < sizeof(MeshCacheHeader))
+    {
+        return {};
+    }
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file->data, sizeof(header));
+
+    auto const path_hash = hashString(std::filesystem::path(source_path).lexically_normal().string());
+
+    if (   header.magic != mesh_cache_magic
+        || header.version != mesh_cache_version
+        || header.vertex_stride != sizeof(Vertex)
+        || header.path_hash != path_hash)
+    {
+        return {};
+    }
+
+    uint64_t const vertex_bytes = uint64_t(header.vertex_count) * sizeof(Vertex);
+    uint64_t const index_bytes = uint64_t(header.index_count) * sizeof(uint32_t);
+    uint64_t const submesh_bytes = uint64_t(header.submesh_count) * sizeof(SubMesh);
+    uint64_t const lod_bytes = uint64_t(header.lod_count) * sizeof(LodRange);
+    uint64_t const meshlet_bytes = uint64_t(header.meshlet_count) * sizeof(Meshlet);
+    uint64_t const meshlet_vertex_bytes = uint64_t(header.meshlet_vertex_count) * sizeof(uint32_t);
+    uint64_t const meshlet_triangle_bytes = uint64_t(header.meshlet_triangle_count) * 3;
+    // Written so a corrupt offset cannot wrap around.
+    auto const fits = [size = uint64_t(file->size)](uint64_t offset, uint64_t bytes)
+    {
+        return bytes <= size && offset <= size - bytes;
+    };
+
+    if (   !fits(header.vertex_offset, vertex_bytes)
+        || !fits(header.index_offset, index_bytes)
+        || !fits(header.submesh_offset, submesh_bytes)
+        || !fits(header.lod_offset, lod_bytes)
+        || !fits(header.meshlet_offset, meshlet_bytes)
+        || !fits(header.meshlet_vertex_offset, meshlet_vertex_bytes)
+        || !fits(header.meshlet_triangle_offset, meshlet_triangle_bytes))
+    {
+        spdlog::warn("Truncated mesh cache: {}", cache_path);
+        return {};
+    }
+
+    // A missing source is fine, the cooked file can be shipped on its own.
+    if (auto const info = sourceInfo(source_path))
+    {
+        if (info->size != header.source_size)
+        {
+            return {};
+        }
+
+        // The timestamp changed, only accept the entry if the content is unchanged.
+        if (info->mtime != header.source_mtime && hashFile(source_path) != header.content_hash)
+        {
+            return {};
+        }
+    }
+
+    auto const* base = static_cast<std::byte const*>(file->data);
+
+    MappedMesh mesh{};
+    mesh.vertices = {reinterpret_cast<Vertex const*>(base + header.vertex_offset), header.vertex_count};
+    mesh.indices = {reinterpret_cast<uint32_t const*>(base + header.index_offset), header.index_count};
+    mesh.submeshes = {reinterpret_cast<SubMesh const*>(base + header.submesh_offset), header.submesh_count};
+    mesh.lods = {reinterpret_cast<LodRange const*>(base + header.lod_offset), header.lod_count};
+    mesh.meshlets = {reinterpret_cast<Meshlet const*>(base + header.meshlet_offset), header.meshlet_count};
+    mesh.meshlet_vertices = {reinterpret_cast<uint32_t const*>(base + header.meshlet_vertex_offset), header.meshlet_vertex_count};
+    mesh.meshlet_triangles = {reinterpret_cast<uint8_t const*>(base + header.meshlet_triangle_offset), header.meshlet_triangle_count * 3};
+
+    for (auto const& lod : mesh.lods)
+    {
+        if (uint64_t(lod.first_index) + lod.index_count > header.index_count)
+        {
+            spdlog::warn("Invalid LOD range in mesh cache: {}", cache_path);
+            return {};
+        }
+    }
+
+    for (auto const& meshlet : mesh.meshlets)
+    {
+        if (   uint64_t(meshlet.vertex_offset) + meshlet.vertex_count > header.meshlet_vertex_count
+            || uint64_t(meshlet.triangle_offset) + uint64_t(meshlet.triangle_count) * 3 > mesh.meshlet_triangles.size())
+        {
+            spdlog::warn("Invalid meshlet in mesh cache: {}", cache_path);
+            return {};
+        }
+    }
+    mesh.file = std::move(*file);
+
+    return mesh;
+}
+
+bool writeCachedMesh(std::string const& source_path, Model const& model)
+{
+    auto const info = sourceInfo(source_path);
+    auto const content_hash = hashFile(source_path);
+    if (!info || !content_hash)
+    {
+        return false;
+    }
+
+    auto const indices = lodIndices(model);
+    auto const lods = lodRanges(model);
+
+    MeshCacheHeader header{};
+    header.magic = mesh_cache_magic;
+    header.version = mesh_cache_version;
+    header.path_hash = hashString(std::filesystem::path(source_path).lexically_normal().string());
+    header.source_mtime = info->mtime;
+    header.source_size = info->size;
+    header.content_hash = *content_hash;
+    header.vertex_stride = sizeof(Vertex);
+    header.vertex_count = model.vertices.size();
+    header.index_count = indices.size();
+    header.submesh_count = model.submeshes.size();
+    header.lod_count = lods.size();
+    header.meshlet_count = model.meshlets.size();
+    header.meshlet_vertex_count = model.meshlet_vertices.size();
+    header.meshlet_triangle_count = model.meshlet_triangles.size() / 3;
+    header.vertex_offset = alignOffset(sizeof(MeshCacheHeader));
+    header.index_offset = alignOffset(header.vertex_offset + model.vertices.size() * sizeof(Vertex));
+    header.submesh_offset = alignOffset(header.index_offset + indices.size() * sizeof(uint32_t));
+    header.lod_offset = alignOffset(header.submesh_offset + model.submeshes.size() * sizeof(SubMesh));
+    header.meshlet_offset = alignOffset(header.lod_offset + lods.size() * sizeof(LodRange));
+    header.meshlet_vertex_offset = alignOffset(header.meshlet_offset + model.meshlets.size() * sizeof(Meshlet));
+    header.meshlet_triangle_offset = alignOffset(header.meshlet_vertex_offset + model.meshlet_vertices.size() * sizeof(uint32_t));
+
+    std::error_code ec;
+    std::filesystem::create_directories(mesh_cache_dir, ec);
+
+    auto const cache_path = meshCachePath(source_path);
+    // Per thread temporary, two loaders may cook the same source at once.
+    auto const tmp_path = fmt::format("{}.{}.tmp", cache_path, std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            spdlog::warn("Could not write mesh cache: {}", cache_path);
+            return false;
+        }
+
+        std::vector<char> padding(16, 0);
+        auto pad_to = [&](uint64_t offset)
+        {
+            out.write(padding.data(), offset - static_cast<uint64_t>(out.tellp()));
+        };
+
+        out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        pad_to(header.vertex_offset);
+        out.write(reinterpret_cast<char const*>(model.vertices.data()), model.vertices.size() * sizeof(Vertex));
+        pad_to(header.index_offset);
+        out.write(reinterpret_cast<char const*>(indices.data()), indices.size() * sizeof(uint32_t));
+        pad_to(header.submesh_offset);
+        out.write(reinterpret_cast<char const*>(model.submeshes.data()), model.submeshes.size() * sizeof(SubMesh));
+        pad_to(header.lod_offset);
+        out.write(reinterpret_cast<char const*>(lods.data()), lods.size() * sizeof(LodRange));
+        pad_to(header.meshlet_offset);
+        out.write(reinterpret_cast<char const*>(model.meshlets.data()), model.meshlets.size() * sizeof(Meshlet));
+        pad_to(header.meshlet_vertex_offset);
+        out.write(reinterpret_cast<char const*>(model.meshlet_vertices.data()), model.meshlet_vertices.size() * sizeof(uint32_t));
+        pad_to(header.meshlet_triangle_offset);
+        out.write(reinterpret_cast<char const*>(model.meshlet_triangles.data()), header.meshlet_triangle_count * 3);
+
+        if (!out)
+        {
+            return false;
+        }
+    }
+
+    // Rename last so a crash never leaves a half written entry behind.
+    std::filesystem::rename(tmp_path, cache_path, ec);
+    if (ec)
+    {
+        spdlog::warn("Could not write mesh cache: {}", cache_path);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Model.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+
+// Cooked meshes are keyed on the source path. The header stores the source
+// modification time and a hash of the source content so a stale cache entry is
+// detected even when the timestamp alone is not trustworthy.
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t path_hash;
+    int64_t source_mtime;
+    uint64_t source_size;
+    uint64_t content_hash;
+
+    uint32_t vertex_stride;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t lod_count;
+    uint32_t meshlet_count;
+    uint32_t meshlet_vertex_count;
+    uint32_t meshlet_triangle_count;
+    uint32_t reserved;
+
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t submesh_offset;
+    uint64_t lod_offset;
+    uint64_t meshlet_offset;
+    uint64_t meshlet_vertex_offset;
+    uint64_t meshlet_triangle_offset;
+};
+
+// A cooked mesh mapped into memory. The spans point straight into the mapping and
+// can be handed to the staging buffer without an intermediate copy.
+struct MappedMesh
+{
+    MappedFile file;
+
+    std::span<Vertex const> vertices;
+    // Every LOD level after each other, see lods for the range of each level.
+    std::span<uint32_t const> indices;
+    std::span<SubMesh const> submeshes;
+    std::span<LodRange const> lods;
+
+    std::span<Meshlet const> meshlets;
+    std::span<uint32_t const> meshlet_vertices;
+    std::span<uint8_t const> meshlet_triangles;
+};
+
+uint64_t hashBytes(std::span<std::byte const> bytes, uint64_t seed = 14695981039346656037ull);
+
+std::string meshCachePath(std::string const& source_path);
+
+std::optional<MappedMesh> mapCachedMesh(std::string const& source_path);
+bool writeCachedMesh(std::string const& source_path, Model const& model);
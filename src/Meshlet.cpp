@@ -0,0 +1,360 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+static constexpr uint8_t not_in_meshlet = 0xff;
+
+static void buildSubmeshMeshlets(Model& model, uint32_t vertex_offset, uint32_t vertex_count, std::span<uint32_t const> indices)
+{
+    size_t const triangle_count = indices.size() / 3;
+
+    // Triangles around every vertex, local to the submesh.
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for (auto index : indices)
+    {
+        ++adjacency_offsets[index - vertex_offset + 1];
+    }
+    for (uint32_t v = 0; v < vertex_count; ++v)
+    {
+        adjacency_offsets[v + 1] += adjacency_offsets[v];
+    }
+
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        auto fill = adjacency_offsets;
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            adjacency[fill[indices[i] - vertex_offset]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    // Triangles not yet emitted around every vertex.
+    std::vector<uint32_t> live(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; ++v)
+    {
+        live[v] = adjacency_offsets[v + 1] - adjacency_offsets[v];
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint8_t> local(vertex_count, not_in_meshlet);
+
+    auto triangle_normal = [&](size_t triangle)
+    {
+        auto const& p0 = model.vertices[indices[triangle * 3]].pos;
+        auto const& p1 = model.vertices[indices[triangle * 3 + 1]].pos;
+        auto const& p2 = model.vertices[indices[triangle * 3 + 2]].pos;
+        auto const normal = glm::cross(p1 - p0, p2 - p0);
+        auto const length = glm::length(normal);
+        return length > 0.0f ? normal / length : glm::vec3(0.0f);
+    };
+
+    auto triangle_centroid = [&](size_t triangle)
+    {
+        return (  model.vertices[indices[triangle * 3]].pos
+                + model.vertices[indices[triangle * 3 + 1]].pos
+                + model.vertices[indices[triangle * 3 + 2]].pos) / 3.0f;
+    };
+
+    Meshlet meshlet{};
+    // Running sums over the triangles of the meshlet.
+    glm::vec3 normal_sum(0.0f);
+    glm::vec3 centroid_sum(0.0f);
+
+    auto reset = [&]
+    {
+        meshlet = {};
+        normal_sum = glm::vec3(0.0f);
+        centroid_sum = glm::vec3(0.0f);
+        meshlet.vertex_offset = static_cast<uint32_t>(model.meshlet_vertices.size());
+        meshlet.triangle_offset = static_cast<uint32_t>(model.meshlet_triangles.size());
+    };
+
+    auto flush = [&]
+    {
+        if (meshlet.triangle_count == 0)
+        {
+            return;
+        }
+
+        for (uint32_t i = 0; i < meshlet.vertex_count; ++i)
+        {
+            local[model.meshlet_vertices[meshlet.vertex_offset + i] - vertex_offset] = not_in_meshlet;
+        }
+
+        computeMeshletBounds(meshlet, model.vertices, model.meshlet_vertices, model.meshlet_triangles);
+        model.meshlets.push_back(meshlet);
+        reset();
+    };
+
+    auto new_vertices = [&](size_t triangle)
+    {
+        uint32_t count = 0;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            count += local[indices[triangle * 3 + k] - vertex_offset] == not_in_meshlet;
+        }
+        return count;
+    };
+
+    reset();
+    size_t seed = 0;
+
+    while (true)
+    {
+        if (meshlet.triangle_count == meshlet_max_triangles)
+        {
+            flush();
+        }
+
+        // The best next triangle adds the fewest new vertices. Ties go to the one
+        // with a vertex that has the fewest triangles left, that keeps the meshlet
+        // from leaving single triangles behind.
+        size_t best = triangle_count;
+        uint32_t best_score = std::numeric_limits<uint32_t>::max();
+
+        for (uint32_t i = 0; i < meshlet.vertex_count; ++i)
+        {
+            auto const v = model.meshlet_vertices[meshlet.vertex_offset + i] - vertex_offset;
+            for (uint32_t a = adjacency_offsets[v]; a < adjacency_offsets[v + 1]; ++a)
+            {
+                auto const triangle = adjacency[a];
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+
+                auto const added = new_vertices(triangle);
+                if (meshlet.vertex_count + added > meshlet_max_vertices)
+                {
+                    continue;
+                }
+
+                uint32_t min_live = std::numeric_limits<uint32_t>::max();
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    min_live = std::min(min_live, live[indices[triangle * 3 + k] - vertex_offset]);
+                }
+
+                uint32_t const score = added * 1024 + std::min(min_live, 1023u);
+                if (score < best_score)
+                {
+                    best_score = score;
+                    best = triangle;
+                }
+            }
+        }
+
+        if (best == triangle_count && meshlet.triangle_count > 0)
+        {
+            // Nothing connected fits. Meshes made of many small disconnected pieces
+            // would end up with nearly empty meshlets, so look a little ahead in
+            // index order, which is cache optimized and so spatially coherent, for
+            // the closest triangle that faces roughly the same way.
+            constexpr size_t look_ahead = 32;
+            constexpr float min_normal_dot = 0.5f;
+
+            auto const axis_length = glm::length(normal_sum);
+            auto const axis = axis_length > 0.0f ? normal_sum / axis_length : glm::vec3(0.0f);
+            auto const centroid = centroid_sum / float(meshlet.triangle_count);
+
+            float best_distance = std::numeric_limits<float>::max();
+            size_t checked = 0;
+            for (size_t triangle = seed; triangle < triangle_count && checked < look_ahead; ++triangle)
+            {
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+                ++checked;
+
+                if (   meshlet.vertex_count + new_vertices(triangle) > meshlet_max_vertices
+                    || glm::dot(triangle_normal(triangle), axis) < min_normal_dot)
+                {
+                    continue;
+                }
+
+                auto const distance = glm::distance(triangle_centroid(triangle), centroid);
+                if (distance < best_distance)
+                {
+                    best_distance = distance;
+                    best = triangle;
+                }
+            }
+        }
+
+        if (best == triangle_count)
+        {
+            // Start a new meshlet from the next triangle in index order.
+            flush();
+
+            while (seed < triangle_count && emitted[seed])
+            {
+                ++seed;
+            }
+
+            if (seed == triangle_count)
+            {
+                break;
+            }
+            best = seed;
+        }
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            auto const index = indices[best * 3 + k];
+            auto& slot = local[index - vertex_offset];
+            if (slot == not_in_meshlet)
+            {
+                slot = static_cast<uint8_t>(meshlet.vertex_count++);
+                model.meshlet_vertices.push_back(index);
+            }
+            model.meshlet_triangles.push_back(slot);
+            --live[index - vertex_offset];
+        }
+
+        emitted[best] = true;
+        ++meshlet.triangle_count;
+        normal_sum += triangle_normal(best);
+        centroid_sum += triangle_centroid(best);
+    }
+
+    flush();
+}
+
+void buildMeshlets(Model& model)
+{
+    model.meshlets.clear();
+    model.meshlet_vertices.clear();
+    model.meshlet_triangles.clear();
+
+    if (model.submeshes.empty())
+    {
+        buildSubmeshMeshlets(model, 0, static_cast<uint32_t>(model.vertices.size()), model.indices);
+        return;
+    }
+
+    for (auto& submesh : model.submeshes)
+    {
+        submesh.meshlet_offset = static_cast<uint32_t>(model.meshlets.size());
+        buildSubmeshMeshlets(model,
+                             submesh.vertex_offset,
+                             submesh.vertex_count,
+                             std::span(model.indices).subspan(submesh.index_offset, submesh.index_count));
+        submesh.meshlet_count = static_cast<uint32_t>(model.meshlets.size()) - submesh.meshlet_offset;
+    }
+}
+
+void computeMeshletBounds(Meshlet& meshlet,
+                          std::span<Vertex const> vertices,
+                          std::span<uint32_t const> meshlet_vertices,
+                          std::span<uint8_t const> meshlet_triangles)
+{
+    auto const local_vertices = meshlet_vertices.subspan(meshlet.vertex_offset, meshlet.vertex_count);
+    auto const triangles = meshlet_triangles.subspan(meshlet.triangle_offset, meshlet.triangle_count * 3);
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (auto index : local_vertices)
+    {
+        min = glm::min(min, vertices[index].pos);
+        max = glm::max(max, vertices[index].pos);
+    }
+
+    meshlet.center = (min + max) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (auto index : local_vertices)
+    {
+        meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, vertices[index].pos));
+    }
+
+    // Normal cone around the average face normal, counter clockwise is front facing.
+    std::vector<glm::vec3> normals;
+    normals.reserve(meshlet.triangle_count);
+    std::vector<glm::vec3> corners;
+    corners.reserve(meshlet.triangle_count);
+
+    glm::vec3 axis(0.0f);
+    for (size_t t = 0; t < triangles.size(); t += 3)
+    {
+        auto const& p0 = vertices[local_vertices[triangles[t]]].pos;
+        auto const& p1 = vertices[local_vertices[triangles[t + 1]]].pos;
+        auto const& p2 = vertices[local_vertices[triangles[t + 2]]].pos;
+
+        auto const normal = glm::cross(p1 - p0, p2 - p0);
+        auto const length = glm::length(normal);
+        if (length <= 0.0f)
+        {
+            continue;
+        }
+
+        normals.push_back(normal / length);
+        corners.push_back(p0);
+        axis += normals.back();
+    }
+
+    meshlet.cone_apex = meshlet.center;
+    meshlet.cone_axis = glm::vec3(0, 0, 1);
+    meshlet.cone_cutoff = 1.0f;
+
+    auto const axis_length = glm::length(axis);
+    if (normals.empty() || axis_length <= 0.0f)
+    {
+        return;
+    }
+    axis /= axis_length;
+
+    float min_dot = 1.0f;
+    for (auto const& normal : normals)
+    {
+        min_dot = std::min(min_dot, glm::dot(normal, axis));
+    }
+
+    meshlet.cone_axis = axis;
+
+    // Wider than a hemisphere, there is no position the whole meshlet faces away from.
+    if (min_dot <= 0.1f)
+    {
+        return;
+    }
+
+    // Move the apex back along the axis until it lies behind every triangle plane,
+    // then the cone test is conservative for the whole meshlet.
+    float max_t = 0.0f;
+    for (size_t i = 0; i < normals.size(); ++i)
+    {
+        float const dc = glm::dot(meshlet.center - corners[i], normals[i]);
+        float const dn = glm::dot(axis, normals[i]);
+        max_t = std::max(max_t, dc / dn);
+    }
+
+    meshlet.cone_apex = meshlet.center - axis * max_t;
+    meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+MeshletStats analyzeMeshlets(std::span<Meshlet const> meshlets)
+{
+    MeshletStats stats{};
+    stats.meshlet_count = meshlets.size();
+    if (meshlets.empty())
+    {
+        return stats;
+    }
+
+    size_t vertices = 0;
+    size_t triangles = 0;
+    size_t cullable = 0;
+    for (auto const& meshlet : meshlets)
+    {
+        vertices += meshlet.vertex_count;
+        triangles += meshlet.triangle_count;
+        cullable += meshlet.cone_cutoff < 1.0f;
+    }
+
+    stats.vertex_fill = float(vertices) / float(meshlets.size() * meshlet_max_vertices);
+    stats.triangle_fill = float(triangles) / float(meshlets.size() * meshlet_max_triangles);
+    stats.cullable = float(cullable) / float(meshlets.size());
+    return stats;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Model.h"
+
+#include <cstdint>
+#include <span>
+
+constexpr uint32_t meshlet_max_vertices = 64;
+constexpr uint32_t meshlet_max_triangles = 124;
+
+// Splits the full detail indices of every submesh into meshlets of at most
+// meshlet_max_vertices vertices and meshlet_max_triangles triangles. Triangles are
+// added greedily, preferring the ones that share the most vertices with the
+// meshlet so far, and every meshlet gets a bounding sphere and a normal cone.
+void buildMeshlets(Model& model);
+
+// Bounds of a set of triangles with global indices into vertices.
+void computeMeshletBounds(Meshlet& meshlet,
+                          std::span<Vertex const> vertices,
+                          std::span<uint32_t const> meshlet_vertices,
+                          std::span<uint8_t const> meshlet_triangles);
+
+// True when every triangle of the meshlet faces away from a camera at camera_pos.
+// Positions are in the space of the model.
+inline bool meshletBackfacing(Meshlet const& meshlet, glm::vec3 const& camera_pos)
+{
+    auto const to_apex = meshlet.cone_apex - camera_pos;
+    auto const length = glm::length(to_apex);
+    return length > 0.0f && glm::dot(to_apex / length, meshlet.cone_axis) >= meshlet.cone_cutoff;
+}
+
+// How well the meshlets use the space they have. A fill of 1 means every meshlet
+// is at the limit, cullable is the part of the meshlets with a usable normal cone.
+struct MeshletStats
+{
+    size_t meshlet_count{};
+    float vertex_fill{};
+    float triangle_fill{};
+    float cullable{};
+};
+
+MeshletStats analyzeMeshlets(std::span<Meshlet const> meshlets);
@@ -1,4 +1,8 @@
 #include "Model.h"
+#include "MeshCache.h"
+#include "Simplify.h"
+#include "ObjLoader.h"
+#include "Meshlet.h"
 #include <stdexcept>
 
 #include <assimp/Importer.hpp>
@@ -7,8 +11,22 @@
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
 
+#include <glm/gtc/packing.hpp>
+
 #include <spdlog/spdlog.h>
 
+#if defined(__SSE__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+#include <limits>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -18,133 +36,385 @@ static_assert(sizeof(float) == 4, "");
 static_assert(sizeof(glm::vec4) == 16, "");
 
 
-int Models::loadModelAssimp(std::string const& path)
+static glm::mat4 toMat4(aiMatrix4x4 const& m)
+{
+    // Assimp matrices are row major, glm is column major.
+    return glm::mat4(m.a1, m.b1, m.c1, m.d1,
+                     m.a2, m.b2, m.c2, m.d2,
+                     m.a3, m.b3, m.c3, m.d3,
+                     m.a4, m.b4, m.c4, m.d4);
+}
+
+static void appendMesh(Model& model, aiMesh const& mesh, glm::mat4 const& transform)
+{
+    if (!mesh.HasTangentsAndBitangents())
+    {
+        throw std::runtime_error("No tangent or bitangent");
+    }
+
+    SubMesh submesh{
+        .vertex_offset = static_cast<uint32_t>(model.vertices.size()),
+        .vertex_count = mesh.mNumVertices,
+        .index_offset = static_cast<uint32_t>(model.indices.size()),
+        .material_index = mesh.mMaterialIndex
+    };
+
+    auto const normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+    auto const tangent_matrix = glm::mat3(transform);
+
+    for (unsigned int i = 0; i < mesh.mNumVertices; ++i)
+    {
+        auto const vertex = mesh.mVertices[i];
+
+        Vertex vert{};
+        vert.pos = glm::vec3(transform * glm::vec4(vertex.x, vertex.y, vertex.z, 1.0f));
+
+        if (mesh.HasNormals())
+        {
+            auto const normal = mesh.mNormals[i];
+            vert.normal = glm::normalize(normal_matrix * glm::vec3(normal.x, normal.y, normal.z));
+        }
+
+        if (mesh.HasTextureCoords(0))
+        {
+            auto const tex_coord = mesh.mTextureCoords[0][i];
+            vert.tex_coord = glm::vec2(tex_coord.x, 1-tex_coord.y);
+        }
+
+        auto const tangent = mesh.mTangents[i];
+        auto const bitangent = mesh.mBitangents[i];
+
+        vert.tangent = tangent_matrix * glm::vec3(tangent.x, tangent.y, tangent.z);
+        vert.bitangent = tangent_matrix * glm::vec3(bitangent.x, bitangent.y, bitangent.z);
+
+        model.vertices.push_back(vert);
+    }
+
+    for (unsigned int i = 0; i < mesh.mNumFaces; ++i)
+    {
+        // Triangulate can still leave points and lines behind, they do not belong in a triangle list.
+        auto const& face = mesh.mFaces[i];
+        if (face.mNumIndices != 3)
+        {
+            continue;
+        }
+
+        for (unsigned int index = 0; index < face.mNumIndices; ++index)
+        {
+            model.indices.push_back(submesh.vertex_offset + face.mIndices[index]);
+        }
+    }
+
+    submesh.index_count = model.indices.size() - submesh.index_offset;
+    model.submeshes.push_back(submesh);
+}
+
+static void appendNode(Model& model, aiScene const& scene, aiNode const& node, glm::mat4 const& transform)
+{
+    for (unsigned int i = 0; i < node.mNumMeshes; ++i)
+    {
+        appendMesh(model, *scene.mMeshes[node.mMeshes[i]], transform);
+    }
+
+    for (unsigned int i = 0; i < node.mNumChildren; ++i)
+    {
+        auto const& child = *node.mChildren[i];
+        appendNode(model, scene, child, transform * toMat4(child.mTransformation));
+    }
+}
+
+// Fills the geometry of the model from its mapping, or from its cooked mesh if
+// there is an up to date one.
+static bool restoreCachedModel(Model& model)
+{
+    auto cached = model.mapped;
+    if (!cached)
+    {
+        auto mapped = mapCachedMesh(model.path);
+        if (!mapped)
+        {
+            return false;
+        }
+        cached = std::make_shared<MappedMesh const>(std::move(*mapped));
+    }
+
+    model.vertices.assign(cached->vertices.begin(), cached->vertices.end());
+    model.indices.clear();
+    model.lods.clear();
+    model.submeshes.assign(cached->submeshes.begin(), cached->submeshes.end());
+    model.meshlets.assign(cached->meshlets.begin(), cached->meshlets.end());
+    model.meshlet_vertices.assign(cached->meshlet_vertices.begin(), cached->meshlet_vertices.end());
+    model.meshlet_triangles.assign(cached->meshlet_triangles.begin(), cached->meshlet_triangles.end());
+
+    for (size_t level = 0; level < cached->lods.size(); ++level)
+    {
+        auto const& range = cached->lods[level];
+        auto const indices = cached->indices.subspan(range.first_index, range.index_count);
+        if (level == 0)
+        {
+            model.indices.assign(indices.begin(), indices.end());
+        }
+        else
+        {
+            model.lods.push_back(ModelLod{{indices.begin(), indices.end()}, range.error});
+        }
+    }
+
+    model.bounds = computeBounds(model.vertices);
+    model.cached = true;
+    model.resident = true;
+    model.mapped.reset();
+
+    spdlog::info("Copied cooked mesh {} ({} vertices, {} submeshes)", model.path, model.vertices.size(), model.submeshes.size());
+
+    return true;
+}
+
+// A model that only maps its cooked mesh, without a copy of the geometry.
+static std::optional<Model> loadCachedModel(std::string const& path)
+{
+    auto cached = mapCachedMesh(path);
+    if (!cached)
+    {
+        return {};
+    }
+
+    Model model;
+    model.path = path;
+    model.submeshes.assign(cached->submeshes.begin(), cached->submeshes.end());
+    model.bounds = computeBounds(cached->vertices);
+    model.cached = true;
+    model.resident = false;
+
+    spdlog::info("Mapped cooked mesh {} ({} vertices, {} submeshes)", path, cached->vertices.size(), model.submeshes.size());
+
+    model.mapped = std::make_shared<MappedMesh const>(std::move(*cached));
+    return model;
+}
+
+// Optimizes a freshly imported model, builds its LODs and writes the result to
+// the mesh cache.
+static void cookModel(Model& model)
+{
+    if (auto const welded = weldVertices(model))
+    {
+        spdlog::info("Welded {} duplicate vertices of {}", welded, model.path);
+    }
+
+    optimizeModel(model);
+    generateLods(model);
+    buildMeshlets(model);
+    model.bounds = computeBounds(model.vertices);
+
+    auto const stats = analyzeMeshlets(model.meshlets);
+    spdlog::info("{} meshlets for {}, vertex fill {:.2f}, triangle fill {:.2f}, cullable {:.2f}",
+                 stats.meshlet_count, model.path, stats.vertex_fill, stats.triangle_fill, stats.cullable);
+
+    model.cached = writeCachedMesh(model.path, model);
+    if (!model.cached)
+    {
+        spdlog::warn("Could not cook mesh {}", model.path);
+    }
+}
+
+std::optional<Model> importModelAssimp(std::string const& path)
 {
+    // Cooked meshes skip the Assimp import entirely.
+    if (auto cached = loadCachedModel(path))
+    {
+        return cached;
+    }
+
     Assimp::Importer importer;
     auto *scene = importer.ReadFile(path,  aiProcess_Triangulate
+                                                                 | aiProcess_JoinIdenticalVertices
                                                                  | aiProcess_CalcTangentSpace);
 
-    if (!scene)
+    if (!scene || !scene->mRootNode || scene->mNumMeshes == 0)
     {
-        return -1;
+        return {};
     }
 
     Model model;
     model.path = path;
-    if (scene->mNumMeshes > 0)
+
+    // Lower bound, meshes referenced by several nodes are appended once per node.
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
     {
-        auto* mesh = scene->mMeshes[0];
+        vertex_count += scene->mMeshes[i]->mNumVertices;
+        index_count += scene->mMeshes[i]->mNumFaces * 3;
+    }
+    model.vertices.reserve(vertex_count);
+    model.indices.reserve(index_count);
 
-        for (int i = 0; i < mesh->mNumVertices; ++i)
-        {
-            auto const vertex = mesh->mVertices[i];
+    // Every node transform below the root is baked into the vertices. The root
+    // transform only holds the unit and axis conversion of the file format,
+    // objects are scaled and rotated in the scene instead.
+    appendNode(model, *scene, *scene->mRootNode, glm::mat4(1.0f));
+
+    if (model.indices.empty())
+    {
+        return {};
+    }
 
-            Vertex vert;
-            vert.pos = glm::vec3(vertex.x, vertex.y, vertex.z);
+    spdlog::info("Imported {} ({} vertices, {} submeshes)", path, model.vertices.size(), model.submeshes.size());
 
-            if (mesh->HasNormals())
-            {
-                auto const normal = mesh->mNormals[i];
-                vert.normal = glm::vec3(normal.x, normal.y, normal.z);
-            }
+    cookModel(model);
 
-            if (mesh->HasTextureCoords(0))
-            {
-                auto const tex_coord = mesh->mTextureCoords[0][i];
-                vert.tex_coord = glm::vec2(tex_coord.x, 1-tex_coord.y);
-            }
+    return model;
+}
 
-            if (mesh->HasTangentsAndBitangents())
-            {
-                auto const tangent = mesh->mTangents[i];
-                auto const bitangent = mesh->mBitangents[i];
+std::optional<Model> importModelObj(std::string const& path)
+{
+    if (auto cached = loadCachedModel(path))
+    {
+        return cached;
+    }
 
-                vert.tangent = glm::vec3(tangent.x, tangent.y, tangent.z);
-                vert.bitangent = glm::vec3(bitangent.x, bitangent.y, bitangent.z);
+    auto model = parseObj(path);
+    if (!model)
+    {
+        return {};
+    }
 
-                if (vert.tangent.length() == 0 ||
-                    vert.bitangent.length() == 0)
-                {
-                    throw std::runtime_error("Invalid tangent/bitangent");
-                }
-            }
-            else
-            {
-                throw std::runtime_error("No tangent or bitangent");
-            }
+    spdlog::info("Imported {} ({} vertices, {} submeshes)", path, model->vertices.size(), model->submeshes.size());
 
-            model.vertices.push_back(vert);
-            //model.indices.push_back(model.indices.size());
-        }
+    cookModel(*model);
 
-        for (int i = 0; i < mesh->mNumFaces; ++i)
-        {
-            auto face = mesh->mFaces[i];
-            for (int index = 0; index < face.mNumIndices; ++index)
-            {
-                model.indices.push_back(face.mIndices[index]);
-            }
-        }
+    return model;
+}
+
+template<typename T>
+static size_t vectorMemory(std::vector<T> const& vector)
+{
+    return vector.capacity() * sizeof(T);
+}
+
+// clear() and assigning {} both keep the capacity, swapping with an empty vector
+// releases it.
+template<typename T>
+static void freeVector(std::vector<T>& vector)
+{
+    std::vector<T>().swap(vector);
+}
+
+size_t modelMemory(Model const& model)
+{
+    size_t bytes = vectorMemory(model.vertices)
+                 + vectorMemory(model.indices)
+                 + vectorMemory(model.submeshes)
+                 + vectorMemory(model.lods)
+                 + vectorMemory(model.meshlets)
+                 + vectorMemory(model.meshlet_vertices)
+                 + vectorMemory(model.meshlet_triangles);
+
+    for (auto const& lod : model.lods)
+    {
+        bytes += vectorMemory(lod.indices);
     }
-    else
+    return bytes;
+}
+
+bool evictModel(Model& model)
+{
+    if (!model.cached)
     {
-        return -1;
+        return false;
+    }
+
+    freeVector(model.vertices);
+    freeVector(model.indices);
+    freeVector(model.lods);
+    freeVector(model.meshlets);
+    freeVector(model.meshlet_vertices);
+    freeVector(model.meshlet_triangles);
+    model.mapped.reset();
+    model.resident = false;
+    return true;
+}
+
+bool reloadModel(Model& model)
+{
+    if (model.resident)
+    {
+        return true;
+    }
+
+    if (!model.cached || !restoreCachedModel(model))
+    {
+        spdlog::warn("Could not reload model {}", model.path);
+        return false;
     }
 
-    models.insert({model.id, model});
-    return model.id;
+    return true;
 }
 
-int Models::loadModel(std::string const& model_path)
+int Models::addModel(Model model, Residency residency)
 {
-    /*
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+    auto const id = model.id;
+    model.residency = residency;
+    models.insert({id, std::move(model)});
+    return id;
+}
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, model_path.c_str()))
+int Models::loadModelAssimp(std::string const& path, Residency residency)
+{
+    auto model = importModelAssimp(path);
+    if (!model)
     {
-        spdlog::warn("Failed loading model");
         return -1;
     }
 
-    Model model{};
-    model.path = model_path;
+    return addModel(std::move(*model), residency);
+}
 
-    for (auto const& shape : shapes)
+Model* Models::acquire(int id)
+{
+    auto it = models.find(id);
+    if (it == models.end() || !reloadModel(it->second))
     {
-        for (auto const& index : shape.mesh.indices)
-        {
-            Vertex vertex;
+        return nullptr;
+    }
 
-            vertex.pos = {
-                  attrib.vertices[3 * index.vertex_index + 0]
-                , attrib.vertices[3 * index.vertex_index + 1]
-                , attrib.vertices[3 * index.vertex_index + 2]
-            };
+    return &it->second;
+}
 
-            vertex.tex_coord = {
-                  attrib.texcoords[2 * index.texcoord_index + 0]
-                , 1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
+void Models::uploaded(int id)
+{
+    auto it = models.find(id);
+    if (it == models.end() || it->second.residency != Residency::EvictAfterUpload)
+    {
+        return;
+    }
 
-            vertex.normal = {
-                  attrib.normals[3 * index.normal_index + 0]
-                , attrib.normals[3 * index.normal_index + 1]
-                , attrib.normals[3 * index.normal_index + 2]
-            };
+    auto const bytes = modelMemory(it->second);
+    if (evictModel(it->second))
+    {
+        spdlog::info("Evicted {} after upload, freed {} KB", it->second.path, bytes / 1024);
+    }
+}
 
-            model.vertices.push_back(vertex);
-            model.indices.push_back(model.indices.size());
-        }
+size_t Models::residentMemory() const
+{
+    size_t bytes = 0;
+    for (auto const& [id, model] : models)
+    {
+        bytes += modelMemory(model);
     }
+    return bytes;
+}
 
-    models.insert({model.id, model});
+int Models::loadModel(std::string const& model_path, Residency residency)
+{
+    auto model = importModelObj(model_path);
+    if (!model)
+    {
+        return -1;
+    }
 
-    return model.id;
-    */
-    return -1;
+    return addModel(std::move(*model), residency);
 }
 
 Model createBox()
@@ -220,5 +490,752 @@ Model createBox()
     model.vertices = vertices;
     model.path = "Box";
 
+    model.bounds = computeBounds(model.vertices);
+
     return model;
-}
\ No newline at end of file
+}
+
+Bounds computeBounds(std::span<Vertex const> vertices)
+{
+    Bounds bounds{};
+    if (vertices.empty())
+    {
+        return bounds;
+    }
+
+    static_assert(offsetof(Vertex, pos) == 0 && sizeof(Vertex) >= 4 * sizeof(float),
+                  "The SIMD loads read pos and the float after it");
+
+#if defined(__SSE__) || defined(_M_X64)
+    // Four lane loads of pos, the fourth lane is the first float after it and ignored.
+    __m128 min = _mm_loadu_ps(&vertices[0].pos.x);
+    __m128 max = min;
+    for (auto const& vertex : vertices)
+    {
+        __m128 const pos = _mm_loadu_ps(&vertex.pos.x);
+        min = _mm_min_ps(min, pos);
+        max = _mm_max_ps(max, pos);
+    }
+
+    alignas(16) float min_lanes[4];
+    alignas(16) float max_lanes[4];
+    _mm_store_ps(min_lanes, min);
+    _mm_store_ps(max_lanes, max);
+    bounds.min = glm::vec3(min_lanes[0], min_lanes[1], min_lanes[2]);
+    bounds.max = glm::vec3(max_lanes[0], max_lanes[1], max_lanes[2]);
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+    __m128 const center = _mm_setr_ps(bounds.center.x, bounds.center.y, bounds.center.z, 0.0f);
+    __m128 const xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 max_distance = _mm_setzero_ps();
+    for (auto const& vertex : vertices)
+    {
+        __m128 const d = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(&vertex.pos.x), center), xyz_mask);
+        __m128 const d2 = _mm_mul_ps(d, d);
+        // x+y+z of the squared distance in every lane.
+        __m128 const sum = _mm_add_ps(d2, _mm_shuffle_ps(d2, d2, _MM_SHUFFLE(2, 3, 0, 1)));
+        max_distance = _mm_max_ps(max_distance, _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+    bounds.radius = std::sqrt(_mm_cvtss_f32(max_distance));
+#else
+    bounds.min = vertices[0].pos;
+    bounds.max = vertices[0].pos;
+    for (auto const& vertex : vertices)
+    {
+        bounds.min = glm::min(bounds.min, vertex.pos);
+        bounds.max = glm::max(bounds.max, vertex.pos);
+    }
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+    float max_distance = 0.0f;
+    for (auto const& vertex : vertices)
+    {
+        auto const d = vertex.pos - bounds.center;
+        max_distance = std::max(max_distance, glm::dot(d, d));
+    }
+    bounds.radius = std::sqrt(max_distance);
+#endif
+
+    return bounds;
+}
+
+Bounds transformBounds(Bounds const& bounds, glm::mat4 const& transform)
+{
+    // Arvo: the extent along each world axis is the absolute transform applied
+    // to the local extent.
+    glm::vec3 const center = (bounds.min + bounds.max) * 0.5f;
+    glm::vec3 const extent = (bounds.max - bounds.min) * 0.5f;
+
+    glm::vec3 const world_center = glm::vec3(transform * glm::vec4(center, 1.0f));
+    glm::vec3 world_extent(0.0f);
+    for (int column = 0; column < 3; ++column)
+    {
+        world_extent += glm::abs(glm::vec3(transform[column])) * extent[column];
+    }
+
+    float const max_scale = std::sqrt(std::max({glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+                                                glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])),
+                                                glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2]))}));
+
+    Bounds world{};
+    world.min = world_center - world_extent;
+    world.max = world_center + world_extent;
+    world.center = glm::vec3(transform * glm::vec4(bounds.center, 1.0f));
+    world.radius = bounds.radius * max_scale;
+    return world;
+}
+
+Frustum extractFrustum(glm::mat4 const& projection_view)
+{
+    // Gribb and Hartmann, the rows of the matrix combined. glm is column major.
+    auto const row = [&](int i)
+    {
+        return glm::vec4(projection_view[0][i], projection_view[1][i], projection_view[2][i], projection_view[3][i]);
+    };
+
+    Frustum frustum{};
+    frustum.planes[0] = row(3) + row(0);    // Left
+    frustum.planes[1] = row(3) - row(0);    // Right
+    frustum.planes[2] = row(3) + row(1);    // Bottom
+    frustum.planes[3] = row(3) - row(1);    // Top
+    frustum.planes[4] = row(2);             // Near, depth is zero to one
+    frustum.planes[5] = row(3) - row(2);    // Far
+
+    for (auto& plane : frustum.planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool intersects(Frustum const& frustum, glm::vec3 const& min, glm::vec3 const& max)
+{
+    for (auto const& plane : frustum.planes)
+    {
+        // The corner furthest along the plane normal.
+        glm::vec3 const corner(plane.x >= 0.0f ? max.x : min.x,
+                               plane.y >= 0.0f ? max.y : min.y,
+                               plane.z >= 0.0f ? max.z : min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+VertexCacheStats analyzeVertexCache(std::span<uint32_t const> indices, size_t vertex_count, uint32_t cache_size)
+{
+    VertexCacheStats stats{};
+    if (indices.size() < 3)
+    {
+        return stats;
+    }
+
+    // FIFO cache, only a miss pushes a vertex so the age of an entry is the number of misses since.
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<bool> referenced(vertex_count, false);
+    uint32_t timestamp = cache_size + 1;
+    size_t misses = 0;
+    size_t unique = 0;
+
+    for (auto index : indices)
+    {
+        if (timestamp - cache_time[index] > cache_size)
+        {
+            cache_time[index] = timestamp++;
+            ++misses;
+        }
+
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++unique;
+        }
+    }
+
+    stats.acmr = float(misses) / (indices.size() / 3);
+    stats.atvr = float(misses) / unique;
+    return stats;
+}
+
+// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation".
+static constexpr uint32_t forsyth_cache_size = 32;
+
+static float forsythVertexScore(int cache_position, uint32_t remaining_triangles)
+{
+    if (remaining_triangles == 0)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 0)
+    {
+        // The last triangle was just drawn, reusing its vertices right away does not
+        // help the next triangle strip along, so they get a fixed lower score.
+        if (cache_position < 3)
+        {
+            score = 0.75f;
+        }
+        else
+        {
+            float const scaler = 1.0f / (forsyth_cache_size - 3);
+            score = std::pow(1.0f - (cache_position - 3) * scaler, 1.5f);
+        }
+    }
+
+    // Prefer vertices with few triangles left so they can leave the cache.
+    score += 2.0f * std::pow(float(remaining_triangles), -0.5f);
+    return score;
+}
+
+void optimizeVertexCache(std::span<uint32_t> indices, size_t vertex_count)
+{
+    size_t const triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+    {
+        return;
+    }
+
+    // Triangles per vertex. The live triangles of a vertex are kept at the front of its range.
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; ++i)
+    {
+        ++remaining[indices[i]];
+    }
+
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; ++v)
+    {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangle_count * 3; ++i)
+        {
+            adjacency[fill[indices[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v)
+    {
+        vertex_score[v] = forsythVertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    int best = 0;
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        triangle_score[t] = vertex_score[indices[t*3]] + vertex_score[indices[t*3+1]] + vertex_score[indices[t*3+2]];
+        if (triangle_score[t] > triangle_score[best])
+        {
+            best = t;
+        }
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> next_cache;
+    cache.reserve(forsyth_cache_size + 3);
+    next_cache.reserve(forsyth_cache_size + 3);
+
+    size_t cursor = 0;
+
+    while (best >= 0)
+    {
+        emitted[best] = true;
+
+        uint32_t const triangle[3] = {indices[best*3], indices[best*3+1], indices[best*3+2]};
+
+        next_cache.clear();
+        for (auto v : triangle)
+        {
+            output.push_back(v);
+            next_cache.push_back(v);
+
+            auto const begin = adjacency.begin() + offsets[v];
+            auto const end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, uint32_t(best)), end - 1);
+            --remaining[v];
+        }
+
+        for (auto v : cache)
+        {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+            {
+                next_cache.push_back(v);
+            }
+        }
+
+        // Rescore everything that moved in the cache, including the vertices pushed out of it.
+        for (size_t i = 0; i < next_cache.size(); ++i)
+        {
+            auto const v = next_cache[i];
+            cache_position[v] = i < forsyth_cache_size ? int(i) : -1;
+
+            float const score = forsythVertexScore(cache_position[v], remaining[v]);
+            float const delta = score - vertex_score[v];
+            vertex_score[v] = score;
+
+            for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; ++j)
+            {
+                triangle_score[adjacency[j]] += delta;
+            }
+        }
+
+        next_cache.resize(std::min<size_t>(next_cache.size(), forsyth_cache_size));
+        std::swap(cache, next_cache);
+
+        // The next triangle is almost always one touching the cache.
+        best = -1;
+        float best_score = -1.0f;
+        for (auto v : cache)
+        {
+            for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; ++j)
+            {
+                auto const t = adjacency[j];
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (best < 0)
+        {
+            while (cursor < triangle_count && emitted[cursor])
+            {
+                ++cursor;
+            }
+            best = cursor < triangle_count ? int(cursor) : -1;
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+// Pedro Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+// Splits the cache optimized order into clusters and draws the clusters facing outwards
+// first, the cluster boundaries are placed where they cost at most `threshold` in ACMR.
+void optimizeOverdraw(std::span<uint32_t> indices, std::span<Vertex const> vertices, float threshold)
+{
+    size_t const triangle_count = indices.size() / 3;
+    if (triangle_count < 2)
+    {
+        return;
+    }
+
+    constexpr uint32_t cache_size = 16;
+    std::vector<uint32_t> cache_time(vertices.size(), 0);
+    uint32_t timestamp = cache_size + 1;
+
+    auto misses = [&](size_t triangle)
+    {
+        uint32_t count = 0;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            auto const v = indices[triangle*3 + k];
+            if (timestamp - cache_time[v] > cache_size)
+            {
+                cache_time[v] = timestamp++;
+                ++count;
+            }
+        }
+        return count;
+    };
+
+    auto flush = [&]()
+    {
+        timestamp += cache_size + 1;
+    };
+
+    // Hard boundaries, the cache is cold here anyway.
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        if (misses(t) == 3)
+        {
+            hard.push_back(t);
+        }
+    }
+    hard.push_back(triangle_count);
+
+    // Soft boundaries, split wherever the cluster so far is close to the ACMR of the whole hard cluster.
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); ++h)
+    {
+        size_t const start = hard[h];
+        size_t const end = hard[h + 1];
+
+        flush();
+        size_t cluster_misses = 0;
+        for (size_t t = start; t < end; ++t)
+        {
+            cluster_misses += misses(t);
+        }
+        float const cluster_acmr = float(cluster_misses) / (end - start);
+
+        flush();
+        clusters.push_back(start);
+        size_t first = start;
+        size_t partial_misses = 0;
+        for (size_t t = start; t < end; ++t)
+        {
+            partial_misses += misses(t);
+            if (t + 1 < end && float(partial_misses) / (t - first + 1) <= cluster_acmr * threshold)
+            {
+                clusters.push_back(t + 1);
+                first = t + 1;
+                partial_misses = 0;
+                flush();
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+
+    struct ClusterInfo
+    {
+        glm::vec3 centroid{0.0f};
+        glm::vec3 normal{0.0f};
+        float area{0.0f};
+    };
+
+    std::vector<ClusterInfo> infos(clusters.size() - 1);
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+
+    for (size_t c = 0; c < infos.size(); ++c)
+    {
+        auto& info = infos[c];
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+        {
+            auto const& v0 = vertices[indices[t*3]];
+            auto const& v1 = vertices[indices[t*3+1]];
+            auto const& v2 = vertices[indices[t*3+2]];
+
+            // Face normal scaled by twice the area, flipped to agree with the vertex normals
+            // so the winding convention of the source does not matter.
+            auto normal = glm::cross(v1.pos - v0.pos, v2.pos - v0.pos);
+            if (glm::dot(normal, v0.normal + v1.normal + v2.normal) < 0.0f)
+            {
+                normal = -normal;
+            }
+
+            float const area = glm::length(normal);
+            info.centroid += (v0.pos + v1.pos + v2.pos) * (area / 3.0f);
+            info.normal += normal;
+            info.area += area;
+        }
+
+        mesh_centroid += info.centroid;
+        mesh_area += info.area;
+
+        if (info.area > 0.0f)
+        {
+            info.centroid /= info.area;
+        }
+    }
+
+    if (mesh_area > 0.0f)
+    {
+        mesh_centroid /= mesh_area;
+    }
+
+    std::vector<std::pair<float, size_t>> order;
+    order.reserve(infos.size());
+    for (size_t c = 0; c < infos.size(); ++c)
+    {
+        auto const& info = infos[c];
+        float const length = glm::length(info.normal);
+        float const score = length > 0.0f ? glm::dot(info.centroid - mesh_centroid, info.normal / length) : 0.0f;
+        order.push_back({score, c});
+    }
+
+    std::stable_sort(order.begin(), order.end(), [](auto const& lhs, auto const& rhs) { return lhs.first > rhs.first; });
+
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+    for (auto const& [score, c] : order)
+    {
+        output.insert(output.end(), indices.begin() + clusters[c]*3, indices.begin() + clusters[c + 1]*3);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void optimizeVertexFetch(std::span<Vertex> vertices, std::span<uint32_t> indices)
+{
+    constexpr uint32_t unused = std::numeric_limits<uint32_t>::max();
+
+    // Number vertices in the order they are first referenced.
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    uint32_t next = 0;
+    for (auto& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+
+    // Unreferenced vertices are kept at the end so the vertex count of the range stays the same.
+    for (auto& slot : remap)
+    {
+        if (slot == unused)
+        {
+            slot = next++;
+        }
+    }
+
+    std::vector<Vertex> reordered(vertices.size());
+    for (size_t v = 0; v < vertices.size(); ++v)
+    {
+        reordered[remap[v]] = vertices[v];
+    }
+
+    std::copy(reordered.begin(), reordered.end(), vertices.begin());
+}
+
+namespace
+{
+
+// The attributes of a vertex as bits, without the padding Vertex may have.
+std::array<uint32_t, 16> vertexBits(Vertex const& v)
+{
+    auto bits = [](float f) { return std::bit_cast<uint32_t>(f); };
+    return {bits(v.pos.x), bits(v.pos.y), bits(v.pos.z),
+            bits(v.tex_coord.x), bits(v.tex_coord.y),
+            bits(v.normal.x), bits(v.normal.y), bits(v.normal.z),
+            bits(v.normal_coord.x), bits(v.normal_coord.y),
+            bits(v.tangent.x), bits(v.tangent.y), bits(v.tangent.z),
+            bits(v.bitangent.x), bits(v.bitangent.y), bits(v.bitangent.z)};
+}
+
+struct VertexBitsHash
+{
+    size_t operator()(Vertex const* vertex) const
+    {
+        auto const bits = vertexBits(*vertex);
+        return hashBytes(std::as_bytes(std::span(bits)));
+    }
+};
+
+struct VertexBitsEqual
+{
+    bool operator()(Vertex const* a, Vertex const* b) const
+    {
+        return vertexBits(*a) == vertexBits(*b);
+    }
+};
+
+}
+
+size_t weldVertices(Model& model)
+{
+    bool const whole_model = model.submeshes.empty();
+    if (whole_model)
+    {
+        model.submeshes.push_back(SubMesh{
+            .vertex_count = static_cast<uint32_t>(model.vertices.size()),
+            .index_count = static_cast<uint32_t>(model.indices.size())
+        });
+    }
+
+    std::vector<Vertex> vertices;
+    vertices.reserve(model.vertices.size());
+    std::vector<uint32_t> remap(model.vertices.size());
+
+    for (auto& submesh : model.submeshes)
+    {
+        std::unordered_map<Vertex const*, uint32_t, VertexBitsHash, VertexBitsEqual> unique;
+        unique.reserve(submesh.vertex_count);
+
+        auto const vertex_offset = static_cast<uint32_t>(vertices.size());
+        for (uint32_t i = submesh.vertex_offset; i < submesh.vertex_offset + submesh.vertex_count; ++i)
+        {
+            auto [it, inserted] = unique.try_emplace(&model.vertices[i], static_cast<uint32_t>(vertices.size()));
+            if (inserted)
+            {
+                vertices.push_back(model.vertices[i]);
+            }
+            remap[i] = it->second;
+        }
+
+        submesh.vertex_offset = vertex_offset;
+        submesh.vertex_count = static_cast<uint32_t>(vertices.size()) - vertex_offset;
+    }
+
+    if (whole_model)
+    {
+        model.submeshes.clear();
+    }
+
+    for (auto& index : model.indices)
+    {
+        index = remap[index];
+    }
+
+    for (auto& lod : model.lods)
+    {
+        for (auto& index : lod.indices)
+        {
+            index = remap[index];
+        }
+    }
+
+    auto const removed = model.vertices.size() - vertices.size();
+    model.vertices = std::move(vertices);
+    return removed;
+}
+
+std::vector<uint16_t> narrowIndices(std::span<uint32_t const> indices)
+{
+    return {indices.begin(), indices.end()};
+}
+
+size_t indexedVertexCount(Model const& model)
+{
+    if (!model.local_indices)
+    {
+        return model.vertices.size();
+    }
+
+    size_t count = 0;
+    for (auto const& submesh : model.submeshes)
+    {
+        count = std::max<size_t>(count, submesh.vertex_count);
+    }
+    return count;
+}
+
+void optimizeModel(Model& model)
+{
+    auto submeshes = model.submeshes;
+    if (submeshes.empty())
+    {
+        submeshes.push_back(SubMesh{
+            .vertex_count = static_cast<uint32_t>(model.vertices.size()),
+            .index_count = static_cast<uint32_t>(model.indices.size())
+        });
+    }
+
+    auto const before = analyzeVertexCache(model.indices, model.vertices.size());
+
+    std::vector<uint32_t> local;
+    for (auto const& submesh : submeshes)
+    {
+        std::span<Vertex> vertices(model.vertices.data() + submesh.vertex_offset, submesh.vertex_count);
+        std::span<uint32_t> indices(model.indices.data() + submesh.index_offset, submesh.index_count);
+
+        local.assign(indices.begin(), indices.end());
+        for (auto& index : local)
+        {
+            index -= submesh.vertex_offset;
+        }
+
+        optimizeVertexCache(local, vertices.size());
+        optimizeOverdraw(local, vertices);
+        optimizeVertexFetch(vertices, local);
+
+        for (size_t i = 0; i < local.size(); ++i)
+        {
+            indices[i] = local[i] + submesh.vertex_offset;
+        }
+    }
+
+    auto const after = analyzeVertexCache(model.indices, model.vertices.size());
+
+    spdlog::info("Optimized {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+                 model.path, before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+static int16_t packSnorm16(float value)
+{
+    return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static uint16_t packUnorm16(float value)
+{
+    return static_cast<uint16_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+// Project the normal onto the octahedron and unfold the lower half over the upper.
+static glm::vec2 octEncode(glm::vec3 n)
+{
+    float const sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (sum == 0.0f)
+    {
+        return glm::vec2(0.0f);
+    }
+
+    n /= sum;
+    if (n.z >= 0.0f)
+    {
+        return glm::vec2(n.x, n.y);
+    }
+
+    return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                     (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+std::vector<PackedVertex> packVertices(std::span<Vertex const> vertices)
+{
+    std::vector<PackedVertex> packed;
+    packed.reserve(vertices.size());
+
+    for (auto const& vertex : vertices)
+    {
+        auto const normal = octEncode(vertex.normal);
+
+        // Gram-Schmidt, the shader rebuilds the bitangent from the normal and
+        // the tangent and expects them to be orthogonal.
+        glm::vec3 tangent = vertex.tangent - vertex.normal * glm::dot(vertex.normal, vertex.tangent);
+        if (glm::dot(tangent, tangent) > 0.0f)
+        {
+            tangent = glm::normalize(tangent);
+        }
+        float const handedness = glm::dot(glm::cross(vertex.normal, tangent), vertex.bitangent) < 0.0f ? -1.0f : 1.0f;
+
+        packed.push_back(PackedVertex{
+            .pos = glm::vec<3, float, glm::packed_highp>(vertex.pos),
+            .tex_coord = {glm::packHalf1x16(vertex.tex_coord.x), glm::packHalf1x16(vertex.tex_coord.y)},
+            .normal = {packSnorm16(normal.x), packSnorm16(normal.y)},
+            .normal_coord = {packUnorm16(vertex.normal_coord.x), packUnorm16(vertex.normal_coord.y)},
+            .tangent = {packSnorm16(tangent.x), packSnorm16(tangent.y), packSnorm16(tangent.z), packSnorm16(handedness)}
+        });
+    }
+
+    return packed;
+}
+
+std::vector<uint32_t> lodIndices(Model const& model)
+{
+    std::vector<uint32_t> indices = model.indices;
+    for (auto const& lod : model.lods)
+    {
+        indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+    }
+    return indices;
+}
+
+std::vector<LodRange> lodRanges(Model const& model)
+{
+    std::vector<LodRange> ranges;
+    ranges.push_back({0, static_cast<uint32_t>(model.indices.size()), 0.0f});
+    for (auto const& lod : model.lods)
+    {
+        auto const& last = ranges.back();
+        ranges.push_back({last.first_index + last.index_count, static_cast<uint32_t>(lod.indices.size()), lod.error});
+    }
+    return ranges;
+}
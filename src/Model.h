@@ -7,9 +7,13 @@
 
 #include "Id.h"
 
+#include <array>
+#include <memory>
 #include <vector>
 #include <string>
 #include <map>
+#include <span>
+#include <optional>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -22,6 +26,9 @@ struct ModelBufferObject
 {
     alignas(16) glm::mat4 model;
     alignas(16) uint32_t texture_index{0};
+    // Inverse transpose of the model matrix for the normals, computed once per
+    // object instead of for every vertex.
+    alignas(16) glm::mat4 normal_matrix;
 };
 
 struct LightBufferObject
@@ -111,6 +118,51 @@ struct Vertex
     glm::vec3 bitangent;
 };
 
+// Storage for quantized vertex attributes, each maps to a single vk::Format.
+struct Half2
+{
+    uint16_t x, y;
+};
+
+struct Snorm16x2
+{
+    int16_t x, y;
+};
+
+struct Unorm16x2
+{
+    uint16_t x, y;
+};
+
+struct Snorm16x4
+{
+    int16_t x, y, z, w;
+};
+
+// Half the size of Vertex. The normal is octahedral encoded and only the tangent
+// is stored, the bitangent is rebuilt in the shader from the sign in tangent.w.
+struct PackedVertex
+{
+    glm::vec<3, float, glm::packed_highp> pos;
+    Half2 tex_coord;
+    Snorm16x2 normal;
+    Unorm16x2 normal_coord;
+    Snorm16x4 tangent;
+};
+
+static_assert(sizeof(PackedVertex) == 32, "");
+
+enum class VertexFormat
+{
+    Full,   // Vertex
+    Packed  // PackedVertex
+};
+
+constexpr uint32_t vertexStride(VertexFormat format)
+{
+    return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
 struct Camera
 {
     glm::mat4 proj;
@@ -121,20 +173,210 @@ struct Camera
     glm::vec2 pitch_yawn{};
 };
 
+// Range of one source mesh inside the shared vertex/index block of a model.
+// Indices are global, so the whole model can be drawn with a single call, unless
+// the model has Model::local_indices.
+struct SubMesh
+{
+    uint32_t vertex_offset{};
+    uint32_t vertex_count{};
+    uint32_t index_offset{};
+    uint32_t index_count{};
+    uint32_t material_index{};
+    uint32_t meshlet_offset{};
+    uint32_t meshlet_count{};
+};
+
+// Small cluster of the full detail mesh for cluster culling. Meshlets never span
+// submeshes. The vertices are global indices in Model::meshlet_vertices and the
+// triangles are three bytes each in Model::meshlet_triangles, local to the meshlet.
+struct Meshlet
+{
+    uint32_t vertex_offset{};
+    uint32_t triangle_offset{};
+    uint32_t vertex_count{};
+    uint32_t triangle_count{};
+
+    // Bounding sphere.
+    glm::vec3 center{};
+    float radius{};
+
+    // Normal cone. The meshlet faces away from a camera at p when
+    // dot(normalize(cone_apex - p), cone_axis) >= cone_cutoff, a cutoff of 1 never culls.
+    glm::vec3 cone_apex{};
+    glm::vec3 cone_axis{};
+    float cone_cutoff{1};
+};
+
+// Index range of one LOD level once all levels are packed into one index buffer.
+// Level 0 is the full detail mesh.
+struct LodRange
+{
+    uint32_t first_index{};
+    uint32_t index_count{};
+    float error{};
+};
+
+// A coarser version of the model drawn from the same vertices. Indices are
+// global like Model::indices, error is the largest distance of a full detail
+// vertex to this level, in object space.
+struct ModelLod
+{
+    std::vector<uint32_t> indices;
+    float error{};
+};
+
+// Axis aligned box and bounding sphere, in object space for models and meshes and
+// in world space for placed objects.
+struct Bounds
+{
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+    glm::vec3 center{0.0f};
+    float radius{0.0f};
+};
+
+// Uses SSE where available, this runs over every vertex at import time.
+Bounds computeBounds(std::span<Vertex const> vertices);
+
+// Bounds of the transformed box and sphere. Conservative, the box of a rotated box
+// is larger than the box of the rotated vertices.
+Bounds transformBounds(Bounds const& bounds, glm::mat4 const& transform);
+
+// Planes of a view frustum, pointing inwards: a point p is inside a plane when
+// dot(plane, vec4(p, 1)) >= 0. Extracted from a projection with zero to one depth,
+// in the space the matrix transforms from.
+struct Frustum
+{
+    std::array<glm::vec4, 6> planes;
+};
+
+Frustum extractFrustum(glm::mat4 const& projection_view);
+
+// False only when the box is entirely outside one of the planes.
+bool intersects(Frustum const& frustum, glm::vec3 const& min, glm::vec3 const& max);
+
+// What happens to the CPU copy of a model once a mesh has been uploaded from it.
+enum class Residency
+{
+    Keep,               // Stays in memory, e.g. for models that are edited or read back.
+    EvictAfterUpload    // Geometry is freed after the upload and reloaded from the mesh cache on demand.
+};
+
+struct MappedMesh;
+
+// Move only, the geometry of a model can be large and is never copied implicitly.
 struct Model
 {
+    Model() = default;
+    Model(Model&&) = default;
+    Model(Model const&) = delete;
+    Model& operator=(Model const&) = delete;
+
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    std::vector<SubMesh> submeshes;
+    std::vector<ModelLod> lods;
+
+    // The indices of every submesh are relative to its vertex_offset and every
+    // submesh is drawn on its own. Lets large grids use 16 bit indices. Only used
+    // by generated geometry, which has no LODs or meshlets and is never cooked.
+    bool local_indices = false;
+
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshlet_vertices;
+    std::vector<uint8_t> meshlet_triangles;
+
+    Bounds bounds;
 
     std::string path;
     int const id = Id();
+
+    Residency residency = Residency::Keep;
+    // There is a mesh cache entry for path that the geometry can be reloaded from.
+    bool cached = false;
+    bool resident = true;
+
+    // The mesh cache entry of a model loaded from the cache. Its geometry is not
+    // copied into the vectors, meshes are uploaded straight from the mapping and
+    // the vectors are only filled when the model is acquired. See Meshes::loadMesh.
+    std::shared_ptr<MappedMesh const> mapped;
 };
 
+// Bytes of CPU memory held by the geometry of the model.
+size_t modelMemory(Model const& model);
+
+// Frees the geometry of the model and its mapping, keeping path, id and
+// submeshes. Only cached models can be evicted, returns false for the others.
+bool evictModel(Model& model);
+
+// Restores the geometry of an evicted or mapped model from the mesh cache.
+bool reloadModel(Model& model);
+
 struct Models
 {
     std::map<int, Model> models;
-    int loadModel(std::string const& model_path);
-    int loadModelAssimp(std::string const& path);
+    int addModel(Model model, Residency residency = Residency::Keep);
+    int loadModel(std::string const& model_path, Residency residency = Residency::Keep);
+    int loadModelAssimp(std::string const& path, Residency residency = Residency::Keep);
+
+    // The model with its geometry in memory, copied from the mesh cache if it was
+    // evicted or is only mapped. nullptr if the id is unknown or the reload fails.
+    Model* acquire(int id);
+
+    // Tells that a mesh has been uploaded from the model, applies the residency policy.
+    void uploaded(int id);
+
+    size_t residentMemory() const;
+};
+
+// Imports a model through Assimp, or maps it from the mesh cache. Does not touch
+// Models so it can run on a loader thread.
+std::optional<Model> importModelAssimp(std::string const& path);
+
+// Same for Wavefront OBJ files, parsed by the native loader in ObjLoader.h.
+std::optional<Model> importModelObj(std::string const& path);
+
+Model createBox();
+
+// Post-transform vertex cache statistics of a FIFO cache. ACMR is the number of
+// vertex shader invocations per triangle, ATVR the number per referenced vertex.
+struct VertexCacheStats
+{
+    float acmr{};
+    float atvr{};
 };
 
-Model createBox();
\ No newline at end of file
+VertexCacheStats analyzeVertexCache(std::span<uint32_t const> indices, size_t vertex_count, uint32_t cache_size = 16);
+
+// Mesh optimization passes. Indices are relative to the start of the vertex range
+// and every pass only reorders, the rendered result stays the same.
+void optimizeVertexCache(std::span<uint32_t> indices, size_t vertex_count);
+void optimizeOverdraw(std::span<uint32_t> indices, std::span<Vertex const> vertices, float threshold = 1.05f);
+void optimizeVertexFetch(std::span<Vertex> vertices, std::span<uint32_t> indices);
+
+// Runs all passes on each submesh of the model.
+void optimizeModel(Model& model);
+
+// Merges vertices with bitwise identical attributes inside each submesh and
+// remaps the indices of every LOD level. Returns the number of vertices removed.
+size_t weldVertices(Model& model);
+
+// 16 bit indices are enough when every index of the buffer fits. Primitive restart
+// is never enabled, so 0xffff is a valid index as well.
+constexpr bool fitsIndex16(size_t vertex_count)
+{
+    return vertex_count <= 0x10000;
+}
+
+std::vector<uint16_t> narrowIndices(std::span<uint32_t const> indices);
+
+// Number of vertices the index buffer of the model addresses, the largest
+// submesh when the indices are local.
+size_t indexedVertexCount(Model const& model);
+
+std::vector<PackedVertex> packVertices(std::span<Vertex const> vertices);
+
+// The indices of every LOD level after each other, and the range of each level in them.
+std::vector<uint32_t> lodIndices(Model const& model);
+std::vector<LodRange> lodRanges(Model const& model);
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "NormalMap.h"
+#include "Float4.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+
+// A row of heights with the border texel repeated once on both sides, and room
+// for the last group of four to read past the end. Texel x is at x + 1.
+static void padRow(std::vector<float>& row, float const* heights, std::size_t width)
+{
+    row[0] = heights[0];
+    std::copy(heights, heights + width, row.begin() + 1);
+    std::fill(row.begin() + width + 1, row.end(), heights[width - 1]);
+}
+
+BakedNormalMap bakeNormalMap(std::span<float const> heights,
+                             std::size_t width,
+                             std::size_t height,
+                             NormalMapSettings const& settings,
+                             bool curvature)
+{
+    BakedNormalMap map;
+    if (width == 0 || height == 0 || heights.size() < width * height)
+    {
+        return map;
+    }
+
+    map.normals.resize(width * height * 4);
+    if (curvature)
+    {
+        map.curvature.resize(width * height);
+    }
+
+    // Height units per texel along both axes of the image.
+    float const texel_x = settings.terrain_size / float(width);
+    float const texel_y = settings.terrain_size / float(height);
+
+    // The Sobel sums are eight times the slope over one texel.
+    auto const slope_x = splat4(settings.max_height / texel_x / 8.0f);
+    auto const slope_y = splat4(settings.max_height / texel_y / 8.0f);
+    auto const laplacian = splat4(-settings.max_height / (texel_x * texel_y) * settings.curvature_scale);
+
+    jobSystem().parallelFor(height, [&](std::size_t begin, std::size_t end)
+    {
+        std::vector<float> above(width + 6);
+        std::vector<float> center(width + 6);
+        std::vector<float> below(width + 6);
+
+        alignas(16) float out[4][4];
+
+        for (std::size_t y = begin; y < end; ++y)
+        {
+            padRow(above, heights.data() + (y > 0 ? y - 1 : 0) * width, width);
+            padRow(center, heights.data() + y * width, width);
+            padRow(below, heights.data() + std::min(y + 1, height - 1) * width, width);
+
+            for (std::size_t x = 0; x < width; x += 4)
+            {
+                auto const two = splat4(2.0f);
+                auto const above_left = load4(above.data() + x);
+                auto const above_middle = load4(above.data() + x + 1);
+                auto const above_right = load4(above.data() + x + 2);
+                auto const left = load4(center.data() + x);
+                auto const middle = load4(center.data() + x + 1);
+                auto const right = load4(center.data() + x + 2);
+                auto const below_left = load4(below.data() + x);
+                auto const below_middle = load4(below.data() + x + 1);
+                auto const below_right = load4(below.data() + x + 2);
+
+                auto const gx = (above_right - above_left) + two * (right - left) + (below_right - below_left);
+                auto const gy = (below_left - above_left) + two * (below_middle - above_middle) + (below_right - above_right);
+
+                // Rows go towards -z, so a height rising down the image tilts the normal to +z.
+                auto const normal = normalize4(Vec3x4{splat4(0.0f) - gx * slope_x, splat4(1.0f), gy * slope_y});
+
+                auto const half = splat4(127.5f);
+                store4(out[0], normal.x * half + half);
+                store4(out[1], normal.z * half + half);
+                store4(out[2], normal.y * half + half);
+
+                if (curvature)
+                {
+                    auto const sum = left + right + above_middle + below_middle - splat4(4.0f) * middle;
+                    auto const gray = max4(splat4(0.0f), min4(splat4(1.0f), splat4(0.5f) + sum * laplacian));
+                    store4(out[3], gray * splat4(255.0f));
+                }
+
+                std::size_t const count = std::min<std::size_t>(4, width - x);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    std::size_t const texel = y * width + x + i;
+                    map.normals[texel * 4] = static_cast<uint8_t>(out[0][i] + 0.5f);
+                    map.normals[texel * 4 + 1] = static_cast<uint8_t>(out[1][i] + 0.5f);
+                    map.normals[texel * 4 + 2] = static_cast<uint8_t>(out[2][i] + 0.5f);
+                    map.normals[texel * 4 + 3] = 255;
+
+                    if (curvature)
+                    {
+                        map.curvature[texel] = static_cast<uint8_t>(out[3][i] + 0.5f);
+                    }
+                }
+            }
+        }
+    }, 16);
+
+    return map;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct NormalMapSettings
+{
+    // The terrain the height map is displaced over, like the CDLOD terrain: a
+    // square of terrain_size with heights from 0 to max_height.
+    float terrain_size{100.0f};
+    float max_height{7.0f};
+
+    // Gray value change of the curvature map for a curvature of 1 per unit.
+    float curvature_scale{1.0f};
+};
+
+struct BakedNormalMap
+{
+    // RGBA8 in the layout the shaders sample with .rbg: red is x, green is z and
+    // blue is up. Image rows go towards -z, see heightCoord in terrain_cdlod.vert.
+    std::vector<uint8_t> normals;
+
+    // R8 Laplacian of the heights, 128 is flat, brighter is convex. Empty unless asked for.
+    std::vector<uint8_t> curvature;
+};
+
+// Normals of a width x height raster of heights in [0, 1] with a Sobel kernel,
+// clamped at the borders. Rows are split across the job system and four
+// texels are processed at a time with SSE.
+BakedNormalMap bakeNormalMap(std::span<float const> heights,
+                             std::size_t width,
+                             std::size_t height,
+                             NormalMapSettings const& settings = {},
+                             bool curvature = false);
@@ -0,0 +1,513 @@
+#include "ObjLoader.h"
+#include "JobSystem.h"
+#include "MappedFile.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+// Zero based indices into the attribute arrays, -1 when the corner has none.
+struct ObjCorner
+{
+    int32_t position{-1};
+    int32_t tex_coord{-1};
+    int32_t normal{-1};
+
+    bool operator==(ObjCorner const&) const = default;
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(ObjCorner const& corner) const
+    {
+        uint64_t hash = uint32_t(corner.position);
+        hash = hash * 0x9e3779b97f4a7c15ull + uint32_t(corner.tex_coord);
+        hash = hash * 0x9e3779b97f4a7c15ull + uint32_t(corner.normal);
+        return hash ^ (hash >> 29);
+    }
+};
+
+// Start of a usemtl run, first_corner is relative to the chunk.
+struct ObjGroup
+{
+    size_t first_corner{};
+    std::string material;
+};
+
+// Corner with negative indices in the file. Those are stored relative to the start
+// of the chunk and get the chunk offset added once all chunks are parsed.
+struct ObjRelativeCorner
+{
+    size_t corner{};
+    bool position{};
+    bool tex_coord{};
+    bool normal{};
+};
+
+struct ObjPolygonCorner
+{
+    ObjCorner corner;
+    ObjRelativeCorner relative;
+};
+
+struct ObjChunk
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> tex_coords;
+    std::vector<glm::vec3> normals;
+
+    // Three per triangle, polygons are already fan triangulated.
+    std::vector<ObjCorner> corners;
+    std::vector<ObjGroup> groups;
+    std::vector<ObjRelativeCorner> relative_corners;
+};
+
+}
+
+static char const* skipSpace(char const* p, char const* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        ++p;
+    }
+    return p;
+}
+
+static char const* parseFloat(char const* p, char const* end, float& value)
+{
+    p = skipSpace(p, end);
+    if (p < end && *p == '+')
+    {
+        ++p;
+    }
+
+    auto const result = std::from_chars(p, end, value);
+    if (result.ec != std::errc{})
+    {
+        value = 0.0f;
+        return p;
+    }
+    return result.ptr;
+}
+
+// Parses one index of a face corner. Returns false if the index is absent.
+static bool parseIndex(char const*& p, char const* end, int32_t count, int32_t& index, bool& relative)
+{
+    int32_t value = 0;
+    auto const result = std::from_chars(p, end, value);
+    if (result.ec != std::errc{} || value == 0)
+    {
+        return false;
+    }
+    p = result.ptr;
+
+    relative = value < 0;
+    index = relative ? count + value : value - 1;
+    return true;
+}
+
+static void parseFace(char const* p, char const* end, ObjChunk& chunk, std::vector<ObjPolygonCorner>& polygon)
+{
+    polygon.clear();
+
+    auto const position_count = static_cast<int32_t>(chunk.positions.size());
+    auto const tex_coord_count = static_cast<int32_t>(chunk.tex_coords.size());
+    auto const normal_count = static_cast<int32_t>(chunk.normals.size());
+
+    while (true)
+    {
+        p = skipSpace(p, end);
+        if (p >= end)
+        {
+            break;
+        }
+
+        ObjCorner corner;
+        ObjRelativeCorner relative{};
+        if (!parseIndex(p, end, position_count, corner.position, relative.position))
+        {
+            break;
+        }
+
+        // v, v/vt, v//vn or v/vt/vn
+        if (p < end && *p == '/')
+        {
+            ++p;
+            if (p < end && *p != '/')
+            {
+                parseIndex(p, end, tex_coord_count, corner.tex_coord, relative.tex_coord);
+            }
+            if (p < end && *p == '/')
+            {
+                ++p;
+                parseIndex(p, end, normal_count, corner.normal, relative.normal);
+            }
+        }
+
+        polygon.push_back({corner, relative});
+    }
+
+    for (size_t i = 2; i < polygon.size(); ++i)
+    {
+        for (auto corner : {polygon[0], polygon[i - 1], polygon[i]})
+        {
+            if (corner.relative.position || corner.relative.tex_coord || corner.relative.normal)
+            {
+                corner.relative.corner = chunk.corners.size();
+                chunk.relative_corners.push_back(corner.relative);
+            }
+            chunk.corners.push_back(corner.corner);
+        }
+    }
+}
+
+static void parseChunk(char const* p, char const* end, ObjChunk& chunk)
+{
+    std::vector<ObjPolygonCorner> polygon;
+
+    while (p < end)
+    {
+        auto const* line_end = static_cast<char const*>(std::memchr(p, '\n', end - p));
+        if (!line_end)
+        {
+            line_end = end;
+        }
+
+        p = skipSpace(p, line_end);
+        auto const remaining = line_end - p;
+
+        if (remaining > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            glm::vec3 position;
+            p = parseFloat(p + 2, line_end, position.x);
+            p = parseFloat(p, line_end, position.y);
+            parseFloat(p, line_end, position.z);
+            chunk.positions.push_back(position);
+        }
+        else if (remaining > 3 && p[0] == 'v' && p[1] == 't')
+        {
+            glm::vec2 tex_coord;
+            p = parseFloat(p + 2, line_end, tex_coord.x);
+            parseFloat(p, line_end, tex_coord.y);
+            chunk.tex_coords.push_back(tex_coord);
+        }
+        else if (remaining > 3 && p[0] == 'v' && p[1] == 'n')
+        {
+            glm::vec3 normal;
+            p = parseFloat(p + 2, line_end, normal.x);
+            p = parseFloat(p, line_end, normal.y);
+            parseFloat(p, line_end, normal.z);
+            chunk.normals.push_back(normal);
+        }
+        else if (remaining > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            parseFace(p + 2, line_end, chunk, polygon);
+        }
+        else if (remaining > 7 && std::string_view(p, 6) == "usemtl")
+        {
+            auto const* name_begin = skipSpace(p + 6, line_end);
+            auto const* name_end = line_end;
+            while (name_end > name_begin && (name_end[-1] == '\r' || name_end[-1] == ' ' || name_end[-1] == '\t'))
+            {
+                --name_end;
+            }
+            chunk.groups.push_back({chunk.corners.size(), std::string(name_begin, name_end)});
+        }
+
+        p = line_end + 1;
+    }
+}
+
+// Moves an offset that falls inside a line to the start of the next line.
+static size_t alignToLine(char const* data, size_t size, size_t offset)
+{
+    if (offset == 0 || offset >= size)
+    {
+        return std::min(offset, size);
+    }
+
+    auto const* line_end = static_cast<char const*>(std::memchr(data + offset - 1, '\n', size - offset + 1));
+    return line_end ? line_end - data + 1 : size;
+}
+
+static void generateNormals(std::vector<glm::vec3> const& positions,
+                            std::vector<glm::vec3>& normals,
+                            std::vector<ObjCorner>& corners)
+{
+    // Smooth normals per position, area weighted by the unnormalized face normal.
+    std::vector<glm::vec3> generated(positions.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i + 2 < corners.size(); i += 3)
+    {
+        auto const& p0 = positions[corners[i].position];
+        auto const& p1 = positions[corners[i + 1].position];
+        auto const& p2 = positions[corners[i + 2].position];
+        auto const face_normal = glm::cross(p1 - p0, p2 - p0);
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            if (corners[i + k].normal < 0)
+            {
+                generated[corners[i + k].position] += face_normal;
+            }
+        }
+    }
+
+    auto const base = static_cast<int32_t>(normals.size());
+    for (auto& normal : generated)
+    {
+        auto const length = glm::length(normal);
+        normals.push_back(length > 0.0f ? normal / length : glm::vec3(0, 1, 0));
+    }
+
+    for (auto& corner : corners)
+    {
+        if (corner.normal < 0)
+        {
+            corner.normal = base + corner.position;
+        }
+    }
+}
+
+static void generateTangents(std::span<Vertex> vertices, std::span<uint32_t const> indices)
+{
+    std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        auto const& v0 = vertices[indices[i]];
+        auto const& v1 = vertices[indices[i + 1]];
+        auto const& v2 = vertices[indices[i + 2]];
+
+        // Same orientation as Assimp: the uvs are flipped back to the file convention.
+        glm::vec2 const uv0(v0.tex_coord.x, 1 - v0.tex_coord.y);
+        glm::vec2 const uv1(v1.tex_coord.x, 1 - v1.tex_coord.y);
+        glm::vec2 const uv2(v2.tex_coord.x, 1 - v2.tex_coord.y);
+
+        auto const e1 = v1.pos - v0.pos;
+        auto const e2 = v2.pos - v0.pos;
+        auto const d1 = uv1 - uv0;
+        auto const d2 = uv2 - uv0;
+
+        auto const det = d1.x * d2.y - d2.x * d1.y;
+        if (std::abs(det) < 1e-12f)
+        {
+            continue;
+        }
+
+        auto const r = 1.0f / det;
+        auto const tangent = (e1 * d2.y - e2 * d1.y) * r;
+        auto const bitangent = (e2 * d1.x - e1 * d2.x) * r;
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            tangents[indices[i + k]] += tangent;
+            bitangents[indices[i + k]] += bitangent;
+        }
+    }
+
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        auto& vertex = vertices[i];
+        auto const& n = vertex.normal;
+
+        auto t = tangents[i] - n * glm::dot(n, tangents[i]);
+        if (glm::dot(t, t) < 1e-12f)
+        {
+            // No usable uvs, any direction perpendicular to the normal will do.
+            t = glm::cross(n, std::abs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0));
+        }
+        t = glm::normalize(t);
+
+        auto const sign = glm::dot(glm::cross(n, t), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+        vertex.tangent = t;
+        vertex.bitangent = glm::cross(n, t) * sign;
+    }
+}
+
+std::optional<Model> parseObj(std::string const& path)
+{
+    auto file = mapFile(path);
+    if (!file)
+    {
+        spdlog::warn("Could not open {}", path);
+        return {};
+    }
+
+    auto& jobs = jobSystem();
+
+    // Enough chunks to balance the workers without making them too small to pay off.
+    constexpr size_t min_chunk_size = 256 * 1024;
+    size_t const chunk_count = std::clamp<size_t>(file->size / min_chunk_size, 1, jobs.size() * 4);
+
+    std::vector<ObjChunk> chunks(chunk_count);
+    jobs.parallelFor(chunk_count, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto const first = alignToLine(file->chars(), file->size, file->size * i / chunk_count);
+            auto const last = alignToLine(file->chars(), file->size, file->size * (i + 1) / chunk_count);
+            parseChunk(file->chars() + first, file->chars() + last, chunks[i]);
+        }
+    });
+
+    // Concatenate the chunks and turn the chunk relative indices into global ones.
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> tex_coords;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjCorner> corners;
+
+    struct Run
+    {
+        size_t first_corner;
+        uint32_t material_index;
+    };
+    std::vector<Run> runs{{0, 0}};
+    std::vector<std::string> materials;
+
+    for (auto& chunk : chunks)
+    {
+        auto const position_base = static_cast<int32_t>(positions.size());
+        auto const tex_coord_base = static_cast<int32_t>(tex_coords.size());
+        auto const normal_base = static_cast<int32_t>(normals.size());
+        auto const corner_base = corners.size();
+
+        for (auto const& relative : chunk.relative_corners)
+        {
+            auto& corner = chunk.corners[relative.corner];
+            corner.position += relative.position ? position_base : 0;
+            corner.tex_coord += relative.tex_coord ? tex_coord_base : 0;
+            corner.normal += relative.normal ? normal_base : 0;
+        }
+
+        for (auto const& group : chunk.groups)
+        {
+            auto material = std::ranges::find(materials, group.material);
+            if (material == materials.end())
+            {
+                material = materials.insert(material, group.material);
+            }
+
+            Run const run{corner_base + group.first_corner, static_cast<uint32_t>(material - materials.begin())};
+            if (runs.back().first_corner == run.first_corner)
+            {
+                runs.back() = run;
+            }
+            else
+            {
+                runs.push_back(run);
+            }
+        }
+
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        tex_coords.insert(tex_coords.end(), chunk.tex_coords.begin(), chunk.tex_coords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+        chunk = {};
+    }
+
+    if (corners.empty())
+    {
+        spdlog::warn("No faces in {}", path);
+        return {};
+    }
+
+    bool missing_normals = false;
+    for (auto const& corner : corners)
+    {
+        if (   corner.position < 0 || corner.position >= static_cast<int32_t>(positions.size())
+            || corner.tex_coord >= static_cast<int32_t>(tex_coords.size())
+            || corner.normal >= static_cast<int32_t>(normals.size()))
+        {
+            spdlog::warn("Face index out of range in {}", path);
+            return {};
+        }
+
+        missing_normals |= corner.normal < 0;
+    }
+
+    if (missing_normals)
+    {
+        generateNormals(positions, normals, corners);
+    }
+
+    // Weld every usemtl run on its own, each becomes a submesh with its own vertex range.
+    struct WeldedRun
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+    std::vector<WeldedRun> welded(runs.size());
+
+    jobs.parallelFor(runs.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t r = begin; r < end; ++r)
+        {
+            auto const first = runs[r].first_corner;
+            auto const last = r + 1 < runs.size() ? runs[r + 1].first_corner : corners.size();
+            auto& run = welded[r];
+
+            std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> remap;
+            remap.reserve(last - first);
+            run.indices.reserve(last - first);
+
+            for (size_t i = first; i < last; ++i)
+            {
+                auto const& corner = corners[i];
+                auto [it, inserted] = remap.try_emplace(corner, static_cast<uint32_t>(run.vertices.size()));
+                if (inserted)
+                {
+                    Vertex vertex{};
+                    vertex.pos = positions[corner.position];
+                    vertex.normal = glm::normalize(normals[corner.normal]);
+                    if (corner.tex_coord >= 0)
+                    {
+                        auto const& tex_coord = tex_coords[corner.tex_coord];
+                        vertex.tex_coord = glm::vec2(tex_coord.x, 1 - tex_coord.y);
+                    }
+                    run.vertices.push_back(vertex);
+                }
+                run.indices.push_back(it->second);
+            }
+
+            generateTangents(run.vertices, run.indices);
+        }
+    });
+
+    Model model;
+    model.path = path;
+
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        auto& run = welded[r];
+        if (run.indices.empty())
+        {
+            continue;
+        }
+
+        SubMesh const submesh{
+            .vertex_offset = static_cast<uint32_t>(model.vertices.size()),
+            .vertex_count = static_cast<uint32_t>(run.vertices.size()),
+            .index_offset = static_cast<uint32_t>(model.indices.size()),
+            .index_count = static_cast<uint32_t>(run.indices.size()),
+            .material_index = runs[r].material_index
+        };
+
+        model.vertices.insert(model.vertices.end(), run.vertices.begin(), run.vertices.end());
+        for (auto index : run.indices)
+        {
+            model.indices.push_back(submesh.vertex_offset + index);
+        }
+        model.submeshes.push_back(submesh);
+    }
+
+    return model;
+}
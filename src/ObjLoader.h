@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Model.h"
+
+#include <optional>
+#include <string>
+
+// Wavefront OBJ parser. The file is mapped and split into line aligned chunks
+// that are parsed in parallel on the job system. Faces are fan triangulated,
+// every usemtl run becomes a submesh and identical position/uv/normal corners
+// are welded into one vertex. Missing normals are generated and tangents are
+// always generated from the uvs.
+//
+// This is only the parse, importModelObj adds the optimization and the cache.
+std::optional<Model> parseObj(std::string const& path);
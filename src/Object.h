@@ -5,6 +5,8 @@
 #include "Id.h"
 #include "Mesh.h"
 
+#include <algorithm>
+
 /*
 struct Terrain
 {
@@ -16,7 +18,16 @@ struct Terrain
 enum class ObjectType
 {
     STANDARD,
-    SKYBOX
+    SKYBOX,
+    // Patch mesh of the CDLOD terrain of the scene, drawn once per selected patch.
+    // Does not cast shadows, the patch is only placed in the vertex shader.
+    TERRAIN,
+    // Coarse grid of the tessellated terrain of the scene, displaced in the
+    // tessellation shaders. Does not cast shadows either.
+    TESSELLATED_TERRAIN,
+    // Blade mesh of the grass field of the scene, drawn indirectly with one
+    // instance per blade scattered on the GPU, see Grass.h.
+    GRASS
 };
 
 struct Object
@@ -24,7 +35,14 @@ struct Object
     // Weak handles to the buffer for now. Fix later.
     vk::Buffer vertex_buffer;
     vk::Buffer index_buffer;
+    vk::IndexType index_type = vk::IndexType::eUint32;
     uint32_t indices_size;
+    uint32_t vertex_count{};
+    uint32_t vertex_stride = sizeof(Vertex);
+    std::vector<LodRange> lods;
+    // Drawn one by one instead of a LOD range when the mesh has local indices.
+    std::vector<SubMesh> tiles;
+    uint32_t instance_count = 1;
 
     glm::vec3 position;
     glm::vec3 rotation;
@@ -36,12 +54,57 @@ struct Object
     std::optional<Lod> lod;
 
     bool shadow = false;
+    // Hidden objects keep their slot in the model and material buffers.
+    bool visible = true;
+    // The vertex buffer holds vertices with the displacement of the material
+    // already applied, see DisplacementBake.h. The vertex shader skips it then.
+    bool displacement_baked = false;
 
     ObjectType object_type = ObjectType::STANDARD;
 
+    Bounds local_bounds;
+    Bounds world_bounds;
+
+    // Placement world_bounds was last computed for, see updateWorldBounds.
+    glm::vec3 bounds_position{};
+    glm::vec3 bounds_rotation{};
+    float bounds_scale{};
+    float bounds_angel{};
+    bool bounds_valid = false;
+
     int id = Id();
 };
 
+inline glm::mat4 objectTransform(Object const& object)
+{
+    auto rotation = glm::rotate(glm::mat4(1.0f), glm::radians(object.angel), object.rotation);
+    auto translation = glm::translate(glm::mat4(1.0f), object.position);
+    auto scale = glm::scale(glm::mat4(1.0f), glm::vec3(object.scale, object.scale, object.scale));
+    return translation * rotation * scale;
+}
+
+// Recomputes the world bounds only when the placement changed since the last
+// call. Returns true if they were updated.
+inline bool updateWorldBounds(Object& object)
+{
+    if (   object.bounds_valid
+        && object.bounds_position == object.position
+        && object.bounds_rotation == object.rotation
+        && object.bounds_scale == object.scale
+        && object.bounds_angel == object.angel)
+    {
+        return false;
+    }
+
+    object.world_bounds = transformBounds(object.local_bounds, objectTransform(object));
+    object.bounds_position = object.position;
+    object.bounds_rotation = object.rotation;
+    object.bounds_scale = object.scale;
+    object.bounds_angel = object.angel;
+    object.bounds_valid = true;
+    return true;
+}
+
 
 inline auto createObject(DrawableMesh const& mesh, glm::vec3 const& position = glm::vec3(0,0,0))
 {
@@ -49,10 +112,62 @@ inline auto createObject(DrawableMesh const& mesh, glm::vec3 const& position = g
 
     draw.vertex_buffer = mesh.vertex_buffer.buffer;
     draw.index_buffer = mesh.index_buffer.buffer;
+    draw.index_type = mesh.index_type;
     draw.indices_size = mesh.indices_size;
+    draw.vertex_count = mesh.vertex_count;
+    draw.vertex_stride = vertexStride(mesh.vertex_format);
+    draw.lods = mesh.lods;
+    if (mesh.local_indices)
+    {
+        draw.tiles = mesh.submeshes;
+    }
+    draw.local_bounds = mesh.bounds;
 
     draw.position = position;
     draw.rotation = glm::vec3(1,1,1);
+    updateWorldBounds(draw);
 
     return draw;
 }
+
+// Index range to draw for the object. LODs are only used when the object has a Lod
+// setting, the coarsest level whose error projected on screen stays below
+// Lod::max_screen_error is used. Shadow casters pass a bias to use coarser levels
+// than the camera view.
+inline LodRange selectLod(Object const& object, Camera const& camera, size_t bias = 0)
+{
+    if (!object.lod || object.lods.empty())
+    {
+        return {0, object.indices_size, 0.0f};
+    }
+
+    // Distance to the closest point of the bounding sphere, proj[1][1] scales a
+    // length at distance one to half the viewport height.
+    float const distance = std::max(glm::distance(camera.pos, object.world_bounds.center) - object.world_bounds.radius, 1e-3f);
+    float const scale = object.scale * camera.proj[1][1] * 0.5f / distance;
+
+    size_t level = 0;
+    while (level + 1 < object.lods.size() && object.lods[level + 1].error * scale <= object.lod->max_screen_error)
+    {
+        ++level;
+    }
+
+    level = std::min(level + bias, object.lods.size() - 1);
+    return object.lods[level];
+}
+
+// Records the draw of the object, every tile on its own for tiled objects. Tiles
+// have a single level of detail, the LOD range is only used otherwise.
+inline void drawObject(vk::CommandBuffer command_buffer, Object const& object, LodRange const& lod, uint32_t instance)
+{
+    if (object.tiles.empty())
+    {
+        command_buffer.drawIndexed(lod.index_count, object.instance_count, lod.first_index, 0, instance);
+        return;
+    }
+
+    for (auto const& tile : object.tiles)
+    {
+        command_buffer.drawIndexed(tile.index_count, 1, tile.index_offset, static_cast<int32_t>(tile.vertex_offset), instance);
+    }
+}
@@ -1,8 +1,10 @@
 
+#include "HeightFieldTexture.h"
 #include "Material.h"
 #include "Model.h"
 #include "VulkanRenderSystem.h"
 #include "Program.h"
+#include "Terrain.h"
 #include "Textures.h"
 #include "descriptor_set.h"
 
@@ -44,8 +46,8 @@ static std::tuple<vk::Pipeline, vk::PipelineLayout> createPipeline(PipelineData
 
     vk::PipelineVertexInputStateCreateInfo vertex_input_info {};
 
-    constexpr auto biding_descrition = getBindingDescription<Vertex>();
-    constexpr auto attrib_descriptions = getAttributeDescriptions<Vertex>();
+    auto const biding_descrition = getBindingDescription(pipeline_data.program_data.vertex_format);
+    auto const attrib_descriptions = getAttributeDescriptions(pipeline_data.program_data.vertex_format);
 
     vertex_input_info.sType = vk::StructureType::ePipelineVertexInputStateCreateInfo;
     vertex_input_info.setVertexBindingDescriptions(biding_descrition);
@@ -152,7 +154,7 @@ static std::tuple<vk::Pipeline, vk::PipelineLayout> createPipeline(PipelineData
     pipeline_info.basePipelineIndex = -1;
 
     vk::PipelineTessellationStateCreateInfo tess {};
-    if (shader_flags | vk::ShaderStageFlagBits::eTessellationControl)
+    if (shader_flags & vk::ShaderStageFlagBits::eTessellationControl)
     {
         tess.sType = vk::StructureType::ePipelineTessellationStateCreateInfo;
         tess.pNext = nullptr;
@@ -169,19 +171,20 @@ static std::tuple<vk::Pipeline, vk::PipelineLayout> createPipeline(PipelineData
 }
 
 
-Pipeline createGeneralPurposePipeline(RenderingState const& state,
-                                      vk::RenderPass const& render_pass,
-                                      Textures const& textures,
-                                      std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
-                                      std::vector<std::unique_ptr<UniformBuffer>> const& model_buffer,
-                                      std::vector<std::unique_ptr<UniformBuffer>> const& material_buffer,
-                                      std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_buffer,
-                                      std::vector<std::unique_ptr<vk::raii::ImageView>> const& shadow_map_images,
-                                      std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances)
+// Sets 0 to 6, shared by the general purpose and the terrain pipeline.
+static layer_types::Program generalPurposeProgram(VertexFormat vertex_format)
 {
     layer_types::Program program_desc;
     program_desc.fragment_shader = {{"./shaders/triplanar_frag.spv"}};
-    program_desc.vertex_shader= {{"./shaders/triplanar_vert.spv"}};
+    if (vertex_format == VertexFormat::Packed)
+    {
+        program_desc.vertex_shader= {{"./shaders/triplanar_packed_vert.spv"}};
+    }
+    else
+    {
+        program_desc.vertex_shader= {{"./shaders/triplanar_vert.spv"}};
+    }
+    program_desc.vertex_format = vertex_format;
     program_desc.buffers.push_back({layer_types::Buffer{
         .name = {{"texture_buffer"}},
         .type = layer_types::BufferType::NoBuffer,
@@ -190,7 +193,7 @@ Pipeline createGeneralPurposePipeline(RenderingState const& state,
             .name = {{"binding textures"}},
             .binding = 0,
             .type = layer_types::BindingType::TextureSampler,
-            .size = 32,
+            .size = max_textures,
             .vertex = true,
             .fragment = true,
         }
@@ -276,11 +279,20 @@ Pipeline createGeneralPurposePipeline(RenderingState const& state,
         }
     }});
 
-    auto const pipeline_data = createPipelineData(state, program_desc);
-    auto const [pipeline, pipeline_layout] = createPipeline(pipeline_data, state.swap_chain.extent, state.device, render_pass, state.msaa);
-    auto pipeline_finish = bindPipeline(pipeline_data, pipeline, pipeline_layout);
+    return program_desc;
+}
 
-    updateImageSampler(state.device, textures.textures, pipeline_finish.descriptor_sets[0].set, pipeline_finish.descriptor_sets[0].layout_bindings[0]);
+static void updateGeneralPurposeDescriptors(RenderingState const& state,
+                                            Pipeline const& pipeline_finish,
+                                            Textures& textures,
+                                            std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
+                                            std::vector<std::unique_ptr<UniformBuffer>> const& model_buffer,
+                                            std::vector<std::unique_ptr<UniformBuffer>> const& material_buffer,
+                                            std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_buffer,
+                                            std::vector<std::unique_ptr<vk::raii::ImageView>> const& shadow_map_images,
+                                            std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances)
+{
+    bindTextures(state.device, textures, pipeline_finish.descriptor_sets[0].set, pipeline_finish.descriptor_sets[0].layout_bindings[0]);
     
     updateUniformBuffer<WorldBufferObject>(state.device,
                                            world_buffer,
@@ -314,6 +326,159 @@ Pipeline createGeneralPurposePipeline(RenderingState const& state,
                                pipeline_finish.descriptor_sets[6].set,
                                pipeline_finish.descriptor_sets[6].layout_bindings[0],
                                16);
+}
+
+Pipeline createGeneralPurposePipeline(RenderingState const& state,
+                                      vk::RenderPass const& render_pass,
+                                      Textures& textures,
+                                      std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
+                                      std::vector<std::unique_ptr<UniformBuffer>> const& model_buffer,
+                                      std::vector<std::unique_ptr<UniformBuffer>> const& material_buffer,
+                                      std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_buffer,
+                                      std::vector<std::unique_ptr<vk::raii::ImageView>> const& shadow_map_images,
+                                      std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances,
+                                      VertexFormat vertex_format)
+{
+    auto const program_desc = generalPurposeProgram(vertex_format);
+
+    auto const pipeline_data = createPipelineData(state, program_desc);
+    auto const [pipeline, pipeline_layout] = createPipeline(pipeline_data, state.swap_chain.extent, state.device, render_pass, state.msaa);
+    auto pipeline_finish = bindPipeline(pipeline_data, pipeline, pipeline_layout);
+
+    updateGeneralPurposeDescriptors(state, pipeline_finish, textures, world_buffer, model_buffer, material_buffer,
+                                    shadow_map_buffer, shadow_map_images, shadow_map_distances);
+
+    return pipeline_finish;
+}
+
+Pipeline createTerrainPipeline(RenderingState const& state,
+                               vk::RenderPass const& render_pass,
+                               Textures& textures,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& model_buffer,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& material_buffer,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_buffer,
+                               std::vector<std::unique_ptr<vk::raii::ImageView>> const& shadow_map_images,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& terrain_patch_buffer,
+                               HeightFieldTexture const& height_field)
+{
+    auto program_desc = generalPurposeProgram(VertexFormat::Full);
+    program_desc.vertex_shader = {{"./shaders/terrain_cdlod_vert.spv"}};
+
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"terrain patches"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = max_terrain_patches,
+        .binding = layer_types::Binding {
+            .name = {{"binding terrain patches"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Storage,
+            .size = 1,
+            .vertex = true,
+        }
+    }});
+
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"height field tiles"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding height field tiles"}},
+            .binding = 0,
+            .type = layer_types::BindingType::TextureSampler,
+            .size = 1, // 2D Array. Set size for the binding to 1
+            .vertex = true,
+        }
+    }});
+
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"height field table"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = height_field.table_size,
+        .binding = layer_types::Binding {
+            .name = {{"binding height field table"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Storage,
+            .size = 1,
+            .vertex = true,
+        }
+    }});
+
+    auto const pipeline_data = createPipelineData(state, program_desc);
+    auto const [pipeline, pipeline_layout] = createPipeline(pipeline_data, state.swap_chain.extent, state.device, render_pass, state.msaa);
+    auto pipeline_finish = bindPipeline(pipeline_data, pipeline, pipeline_layout);
+
+    updateGeneralPurposeDescriptors(state, pipeline_finish, textures, world_buffer, model_buffer, material_buffer,
+                                    shadow_map_buffer, shadow_map_images, shadow_map_distances);
+
+    updateImageSampler(state.device, {*height_field.view}, *height_field.sampler,
+                       pipeline_finish.descriptor_sets[8].set, pipeline_finish.descriptor_sets[8].layout_bindings[0]);
+
+    updateUniformBuffer<int32_t>(state.device,
+                                 height_field.tile_table,
+                                 pipeline_finish.descriptor_sets[9].set,
+                                 pipeline_finish.descriptor_sets[9].layout_bindings[0],
+                                 height_field.table_size);
+
+    updateUniformBuffer<TerrainPatch>(state.device,
+                                      terrain_patch_buffer,
+                                      pipeline_finish.descriptor_sets[7].set,
+                                      pipeline_finish.descriptor_sets[7].layout_bindings[0],
+                                      max_terrain_patches);
 
     return pipeline_finish;
-}
\ No newline at end of file
+}
+
+Pipeline createTerrainTessellationPipeline(RenderingState const& state,
+                                           vk::RenderPass const& render_pass,
+                                           Textures& textures,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& model_buffer,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& material_buffer,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_buffer,
+                                           std::vector<std::unique_ptr<vk::raii::ImageView>> const& shadow_map_images,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& terrain_tessellation_buffer)
+{
+    auto program_desc = generalPurposeProgram(VertexFormat::Full);
+    program_desc.vertex_shader = {{"./shaders/terrain_vert.spv"}};
+    program_desc.tesselation_ctrl_shader = {{"./shaders/terrain_tess_ctrl.spv"}};
+    program_desc.tesselation_evaluation_shader = {{"./shaders/terrain_tess_evu.spv"}};
+
+    // Textures, world, model and material are read by both tessellation stages.
+    for (size_t i = 0; i < 4; ++i)
+    {
+        program_desc.buffers[i].binding.tess_ctrl = true;
+        program_desc.buffers[i].binding.tess_evu = true;
+    }
+
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"terrain tessellation"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding terrain tessellation"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Uniform,
+            .size = 1,
+            .tess_ctrl = true,
+            .tess_evu = true,
+        }
+    }});
+
+    auto const pipeline_data = createPipelineData(state, program_desc);
+    auto const [pipeline, pipeline_layout] = createPipeline(pipeline_data, state.swap_chain.extent, state.device, render_pass, state.msaa);
+    auto pipeline_finish = bindPipeline(pipeline_data, pipeline, pipeline_layout);
+
+    updateGeneralPurposeDescriptors(state, pipeline_finish, textures, world_buffer, model_buffer, material_buffer,
+                                    shadow_map_buffer, shadow_map_images, shadow_map_distances);
+
+    updateUniformBuffer<TerrainTessellationBufferObject>(state.device,
+                                                         terrain_tessellation_buffer,
+                                                         pipeline_finish.descriptor_sets[7].set,
+                                                         pipeline_finish.descriptor_sets[7].layout_bindings[0],
+                                                         1);
+
+    return pipeline_finish;
+}
@@ -1,5 +1,6 @@
 #include "VulkanRenderSystem.h"
 
+#include "HeightFieldTexture.h"
 #include "Program.h"
 #include "Textures.h"
 
@@ -7,10 +8,39 @@
 
 Pipeline createGeneralPurposePipeline(RenderingState const& state,
                                       vk::RenderPass const& render_pass,
-                                      Textures const& textures,
+                                      Textures& textures,
                                       std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer = {},
                                       std::vector<std::unique_ptr<UniformBuffer>> const& model_buffer = {},
                                       std::vector<std::unique_ptr<UniformBuffer>> const& material_buffer = {},
                                       std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_buffer = {},
                                       std::vector<std::unique_ptr<vk::raii::ImageView>> const& shadow_map_images = {},
-                                      std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances = {});
\ No newline at end of file
+                                      std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances = {},
+                                      VertexFormat vertex_format = VertexFormat::Full);
+
+// The general purpose program with terrain_cdlod.vert, for the CDLOD terrain.
+// Set 7 is the storage buffer with the TerrainPatch instances of the frame, sets
+// 8 and 9 the tiles and the tile table of the streamed height field.
+Pipeline createTerrainPipeline(RenderingState const& state,
+                               vk::RenderPass const& render_pass,
+                               Textures& textures,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& model_buffer,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& material_buffer,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_buffer,
+                               std::vector<std::unique_ptr<vk::raii::ImageView>> const& shadow_map_images,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances,
+                               std::vector<std::unique_ptr<UniformBuffer>> const& terrain_patch_buffer,
+                               HeightFieldTexture const& height_field);
+
+// The general purpose program with the terrain tessellation shaders. Draws a
+// coarse grid as triangle patches, set 7 is the TerrainTessellationBufferObject.
+Pipeline createTerrainTessellationPipeline(RenderingState const& state,
+                                           vk::RenderPass const& render_pass,
+                                           Textures& textures,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& model_buffer,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& material_buffer,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_buffer,
+                                           std::vector<std::unique_ptr<vk::raii::ImageView>> const& shadow_map_images,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& shadow_map_distances,
+                                           std::vector<std::unique_ptr<UniformBuffer>> const& terrain_tessellation_buffer);
@@ -0,0 +1,69 @@
+#include "Pipelines/Grass.h"
+
+#include "Model.h"
+#include "Pipelines/Pipeline.h"
+#include "descriptor_set.h"
+
+Pipeline createGrassPipeline(RenderingState const& state,
+                             vk::RenderPass const& render_pass,
+                             Textures& textures,
+                             std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
+                             GrassField const& grass)
+{
+    layer_types::Program program_desc;
+    program_desc.vertex_shader = {{"./shaders/grass_vert.spv"}};
+    program_desc.fragment_shader = {{"./shaders/grass_frag.spv"}};
+
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"texture_buffer"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding textures"}},
+            .binding = 0,
+            .type = layer_types::BindingType::TextureSampler,
+            .size = max_textures,
+            .fragment = true,
+        }
+    }});
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"world_buffer"}},
+        .type = layer_types::BufferType::WorldBufferObject,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding world"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Uniform,
+            .size = 1,
+            .vertex = true,
+        }
+    }});
+    program_desc.buffers.push_back({layer_types::Buffer{
+        .name = {{"grass blades"}},
+        .type = layer_types::BufferType::NoBuffer,
+        .size = 1,
+        .binding = layer_types::Binding {
+            .name = {{"binding grass blades"}},
+            .binding = 0,
+            .type = layer_types::BindingType::Storage,
+            .size = 1,
+            .vertex = true,
+        }
+    }});
+
+    auto const pipeline_data = createPipelineData(state, program_desc);
+    auto const [pipeline, pipeline_layout] = createPipeline(pipeline_data, state.swap_chain.extent, state.device, render_pass, state.msaa);
+    auto pipeline_finish = bindPipeline(pipeline_data, pipeline, pipeline_layout);
+
+    bindTextures(state.device, textures, pipeline_finish.descriptor_sets[0].set, pipeline_finish.descriptor_sets[0].layout_bindings[0]);
+
+    updateUniformBuffer<WorldBufferObject>(state.device,
+                                           world_buffer,
+                                           pipeline_finish.descriptor_sets[1].set,
+                                           pipeline_finish.descriptor_sets[1].layout_bindings[0],
+                                           1);
+
+    updateStorageBuffer(state.device, grass.blades, pipeline_finish.descriptor_sets[2].set, pipeline_finish.descriptor_sets[2].layout_bindings[0]);
+
+    return pipeline_finish;
+}
@@ -0,0 +1,13 @@
+#include "VulkanRenderSystem.h"
+
+#include "Grass.h"
+#include "Program.h"
+#include "Textures.h"
+
+// Draws the blades of the grass field with grass.vert, one instance per blade.
+// Set 1 is the world buffer, set 2 the blades of the frame.
+Pipeline createGrassPipeline(RenderingState const& state,
+                             vk::RenderPass const& render_pass,
+                             Textures& textures,
+                             std::vector<std::unique_ptr<UniformBuffer>> const& world_buffer,
+                             GrassField const& grass);
@@ -70,8 +70,8 @@ std::tuple<vk::Pipeline, vk::PipelineLayout> createPipeline(PipelineData const&
 
     vk::PipelineVertexInputStateCreateInfo vertex_input_info {};
 
-    constexpr auto biding_descrition = getBindingDescription<Vertex>();
-    constexpr auto attrib_descriptions = getAttributeDescriptions<Vertex>();
+    auto const biding_descrition = getBindingDescription(pipeline_data.program_data.vertex_format);
+    auto const attrib_descriptions = getAttributeDescriptions(pipeline_data.program_data.vertex_format);
 
     vertex_input_info.sType = vk::StructureType::ePipelineVertexInputStateCreateInfo;
     vertex_input_info.setVertexBindingDescriptions(biding_descrition);
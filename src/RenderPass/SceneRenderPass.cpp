@@ -10,6 +10,7 @@
 #include "Renderer.h"
 #include "Scene.h"
 #include "Pipelines/GeneralPurpuse.h"
+#include "Pipelines/Grass.h"
 #include "Pipelines/Skybox.h"
 
 static void drawScene(vk::CommandBuffer& cmd_buffer, SceneRenderPass& scene_render_pass, Scene const& scene, int frame)
@@ -44,9 +45,25 @@ static void drawScene(vk::CommandBuffer& cmd_buffer, SceneRenderPass& scene_rend
         for (size_t i = 0; i < o.second.size(); ++i)
         {
             auto &drawable = scene.objs[o.second[i]];
+            if (!drawable.visible)
+            {
+                index++;
+                continue;
+            }
+
             cmd_buffer.bindVertexBuffers(0, drawable.vertex_buffer, {0});
-            cmd_buffer.bindIndexBuffer(drawable.index_buffer, 0, vk::IndexType::eUint32);
-            cmd_buffer.drawIndexed(drawable.indices_size, 1, 0,0, index);
+            cmd_buffer.bindIndexBuffer(drawable.index_buffer, 0, drawable.index_type);
+
+            if (drawable.object_type == ObjectType::GRASS)
+            {
+                // The instance count was written by the grass scatter of the frame.
+                cmd_buffer.drawIndexedIndirect(*scene.grass.draw[frame].buffer, 0, 1, sizeof(vk::DrawIndexedIndirectCommand));
+                index++;
+                continue;
+            }
+
+            auto const lod = selectLod(drawable, scene.camera);
+            drawObject(cmd_buffer, drawable, lod, index);
             index++;
         }
     }
@@ -229,7 +246,7 @@ static vk::RenderPass createRenderPass(vk::Device const& device, vk::Format cons
 }
 
 SceneRenderPass createSceneRenderPass(RenderingState const& state,
-                                      Textures const& textures,
+                                      Textures& textures,
                                       Scene const& scene,
                                       CascadedShadowMap const& shadow_map)
 {
@@ -252,5 +269,36 @@ SceneRenderPass createSceneRenderPass(RenderingState const& state,
 
     scene_render_pass.pipelines.push_back(createSkyboxPipeline(state, render_pass, scene.world_buffer, scene.model_buffer, scene.atmosphere_data));
 
+    // Same as the general purpose pipeline, but for meshes uploaded as PackedVertex.
+    scene_render_pass.pipelines.push_back(createGeneralPurposePipeline(state, render_pass, textures,
+                                                                       scene.world_buffer,
+                                                                       scene.model_buffer,
+                                                                       scene.material_buffer,
+                                                                       shadow_map.cascaded_shadow_map_buffer_packed,
+                                                                       shadow_map.framebuffer_data.image_views,
+                                                                       shadow_map.cascaded_distances,
+                                                                       VertexFormat::Packed));
+
+    scene_render_pass.pipelines.push_back(createTerrainPipeline(state, render_pass, textures,
+                                                                scene.world_buffer,
+                                                                scene.model_buffer,
+                                                                scene.material_buffer,
+                                                                shadow_map.cascaded_shadow_map_buffer_packed,
+                                                                shadow_map.framebuffer_data.image_views,
+                                                                shadow_map.cascaded_distances,
+                                                                scene.terrain_patch_buffer,
+                                                                scene.height_field_texture));
+
+    scene_render_pass.pipelines.push_back(createTerrainTessellationPipeline(state, render_pass, textures,
+                                                                            scene.world_buffer,
+                                                                            scene.model_buffer,
+                                                                            scene.material_buffer,
+                                                                            shadow_map.cascaded_shadow_map_buffer_packed,
+                                                                            shadow_map.framebuffer_data.image_views,
+                                                                            shadow_map.cascaded_distances,
+                                                                            scene.terrain_tessellation_buffer));
+
+    scene_render_pass.pipelines.push_back(createGrassPipeline(state, render_pass, textures, scene.world_buffer, scene.grass));
+
     return scene_render_pass;
 }
\ No newline at end of file
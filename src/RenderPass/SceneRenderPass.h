@@ -26,10 +26,16 @@ struct SceneRenderPass
     std::vector<Pipeline> pipelines;
 };
 
+// The general purpose pipeline in SceneRenderPass::pipelines for a mesh with the given vertex format.
+inline int generalPurposeProgram(VertexFormat format)
+{
+    return format == VertexFormat::Packed ? 2 : 0;
+}
+
 void sceneRenderPass(vk::CommandBuffer command_buffer,
                      RenderingState const& state,
                      SceneRenderPass& scene_render_pass,
                      Scene const& scene_data,
                      uint32_t image_index);
 
-SceneRenderPass createSceneRenderPass(RenderingState const& state, Textures const& textures, Scene const& scene, CascadedShadowMap const& shadow_map);
\ No newline at end of file
+SceneRenderPass createSceneRenderPass(RenderingState const& state, Textures& textures, Scene const& scene, CascadedShadowMap const& shadow_map);
\ No newline at end of file
@@ -475,11 +475,14 @@ static void drawShadowMap(vk::CommandBuffer const& command_buffer,
         for (size_t i = 0; i < o.second.size(); ++i)
         {
             auto &drawable = scene.objs[o.second[i]];
-            if (drawable.shadow)
+            if (drawable.shadow && drawable.visible)
             {
-                command_buffer.bindVertexBuffers(0, drawable.vertex_buffer, {0});
-                command_buffer.bindIndexBuffer(drawable.index_buffer, 0, vk::IndexType::eUint32);
-                command_buffer.drawIndexed(drawable.indices_size, 1, 0,0, i);
+                command_buffer.bindVertexBuffers2(0, drawable.vertex_buffer, {0}, nullptr, {drawable.vertex_stride});
+                command_buffer.bindIndexBuffer(drawable.index_buffer, 0, drawable.index_type);
+
+                // Shadows are low resolution, one level coarser than the camera view is not noticeable.
+                auto const lod = selectLod(drawable, scene.camera, 1);
+                drawObject(command_buffer, drawable, lod, index);
             }
             index++;
         }
@@ -626,8 +629,11 @@ static std::tuple<vk::Pipeline, vk::PipelineLayout> createCascadedShadowMapPipel
 
     vk::PipelineVertexInputStateCreateInfo vertex_input_info {};
 
+    // Shadow casters only read the position, which sits at the start of every vertex
+    // format. The stride is set per draw so meshes of all formats share this pipeline.
+    static_assert(offsetof(Vertex, pos) == 0 && offsetof(PackedVertex, pos) == 0, "");
     constexpr auto biding_descrition = getBindingDescription<Vertex>();
-    constexpr auto attrib_descriptions = getAttributeDescriptions<Vertex>();
+    constexpr auto attrib_descriptions = std::array{getAttributeDescriptions<Vertex>()[0]};
 
     vertex_input_info.sType = vk::StructureType::ePipelineVertexInputStateCreateInfo;
     vertex_input_info.setVertexBindingDescriptions(biding_descrition);
@@ -676,6 +682,7 @@ static std::tuple<vk::Pipeline, vk::PipelineLayout> createCascadedShadowMapPipel
     std::vector<vk::DynamicState> dynamic_states {
           vk::DynamicState::eViewport
         , vk::DynamicState::eScissor
+        , vk::DynamicState::eVertexInputBindingStride
     };
 
     vk::PipelineDynamicStateCreateInfo dynamic_state{};
@@ -1,8 +1,12 @@
 #pragma once
 
+#include "Grass.h"
+#include "HeightFieldTexture.h"
+#include "HeightPyramid.h"
 #include "Material.h"
 #include "Model.h"
 #include "Object.h"
+#include "Terrain.h"
 #include "VulkanRenderSystem.h"
 
 #define GLM_FORCE_RADIANS
@@ -14,7 +18,9 @@
 #include <glm/geometric.hpp>
 #include <glm/trigonometric.hpp>
 
+#include <algorithm>
 #include <map>
+#include <optional>
 #include <vector>
 
 struct Scene
@@ -34,6 +40,33 @@ struct Scene
     std::vector<std::unique_ptr<UniformBuffer>> model_buffer;
     std::vector<std::unique_ptr<UniformBuffer>> material_buffer;
     std::vector<std::unique_ptr<UniformBuffer>> atmosphere_data;
+
+    // CDLOD terrain, drawn by the ObjectType::TERRAIN object. The patches are
+    // selected again every frame, one terrain per scene.
+    TerrainQuadtree terrain_quadtree;
+    std::vector<TerrainPatch> terrain_patches;
+    std::vector<std::unique_ptr<UniformBuffer>> terrain_patch_buffer;
+
+    // Heights of the CDLOD terrain streamed from a tiled height field, when there
+    // is one. The texture is there either way, the terrain pipeline binds it.
+    std::optional<HeightFieldStream> height_field_stream;
+    HeightFieldTexture height_field_texture;
+
+    // Heights of the terrain on the CPU, for height queries and ray casts in the
+    // space of the terrain object. The camera is kept camera_ground_clearance
+    // above the ground when it is set.
+    std::optional<HeightPyramid> height_pyramid;
+    std::optional<float> camera_ground_clearance;
+
+    // Tessellated terrain, drawn by the ObjectType::TESSELLATED_TERRAIN object.
+    // The corners of its grid are kept for the triangle budget.
+    TerrainTessellation terrain_tessellation;
+    TessellationBudget terrain_tessellation_budget;
+    std::vector<glm::vec3> terrain_tessellation_corners;
+    std::vector<std::unique_ptr<UniformBuffer>> terrain_tessellation_buffer;
+
+    // Grass on the visible terrain, drawn by the ObjectType::GRASS object.
+    GrassField grass;
 };
 
 inline void addObject(Scene& scene, Object o)
@@ -82,17 +115,78 @@ inline ModelBufferObject createModelBufferObject(Object const& object)
 {
     ModelBufferObject model_buffer{};
 
-    auto rotation = glm::rotate(glm::mat4(1.0f), glm::radians(object.angel), object.rotation);
-    auto translation = glm::translate(glm::mat4(1.0f), object.position);
-    auto scale = glm::scale(glm::mat4(1.0f), glm::vec3(object.scale, object.scale, object.scale));
-    model_buffer.model = translation * rotation * scale;
+    model_buffer.model = objectTransform(object);
+    model_buffer.normal_matrix = glm::transpose(glm::inverse(model_buffer.model));
     return model_buffer;
 }
 
-inline void sceneWriteBuffers(Scene & scene, uint32_t frame)
+// The terrain object that is drawn, the CDLOD or the tessellated one.
+inline Object const* visibleTerrain(Scene const& scene)
+{
+    for (auto const& obj : scene.objs)
+    {
+        if ((obj.object_type == ObjectType::TERRAIN || obj.object_type == ObjectType::TESSELLATED_TERRAIN) && obj.visible)
+        {
+            return &obj;
+        }
+    }
+    return nullptr;
+}
+
+// Ray from the world against the visible terrain. The hit is in world space.
+inline std::optional<TerrainHit> castTerrainRay(Scene const& scene, glm::vec3 const& origin, glm::vec3 const& direction)
+{
+    auto const* terrain = visibleTerrain(scene);
+    if (!terrain || !scene.height_pyramid)
+    {
+        return std::nullopt;
+    }
+
+    auto const transform = objectTransform(*terrain);
+    auto const inverse = glm::inverse(transform);
+    auto hit = castRay(*scene.height_pyramid,
+                       glm::vec3(inverse * glm::vec4(origin, 1.0f)),
+                       glm::vec3(inverse * glm::vec4(direction, 0.0f)));
+    if (hit)
+    {
+        hit->position = glm::vec3(transform * glm::vec4(hit->position, 1.0f));
+        hit->normal = glm::normalize(glm::vec3(glm::transpose(inverse) * glm::vec4(hit->normal, 0.0f)));
+    }
+    return hit;
+}
+
+// Height of the visible terrain below pos in world space, if there is one.
+inline std::optional<float> groundHeight(Scene const& scene, glm::vec3 const& pos)
+{
+    auto const* terrain = visibleTerrain(scene);
+    if (!terrain || !scene.height_pyramid)
+    {
+        return std::nullopt;
+    }
+
+    auto const transform = objectTransform(*terrain);
+    auto const local = glm::vec3(glm::inverse(transform) * glm::vec4(pos, 1.0f));
+    auto const ground = glm::vec3(local.x, terrainHeight(*scene.height_pyramid, glm::vec2(local.x, local.z)), local.z);
+    return (transform * glm::vec4(ground, 1.0f)).y;
+}
+
+inline void clampCameraToGround(Scene& scene)
+{
+    if (!scene.camera_ground_clearance)
+    {
+        return;
+    }
+
+    if (auto const ground = groundHeight(scene, scene.camera.pos))
+    {
+        scene.camera.pos.y = std::max(scene.camera.pos.y, *ground + *scene.camera_ground_clearance);
+    }
+}
+
+inline void sceneWriteBuffers(Scene & scene, uint32_t frame, vk::Extent2D const& extent)
 {
-    WorldBufferObject ubo = createWorldBufferObject(scene);
-    writeBuffer(*scene.world_buffer[frame], ubo);
+    WorldBufferObject world = createWorldBufferObject(scene);
+    writeBuffer(*scene.world_buffer[frame], world);
     writeBuffer(*scene.atmosphere_data[frame], scene.atmosphere);
 
     // Need to add material and model matrix data in the buffers the same order
@@ -108,10 +202,62 @@ inline void sceneWriteBuffers(Scene & scene, uint32_t frame)
             {
                 obj.position = scene.camera.pos;
             }
+            updateWorldBounds(obj);
 
             auto ubo = createModelBufferObject(obj);
+
+            if (obj.object_type == ObjectType::TERRAIN && obj.visible)
+            {
+                // Selected in the space of the object, the ranges scale with it.
+                auto const camera_pos = glm::vec3(glm::inverse(ubo.model) * glm::vec4(scene.camera.pos, 1.0f));
+                auto const frustum = extractFrustum(world.camera_proj * world.camera_view * ubo.model);
+                selectTerrainPatches(scene.terrain_quadtree, camera_pos, frustum, scene.terrain_patches);
+
+                for (size_t patch = 0; patch < scene.terrain_patches.size(); ++patch)
+                {
+                    writeBuffer(*scene.terrain_patch_buffer[frame], scene.terrain_patches[patch], patch);
+                }
+                obj.instance_count = static_cast<uint32_t>(scene.terrain_patches.size());
+
+                if (scene.height_field_stream)
+                {
+                    auto& stream = *scene.height_field_stream;
+                    updateHeightFieldStream(stream, heightFieldSample(stream.height_field->header,
+                                                                      glm::vec2(camera_pos.x, camera_pos.z),
+                                                                      scene.terrain_quadtree.size));
+                }
+            }
+
+            if (obj.object_type == ObjectType::TESSELLATED_TERRAIN && obj.visible)
+            {
+                float const projection_scale = world.camera_proj[1][1] * extent.height * 0.5f;
+                float const max_height = obj.material.shader_data.displacement_y;
+
+                auto const camera_pos = glm::vec3(glm::inverse(ubo.model) * glm::vec4(scene.camera.pos, 1.0f));
+                auto const frustum = extractFrustum(world.camera_proj * world.camera_view * ubo.model);
+                scene.terrain_tessellation_budget = budgetTessellation(scene.terrain_tessellation,
+                                                                       scene.terrain_tessellation_corners,
+                                                                       camera_pos, frustum, max_height, projection_scale);
+
+                TerrainTessellationBufferObject tessellation{
+                    .frustum_planes = extractFrustum(world.camera_proj * world.camera_view).planes,
+                    .pixels_per_edge = scene.terrain_tessellation_budget.pixels_per_edge,
+                    .max_level = scene.terrain_tessellation.max_level,
+                    .viewport_height = float(extent.height),
+                    .terrain_size = scene.terrain_quadtree.size,
+                    .backface_cutoff = scene.terrain_tessellation.backface_cutoff
+                };
+                writeBuffer(*scene.terrain_tessellation_buffer[frame], tessellation);
+            }
+
+            auto shader_data = obj.material.shader_data;
+            if (obj.displacement_baked)
+            {
+                shader_data.material_features &= ~(MaterialFeatureFlag::DisplacementMap | MaterialFeatureFlag::DisplacementNormalMap);
+            }
+
             writeBuffer(*scene.model_buffer[frame], ubo, index);
-            writeBuffer(*scene.material_buffer[frame], obj.material.shader_data, index);
+            writeBuffer(*scene.material_buffer[frame], shader_data, index);
 
             ++index;
         }
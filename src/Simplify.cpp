@@ -0,0 +1,521 @@
+#include "Simplify.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes.
+// The weight is the summed area, evaluate divides by it so the error is a mean
+// squared distance no matter how finely the surface is tessellated.
+struct Quadric
+{
+    double a00{}, a01{}, a02{}, a03{};
+    double a11{}, a12{}, a13{};
+    double a22{}, a23{};
+    double a33{};
+    double weight{};
+};
+
+static Quadric planeQuadric(glm::vec3 const& n, float d, float weight)
+{
+    Quadric q;
+    q.a00 = n.x * n.x * weight;
+    q.a01 = n.x * n.y * weight;
+    q.a02 = n.x * n.z * weight;
+    q.a03 = n.x * d * weight;
+    q.a11 = n.y * n.y * weight;
+    q.a12 = n.y * n.z * weight;
+    q.a13 = n.y * d * weight;
+    q.a22 = n.z * n.z * weight;
+    q.a23 = n.z * d * weight;
+    q.a33 = d * d * weight;
+    q.weight = weight;
+    return q;
+}
+
+static void addQuadric(Quadric& q, Quadric const& r)
+{
+    q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a03 += r.a03;
+    q.a11 += r.a11; q.a12 += r.a12; q.a13 += r.a13;
+    q.a22 += r.a22; q.a23 += r.a23;
+    q.a33 += r.a33;
+    q.weight += r.weight;
+}
+
+static float quadricError(Quadric const& q, glm::vec3 const& p)
+{
+    double const x = p.x, y = p.y, z = p.z;
+    double const error = q.a00*x*x + 2*q.a01*x*y + 2*q.a02*x*z + 2*q.a03*x
+                       + q.a11*y*y + 2*q.a12*y*z + 2*q.a13*y
+                       + q.a22*z*z + 2*q.a23*z
+                       + q.a33;
+
+    return q.weight > 0 ? static_cast<float>(std::sqrt(std::max(error, 0.0) / q.weight)) : 0.0f;
+}
+
+// Distance from p to the closest point of the triangle abc.
+static float triangleDistance(glm::vec3 const& p, glm::vec3 const& a, glm::vec3 const& b, glm::vec3 const& c)
+{
+    auto const ab = b - a;
+    auto const ac = c - a;
+    auto const ap = p - a;
+    float const d1 = glm::dot(ab, ap);
+    float const d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+    {
+        return glm::length(ap);
+    }
+
+    auto const bp = p - b;
+    float const d3 = glm::dot(ab, bp);
+    float const d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+    {
+        return glm::length(bp);
+    }
+
+    float const vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    {
+        return glm::distance(p, a + ab * (d1 / (d1 - d3)));
+    }
+
+    auto const cp = p - c;
+    float const d5 = glm::dot(ab, cp);
+    float const d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+    {
+        return glm::length(cp);
+    }
+
+    float const vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    {
+        return glm::distance(p, a + ac * (d2 / (d2 - d6)));
+    }
+
+    float const va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+    {
+        return glm::distance(p, b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+    }
+
+    float const sum = va + vb + vc;
+    if (sum <= 0.0f)
+    {
+        // Degenerate triangle, fall back to the closest corner.
+        return std::min({glm::length(ap), glm::length(bp), glm::length(cp)});
+    }
+    return glm::distance(p, a + ab * (vb / sum) + ac * (vc / sum));
+}
+
+// Largest distance of a vertex of `indices` to the simplified triangles around
+// the vertex it collapsed onto, `moved_to`. Measured at the vertices, so it is
+// the deviation a viewer sees at the original corners.
+static float maxVertexDeviation(std::span<Vertex const> vertices,
+                                std::span<uint32_t const> indices,
+                                std::span<uint32_t const> simplified,
+                                std::span<uint32_t const> moved_to)
+{
+    std::vector<uint32_t> offsets(vertices.size() + 1, 0);
+    for (auto index : simplified)
+    {
+        ++offsets[index + 1];
+    }
+    for (size_t v = 0; v < vertices.size(); ++v)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(simplified.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < simplified.size(); ++i)
+        {
+            adjacency[fill[simplified[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<bool> measured(vertices.size(), false);
+    float max_error = 0.0f;
+    for (auto v : indices)
+    {
+        if (measured[v])
+        {
+            continue;
+        }
+        measured[v] = true;
+
+        auto const target = moved_to[v];
+        auto const& p = vertices[v].pos;
+        float error = glm::distance(p, vertices[target].pos);
+        for (uint32_t j = offsets[target]; j < offsets[target + 1]; ++j)
+        {
+            auto const* triangle = &simplified[adjacency[j] * 3];
+            error = std::min(error, triangleDistance(p, vertices[triangle[0]].pos, vertices[triangle[1]].pos, vertices[triangle[2]].pos));
+        }
+        max_error = std::max(max_error, error);
+    }
+    return max_error;
+}
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    float error;
+};
+
+std::vector<uint32_t> simplifyMesh(std::span<Vertex const> vertices,
+                                   std::span<uint32_t const> indices,
+                                   size_t target_index_count,
+                                   float target_error,
+                                   float* result_error)
+{
+    std::vector<uint32_t> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+
+    if (result.size() <= target_index_count)
+    {
+        if (result_error) *result_error = 0.0f;
+        return result;
+    }
+
+    size_t const vertex_count = vertices.size();
+
+    // Vertices sharing a position are wedges of the same point and form one group.
+    std::vector<uint32_t> group(vertex_count);
+    {
+        struct PositionHash
+        {
+            size_t operator()(std::array<uint32_t, 3> const& p) const
+            {
+                return (p[0] * 73856093u) ^ (p[1] * 19349663u) ^ (p[2] * 83492791u);
+            }
+        };
+
+        std::unordered_map<std::array<uint32_t, 3>, uint32_t, PositionHash> positions;
+        positions.reserve(vertex_count);
+        for (uint32_t v = 0; v < vertex_count; ++v)
+        {
+            auto const& p = vertices[v].pos;
+            std::array<uint32_t, 3> key{std::bit_cast<uint32_t>(p.x), std::bit_cast<uint32_t>(p.y), std::bit_cast<uint32_t>(p.z)};
+            group[v] = positions.try_emplace(key, v).first->second;
+        }
+    }
+
+    std::vector<bool> locked(vertex_count, false);
+    {
+        std::vector<uint8_t> wedges(vertex_count, 0);
+        std::vector<bool> referenced(vertex_count, false);
+        for (auto index : result)
+        {
+            if (!referenced[index])
+            {
+                referenced[index] = true;
+                wedges[group[index]] = std::min(wedges[group[index]] + 1, 2);
+            }
+        }
+
+        // An edge is open when its opposite half edge does not exist, and non-manifold
+        // when the same half edge is used more than once.
+        std::unordered_map<uint64_t, uint32_t> edges;
+        edges.reserve(result.size());
+        auto key = [&](uint32_t a, uint32_t b) { return (uint64_t(group[a]) << 32) | group[b]; };
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                ++edges[key(result[i + k], result[i + (k + 1) % 3])];
+            }
+        }
+
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                auto const a = result[i + k];
+                auto const b = result[i + (k + 1) % 3];
+                auto const opposite = edges.find(key(b, a));
+                if (edges[key(a, b)] > 1 || opposite == edges.end() || opposite->second > 1)
+                {
+                    locked[group[a]] = true;
+                    locked[group[b]] = true;
+                }
+            }
+        }
+
+        for (uint32_t v = 0; v < vertex_count; ++v)
+        {
+            if (wedges[group[v]] > 1)
+            {
+                locked[group[v]] = true;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertex_count);
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        auto const& p0 = vertices[result[i]].pos;
+        auto const& p1 = vertices[result[i + 1]].pos;
+        auto const& p2 = vertices[result[i + 2]].pos;
+
+        auto normal = glm::cross(p1 - p0, p2 - p0);
+        float const length = glm::length(normal);
+        if (length == 0.0f)
+        {
+            continue;
+        }
+        normal /= length;
+
+        auto const q = planeQuadric(normal, -glm::dot(normal, p0), length * 0.5f);
+        addQuadric(quadrics[group[result[i]]], q);
+        addQuadric(quadrics[group[result[i + 1]]], q);
+        addQuadric(quadrics[group[result[i + 2]]], q);
+    }
+
+    std::vector<uint32_t> remap(vertex_count);
+    // The vertex every vertex ended up on over all passes.
+    std::vector<uint32_t> moved_to(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; ++v)
+    {
+        moved_to[v] = v;
+    }
+    std::vector<bool> touched(vertex_count);
+    std::vector<uint32_t> offsets(vertex_count + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+
+    auto position = [&](uint32_t v) -> glm::vec3 const& { return vertices[remap[v]].pos; };
+
+    // Moving `from` onto `to` must not turn any of the remaining triangles around `from` over.
+    auto flips = [&](uint32_t from, uint32_t to)
+    {
+        for (uint32_t j = offsets[from]; j < offsets[from + 1]; ++j)
+        {
+            auto const* triangle = &result[adjacency[j] * 3];
+            if (remap[triangle[0]] == to || remap[triangle[1]] == to || remap[triangle[2]] == to)
+            {
+                continue;
+            }
+
+            glm::vec3 p[3];
+            glm::vec3 q[3];
+            for (size_t k = 0; k < 3; ++k)
+            {
+                p[k] = position(triangle[k]);
+                q[k] = triangle[k] == from ? vertices[to].pos : p[k];
+            }
+
+            auto const before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            auto const after = glm::cross(q[1] - q[0], q[2] - q[0]);
+
+            if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (int pass = 0; pass < 100 && result.size() > target_index_count; ++pass)
+    {
+        // Triangles per vertex for the current index list.
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (auto index : result)
+        {
+            ++offsets[index + 1];
+        }
+        for (size_t v = 0; v < vertex_count; ++v)
+        {
+            offsets[v + 1] += offsets[v];
+        }
+        adjacency.resize(result.size());
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i)
+            {
+                adjacency[fill[result[i]]++] = i / 3;
+            }
+        }
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                auto const a = result[i + k];
+                auto const b = result[i + (k + 1) % 3];
+
+                if (group[a] == group[b])
+                {
+                    continue;
+                }
+
+                if (!locked[group[a]])
+                {
+                    collapses.push_back({a, b, quadricError(quadrics[group[a]], vertices[b].pos)});
+                }
+                if (!locked[group[b]])
+                {
+                    collapses.push_back({b, a, quadricError(quadrics[group[b]], vertices[a].pos)});
+                }
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](auto const& lhs, auto const& rhs) { return lhs.error < rhs.error; });
+
+        for (uint32_t v = 0; v < vertex_count; ++v)
+        {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t triangles = result.size() / 3;
+        size_t const target_triangles = target_index_count / 3;
+        size_t collapsed = 0;
+
+        for (auto const& collapse : collapses)
+        {
+            if (collapse.error > target_error || triangles <= target_triangles)
+            {
+                break;
+            }
+
+            auto const from = group[collapse.from];
+            auto const to = group[collapse.to];
+            if (touched[from] || touched[to] || flips(collapse.from, collapse.to))
+            {
+                continue;
+            }
+
+            // Unlocked groups have a single wedge, so remapping the vertex moves the whole point.
+            remap[collapse.from] = collapse.to;
+            addQuadric(quadrics[to], quadrics[from]);
+            touched[from] = true;
+            touched[to] = true;
+
+            // Every triangle sharing the edge disappears, usually two.
+            for (uint32_t j = offsets[collapse.from]; j < offsets[collapse.from + 1]; ++j)
+            {
+                auto const* triangle = &result[adjacency[j] * 3];
+                if (std::find(triangle, triangle + 3, collapse.to) != triangle + 3)
+                {
+                    --triangles;
+                }
+            }
+
+            ++collapsed;
+        }
+
+        if (collapsed == 0)
+        {
+            break;
+        }
+
+        for (auto& target : moved_to)
+        {
+            target = remap[target];
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            auto const a = remap[result[i]];
+            auto const b = remap[result[i + 1]];
+            auto const c = remap[result[i + 2]];
+            if (a != b && b != c && c != a)
+            {
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+        }
+        result.resize(write);
+    }
+
+    if (result_error) *result_error = maxVertexDeviation(vertices, indices, result, moved_to);
+    return result;
+}
+
+void generateLods(Model& model, size_t level_count)
+{
+    model.lods.clear();
+
+    auto submeshes = model.submeshes;
+    if (submeshes.empty())
+    {
+        submeshes.push_back(SubMesh{
+            .vertex_count = static_cast<uint32_t>(model.vertices.size()),
+            .index_count = static_cast<uint32_t>(model.indices.size())
+        });
+    }
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (auto const& vertex : model.vertices)
+    {
+        min = glm::min(min, vertex.pos);
+        max = glm::max(max, vertex.pos);
+    }
+    float const extent = model.vertices.empty() ? 0.0f : glm::length(max - min);
+
+    // The previous level of every submesh, local to the submesh vertex range.
+    std::vector<std::vector<uint32_t>> previous;
+    for (auto const& submesh : submeshes)
+    {
+        auto& local = previous.emplace_back(model.indices.begin() + submesh.index_offset,
+                                            model.indices.begin() + submesh.index_offset + submesh.index_count);
+        for (auto& index : local)
+        {
+            index -= submesh.vertex_offset;
+        }
+    }
+
+    size_t previous_count = model.indices.size();
+    float previous_error = 0.0f;
+
+    for (size_t level = 1; level <= level_count; ++level)
+    {
+        // Allow a little more error for every level, relative to the size of the model.
+        float const target_error = extent * 0.01f * float(1 << (level - 1));
+
+        ModelLod lod;
+        float level_error = 0.0f;
+        for (size_t s = 0; s < submeshes.size(); ++s)
+        {
+            auto const& submesh = submeshes[s];
+            std::span<Vertex const> vertices(model.vertices.data() + submesh.vertex_offset, submesh.vertex_count);
+
+            float error = 0.0f;
+            auto simplified = simplifyMesh(vertices, previous[s], previous[s].size() / 6 * 3, target_error, &error);
+            optimizeVertexCache(simplified, vertices.size());
+
+            level_error = std::max(level_error, error);
+            for (auto index : simplified)
+            {
+                lod.indices.push_back(index + submesh.vertex_offset);
+            }
+            previous[s] = std::move(simplified);
+        }
+
+        // Not worth a level of its own.
+        if (lod.indices.size() > previous_count * 9 / 10)
+        {
+            break;
+        }
+
+        // Each level starts from the previous one, so the deviations add up to a
+        // bound on the distance to the full detail mesh.
+        lod.error = previous_error + level_error;
+        previous_count = lod.indices.size();
+        previous_error = lod.error;
+
+        spdlog::info("LOD {} of {}: {} triangles, error {}", level, model.path, lod.indices.size() / 3, lod.error);
+        model.lods.push_back(std::move(lod));
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Model.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Quadric error metric edge collapse simplification (Garland and Heckbert).
+// Vertices only ever collapse onto other existing vertices, so the simplified
+// index list keeps using the original vertex buffer.
+//
+// Vertices on open borders and on attribute seams, where several vertices share
+// one position, are locked so the silhouette and the UV layout stay intact.
+//
+// Indices are relative to `vertices`. `target_error` limits the quadric error of
+// a collapse. `result_error` receives the largest distance of an input vertex to
+// the simplified surface around it, in object space.
+std::vector<uint32_t> simplifyMesh(std::span<Vertex const> vertices,
+                                   std::span<uint32_t const> indices,
+                                   size_t target_index_count,
+                                   float target_error,
+                                   float* result_error = nullptr);
+
+// Builds up to `level_count` LODs of the model, each roughly halving the triangle
+// count of the one before. Submeshes are simplified separately.
+void generateLods(Model& model, size_t level_count = 3);
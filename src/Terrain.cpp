@@ -0,0 +1,289 @@
+#include "Terrain.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+float terrainNodeSize(TerrainQuadtree const& terrain, uint32_t level)
+{
+    return terrain.size / float(1u << (terrain.lod_count - 1 - level));
+}
+
+float terrainLodRange(TerrainQuadtree const& terrain, uint32_t level)
+{
+    return terrain.lod_distance * terrainNodeSize(terrain, level);
+}
+
+namespace
+{
+
+struct Selection
+{
+    TerrainQuadtree const& terrain;
+    glm::vec3 camera_pos;
+    Frustum const& frustum;
+    std::vector<TerrainPatch>& patches;
+    size_t max_patches;
+};
+
+bool inRange(glm::vec3 const& camera_pos, glm::vec3 const& min, glm::vec3 const& max, float range)
+{
+    auto const closest = glm::clamp(camera_pos, min, max);
+    auto const d = closest - camera_pos;
+    return glm::dot(d, d) <= range * range;
+}
+
+glm::vec3 boxMin(glm::vec2 corner)
+{
+    return glm::vec3(corner.x, 0.0f, corner.y);
+}
+
+glm::vec3 boxMax(TerrainQuadtree const& terrain, glm::vec2 corner, float size)
+{
+    return glm::vec3(corner.x + size, terrain.max_height, corner.y + size);
+}
+
+void addQuadrant(Selection& selection, glm::vec2 corner, float size, uint32_t level)
+{
+    auto const& terrain = selection.terrain;
+    if (   selection.patches.size() == selection.max_patches
+        || !intersects(selection.frustum, boxMin(corner), boxMax(terrain, corner, size)))
+    {
+        return;
+    }
+
+    float const end = terrainLodRange(terrain, level);
+    float const previous = level > 0 ? terrainLodRange(terrain, level - 1) : 0.0f;
+    float const start = previous + (end - previous) * terrain.morph_start;
+
+    selection.patches.push_back(TerrainPatch{
+        .offset = corner,
+        .size = size,
+        .lod = float(level),
+        .morph = glm::vec2(end / (end - start), 1.0f / (end - start)),
+        .patch_resolution = float(terrain.patch_resolution),
+        .terrain_size = terrain.size});
+}
+
+std::array<glm::vec2, 4> quadrants(glm::vec2 corner, float half)
+{
+    return {corner,
+            corner + glm::vec2(half, 0.0f),
+            corner + glm::vec2(0.0f, half),
+            corner + glm::vec2(half, half)};
+}
+
+// Strugar's selection. Returns false when the node is out of the range of its
+// level, then the parent draws the area at its own level instead.
+bool selectNode(Selection& selection, glm::vec2 corner, float size, uint32_t level)
+{
+    auto const& terrain = selection.terrain;
+    auto const min = boxMin(corner);
+    auto const max = boxMax(terrain, corner, size);
+
+    if (!intersects(selection.frustum, min, max))
+    {
+        // Nothing to draw, but the area is handled.
+        return true;
+    }
+
+    if (!inRange(selection.camera_pos, min, max, terrainLodRange(terrain, level)))
+    {
+        return false;
+    }
+
+    float const half = size * 0.5f;
+    if (level == 0 || !inRange(selection.camera_pos, min, max, terrainLodRange(terrain, level - 1)))
+    {
+        for (auto const& quadrant : quadrants(corner, half))
+        {
+            addQuadrant(selection, quadrant, half, level);
+        }
+        return true;
+    }
+
+    for (auto const& child : quadrants(corner, half))
+    {
+        if (!selectNode(selection, child, half, level - 1))
+        {
+            addQuadrant(selection, child, half, level);
+        }
+    }
+    return true;
+}
+
+}
+
+void selectTerrainPatches(TerrainQuadtree const& terrain,
+                          glm::vec3 const& camera_pos,
+                          Frustum const& frustum,
+                          std::vector<TerrainPatch>& patches,
+                          size_t max_patches)
+{
+    patches.clear();
+    if (terrain.lod_count == 0)
+    {
+        return;
+    }
+
+    Selection selection{terrain, camera_pos, frustum, patches, max_patches};
+
+    // The root is drawn at the coarsest level even when the camera is further away.
+    uint32_t const root = terrain.lod_count - 1;
+    glm::vec2 const corner(-terrain.size / 2, -terrain.size / 2);
+    if (!selectNode(selection, corner, terrain.size, root))
+    {
+        for (auto const& quadrant : quadrants(corner, terrain.size / 2))
+        {
+            addQuadrant(selection, quadrant, terrain.size / 2, root);
+        }
+    }
+}
+
+Model createTerrainPatch(uint32_t resolution)
+{
+    Model model{};
+
+    uint32_t const columns = resolution + 1;
+    model.vertices.reserve(columns * columns);
+    for (uint32_t y = 0; y < columns; ++y)
+    {
+        for (uint32_t x = 0; x < columns; ++x)
+        {
+            glm::vec2 const grid(float(x) / resolution, float(y) / resolution);
+            model.vertices.push_back(Vertex{
+                .pos = glm::vec3(grid.x, 0, grid.y),
+                .tex_coord = grid,
+                .normal = glm::vec3(0,1,0),
+                .normal_coord = grid,
+                .tangent = glm::vec3(1,0,0),
+                .bitangent = glm::vec3(0,0,-1)});
+        }
+    }
+
+    model.indices.reserve(resolution * resolution * 6);
+    for (uint32_t y = 0; y < resolution; ++y)
+    {
+        uint32_t const top = y * columns;
+        uint32_t const bottom = top + columns;
+        for (uint32_t left = 0; left < resolution; ++left)
+        {
+            uint32_t const right = left + 1;
+            model.indices.insert(model.indices.end(), {
+                bottom + left, bottom + right, top + right,
+                top + right, top + left, bottom + left});
+        }
+    }
+
+    // Drawn for every patch of the terrain, hundreds of times a frame.
+    optimizeVertexCache(model.indices, model.vertices.size());
+
+    model.bounds = computeBounds(model.vertices);
+    return model;
+}
+
+float tessellationEdgeLevel(glm::vec3 const& a, glm::vec3 const& b, glm::vec3 const& camera_pos,
+                            float projection_scale, float pixels_per_edge, float max_level)
+{
+    // The distance to the camera rather than the view depth, so turning the camera
+    // does not change the levels.
+    auto const center = (a + b) * 0.5f;
+    float const distance = std::max(glm::length(camera_pos - center), 0.001f);
+    float const pixels = glm::length(a - b) * projection_scale / distance;
+    return std::clamp(pixels / pixels_per_edge, 1.0f, max_level);
+}
+
+// Triangles of a triangle patch with every level at level, fractional even spacing.
+static size_t tessellatedTriangles(float level)
+{
+    auto const segments = static_cast<size_t>(std::ceil(level * 0.5f)) * 2;
+
+    // Rings of 3 * (outer + inner) triangles, inner levels go down by two.
+    size_t triangles = 0;
+    for (size_t outer = segments; outer > 0; outer = outer > 2 ? outer - 2 : 0)
+    {
+        triangles += 3 * (outer + (outer > 2 ? outer - 2 : 0));
+    }
+    return triangles;
+}
+
+size_t estimateTessellatedTriangles(std::span<glm::vec3 const> corners,
+                                    glm::vec3 const& camera_pos,
+                                    Frustum const& frustum,
+                                    float max_height,
+                                    float projection_scale,
+                                    float pixels_per_edge,
+                                    float max_level)
+{
+    size_t triangles = 0;
+    for (size_t i = 0; i + 2 < corners.size(); i += 3)
+    {
+        auto const& a = corners[i];
+        auto const& b = corners[i + 1];
+        auto const& c = corners[i + 2];
+
+        auto min = glm::min(a, glm::min(b, c));
+        auto max = glm::max(a, glm::max(b, c));
+        min.y = std::min(min.y, 0.0f);
+        max.y = std::max(max.y, max_height);
+        if (!intersects(frustum, min, max))
+        {
+            continue;
+        }
+
+        float const level = std::max({tessellationEdgeLevel(b, c, camera_pos, projection_scale, pixels_per_edge, max_level),
+                                      tessellationEdgeLevel(c, a, camera_pos, projection_scale, pixels_per_edge, max_level),
+                                      tessellationEdgeLevel(a, b, camera_pos, projection_scale, pixels_per_edge, max_level)});
+        triangles += tessellatedTriangles(level);
+    }
+    return triangles;
+}
+
+TessellationBudget budgetTessellation(TerrainTessellation const& settings,
+                                      std::span<glm::vec3 const> corners,
+                                      glm::vec3 const& camera_pos,
+                                      Frustum const& frustum,
+                                      float max_height,
+                                      float projection_scale)
+{
+    TessellationBudget budget{.pixels_per_edge = settings.pixels_per_edge};
+    auto estimate = [&]
+    {
+        return estimateTessellatedTriangles(corners, camera_pos, frustum, max_height, projection_scale,
+                                            budget.pixels_per_edge, settings.max_level);
+    };
+
+    // The count goes with the inverse square of the edge length. The clamped
+    // levels make it less than that, so correct a few times.
+    budget.triangles = estimate();
+    for (int i = 0; i < 4 && budget.triangles > settings.triangle_budget; ++i)
+    {
+        budget.pixels_per_edge *= std::sqrt(float(budget.triangles) / float(std::max(settings.triangle_budget, 1u))) * 1.05f;
+        budget.triangles = estimate();
+    }
+    return budget;
+}
+
+std::vector<glm::vec3> triangleCorners(Model const& model)
+{
+    std::vector<glm::vec3> corners;
+    corners.reserve(model.indices.size());
+
+    if (!model.local_indices)
+    {
+        for (auto index : model.indices)
+        {
+            corners.push_back(model.vertices[index].pos);
+        }
+        return corners;
+    }
+
+    for (auto const& submesh : model.submeshes)
+    {
+        for (uint32_t i = 0; i < submesh.index_count; ++i)
+        {
+            corners.push_back(model.vertices[submesh.vertex_offset + model.indices[submesh.index_offset + i]].pos);
+        }
+    }
+    return corners;
+}
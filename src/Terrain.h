@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Model.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Continuous distance dependent LOD terrain (CDLOD). The terrain is a quadtree
+// over a square centered on the origin of the object, like createFlatGround, and
+// every selected node is drawn with instances of one small grid patch scaled to
+// the node. The heights come from the displacement map of the material, so the
+// geometry on the GPU is the same few KB however large the terrain is.
+//
+// A node is drawn as its four quadrants. That way a parent fills in exactly the
+// quadrants its children leave out and every instance is the same patch.
+struct TerrainQuadtree
+{
+    float size{100};
+
+    // Heights are between 0 and max_height, the displacement_y of the material.
+    float max_height{7};
+
+    // Quads along an edge of the patch, so a node has twice as many. Even, the
+    // odd vertices morph onto the even ones.
+    uint32_t patch_resolution{16};
+
+    // Levels of the tree, the root is level lod_count - 1 and covers the whole terrain.
+    uint32_t lod_count{5};
+
+    // Distance a level reaches, in node sizes of that level. Every level covers
+    // twice the distance of the finer one below it.
+    float lod_distance{3.0f};
+
+    // Part of the range between the previous level and this one after which the
+    // vertices start to morph into the coarser level. Neighbouring patches only
+    // line up while lod_distance * morph_start is larger than the diagonal of a
+    // node, height included, in node sizes.
+    float morph_start{0.7f};
+};
+
+// One instance of the patch, read by terrain_cdlod.vert with gl_InstanceIndex.
+// Matches the std430 layout of the shader.
+struct TerrainPatch
+{
+    glm::vec2 offset;           // Corner with the smallest x and z.
+    float size;                 // Edge length.
+    float lod;                  // Level, 0 is the finest.
+    glm::vec2 morph;            // end/(end - start) and 1/(end - start) of the morph range of the level.
+    float patch_resolution;
+    float terrain_size;
+};
+
+static_assert(sizeof(TerrainPatch) == 32, "");
+
+// Patches in the storage buffer of a frame. More than enough for the default tree.
+constexpr uint32_t max_terrain_patches = 2048;
+
+// Edge length of the nodes of a level.
+float terrainNodeSize(TerrainQuadtree const& terrain, uint32_t level);
+
+// Distance from the camera up to which a level is used.
+float terrainLodRange(TerrainQuadtree const& terrain, uint32_t level);
+
+// Replaces patches with the ones to draw for a camera at camera_pos. The camera
+// and the frustum are in the space of the terrain object. Nodes and quadrants
+// outside the frustum are skipped, at most max_patches are selected.
+void selectTerrainPatches(TerrainQuadtree const& terrain,
+                          glm::vec3 const& camera_pos,
+                          Frustum const& frustum,
+                          std::vector<TerrainPatch>& patches,
+                          size_t max_patches = max_terrain_patches);
+
+// The patch, resolution x resolution quads over [0, 1] in x and z at height 0,
+// with the same triangles as createFlatGround.
+Model createTerrainPatch(uint32_t resolution);
+
+// Settings of the tessellated terrain, the alternative to the CDLOD terrain that
+// tessellates a coarse grid on the GPU, see terrain.tesc.
+struct TerrainTessellation
+{
+    // Target length of a tessellated edge on screen.
+    float pixels_per_edge{8.0f};
+    float max_level{64.0f};
+
+    // Upper bound of triangles for the whole terrain. When the estimate for a
+    // frame is above it, pixels_per_edge is raised for that frame. Every visible
+    // patch is at least 6 triangles with fractional even spacing.
+    uint32_t triangle_budget{1'000'000};
+
+    // A patch is dropped when the terrain faces away from the camera at all three
+    // corners with a cosine below -backface_cutoff. The surface in between is not
+    // checked, a positive cutoff leaves room for it.
+    float backface_cutoff{0.3f};
+};
+
+// Set 7 of the tessellated terrain pipeline.
+struct alignas(16) TerrainTessellationBufferObject
+{
+    std::array<glm::vec4, 6> frustum_planes;   // World space, see Frustum.
+    float pixels_per_edge;
+    float max_level;
+    float viewport_height;
+    float terrain_size;
+    float backface_cutoff;
+};
+
+// Tessellation level of an edge, the screen size of the sphere around it in
+// pixels_per_edge. projection_scale is proj[1][1] * viewport height / 2. Same
+// as in terrain.tesc, both sides of an edge get the same level so there are no
+// cracks between patches.
+float tessellationEdgeLevel(glm::vec3 const& a, glm::vec3 const& b, glm::vec3 const& camera_pos,
+                            float projection_scale, float pixels_per_edge, float max_level);
+
+struct TessellationBudget
+{
+    float pixels_per_edge{};
+    size_t triangles{};
+};
+
+// Triangles the patches are tessellated into with pixels_per_edge, ignoring the
+// heights and backface culling. corners has three points per patch, in the space
+// of the terrain object like the camera and the frustum.
+size_t estimateTessellatedTriangles(std::span<glm::vec3 const> corners,
+                                    glm::vec3 const& camera_pos,
+                                    Frustum const& frustum,
+                                    float max_height,
+                                    float projection_scale,
+                                    float pixels_per_edge,
+                                    float max_level);
+
+// The pixels_per_edge of the settings, raised until the estimate fits in the
+// triangle budget.
+TessellationBudget budgetTessellation(TerrainTessellation const& settings,
+                                      std::span<glm::vec3 const> corners,
+                                      glm::vec3 const& camera_pos,
+                                      Frustum const& frustum,
+                                      float max_height,
+                                      float projection_scale);
+
+// Corners of every triangle of the model, in draw order.
+std::vector<glm::vec3> triangleCorners(Model const& model);
@@ -0,0 +1,269 @@
+#include "TextureStreaming.h"
+
+#include "JobSystem.h"
+#include "Scene.h"
+#include "descriptor_set.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// Bytes of the levels of a cooked texture from first_level on.
+static uint64_t levelBytes(MappedKtx2 const& cooked, uint32_t first_level)
+{
+    uint64_t bytes = 0;
+    for (uint32_t level = first_level; level < cooked.levels.size(); ++level)
+    {
+        bytes += cooked.levels[level].size;
+    }
+    return bytes;
+}
+
+// Level of a texture of texels along its larger side that has about one texel
+// per pixel where the object is closest to the camera. Triplanar materials
+// repeat the texture every 1 / scaling_factor units, textures sampled by UV
+// are taken to cover the object once.
+static float wantedLevel(Object const& obj, uint32_t texels, glm::vec3 const& camera_pos, float projection_scale)
+{
+    auto const& bounds = obj.world_bounds;
+    auto const& material = obj.material.shader_data;
+
+    float const distance = std::max(glm::length(bounds.center - camera_pos) - bounds.radius, 0.1f);
+    float const repeat = material.sampling_mode == SamplingMode::TriplanarSampling
+        ? 1.0f / std::max(material.scaling_factor, 1e-4f)
+        : std::max(2.0f * bounds.radius, 1e-4f);
+
+    float const texels_per_unit = texels / repeat;
+    float const pixels_per_unit = projection_scale / distance;
+    return std::log2(texels_per_unit / pixels_per_unit);
+}
+
+// The cooked textures in the slots of Textures, by the generation of each slot.
+static void syncStreamedTextures(TextureStream& stream, Textures const& textures)
+{
+    std::erase_if(stream.textures, [&textures](StreamedTexture const& streamed)
+    {
+        return textures.generations[streamed.texture] != streamed.generation || !textures.textures[streamed.texture];
+    });
+
+    stream.stream_index.assign(textures.textures.size(), -1);
+    for (uint32_t i = 0; i < stream.textures.size(); ++i)
+    {
+        stream.stream_index[stream.textures[i].texture] = static_cast<int32_t>(i);
+    }
+
+    for (uint32_t slot = 0; slot < textures.textures.size(); ++slot)
+    {
+        auto const& texture = textures.textures[slot];
+        if (!texture || !texture->cooked || stream.stream_index[slot] >= 0)
+        {
+            continue;
+        }
+
+        auto const tail_level = streamedTextureTailLevel(texture->cooked->header);
+        stream.stream_index[slot] = static_cast<int32_t>(stream.textures.size());
+        stream.textures.push_back({.texture = slot, .generation = textures.generations[slot], .tail_level = tail_level,
+                                   .wanted_level = tail_level, .target_level = tail_level});
+    }
+}
+
+TextureStream createTextureStream(Textures const& textures, uint32_t frames, TextureStreamSettings const& settings)
+{
+    TextureStream stream{.settings = settings};
+    stream.dirty.resize(frames);
+    syncStreamedTextures(stream, textures);
+    return stream;
+}
+
+void updateTextureStream(TextureStream& stream, Textures const& textures, Scene const& scene, vk::Extent2D const& extent)
+{
+    syncStreamedTextures(stream, textures);
+
+    for (auto& streamed : stream.textures)
+    {
+        streamed.wanted_level = streamed.tail_level;
+    }
+
+    float const projection_scale = scene.camera.proj[1][1] * extent.height * 0.5f;
+    for (auto const& obj : scene.objs)
+    {
+        if (!obj.visible || !obj.bounds_valid)
+        {
+            continue;
+        }
+
+        auto const& material = obj.material.shader_data;
+        for (int const index : {material.base_color_texture, material.base_color_normal_texture, material.roughness_texture,
+                                material.metallic_texture, material.ao_texture, material.normal_map_texture,
+                                material.displacement_map_texture})
+        {
+            if (index < 0 || index >= static_cast<int>(stream.stream_index.size()) || stream.stream_index[index] < 0)
+            {
+                continue;
+            }
+
+            auto& streamed = stream.textures[stream.stream_index[index]];
+            auto const& header = textures.textures[index]->cooked->header;
+            float const level = wantedLevel(obj, std::max(header.width, header.height), scene.camera.pos, projection_scale)
+                              + stream.settings.lod_bias;
+
+            auto const clamped = static_cast<uint32_t>(std::clamp(std::floor(level), 0.0f, float(streamed.tail_level)));
+            streamed.wanted_level = std::min(streamed.wanted_level, clamped);
+        }
+    }
+
+    // Leave out the largest level left until the targets fit the budget.
+    uint64_t target_bytes = 0;
+    uint64_t resident_bytes = 0;
+    for (auto& streamed : stream.textures)
+    {
+        auto const& texture = *textures.textures[streamed.texture];
+        streamed.target_level = streamed.wanted_level;
+        target_bytes += levelBytes(*texture.cooked, streamed.target_level);
+        resident_bytes += levelBytes(*texture.cooked, texture.first_level);
+    }
+
+    while (target_bytes > stream.settings.memory_budget)
+    {
+        StreamedTexture* largest = nullptr;
+        uint64_t largest_bytes = 0;
+        for (auto& streamed : stream.textures)
+        {
+            if (streamed.target_level < streamed.tail_level)
+            {
+                auto const bytes = textures.textures[streamed.texture]->cooked->levels[streamed.target_level].size;
+                if (bytes > largest_bytes)
+                {
+                    largest = &streamed;
+                    largest_bytes = bytes;
+                }
+            }
+        }
+
+        if (!largest)
+        {
+            break;
+        }
+
+        ++largest->target_level;
+        target_bytes -= largest_bytes;
+    }
+
+    stream.stats.target_bytes = target_bytes;
+    stream.stats.resident_bytes = resident_bytes;
+
+    // Drops first, they make room, then the textures the most levels away.
+    struct Change
+    {
+        uint32_t texture;
+        bool drop;
+        uint32_t levels;
+    };
+
+    std::vector<Change> changes;
+    bool const over_budget = resident_bytes > stream.settings.memory_budget;
+    for (auto const& streamed : stream.textures)
+    {
+        if (stream.loading.contains(streamed.texture))
+        {
+            continue;
+        }
+
+        auto const resident_level = textures.textures[streamed.texture]->first_level;
+        if (streamed.target_level < resident_level)
+        {
+            changes.push_back({streamed.texture, false, resident_level - streamed.target_level});
+        }
+        else if (streamed.target_level > resident_level && (over_budget || streamed.target_level >= resident_level + 2))
+        {
+            changes.push_back({streamed.texture, true, streamed.target_level - resident_level});
+        }
+    }
+
+    std::sort(changes.begin(), changes.end(), [](Change const& a, Change const& b)
+    {
+        return a.drop != b.drop ? a.drop : a.levels > b.levels;
+    });
+
+    for (auto const& change : changes)
+    {
+        if (stream.loading.size() >= stream.settings.max_loads)
+        {
+            break;
+        }
+
+        auto cooked = textures.textures[change.texture]->cooked;
+        auto const& streamed = stream.textures[stream.stream_index[change.texture]];
+        stream.loading.emplace(change.texture, jobSystem().submit([cooked, texture = change.texture,
+                                                                   generation = streamed.generation,
+                                                                   first_level = streamed.target_level]
+        {
+            // Reading from the mapping is where the disk is touched.
+            auto const levels = ktx2Levels(*cooked, first_level);
+            return TextureLevelsData{texture, generation, first_level, std::vector<std::byte>(levels.begin(), levels.end())};
+        }));
+    }
+
+    stream.stats.loading = static_cast<uint32_t>(stream.loading.size());
+}
+
+void recordTextureStreamUploads(RenderingState const& state,
+                                vk::CommandBuffer const& cmd_buffer,
+                                TextureStream& stream,
+                                Textures& textures,
+                                uint32_t frame)
+{
+    uint32_t uploads = 0;
+    for (auto it = stream.loading.begin(); it != stream.loading.end() && uploads < stream.settings.max_uploads;)
+    {
+        if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+
+        auto data = it->second.get();
+        it = stream.loading.erase(it);
+
+        // Released while it was loading, the slot may have another texture by now.
+        if (textures.generations[data.texture] != data.generation || !textures.textures[data.texture])
+        {
+            continue;
+        }
+
+        vk::DeviceSize const size = data.levels.size();
+        auto staging = createBuffer(state, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+        auto mapped = staging.memory.mapMemory(0, size, static_cast<vk::MemoryMapFlagBits>(0));
+        memcpy(mapped, data.levels.data(), static_cast<size_t>(size));
+        staging.memory.unmapMemory();
+
+        auto& texture = textures.textures[data.texture];
+        if (data.first_level < texture->first_level)
+        {
+            ++stream.stats.loaded;
+        }
+        else
+        {
+            ++stream.stats.dropped;
+        }
+
+        auto replacement = createCookedTexture(state, cmd_buffer, *staging.buffer, texture->cooked, data.first_level, texture->sampler, texture->name);
+        std::swap(texture, replacement);
+
+        textures.retired.push_back({std::move(replacement), std::move(staging), textures.frames, {}});
+        for (auto& dirty : stream.dirty)
+        {
+            dirty.push_back(data.texture);
+        }
+        ++uploads;
+    }
+
+    for (auto const index : stream.dirty[frame])
+    {
+        writeTextureDescriptor(state.device, textures, index, frame);
+    }
+    stream.dirty[frame].clear();
+
+    stream.stats.loading = static_cast<uint32_t>(stream.loading.size());
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Textures.h"
+#include "VulkanRenderSystem.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct Scene;
+
+struct TextureStreamSettings
+{
+    // GPU memory of the levels of the streamed textures. When the levels the
+    // visible objects want do not fit, the largest levels are left out first.
+    size_t memory_budget{256 * 1024 * 1024};
+
+    // Added to the level every object wants, above 0 streams less detail than
+    // one texel per pixel.
+    float lod_bias{0.0f};
+
+    // Textures read at the same time on the job system, and replaced per frame.
+    uint32_t max_loads{4};
+    uint32_t max_uploads{2};
+};
+
+// The levels of a texture from first_level on, read from the mapping like
+// ktx2Levels.
+struct TextureLevelsData
+{
+    uint32_t texture;
+    uint32_t generation;
+    uint32_t first_level;
+    std::vector<std::byte> levels;
+};
+
+struct StreamedTexture
+{
+    // Slot in Textures::textures and the generation of the texture in it.
+    uint32_t texture;
+    uint32_t generation;
+
+    // The tail from this level on is always resident.
+    uint32_t tail_level;
+
+    // Largest level the visible objects want, and the one that fits the budget.
+    uint32_t wanted_level;
+    uint32_t target_level;
+};
+
+struct TextureStreamStats
+{
+    uint64_t resident_bytes{};
+    uint64_t target_bytes{};
+    uint32_t loading{};
+    uint64_t loaded{};
+    uint64_t dropped{};
+};
+
+// Streams the levels of the cooked textures uploaded with stream_cooked, see
+// createTextures. They start with their tail levels only. Every frame each one
+// gets the level that is sampled about one texel per pixel on the closest
+// visible object using it, and its levels are read from the mapping on the job
+// system. A texture with more or fewer levels gets a new image, the old one is
+// kept until no frame in flight uses it.
+//
+// Levels above the target are dropped when the resident levels are over the
+// budget, or when the texture wants at least two levels less, so a texture
+// does not get a new image every time an object moves a little.
+struct TextureStream
+{
+    TextureStreamSettings settings;
+    std::vector<StreamedTexture> textures;
+
+    // Index in textures of every slot of Textures, -1 when it does not stream.
+    std::vector<int32_t> stream_index;
+
+    // By slot in Textures::textures, one load per slot at a time.
+    std::unordered_map<uint32_t, std::future<TextureLevelsData>> loading;
+
+    // Textures to write again in the descriptor sets of each frame in flight.
+    std::vector<std::vector<uint32_t>> dirty;
+
+    TextureStreamStats stats;
+};
+
+TextureStream createTextureStream(Textures const& textures, uint32_t frames, TextureStreamSettings const& settings = {});
+
+// Once a frame, after the world bounds of the objects are updated. Follows the
+// textures acquired and released since the last frame, picks the levels of
+// every texture and starts loading the ones that change.
+void updateTextureStream(TextureStream& stream, Textures const& textures, Scene const& scene, vk::Extent2D const& extent);
+
+// Replaces the textures that finished loading, at most max_uploads a frame, and
+// writes the changed textures into the descriptor sets of the frame. Before the
+// render passes, outside of any render pass.
+void recordTextureStreamUploads(RenderingState const& state,
+                                vk::CommandBuffer const& cmd_buffer,
+                                TextureStream& stream,
+                                Textures& textures,
+                                uint32_t frame);
@@ -1,19 +1,20 @@
 #include "Textures.h"
 
 #include "VulkanRenderSystem.h"
+#include "JobSystem.h"
+#include "descriptor_set.h"
 
 #include <spdlog/spdlog.h>
 #include <stb/stb_image.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <vulkan/vulkan_enums.hpp>
 #include <vulkan/vulkan_handles.hpp>
 #include <vulkan/vulkan_structs.hpp>
 
-void generateMipmaps(RenderingState const& state, vk::Image const& image, int32_t width, int32_t height, uint32_t mip_levels)
+static void generateMipmaps(vk::CommandBuffer const& cmd_buffer, vk::Image const& image, int32_t width, int32_t height, uint32_t mip_levels)
 {
-    vk::raii::CommandBuffer cmd_buffer = beginSingleTimeCommands(state);
-
     vk::ImageMemoryBarrier barrier{};
     barrier.sType = vk::StructureType::eImageMemoryBarrier;
     barrier.image = image;
@@ -75,80 +76,253 @@ void generateMipmaps(RenderingState const& state, vk::Image const& image, int32_
 
     cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
                     vk::DependencyFlags{0}, 0, {}, barrier);
+}
 
-    endSingleTimeCommands(state, cmd_buffer);
+// Copies the pixels into a new staging buffer of the batch.
+static vk::Buffer stagePixels(RenderingState const& state, TextureUploadBatch& batch, void const* pixels, vk::DeviceSize size)
+{
+    auto staging = createBuffer(state, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    auto data = staging.memory.mapMemory(0, size, static_cast<vk::MemoryMapFlagBits>(0));
+    memcpy(data, pixels, static_cast<size_t>(size));
+    staging.memory.unmapMemory();
+
+    batch.staging.push_back(std::move(staging));
+    batch.staging_size += size;
+    return *batch.staging.back().buffer;
 }
 
-static std::tuple<vk::raii::Image, vk::raii::DeviceMemory> createImageMapTexture(RenderingState const& state, void* pixels, std::size_t width, std::size_t height, vk::Format format)
+static std::tuple<vk::raii::Image, vk::raii::DeviceMemory> createImageMapTexture(RenderingState const& state, TextureUploadBatch& batch, void* pixels, std::size_t width, std::size_t height, vk::Format format)
 {
     vk::DeviceSize image_size = width*height*4;
-    auto [staging_buffer, staging_buffer_memory] = createBuffer(state, image_size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    auto data = staging_buffer_memory.mapMemory(0, image_size, static_cast<vk::MemoryMapFlagBits>(0));
-    memcpy(data, pixels, static_cast<size_t>(image_size));
-    staging_buffer_memory.unmapMemory();
+    auto staging_buffer = stagePixels(state, batch, pixels, image_size);
 
     auto [image, image_device_memory] = createImage(state, width, height, 1, format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::SampleCountFlagBits::e1);
 
-    transitionImageLayout(state, image, format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1);
-    copyBufferToImage(state, staging_buffer, image, width, height);
-    transitionImageLayout(state, image, format, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, 1);
+    transitionImageLayout(batch.cmd_buffer, image, format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1);
+    copyBufferToImage(batch.cmd_buffer, staging_buffer, image, width, height);
+    transitionImageLayout(batch.cmd_buffer, image, format, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, 1);
 
     return {std::move(image), std::move(image_device_memory)};
 }
 
-static std::tuple<vk::raii::Image, vk::raii::DeviceMemory, uint32_t> createTextureImage(RenderingState const& state, vk::Format format, std::string const& path)
+static std::tuple<vk::raii::Image, vk::raii::DeviceMemory, uint32_t> createTextureImage(RenderingState const& state, TextureUploadBatch& batch, DecodedTexture const& decoded)
 {
-    int width, height, channels {};
+    auto const format = decoded.input.format;
+    auto const width = decoded.width;
+    auto const height = decoded.height;
 
-    int image_channels = 4;
+    uint32_t mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
 
-    int stbi_format = STBI_rgb_alpha;
-    if (format == vk::Format::eR8Unorm)
+    vk::DeviceSize image_size = width * height * decoded.channels;
+    auto staging_buffer = stagePixels(state, batch, decoded.pixels.get(), image_size);
+
+    auto [image, image_device_memory] = createImage(state, width, height, mip_levels, format, vk::ImageTiling::eOptimal,
+                        vk::ImageUsageFlagBits::eTransferDst
+                            | vk::ImageUsageFlagBits::eTransferSrc
+                            | vk::ImageUsageFlagBits::eSampled,
+                                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                vk::SampleCountFlagBits::e1);
+
+    transitionImageLayout(batch.cmd_buffer, image, format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, mip_levels);
+    copyBufferToImage(batch.cmd_buffer, staging_buffer, image, width, height);
+    generateMipmaps(batch.cmd_buffer, image, width, height, mip_levels);
+
+    return {std::move(image), std::move(image_device_memory), mip_levels};
+}
+
+uint32_t streamedTextureTailLevel(Ktx2Header const& header)
+{
+    uint32_t level = 0;
+    while (level + 1 < header.level_count && std::max(header.width, header.height) >> level > streamed_texture_tail_size)
     {
-        image_channels = 1;
-        stbi_format = STBI_grey;
+        ++level;
     }
-    //auto pixels = stbi_load("textures/far.jpg", &width, &height, &channels, STBI_rgb_alpha);
-    auto pixels = stbi_load(path.c_str(), &width, &height, &channels, stbi_format);
+    return level;
+}
 
-    if (!pixels)
+// One region per level, the levels are next to each other in staging, smallest
+// first, so they are staged straight from the mapping.
+std::unique_ptr<Texture> createCookedTexture(RenderingState const& state,
+                                             vk::CommandBuffer const& cmd_buffer,
+                                             vk::Buffer staging,
+                                             std::shared_ptr<MappedKtx2 const> cooked,
+                                             uint32_t first_level,
+                                             vk::Sampler sampler,
+                                             std::string name)
+{
+    auto const& header = cooked->header;
+    auto const format = static_cast<vk::Format>(header.vk_format);
+    auto const width = std::max(1u, header.width >> first_level);
+    auto const height = std::max(1u, header.height >> first_level);
+    auto const mip_levels = header.level_count - first_level;
+
+    std::vector<vk::BufferImageCopy> regions;
+    for (uint32_t level = 0; level < mip_levels; ++level)
     {
-        spdlog::warn("Could not load texture: {}", path);
+        vk::BufferImageCopy region{};
+        region.bufferOffset = cooked->levels[first_level + level].offset - cooked->levels.back().offset;
+        region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = vk::Extent3D(std::max(1u, width >> level), std::max(1u, height >> level), 1);
+        regions.push_back(region);
     }
 
-    uint32_t mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    auto [image, image_device_memory] = createImage(state, width, height, mip_levels, format, vk::ImageTiling::eOptimal,
+                                                    vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+                                                    vk::MemoryPropertyFlagBits::eDeviceLocal, vk::SampleCountFlagBits::e1);
+
+    transitionImageLayout(cmd_buffer, image, format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, mip_levels);
+    cmd_buffer.copyBufferToImage(staging, image, vk::ImageLayout::eTransferDstOptimal, regions);
+    transitionImageLayout(cmd_buffer, image, format, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, mip_levels);
+
+    auto image_view = createTextureImageView(state, image, format, mip_levels);
+
+    return std::make_unique<Texture>(
+        std::move(image),
+        std::move(image_device_memory),
+        std::move(image_view),
+        sampler,
+        std::move(name),
+        mip_levels,
+        std::move(cooked),
+        first_level);
+}
+
+TextureUploadBatch beginTextureUploads(RenderingState const& state)
+{
+    return TextureUploadBatch{.cmd_buffer = beginSingleTimeCommands(state)};
+}
+
+void submitTextureUploads(RenderingState const& state, TextureUploadBatch& batch)
+{
+    vk::CommandBuffer cmd_buffer = batch.cmd_buffer;
+    checkResult(cmd_buffer.end());
+    if (batch.textures == 0)
+    {
+        return;
+    }
+
+    vk::FenceCreateInfo fence_info{};
+    fence_info.sType = vk::StructureType::eFenceCreateInfo;
+    auto fence = state.device.createFence(fence_info).value();
 
-    vk::DeviceSize image_size = width * height * image_channels;
+    vk::SubmitInfo submit_info{};
+    submit_info.sType = vk::StructureType::eSubmitInfo;
+    submit_info.commandBufferCount = 1;
+    submit_info.setCommandBuffers(cmd_buffer);
 
-    auto [staging_buffer, staging_buffer_memory] = createBuffer(state, image_size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    state.graphics_queue.submit(submit_info, *fence);
+    checkResult(state.device.waitForFences({*fence}, true, ~0));
+
+    spdlog::info("Uploaded {} textures from {} MB of staging memory in one submit",
+                 batch.textures, batch.staging_size / (1024 * 1024));
+
+    batch.staging.clear();
+    batch.staging_size = 0;
+    batch.textures = 0;
+}
 
-    auto data = staging_buffer_memory.mapMemory(0, image_size, static_cast<vk::MemoryMapFlagBits>(0));
-    memcpy(data, pixels, static_cast<size_t>(image_size));
-    staging_buffer_memory.unmapMemory();
+void DecodedTexture::PixelDeleter::operator()(unsigned char* pixels) const
+{
     stbi_image_free(pixels);
+}
 
-    auto [image, image_device_memory] = createImage(state, width, height, mip_levels, format, vk::ImageTiling::eOptimal,
-                        vk::ImageUsageFlagBits::eTransferDst
-                            | vk::ImageUsageFlagBits::eTransferSrc
-                            | vk::ImageUsageFlagBits::eSampled,
-                                vk::MemoryPropertyFlagBits::eDeviceLocal,
-                                vk::SampleCountFlagBits::e1);
+static bool isSrgb(vk::Format format)
+{
+    return format == vk::Format::eR8G8B8A8Srgb || format == vk::Format::eB8G8R8A8Srgb || format == vk::Format::eR8G8B8Srgb;
+}
 
-    transitionImageLayout(state, image, format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, mip_levels);
-    copyBufferToImage(state, staging_buffer, image, width, height);
-    generateMipmaps(state, image, width, height, mip_levels);
+DecodedTexture decodeTexture(TextureInput const& input, bool cooked)
+{
+    DecodedTexture decoded{.input = input};
 
-    return {std::move(image), std::move(image_device_memory), mip_levels};
+    auto const cooked_path = std::filesystem::path(input.path).replace_extension(".ktx2");
+    if (cooked && input.texture_type == TextureType::MipMap && std::filesystem::exists(cooked_path))
+    {
+        auto cooked_texture = mapKtx2(cooked_path.string());
+        if (cooked_texture && ktx2FormatIsSrgb(cooked_texture->header.vk_format) != isSrgb(input.format))
+        {
+            spdlog::warn("{} is not cooked in the color space of {}, decoding the image instead", cooked_path.string(), input.path);
+        }
+        else if (cooked_texture)
+        {
+            decoded.width = cooked_texture->header.width;
+            decoded.height = cooked_texture->header.height;
+            decoded.cooked = std::make_shared<MappedKtx2 const>(std::move(*cooked_texture));
+            return decoded;
+        }
+    }
+
+    // Single channel formats are only supported for mip mapped textures.
+    decoded.channels = 4;
+    int stbi_format = STBI_rgb_alpha;
+    if (input.texture_type == TextureType::MipMap && input.format == vk::Format::eR8Unorm)
+    {
+        decoded.channels = 1;
+        stbi_format = STBI_grey;
+    }
+
+    int channels{};
+    decoded.pixels.reset(stbi_load(input.path.c_str(), &decoded.width, &decoded.height, &channels, stbi_format));
+
+    if (!decoded.pixels)
+    {
+        spdlog::warn("Could not load texture: {}", input.path);
+    }
+
+    return decoded;
 }
 
-std::unique_ptr<Texture> createTexture(RenderingState const& state, std::string const& path, TextureType type, vk::Format format, vk::Sampler sampler)
+std::vector<std::future<DecodedTexture>> decodeTextures(std::vector<TextureInput> const& inputs)
 {
-    if (type == TextureType::MipMap)
+    std::vector<std::future<DecodedTexture>> decoded;
+    decoded.reserve(inputs.size());
+
+    for (auto const& input : inputs)
     {
-        auto [image, mem, mip_maps] = createTextureImage(state, format, path);
-        auto image_view = createTextureImageView(state, image, format, mip_maps);
+        decoded.push_back(jobSystem().submit([input]{ return decodeTexture(input); }));
+    }
 
-        auto file_name = std::filesystem::path(path).filename().string();
+    return decoded;
+}
+
+std::unique_ptr<Texture> uploadTexture(RenderingState const& state, TextureUploadBatch& batch, DecodedTexture const& decoded, vk::Sampler sampler, bool stream_cooked)
+{
+    if (decoded.cooked && !state.texture_compression_bc)
+    {
+        spdlog::warn("BC textures are not supported, decoding {} instead of the cooked texture", decoded.input.path);
+        return uploadTexture(state, batch, decodeTexture(decoded.input, false), sampler);
+    }
+
+    if (!decoded.pixels && !decoded.cooked)
+    {
+        return {};
+    }
+
+    auto const format = decoded.input.format;
+    auto file_name = std::filesystem::path(decoded.input.path).filename().string();
+    ++batch.textures;
+
+    if (decoded.cooked)
+    {
+        auto const first_level = stream_cooked ? streamedTextureTailLevel(decoded.cooked->header) : 0;
+        auto const levels = ktx2Levels(*decoded.cooked, first_level);
+        auto staging_buffer = stagePixels(state, batch, levels.data(), levels.size());
+
+        auto texture = createCookedTexture(state, batch.cmd_buffer, staging_buffer, decoded.cooked, first_level, sampler, file_name);
+        if (!stream_cooked)
+        {
+            // Only textures that stream keep the file mapped.
+            texture->cooked.reset();
+        }
+        return texture;
+    }
+    else if (decoded.input.texture_type == TextureType::MipMap)
+    {
+        auto [image, mem, mip_maps] = createTextureImage(state, batch, decoded);
+        auto image_view = createTextureImageView(state, image, format, mip_maps);
 
         return std::make_unique<Texture>(
             std::move(image),
@@ -160,21 +334,9 @@ std::unique_ptr<Texture> createTexture(RenderingState const& state, std::string
     }
     else
     {
-        int width, height, channels{};
-        auto pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-
-        if (!pixels)
-        {
-            spdlog::warn("Could not load texture", path);
-            return {};
-        }
-
-        auto [image, mem] = createImageMapTexture(state, pixels, width,height, format);
-        stbi_image_free(pixels);
+        auto [image, mem] = createImageMapTexture(state, batch, decoded.pixels.get(), decoded.width, decoded.height, format);
         auto image_view = createTextureImageView(state, image, format, 1);
 
-        auto file_name = std::filesystem::path(path).filename().string();
-
         return std::make_unique<Texture>(
             std::move(image),
             std::move(mem),
@@ -185,18 +347,229 @@ std::unique_ptr<Texture> createTexture(RenderingState const& state, std::string
     }
 }
 
-Textures createTextures(RenderingState const& core, std::vector<TextureInput> const& paths)
+std::unique_ptr<Texture> uploadTexture(RenderingState const& state, DecodedTexture const& decoded, vk::Sampler sampler)
 {
-    Textures textures{.sampler_mip_map = createTextureSampler(core, true),
-                      .sampler_no_mip_map = createTextureSampler(core, false),
-                      .sampler_depth = createDepthTextureSampler(core)};
+    auto batch = beginTextureUploads(state);
+    auto texture = uploadTexture(state, batch, decoded, sampler);
+    submitTextureUploads(state, batch);
+    return texture;
+}
 
-    for (auto const& path : paths)
+std::unique_ptr<Texture> createTexture(RenderingState const& state, std::string const& path, TextureType type, vk::Format format, vk::Sampler sampler)
+{
+    return uploadTexture(state, decodeTexture({path, type, format}), sampler);
+}
+
+TextureKey textureKey(TextureInput const& input)
+{
+    return {std::filesystem::path(input.path).lexically_normal().string(), input.format, input.texture_type};
+}
+
+vk::DeviceSize textureMemorySize(Texture const& texture)
+{
+    return texture.image.getMemoryRequirements().size;
+}
+
+Textures createTextures(RenderingState const& core)
+{
+    return Textures{.sampler_mip_map = createTextureSampler(core, true),
+                    .sampler_no_mip_map = createTextureSampler(core, false),
+                    .sampler_depth = createDepthTextureSampler(core),
+                    .frames = static_cast<uint32_t>(core.command_buffer.size())};
+}
+
+// A free slot for a texture, nullopt when the texture array is full.
+static std::optional<uint32_t> allocateSlot(Textures& textures)
+{
+    if (!textures.free_slots.empty())
+    {
+        auto const slot = textures.free_slots.back();
+        textures.free_slots.pop_back();
+        return slot;
+    }
+
+    if (textures.textures.size() >= max_textures)
+    {
+        return {};
+    }
+
+    textures.textures.emplace_back();
+    textures.generations.push_back(1);
+    textures.references.push_back(0);
+    return static_cast<uint32_t>(textures.textures.size() - 1);
+}
+
+std::vector<TextureHandle> acquireTextures(RenderingState const& core, Textures& textures, std::vector<TextureInput> const& inputs, bool stream_cooked)
+{
+    std::vector<TextureHandle> handles(inputs.size());
+
+    // The textures to load and the inputs that asked for each one.
+    std::vector<TextureInput> misses;
+    std::vector<std::vector<size_t>> requests;
+    std::map<TextureKey, size_t> pending;
+
+    auto& stats = textures.registry_stats;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        auto key = textureKey(inputs[i]);
+        if (auto const loaded = textures.registry.find(key); loaded != textures.registry.end())
+        {
+            auto const slot = loaded->second;
+            handles[i] = {slot, textures.generations[slot]};
+            ++textures.references[slot];
+            ++stats.hits;
+            stats.bytes_saved += textureMemorySize(*textures.textures[slot]);
+        }
+        else if (auto const miss = pending.find(key); miss != pending.end())
+        {
+            requests[miss->second].push_back(i);
+        }
+        else
+        {
+            pending.emplace(std::move(key), misses.size());
+            misses.push_back(inputs[i]);
+            requests.push_back({i});
+        }
+    }
+
+    // Recorded in order as each decode finishes. A batch is only begun for a
+    // texture to upload, and submitted early when the staging memory reaches
+    // the budget.
+    std::vector<uint32_t> loaded;
+    auto decoded = decodeTextures(misses);
+    std::optional<TextureUploadBatch> batch;
+    for (size_t miss = 0; miss < decoded.size(); ++miss)
+    {
+        auto const texture = decoded[miss].get();
+        vk::Sampler sampler = texture.input.texture_type == TextureType::MipMap ? textures.sampler_mip_map: textures.sampler_no_mip_map;
+
+        if (!batch)
+        {
+            batch.emplace(beginTextureUploads(core));
+        }
+        auto uploaded = uploadTexture(core, *batch, texture, sampler, stream_cooked);
+        if (batch->staging_size >= texture_upload_staging_budget)
+        {
+            submitTextureUploads(core, *batch);
+            batch.reset();
+        }
+
+        if (!uploaded)
+        {
+            continue;
+        }
+
+        auto const slot = allocateSlot(textures);
+        if (!slot)
+        {
+            // The batch may not be submitted yet.
+            spdlog::warn("No free texture slot for {}, at most {} textures", texture.input.path, max_textures);
+            textures.retired.push_back({std::move(uploaded), Buffer{nullptr, nullptr}, textures.frames, {}});
+            continue;
+        }
+
+        auto const bytes = textureMemorySize(*uploaded);
+        textures.textures[*slot] = std::move(uploaded);
+        textures.references[*slot] = static_cast<uint32_t>(requests[miss].size());
+        textures.registry.emplace(textureKey(texture.input), *slot);
+        loaded.push_back(*slot);
+
+        for (auto const request : requests[miss])
+        {
+            handles[request] = {*slot, textures.generations[*slot]};
+        }
+
+        ++stats.misses;
+        stats.hits += requests[miss].size() - 1;
+        stats.bytes_saved += (requests[miss].size() - 1) * bytes;
+    }
+    if (batch)
     {
-        vk::Sampler sampler = path.texture_type == TextureType::MipMap ? textures.sampler_mip_map: textures.sampler_no_mip_map;
-        textures.textures.push_back(createTexture(core, path.path, path.texture_type,
-                                            path.format, sampler));
+        submitTextureUploads(core, *batch);
     }
 
-    return textures;
+    // No frame in flight samples a free slot, they are written to every frame.
+    for (auto const slot : loaded)
+    {
+        for (uint32_t frame = 0; frame < textures.frames; ++frame)
+        {
+            writeTextureDescriptor(core.device, textures, slot, frame);
+        }
+    }
+
+    spdlog::info("Textures: {} requests, {} loaded, {} shared a loaded texture, {} MB saved so far",
+                 inputs.size(), loaded.size(), inputs.size() - misses.size(), stats.bytes_saved / (1024 * 1024));
+
+    return handles;
+}
+
+bool isTextureLoaded(Textures const& textures, TextureHandle handle)
+{
+    return handle.generation != 0 && handle.slot < textures.textures.size()
+        && textures.generations[handle.slot] == handle.generation && textures.textures[handle.slot];
+}
+
+void releaseTexture(Textures& textures, TextureHandle handle)
+{
+    if (!isTextureLoaded(textures, handle) || textures.references[handle.slot] == 0)
+    {
+        spdlog::warn("Released texture {} of generation {} without a reference", handle.slot, handle.generation);
+        return;
+    }
+
+    auto const slot = handle.slot;
+    if (--textures.references[slot] > 0)
+    {
+        return;
+    }
+
+    std::erase_if(textures.registry, [slot](auto const& entry) { return entry.second == slot; });
+    ++textures.generations[slot];
+    textures.retired.push_back({std::move(textures.textures[slot]), Buffer{nullptr, nullptr}, textures.frames, slot});
+}
+
+TextureHandle reloadTexture(RenderingState const& core, Textures& textures, TextureHandle handle, bool stream_cooked)
+{
+    auto const entry = std::ranges::find_if(textures.registry, [slot = handle.slot](auto const& loaded) { return loaded.second == slot; });
+    if (!isTextureLoaded(textures, handle) || entry == textures.registry.end())
+    {
+        return {};
+    }
+
+    // Out of the registry the texture is a miss and is loaded again.
+    auto const key = entry->first;
+    textures.registry.erase(entry);
+    auto const reloaded = acquireTextures(core, textures, {{key.path, key.texture_type, key.format}}, stream_cooked).front();
+    if (!isTextureLoaded(textures, reloaded))
+    {
+        textures.registry.emplace(key, handle.slot);
+        return {};
+    }
+
+    textures.references[reloaded.slot] = textures.references[handle.slot];
+    textures.references[handle.slot] = 1;
+    releaseTexture(textures, handle);
+    return reloaded;
+}
+
+int textureSlot(Textures const& textures, TextureHandle handle)
+{
+    return isTextureLoaded(textures, handle) ? static_cast<int>(handle.slot) : -1;
+}
+
+void collectRetiredTextures(Textures& textures)
+{
+    std::erase_if(textures.retired, [&textures](RetiredTexture& retired)
+    {
+        if (--retired.frames > 0)
+        {
+            return false;
+        }
+
+        if (retired.free_slot)
+        {
+            textures.free_slots.push_back(*retired.free_slot);
+        }
+        return true;
+    });
 }
@@ -1,7 +1,13 @@
 #pragma once
 
+#include "Ktx2.h"
 #include "VulkanRenderSystem.h"
 
+#include <future>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 struct Texture
@@ -16,14 +22,19 @@ struct Texture
     std::string const name;
 
     uint32_t mip_levels;
+
+    // The cooked file of a texture that streams its levels, see TextureStreaming.h.
+    // Level 0 of the image is first_level of the file.
+    std::shared_ptr<MappedKtx2 const> cooked;
+    uint32_t first_level{};
 };
 
-struct Textures
+// A descriptor set of every frame in flight the whole texture array is written to.
+struct TextureArrayBinding
 {
-    vk::raii::Sampler sampler_mip_map;
-    vk::raii::Sampler sampler_no_mip_map;
-    vk::raii::Sampler sampler_depth;
-    std::vector<std::unique_ptr<Texture>> textures;
+    std::vector<vk::DescriptorSet> sets;
+    uint32_t binding;
+    vk::DescriptorType type;
 };
 
 enum class TextureType
@@ -39,8 +50,195 @@ struct TextureInput
     vk::Format format;
 };
 
-Textures createTextures(RenderingState const& core,
-                        std::vector<TextureInput> const& paths);
+// What a texture was loaded from. The same image loaded with another format or
+// type is another texture.
+struct TextureKey
+{
+    std::string path;
+    vk::Format format;
+    TextureType texture_type;
+
+    auto operator<=>(TextureKey const&) const = default;
+};
+
+TextureKey textureKey(TextureInput const& input);
+
+struct TextureRegistryStats
+{
+    // Requests that got a texture that was already loaded, and the ones that
+    // loaded one.
+    uint64_t hits{};
+    uint64_t misses{};
+
+    // GPU memory the hits would have taken as textures of their own.
+    uint64_t bytes_saved{};
+};
+
+// Size of the texture array of the shaders, the slots of Textures.
+constexpr uint32_t max_textures = 32;
+
+// A texture of Textures. The slot is its index in the texture array of the
+// shaders and stays the same while the texture is loaded, also when it streams
+// its levels. The generation tells the handle apart from the handles of the
+// textures that had the slot before, generation 0 is no texture.
+struct TextureHandle
+{
+    uint32_t slot{};
+    uint32_t generation{};
+};
+
+// A texture that was replaced or released and the staging of its replacement,
+// kept until the frames in flight that may still sample them are done. The slot
+// of a released texture is only reused then.
+struct RetiredTexture
+{
+    std::unique_ptr<Texture> texture;
+    Buffer staging;
+    uint32_t frames;
+    std::optional<uint32_t> free_slot;
+};
+
+struct Textures
+{
+    vk::raii::Sampler sampler_mip_map;
+    vk::raii::Sampler sampler_no_mip_map;
+    vk::raii::Sampler sampler_depth;
+
+    // By slot, a released slot has no texture until it is reused.
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> free_slots;
+
+    // Slot in textures of every loaded texture and the references to each slot,
+    // see acquireTextures.
+    std::map<TextureKey, uint32_t> registry;
+    std::vector<uint32_t> references;
+    TextureRegistryStats registry_stats;
+
+    uint32_t frames{};
+    std::vector<RetiredTexture> retired;
+
+    // Where the texture array is bound, see bindTextures. Slots are written to
+    // them when a texture is loaded, and again when a streamed texture gets a
+    // new image.
+    std::vector<TextureArrayBinding> bindings;
+};
+
+// Cooked textures that stream their levels start out with the levels of at most
+// this size, the larger ones are streamed in when they are needed.
+constexpr uint32_t streamed_texture_tail_size = 128;
+
+uint32_t streamedTextureTailLevel(Ktx2Header const& header);
+
+// Pixels of a texture decoded on the CPU, waiting to be uploaded. Decoding does not
+// touch Vulkan and can run on any thread.
+//
+// A mip mapped texture with a .ktx2 of the same name next to it, see
+// tools/TextureCooker.cpp, is not decoded. The cooked file is mapped instead and
+// its blocks and mip levels are uploaded as they are.
+struct DecodedTexture
+{
+    struct PixelDeleter
+    {
+        void operator()(unsigned char* pixels) const;
+    };
+
+    TextureInput input;
+    int width{};
+    int height{};
+    int channels{};
+    std::unique_ptr<unsigned char, PixelDeleter> pixels;
+    std::shared_ptr<MappedKtx2 const> cooked;
+};
+
+// The image is decoded even when there is a cooked texture if cooked is not set.
+DecodedTexture decodeTexture(TextureInput const& input, bool cooked = true);
+
+// Starts decoding every texture on the job system.
+std::vector<std::future<DecodedTexture>> decodeTextures(std::vector<TextureInput> const& inputs);
+
+// Uploads of textures recorded into one command buffer: the staging copies, the
+// layout transitions and the mip map blits of every texture. Submitted with one
+// fence, instead of a queue wait for each step of each texture. The textures can
+// only be used and the staging buffers are only freed once it is submitted.
+struct TextureUploadBatch
+{
+    vk::raii::CommandBuffer cmd_buffer;
+    std::vector<Buffer> staging;
+    vk::DeviceSize staging_size{};
+    size_t textures{};
+};
+
+// Staging memory createTextures lets a batch hold before it submits it and starts
+// the next one. The decoded 4K textures would take more than a GB otherwise.
+constexpr vk::DeviceSize texture_upload_staging_budget = 256 * 1024 * 1024;
+
+TextureUploadBatch beginTextureUploads(RenderingState const& state);
+
+// Ends the batch, then submits it and waits for it. Nothing is submitted for an
+// empty batch. Has to be begun again to record more uploads.
+void submitTextureUploads(RenderingState const& state, TextureUploadBatch& batch);
+
+// The samplers, without any textures.
+Textures createTextures(RenderingState const& core);
+
+// A handle to every input. An input that is already loaded, or that comes more
+// than once, gets the handle of that texture and one more reference to it. The
+// others are decoded on the job system, once each, uploaded in as few batches as
+// the staging budget allows and get a free slot. Their slots are written to the
+// bound texture arrays, which are update after bind, so textures can be acquired
+// while frames are in flight. A texture that could not be loaded, or that finds
+// no free slot, gets a handle of generation 0.
+//
+// With stream_cooked the cooked textures only get their tail levels uploaded.
+std::vector<TextureHandle> acquireTextures(RenderingState const& core,
+                                           Textures& textures,
+                                           std::vector<TextureInput> const& inputs,
+                                           bool stream_cooked = false);
+
+// Drops a reference taken by acquireTextures. The last one retires the texture,
+// its slot is reused once no frame in flight can sample it.
+void releaseTexture(Textures& textures, TextureHandle handle);
+
+bool isTextureLoaded(Textures const& textures, TextureHandle handle);
+
+// Loads the texture of handle again from its file into a free slot. The
+// references to the old texture move to the new one, every handle to the old
+// texture has to be replaced with the returned handle, and the old texture is
+// retired. When the texture can not be loaded again the old one stays as it is
+// and a handle of generation 0 is returned.
+TextureHandle reloadTexture(RenderingState const& core, Textures& textures, TextureHandle handle, bool stream_cooked = false);
+
+// Slot of the texture of a handle for the materials, -1 when it is not loaded.
+int textureSlot(Textures const& textures, TextureHandle handle);
+
+// Once a frame, after the fence of the frame is waited for. Frees the retired
+// textures no frame in flight uses any more.
+void collectRetiredTextures(Textures& textures);
+
+// GPU memory of the image of a texture.
+vk::DeviceSize textureMemorySize(Texture const& texture);
+std::unique_ptr<Texture> uploadTexture(RenderingState const& state,
+                                       TextureUploadBatch& batch,
+                                       DecodedTexture const& decoded,
+                                       vk::Sampler sampler,
+                                       bool stream_cooked = false);
+
+// Image of the levels from first_level on of a cooked texture. staging holds
+// them like ktx2Levels, the copy and the layout transitions are recorded into
+// cmd_buffer and staging has to live until it is done.
+std::unique_ptr<Texture> createCookedTexture(RenderingState const& state,
+                                             vk::CommandBuffer const& cmd_buffer,
+                                             vk::Buffer staging,
+                                             std::shared_ptr<MappedKtx2 const> cooked,
+                                             uint32_t first_level,
+                                             vk::Sampler sampler,
+                                             std::string name);
+
+// A batch of its own for one texture.
+std::unique_ptr<Texture> uploadTexture(RenderingState const& state,
+                                       DecodedTexture const& decoded,
+                                       vk::Sampler sampler);
 std::unique_ptr<Texture> createTexture(RenderingState const& state,
                                        std::string const& path,
                                        TextureType type,
@@ -77,6 +77,7 @@ struct Program
     std::array<char, 50> compute_shader{{}};
 
     PolygonMode polygon_mode = PolygonMode::Fill;
+    VertexFormat vertex_format = VertexFormat::Full;
 
     std::vector<Buffer> buffers;
 };
@@ -23,6 +23,7 @@
 
 #include <algorithm>
 #include <set>
+#include <string>
 
 #include <spdlog/spdlog.h>
 
@@ -291,7 +292,7 @@ static bool isDeviceSuitable(vk::PhysicalDevice const& device, vk::SurfaceKHR co
     return true;
 }
 
-static vk::raii::Device createLogicalDevice(vk::raii::PhysicalDevice const& physical_device, QueueFamilyIndices const& indices)
+static std::optional<vk::raii::Device> createLogicalDevice(vk::raii::PhysicalDevice const& physical_device, QueueFamilyIndices const& indices)
 {
     //
     // Local devices
@@ -327,6 +328,7 @@ static vk::raii::Device createLogicalDevice(vk::raii::PhysicalDevice const& phys
     vk::PhysicalDeviceFeatures device_features{};
     device_features.samplerAnisotropy = true;
     device_features.tessellationShader = true;
+    device_features.textureCompressionBC = physical_device.getFeatures().textureCompressionBC;
     
     vk::PhysicalDeviceVulkan11Features f{};
     f.shaderDrawParameters = true;
@@ -337,15 +339,42 @@ static vk::raii::Device createLogicalDevice(vk::raii::PhysicalDevice const& phys
     desc_indexing_features.runtimeDescriptorArray = true;
     desc_indexing_features.descriptorBindingVariableDescriptorCount = true;
     desc_indexing_features.descriptorBindingPartiallyBound = true;
+    desc_indexing_features.descriptorBindingSampledImageUpdateAfterBind = true;
+    desc_indexing_features.descriptorBindingUpdateUnusedWhilePending = true;
+
+    // The texture arrays are written while frames that use them are in flight,
+    // see isUpdateAfterBindBinding.
+    auto const supported_features = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeatures>();
+    auto const& supported_indexing = supported_features.get<vk::PhysicalDeviceDescriptorIndexingFeatures>();
+    std::string missing_indexing;
+    if (!supported_indexing.shaderSampledImageArrayNonUniformIndexing) missing_indexing += " shaderSampledImageArrayNonUniformIndexing";
+    if (!supported_indexing.runtimeDescriptorArray) missing_indexing += " runtimeDescriptorArray";
+    if (!supported_indexing.descriptorBindingVariableDescriptorCount) missing_indexing += " descriptorBindingVariableDescriptorCount";
+    if (!supported_indexing.descriptorBindingPartiallyBound) missing_indexing += " descriptorBindingPartiallyBound";
+    if (!supported_indexing.descriptorBindingSampledImageUpdateAfterBind) missing_indexing += " descriptorBindingSampledImageUpdateAfterBind";
+    if (!supported_indexing.descriptorBindingUpdateUnusedWhilePending) missing_indexing += " descriptorBindingUpdateUnusedWhilePending";
+    if (!missing_indexing.empty())
+    {
+        spdlog::error("The device does not support the descriptor indexing features the texture arrays need:{}", missing_indexing);
+        return {};
+    }
 
     desc_indexing_features.pNext = &f;
 
-    static const std::vector<const char*> device_extensions = {
+    std::vector<const char*> device_extensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
         VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME,
     };
 
+    // The shadow pass sets the vertex stride per draw with vkCmdBindVertexBuffers2,
+    // which is core in Vulkan 1.3.
+    if (physical_device.getProperties().apiVersion < VK_API_VERSION_1_3)
+    {
+        spdlog::error("The device needs Vulkan 1.3 for the dynamic vertex stride of the shadow pass");
+        return {};
+    }
+
     vk::DeviceCreateInfo device_info;
     device_info.enabledExtensionCount = device_extensions.size();
     device_info.setPpEnabledExtensionNames(device_extensions.data());
@@ -838,7 +867,12 @@ std::optional<RenderingState> createVulkanRenderState()
     auto const msaa_samples = getMaxUsableSampleCount(*physical_device);
     auto const indices = findQueueFamilies(*physical_device, surface);
 
-    auto device = createLogicalDevice(*physical_device, indices);
+    auto logical_device = createLogicalDevice(*physical_device, indices);
+    if (!logical_device)
+    {
+        return {};
+    }
+    auto device = std::move(*logical_device);
 
     auto sc = createSwapchain(*physical_device, device, surface, window, indices);
 
@@ -874,7 +908,8 @@ std::optional<RenderingState> createVulkanRenderState()
         .graphics_queue = std::move(graphics_queue),
         .present_queue = std::move(present_queue),
         .msaa = msaa_samples,
-        .uniform_buffer_alignment_min = uniform_buffer_alignment_min
+        .uniform_buffer_alignment_min = uniform_buffer_alignment_min,
+        .texture_compression_bc = physical_device->getFeatures().textureCompressionBC == VK_TRUE
     };
 
     return render_state;
@@ -1114,6 +1149,13 @@ void copyBufferToImage(RenderingState const& state, vk::Buffer buffer, vk::Image
 {
     auto cmd_buffer = beginSingleTimeCommands(state);
 
+    copyBufferToImage(cmd_buffer, buffer, image, width, height);
+
+    endSingleTimeCommands(state, cmd_buffer);
+}
+
+void copyBufferToImage(vk::CommandBuffer const& cmd_buffer, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height)
+{
     vk::BufferImageCopy region {};
     region.bufferOffset = 0;
     region.bufferRowLength = 0;
@@ -1127,8 +1169,6 @@ void copyBufferToImage(RenderingState const& state, vk::Buffer buffer, vk::Image
     region.imageExtent = vk::Extent3D(width,height,1);
 
     cmd_buffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
-
-    endSingleTimeCommands(state, cmd_buffer);
 }
 
 Buffer createBuffer(RenderingState const& state,
@@ -1227,9 +1267,9 @@ vk::raii::Sampler createTextureSampler(RenderingState const& state, bool mip_map
 }
 
 
-Buffer createVertexBuffer(RenderingState const& state, std::vector<Vertex> const& vertices)
+Buffer createVertexBuffer(RenderingState const& state, std::span<std::byte const> vertices)
 {
-    vk::DeviceSize buffer_size = sizeof(Vertex) * vertices.size();
+    vk::DeviceSize buffer_size = vertices.size_bytes();
     auto [staging_buffer, staging_buffer_memory] = createBuffer(state,
                                buffer_size, vk::BufferUsageFlagBits::eTransferSrc,
                                vk::MemoryPropertyFlagBits::eHostVisible
@@ -1239,8 +1279,10 @@ Buffer createVertexBuffer(RenderingState const& state, std::vector<Vertex> const
     memcpy(data, vertices.data(), buffer_size);
     staging_buffer_memory.unmapMemory();
 
+    // Also read as storage by the displacement bake, see DisplacementBake.h.
     auto [vertex_buffer, vertex_buffer_memory] = createBuffer(state, buffer_size,  vk::BufferUsageFlagBits::eTransferDst
-                                                  | vk::BufferUsageFlagBits::eVertexBuffer,
+                                                  | vk::BufferUsageFlagBits::eVertexBuffer
+                                                  | vk::BufferUsageFlagBits::eStorageBuffer,
                                       vk::MemoryPropertyFlagBits::eDeviceLocal);
 
     copyBuffer(state, staging_buffer, vertex_buffer, buffer_size);
@@ -1248,9 +1290,9 @@ Buffer createVertexBuffer(RenderingState const& state, std::vector<Vertex> const
     return {std::move(vertex_buffer), std::move(vertex_buffer_memory)};
 }
 
-Buffer createIndexBuffer(RenderingState const& state, std::vector<uint32_t> indices)
+Buffer createIndexBuffer(RenderingState const& state, std::span<std::byte const> indices)
 {
-    vk::DeviceSize buffer_size = sizeof(decltype(indices)::value_type) * indices.size();
+    vk::DeviceSize buffer_size = indices.size_bytes();
 
     auto [staging_buffer, staging_buffer_memory] = createBuffer(state,
                                buffer_size, vk::BufferUsageFlagBits::eTransferSrc,
@@ -23,6 +23,7 @@
 
 #include <memory>
 #include <queue>
+#include <span>
 #include <optional>
 #include <iostream>
 
@@ -156,6 +157,9 @@ struct RenderingState
     vk::SampleCountFlagBits msaa;
 
     uint32_t uniform_buffer_alignment_min{};
+
+    // BC compressed formats can be sampled, the cooked textures need them.
+    bool texture_compression_bc{};
 };
 
 struct GraphicsPipelineInput
@@ -186,11 +190,33 @@ DepthResources createDepth(RenderingState const& state, vk::SampleCountFlagBits
 vk::raii::CommandBuffer beginSingleTimeCommands(RenderingState const& state);
 
 void endSingleTimeCommands(RenderingState const& state, vk::CommandBuffer const& cmd_buffer);
-Buffer createVertexBuffer(RenderingState const& state, std::vector<Vertex> const& vertices);
-Buffer createIndexBuffer(RenderingState const& state, std::vector<uint32_t> indices);
+Buffer createVertexBuffer(RenderingState const& state, std::span<std::byte const> vertices);
+
+inline Buffer createVertexBuffer(RenderingState const& state, std::span<Vertex const> vertices)
+{
+    return createVertexBuffer(state, std::as_bytes(vertices));
+}
+
+inline Buffer createVertexBuffer(RenderingState const& state, std::span<PackedVertex const> vertices)
+{
+    return createVertexBuffer(state, std::as_bytes(vertices));
+}
+
+Buffer createIndexBuffer(RenderingState const& state, std::span<std::byte const> indices);
+
+inline Buffer createIndexBuffer(RenderingState const& state, std::span<uint32_t const> indices)
+{
+    return createIndexBuffer(state, std::as_bytes(indices));
+}
+
+inline Buffer createIndexBuffer(RenderingState const& state, std::span<uint16_t const> indices)
+{
+    return createIndexBuffer(state, std::as_bytes(indices));
+}
 void transitionImageLayout(RenderingState const& state, vk::Image const& image, vk::Format const& format, vk::ImageLayout old_layout, vk::ImageLayout new_layout, uint32_t mip_levels, uint32_t layer_count = 1);
 void transitionImageLayout(vk::CommandBuffer const& cmd_buffer, vk::Image const& image, vk::Format const& format, vk::ImageLayout old_layout, vk::ImageLayout new_layout, uint32_t mip_levels, uint32_t layer_count = 1);
 void copyBufferToImage(RenderingState const& state, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height);
+void copyBufferToImage(vk::CommandBuffer const& cmd_buffer, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height);
 vk::raii::ImageView createTextureImageView(RenderingState const& state, vk::Image const& texture_image, vk::Format format, uint32_t mip_levels, uint32_t level_count = 1);
 vk::raii::Sampler createTextureSampler(RenderingState const& state, bool mip_maps);
 Buffer createBuffer(RenderingState const& state,
@@ -280,51 +306,109 @@ inline void writeBuffer(UniformBuffer& dst, BufferObject const& src, size_t inde
     memcpy(buffer, (unsigned char*)&src, sizeof(BufferObject));
 }
 
-template<typename Vertex>
+template<typename T>
+struct VertexAttributeFormat;
+
+template<glm::qualifier Q>
+struct VertexAttributeFormat<glm::vec<2, float, Q>> { static constexpr vk::Format value = vk::Format::eR32G32Sfloat; };
+
+template<glm::qualifier Q>
+struct VertexAttributeFormat<glm::vec<3, float, Q>> { static constexpr vk::Format value = vk::Format::eR32G32B32Sfloat; };
+
+template<glm::qualifier Q>
+struct VertexAttributeFormat<glm::vec<4, float, Q>> { static constexpr vk::Format value = vk::Format::eR32G32B32A32Sfloat; };
+
+template<>
+struct VertexAttributeFormat<Half2> { static constexpr vk::Format value = vk::Format::eR16G16Sfloat; };
+
+template<>
+struct VertexAttributeFormat<Snorm16x2> { static constexpr vk::Format value = vk::Format::eR16G16Snorm; };
+
+template<>
+struct VertexAttributeFormat<Unorm16x2> { static constexpr vk::Format value = vk::Format::eR16G16Unorm; };
+
+template<>
+struct VertexAttributeFormat<Snorm16x4> { static constexpr vk::Format value = vk::Format::eR16G16B16A16Snorm; };
+
+struct VertexAttribute
+{
+    vk::Format format;
+    uint32_t offset;
+};
+
+// The format is derived from the type of the member.
+#define VERTEX_ATTRIBUTE(VertexType, member) \
+    VertexAttribute{VertexAttributeFormat<decltype(VertexType::member)>::value, offsetof(VertexType, member)}
+
+// Vertex attributes in shader location order.
+template<typename V>
+struct VertexLayout;
+
+template<>
+struct VertexLayout<Vertex>
+{
+    static constexpr std::array attributes {
+        VERTEX_ATTRIBUTE(Vertex, pos),
+        VERTEX_ATTRIBUTE(Vertex, tex_coord),
+        VERTEX_ATTRIBUTE(Vertex, normal),
+        VERTEX_ATTRIBUTE(Vertex, normal_coord),
+        VERTEX_ATTRIBUTE(Vertex, tangent),
+        VERTEX_ATTRIBUTE(Vertex, bitangent),
+    };
+};
+
+template<>
+struct VertexLayout<PackedVertex>
+{
+    static constexpr std::array attributes {
+        VERTEX_ATTRIBUTE(PackedVertex, pos),
+        VERTEX_ATTRIBUTE(PackedVertex, tex_coord),
+        VERTEX_ATTRIBUTE(PackedVertex, normal),
+        VERTEX_ATTRIBUTE(PackedVertex, normal_coord),
+        VERTEX_ATTRIBUTE(PackedVertex, tangent),
+    };
+};
+
+template<typename V>
 static constexpr vk::VertexInputBindingDescription getBindingDescription()
 {
     auto desc = vk::VertexInputBindingDescription{};
     desc.binding = 0;
-    desc.stride = sizeof(Vertex);
+    desc.stride = sizeof(V);
     desc.inputRate = vk::VertexInputRate::eVertex;
 
     return desc;
 };
 
-template<typename Vertex>
-static constexpr std::array<vk::VertexInputAttributeDescription, 6> getAttributeDescriptions()
+template<typename V>
+static constexpr std::array<vk::VertexInputAttributeDescription, VertexLayout<V>::attributes.size()> getAttributeDescriptions()
 {
-    std::array<vk::VertexInputAttributeDescription, 6> desc;
-
-    desc[0].binding = 0;
-    desc[0].location = 0;
-    desc[0].format = vk::Format::eR32G32B32Sfloat;
-    desc[0].offset = offsetof(Vertex, pos);
-
-    desc[1].binding = 0;
-    desc[1].location = 1;
-    desc[1].format = vk::Format::eR32G32Sfloat;
-    desc[1].offset = offsetof(Vertex, tex_coord);
-
-    desc[2].binding = 0;
-    desc[2].location = 2;
-    desc[2].format = vk::Format::eR32G32B32Sfloat;
-    desc[2].offset = offsetof(Vertex, normal);
-
-    desc[3].binding = 0;
-    desc[3].location = 3;
-    desc[3].format = vk::Format::eR32G32Sfloat;
-    desc[3].offset = offsetof(Vertex, normal_coord);
-
-    desc[4].binding = 0;
-    desc[4].location = 4;
-    desc[4].format = vk::Format::eR32G32B32Sfloat;
-    desc[4].offset = offsetof(Vertex, tangent);
-
-    desc[5].binding = 0;
-    desc[5].location = 5;
-    desc[5].format = vk::Format::eR32G32B32Sfloat;
-    desc[5].offset = offsetof(Vertex, bitangent);
+    std::array<vk::VertexInputAttributeDescription, VertexLayout<V>::attributes.size()> desc;
+
+    for (uint32_t i = 0; i < desc.size(); ++i)
+    {
+        desc[i].binding = 0;
+        desc[i].location = i;
+        desc[i].format = VertexLayout<V>::attributes[i].format;
+        desc[i].offset = VertexLayout<V>::attributes[i].offset;
+    }
 
     return  desc;
 }
+
+inline vk::VertexInputBindingDescription getBindingDescription(VertexFormat format)
+{
+    return format == VertexFormat::Packed ? getBindingDescription<PackedVertex>() : getBindingDescription<Vertex>();
+}
+
+inline std::span<vk::VertexInputAttributeDescription const> getAttributeDescriptions(VertexFormat format)
+{
+    static constexpr auto full = getAttributeDescriptions<Vertex>();
+    static constexpr auto packed = getAttributeDescriptions<PackedVertex>();
+
+    if (format == VertexFormat::Packed)
+    {
+        return packed;
+    }
+    return full;
+}
@@ -12,6 +12,7 @@
 #include <vulkan/vulkan_funcs.hpp>
 #include <vulkan/vulkan_structs.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 #include "Textures.h"
@@ -63,6 +64,13 @@ inline auto createStorageImageBinding(int binding, int count, vk::ShaderStageFla
     return createLayoutBinding(binding, vk::DescriptorType::eStorageImage, count, shader_flags);
 }
 
+// Texture arrays are updated after they are bound: textures are loaded and
+// streamed while the sets are used by frames in flight.
+inline bool isUpdateAfterBindBinding(vk::DescriptorSetLayoutBinding const& binding)
+{
+    return binding.descriptorCount > 1 && binding.descriptorType == vk::DescriptorType::eCombinedImageSampler;
+}
+
 inline auto createDescriptorPoolInfo(vk::Device const& device, std::vector<vk::DescriptorSetLayoutBinding> const& bindings)
 {
     std::vector<vk::DescriptorPoolSize> pool_sizes;
@@ -80,6 +88,10 @@ inline auto createDescriptorPoolInfo(vk::Device const& device, std::vector<vk::D
     pool_info.sType = vk::StructureType::eDescriptorPoolCreateInfo;
     pool_info.setPoolSizes(pool_sizes);
     pool_info.maxSets = 2;
+    if (std::any_of(bindings.begin(), bindings.end(), isUpdateAfterBindBinding))
+    {
+        pool_info.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
+    }
 
     auto pool = device.createDescriptorPool(pool_info);
     checkResult(pool.result);
@@ -96,6 +108,13 @@ inline vk::DescriptorSetLayout createDescriptorSetLayout(vk::Device const& devic
                     {
                         return vk::DescriptorBindingFlags{};
                     }
+                    else if (isUpdateAfterBindBinding(binding))
+                    {
+                        return   vk::DescriptorBindingFlagBits::eVariableDescriptorCount
+                               | vk::DescriptorBindingFlagBits::ePartiallyBound
+                               | vk::DescriptorBindingFlagBits::eUpdateAfterBind
+                               | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+                    }
                     else
                     {
                         return   vk::DescriptorBindingFlagBits::eVariableDescriptorCount
@@ -111,6 +130,10 @@ inline vk::DescriptorSetLayout createDescriptorSetLayout(vk::Device const& devic
     layout_info.sType = vk::StructureType::eDescriptorSetLayoutCreateInfo;
     layout_info.setBindings(bindings);
     layout_info.pNext = &binding_flags;
+    if (std::any_of(bindings.begin(), bindings.end(), isUpdateAfterBindBinding))
+    {
+        layout_info.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+    }
 
     auto layout = device.createDescriptorSetLayout(layout_info);
 
@@ -176,6 +199,32 @@ inline void updateUniformBuffer(vk::Device const& device, std::vector<std::uniqu
     }
 }
 
+// The whole of one buffer per frame, for buffers that only the GPU writes.
+inline void updateStorageBuffer(vk::Device const& device, std::vector<Buffer> const& buffers,
+        std::vector<vk::DescriptorSet> const& sets, vk::DescriptorSetLayoutBinding const& binding)
+{
+    int i = 0;
+    for (auto const& set : sets)
+    {
+        vk::DescriptorBufferInfo buffer_info{};
+        buffer_info.buffer = *buffers[i].buffer;
+        buffer_info.offset = 0;
+        buffer_info.range = VK_WHOLE_SIZE;
+
+        vk::WriteDescriptorSet desc_writes{};
+        desc_writes.sType = vk::StructureType::eWriteDescriptorSet;
+        desc_writes.setDstSet(set);
+        desc_writes.dstBinding = binding.binding;
+        desc_writes.dstArrayElement = 0;
+        desc_writes.descriptorType = binding.descriptorType;
+        desc_writes.descriptorCount = 1;
+        desc_writes.setBufferInfo(buffer_info);
+        ++i;
+
+        device.updateDescriptorSets(desc_writes, nullptr);
+    }
+}
+
 inline void updateImageSampler(vk::Device const& device,
         std::vector<std::unique_ptr<vk::raii::ImageView>> image_views, vk::raii::Sampler sampler,
         std::vector<vk::DescriptorSet> const& sets, vk::DescriptorSetLayoutBinding const& binding)
@@ -248,6 +297,79 @@ inline void updateImageSampler(vk::Device const& device,
     }
 }
 
+// Writes texture index again in the sets of frame of every binding of the array.
+// The frame must not be in flight, or must not sample index.
+inline void writeTextureDescriptor(vk::Device const& device, Textures const& textures, uint32_t index, uint32_t frame)
+{
+    auto const& texture = textures.textures[index];
+    if (!texture)
+    {
+        return;
+    }
+
+    vk::DescriptorImageInfo image_info{};
+    image_info.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    image_info.imageView = texture->view;
+    image_info.sampler = texture->sampler;
+
+    for (auto const& binding : textures.bindings)
+    {
+        vk::WriteDescriptorSet desc_writes{};
+        desc_writes.sType = vk::StructureType::eWriteDescriptorSet;
+        desc_writes.setDstSet(binding.sets[frame]);
+        desc_writes.dstBinding = binding.binding;
+        desc_writes.dstArrayElement = index;
+        desc_writes.descriptorType = binding.type;
+        desc_writes.descriptorCount = 1;
+        desc_writes.setImageInfo(image_info);
+
+        device.updateDescriptorSets(desc_writes, nullptr);
+    }
+}
+
+// Writes the loaded slots of the texture array to the sets and keeps them in
+// textures.bindings, so the slots of textures loaded or streamed later are
+// written to them as well. Free slots are left as they are, the array is
+// partially bound.
+inline void bindTextures(vk::Device const& device,
+        Textures& textures,
+        std::vector<vk::DescriptorSet> const& sets, vk::DescriptorSetLayoutBinding const& binding)
+{
+    std::vector<vk::DescriptorImageInfo> image_info(textures.textures.size());
+    std::vector<vk::WriteDescriptorSet> desc_writes;
+    for (auto const& set : sets)
+    {
+        for (uint32_t slot = 0; slot < textures.textures.size(); ++slot)
+        {
+            auto const& texture = textures.textures[slot];
+            if (!texture)
+            {
+                continue;
+            }
+
+            image_info[slot].imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+            image_info[slot].imageView = texture->view;
+            image_info[slot].sampler = texture->sampler;
+
+            vk::WriteDescriptorSet write{};
+            write.sType = vk::StructureType::eWriteDescriptorSet;
+            write.setDstSet(set);
+            write.dstBinding = binding.binding;
+            write.dstArrayElement = slot;
+            write.descriptorType = binding.descriptorType;
+            write.descriptorCount = 1;
+            write.setPImageInfo(&image_info[slot]);
+            desc_writes.push_back(write);
+        }
+    }
+
+    if (!desc_writes.empty())
+    {
+        device.updateDescriptorSets(desc_writes, nullptr);
+    }
+    textures.bindings.push_back({sets, binding.binding, binding.descriptorType});
+}
+
 inline void updateImage(vk::Device const& device,
         vk::ImageView view,
         std::vector<vk::DescriptorSet> const& sets, vk::DescriptorSetLayoutBinding const& binding)
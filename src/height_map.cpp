@@ -2,8 +2,8 @@
 #include <vector>
 #include <numeric>
 #include <math.h>
+#include <cmath>
 #include <iostream>
-#include <map>
 
 #include <glm/common.hpp>
 #include <glm/glm.hpp>
@@ -12,216 +12,392 @@
 #include <stb/stb_image.h>
 #include <vulkan/vulkan_core.h>
 
+#include "Float4.h"
+#include "height_map.h"
+#include "JobSystem.h"
 #include "Model.h"
 
-struct BTN
+// Grid lines of a run of quads along one axis. A line is shared by the quads on
+// both sides of it, except where the texture repeats: there the quad on the left
+// ends the texture at 1 and the one on the right starts it at 0 again, so the line
+// is there twice.
+struct TileAxis
 {
-    glm::vec3 tangent;
-    glm::vec3 bitangent;
-    glm::vec3 normal;
-};
-
-BTN createBtn(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, glm::vec2 uv1, glm::vec2 uv2, glm::vec2 uv3)
-{
-    glm::vec3 edge1 = p1 - p3;
-    glm::vec3 edge2 = p2 - p3;
+    size_t first_quad{};
+    size_t quad_count{};
 
-    glm::vec2 delta_uv1 = uv1 - uv3;
-    glm::vec2 delta_uv2 = uv2 - uv3;
-
-    float f = 1.0f / (delta_uv1.x * delta_uv2.y - delta_uv2.x * delta_uv2.y);
+    std::vector<uint32_t> lines;        // Grid line of every slot.
+    std::vector<float> tex_coords;      // Texture coordinate of every slot.
+    std::vector<uint32_t> quad_slots;   // Slot of the left/top line of every quad, the other one is the next slot.
+};
 
-    glm::vec3 tangent;
-    tangent.x = f * (delta_uv2.y * edge1.x - delta_uv1.y * edge2.x);
-    tangent.y = f * (delta_uv2.y * edge1.y - delta_uv1.y * edge2.y);
-    tangent.z = f * (delta_uv2.y * edge1.z - delta_uv1.y * edge2.z);
+// At most 256 lines per axis, then a tile has at most 0x10000 vertices.
+static constexpr size_t max_tile_lines = 256;
 
-    glm::vec3 bitangent;
-    bitangent.x = f * (-delta_uv2.x * edge1.x + delta_uv1.x * edge2.x);
-    bitangent.y = f * (-delta_uv2.x * edge1.y + delta_uv1.x * edge2.y);
-    bitangent.z = f * (-delta_uv2.x * edge1.z + delta_uv1.x * edge2.z);
+static std::vector<TileAxis> tileAxes(size_t size, size_t texture_size)
+{
+    size_t const period = texture_size + 1;
+    auto start = [&](size_t quad) { return (float)(quad % period)/period; };
+    auto end = [&](size_t quad) { return (float)(quad % period + 1)/period; };
 
-    glm::vec3 normal(0,1,0);
+    std::vector<TileAxis> tiles;
+    for (size_t quad = 0; quad < size; ++quad)
+    {
+        bool const shared = !tiles.empty() && tiles.back().quad_count > 0 && start(quad) == end(quad - 1);
+        size_t const new_lines = shared ? 1 : 2;
 
-    return BTN{glm::normalize(tangent), glm::normalize(bitangent), glm::normalize(normal)};
+        if (tiles.empty() || tiles.back().lines.size() + new_lines > max_tile_lines)
+        {
+            tiles.push_back(TileAxis{.first_quad = quad});
+            auto& tile = tiles.back();
+            tile.lines.push_back(quad);
+            tile.tex_coords.push_back(start(quad));
+        }
+        else if (!shared)
+        {
+            auto& tile = tiles.back();
+            tile.lines.push_back(quad);
+            tile.tex_coords.push_back(start(quad));
+        }
 
+        auto& tile = tiles.back();
+        tile.quad_slots.push_back(tile.lines.size() - 1);
+        tile.lines.push_back(quad + 1);
+        tile.tex_coords.push_back(end(quad));
+        ++tile.quad_count;
+    }
+    return tiles;
 }
 
 Model createFlatGround(std::size_t size, float length, size_t texture_size)
 {
-    size_t x_size = size;
-    size_t y_size = size;
-
-    float x_interval = float(length)/x_size;
-    float y_interval = float(length)/y_size;
-
-    float x_left = 0.0f - (length/2);
-    float y_left = 0.0f - (length/2);
+    auto const grid = flatGroundLayout(size, length);
+    auto const x_tiles = tileAxes(size, texture_size);
+    auto const& y_tiles = x_tiles;
 
     Model model{};
-    size_t count = 0;
+    model.local_indices = true;
 
-    for (size_t y = 0; y < y_size; ++y)
+    size_t vertex_count = 0;
+    for (auto const& y_tile : y_tiles)
     {
-        float y_top_left = y_left  + y_interval*(y%y_size);
-        for (size_t x = 0; x < x_size; ++x)
+        for (auto const& x_tile : x_tiles)
         {
-            float x_top_left = x_left + x_interval*(x%x_size);
-
-            glm::vec3 top_left  (x_top_left, 0, y_top_left);                             // 2      3 
-            glm::vec3 top_right (x_top_left+x_interval, 0, y_top_left);                  // 1
-            glm::vec3 bottom_left (x_top_left, 0, y_top_left+y_interval);                //        4
-            glm::vec3 bottom_right (x_top_left+x_interval, 0, y_top_left+y_interval);    // 0      5
-
-            glm::vec2 norm_top_left((float)x/(x_size+1), 1.0-((float)y/(y_size+1)));
-            glm::vec2 norm_top_right((float)(x+1)/(x_size+1), 1.0-((float)y/(y_size+1)));
-            glm::vec2 norm_bottom_left((float)x/(x_size+1), 1.0-(float(y+1)/(y_size+1)));
-            glm::vec2 norm_bottom_right((float)(x+1)/(x_size+1), 1.0-(float(y+1)/(y_size+1)));
-
-            size_t x_texture = x % (texture_size+1);
-            size_t y_texture = y % (texture_size+1);
-
-            glm::vec2 tex_top_left((float)x_texture/(texture_size+1), 1.0-((float)y_texture/(texture_size+1)));
-            glm::vec2 tex_top_right((float)(x_texture+1)/(texture_size+1), 1.0-((float)y_texture/(texture_size+1)));
-            glm::vec2 tex_bottom_left((float)x_texture/(texture_size+1), 1.0-(float(y_texture+1)/(texture_size+1)));
-            glm::vec2 tex_bottom_right((float)(x_texture+1)/(texture_size+1), 1.0-(float(y_texture+1)/(texture_size+1)));
-
-            auto btn   = createBtn(top_right, top_left, bottom_right, norm_top_right, norm_top_left, norm_bottom_right);
-            auto btn_2 = createBtn(bottom_left, bottom_right, top_left, norm_bottom_left, norm_bottom_right, norm_top_left);
-
-            // TODO: Make BTN per triangle. I think we need two more vertices per quad
+            vertex_count += y_tile.lines.size() * x_tile.lines.size();
+        }
+    }
+    model.vertices.reserve(vertex_count);
+    model.indices.reserve(size * size * 6);
 
-            glm::vec3 normal(0,1,0);
-            model.vertices.push_back(Vertex{.pos=bottom_left,.tex_coord=tex_bottom_left, .normal=normal, .normal_coord=norm_bottom_left, .tangent=btn_2.tangent, .bitangent=btn_2.bitangent});
-            model.vertices.push_back(Vertex{.pos=bottom_right,.tex_coord=tex_bottom_right, .normal=normal, .normal_coord=norm_bottom_right, .tangent=btn_2.tangent, .bitangent=btn_2.bitangent});
-            model.vertices.push_back(Vertex{.pos=top_right,.tex_coord=tex_top_right, .normal=normal, .normal_coord=norm_top_right, .tangent=btn.tangent, .bitangent=btn.bitangent});
-            model.vertices.push_back(Vertex{.pos=top_right,.tex_coord=tex_top_right, .normal=normal, .normal_coord=norm_top_right, .tangent=btn.tangent, .bitangent=btn.bitangent});
-            model.vertices.push_back(Vertex{.pos=top_left,.tex_coord=tex_top_left, .normal=normal, .normal_coord=norm_top_left, .tangent=btn_2.tangent, .bitangent=btn_2.bitangent});
-            model.vertices.push_back(Vertex{.pos=bottom_left,.tex_coord=tex_bottom_left, .normal=normal, .normal_coord=norm_bottom_left, .tangent=btn_2.tangent, .bitangent=btn_2.bitangent});
+    // Quads are emitted in vertical strips of at most this many vertex columns.
+    // Two rows of a strip fit in a 16 entry post-transform cache, so the top
+    // vertices of every quad are still cached from the quad above it.
+    constexpr uint32_t strip_columns = 7;
 
+    for (auto const& y_tile : y_tiles)
+    {
+        for (auto const& x_tile : x_tiles)
+        {
+            SubMesh tile{
+                .vertex_offset = static_cast<uint32_t>(model.vertices.size()),
+                .vertex_count = static_cast<uint32_t>(y_tile.lines.size() * x_tile.lines.size()),
+                .index_offset = static_cast<uint32_t>(model.indices.size())
+            };
 
-            model.indices.push_back(count+0);
-            model.indices.push_back(count+1);
-            model.indices.push_back(count+2);
+            for (size_t row = 0; row < y_tile.lines.size(); ++row)
+            {
+                auto const y = y_tile.lines[row];
+                float const z = grid.z_top + grid.z_interval*y;
+                float const v = 1.0-y_tile.tex_coords[row];
+                float const normal_v = 1.0-((float)y/(size+1));
+
+                for (size_t column = 0; column < x_tile.lines.size(); ++column)
+                {
+                    auto const x = x_tile.lines[column];
+                    model.vertices.push_back(Vertex{
+                        .pos = glm::vec3(grid.x_left + grid.x_interval*x, 0, z),
+                        .tex_coord = glm::vec2(x_tile.tex_coords[column], v),
+                        .normal = glm::vec3(0,1,0),
+                        .normal_coord = glm::vec2((float)x/(size+1), normal_v),
+                        .tangent = glm::vec3(1,0,0),
+                        .bitangent = glm::vec3(0,0,-1)});
+                }
+            }
 
-            model.indices.push_back(count+3);
-            model.indices.push_back(count+4);
-            model.indices.push_back(count+5);
+            auto const columns = static_cast<uint32_t>(x_tile.lines.size());
+            for (size_t strip = 0, strip_end = 0; strip < x_tile.quad_count; strip = strip_end)
+            {
+                while (   strip_end < x_tile.quad_count
+                       && x_tile.quad_slots[strip_end] + 1 - x_tile.quad_slots[strip] < strip_columns)
+                {
+                    ++strip_end;
+                }
+
+                for (size_t y = 0; y < y_tile.quad_count; ++y)
+                {
+                    uint32_t const top = y_tile.quad_slots[y] * columns;
+                    uint32_t const bottom = top + columns;
+
+                    for (size_t x = strip; x < strip_end; ++x)
+                    {
+                        uint32_t const left = x_tile.quad_slots[x];
+                        uint32_t const right = left + 1;
+
+                        // Same triangles as one quad of the height map grid, see computeGridFrames.
+                        model.indices.insert(model.indices.end(), {
+                            bottom + left, bottom + right, top + right,
+                            top + right, top + left, bottom + left});
+                    }
+                }
+            }
 
-            count += 6;
+            tile.index_count = static_cast<uint32_t>(model.indices.size()) - tile.index_offset;
+            model.submeshes.push_back(tile);
         }
     }
+
+    model.bounds = computeBounds(model.vertices);
     return model;
 }
 
-struct Comp
+// Face normals of one row of quads, two triangles per quad. Stored with one zero
+// entry before the first and after the last quad (and padding for the last four
+// lane load), so points on the border read zero for the missing faces.
+struct QuadRowNormals
 {
-    bool operator()(glm::vec<3, float, glm::packed_highp> const& lhs, glm::vec<3, float, glm::packed_highp> const& rhs) const
+    std::vector<float> x1, y1, z1;
+    std::vector<float> x2, y2, z2;
+
+    explicit QuadRowNormals(size_t quads)
+        : x1(quads + 6), y1(quads + 6), z1(quads + 6)
+        , x2(quads + 6), y2(quads + 6), z2(quads + 6)
+    {}
+
+    void clear()
     {
-        return lhs.x < rhs.x ||
-           lhs.x == rhs.x && (lhs.y < rhs.y || lhs.y == rhs.y && lhs.z < rhs.z);
+        for (auto* v : {&x1, &y1, &z1, &x2, &y2, &z2})
+        {
+            std::fill(v->begin(), v->end(), 0.0f);
+        }
     }
 };
 
-Model createModelFromHeightMap(std::string const& height_map_path, float size, float max_height)
+static void quadRowNormals(GridLayout const& grid, std::span<float const> heights, size_t row, QuadRowNormals& out)
 {
-    int width, height, channels {};
-    auto pixels = stbi_load(height_map_path.c_str(), &width, &height, &channels, STBI_grey);
+    size_t const quads = grid.columns - 1;
+    float const* top = heights.data() + row * grid.columns;
+    float const* bottom = top + grid.columns;
 
-    if (width != height)
+    // Corner positions exactly as createFlatGround computes them.
+    auto const z0 = splat4(grid.z_top + grid.z_interval * float(row));
+    auto const z1 = splat4(grid.z_top + grid.z_interval * float(row + 1));
+
+    for (size_t x = 0; x < quads; x += 4)
     {
-        return {};
-    }
+        // The last group may reach past the row, those lanes are written into the padding.
+        alignas(16) float h[4][4]{};
+        size_t const lanes = std::min<size_t>(4, quads - x);
+        for (size_t i = 0; i < lanes; ++i)
+        {
+            h[0][i] = top[x + i];
+            h[1][i] = top[x + i + 1];
+            h[2][i] = bottom[x + i];
+            h[3][i] = bottom[x + i + 1];
+        }
 
-    auto m = createFlatGround(width-1, size, 8);
+        auto const x0 = splat4(grid.x_left) + splat4(grid.x_interval) * ramp4(float(x));
+        auto const x1 = splat4(grid.x_left) + splat4(grid.x_interval) * ramp4(float(x + 1));
 
-    size_t index = 0;
+        Vec3x4 const top_left{x0, load4(h[0]), z0};
+        Vec3x4 const top_right{x1, load4(h[1]), z0};
+        Vec3x4 const bottom_left{x0, load4(h[2]), z1};
+        Vec3x4 const bottom_right{x1, load4(h[3]), z1};
 
-    for (auto& vertex : m.vertices)
-    {
-        int mapped_x = (vertex.pos.x+(size/2))/size*width;
-        int mapped_y = (vertex.pos.z+(size/2))/size*height;
+        auto const n1 = normalize4(cross4(bottom_right - bottom_left, top_right - bottom_left));
+        auto const n2 = normalize4(cross4(top_left - top_right, bottom_left - top_right));
 
-        size_t pos = (mapped_y*width) + mapped_x;
-        unsigned char height = pixels[pos];
+        store4(out.x1.data() + x + 1, n1.x);
+        store4(out.y1.data() + x + 1, n1.y);
+        store4(out.z1.data() + x + 1, n1.z);
+        store4(out.x2.data() + x + 1, n2.x);
+        store4(out.y2.data() + x + 1, n2.y);
+        store4(out.z2.data() + x + 1, n2.z);
+    }
 
-        vertex.pos.y = float(height)/256*max_height;
+    // Clear the padding lanes again, the entry after the last quad must read zero.
+    for (auto* v : {&out.x1, &out.y1, &out.z1, &out.x2, &out.y2, &out.z2})
+    {
+        std::fill(v->begin() + quads + 1, v->end(), 0.0f);
     }
+}
 
-    // TODO Calculate normal for each vertex.
-    // Interpolate normals from all adjecent faces
-    // Each vertex that is not an edge has 6 neighbour vertices.
-    //
-    // 1. In the loop over add each vertex to a map that is keyed on the vertex position. As value it contains a list of references
-    //    to all vertices sharing the same position, and information about each triangle.
-    //
-    // 2. Loop over the map and calculate the normal for each point, the normal is shared between all neighbouring vertices.
+GridFrames computeGridFrames(GridLayout const& grid, std::span<float const> heights)
+{
+    size_t const points = grid.columns * grid.rows;
 
+    GridFrames frames;
+    frames.normals.resize(points);
+    frames.tangents.resize(points);
+    frames.bitangents.resize(points);
 
-    std::map<glm::vec3, std::vector<glm::vec3>, Comp> normal_map;
-    for (auto index = m.indices.begin(); index != m.indices.end(); index += 3)
+    if (grid.columns < 2 || grid.rows < 2 || heights.size() < points)
     {
-        // Create the normal for the face index(0,1,2)
-        auto v1 = m.vertices[*index].pos;
-        auto v2 = m.vertices[*(index+1)].pos;
-        auto v3 = m.vertices[*(index+2)].pos;
-
-        // Face normal
-        auto normal = glm::normalize(glm::cross(v2-v1, v3-v1));
-
-        normal_map[v1].push_back(normal);
-        normal_map[v2].push_back(normal);
-        normal_map[v3].push_back(normal);
+        return frames;
     }
 
-    for (auto& vertex : m.vertices)
+    jobSystem().parallelFor(grid.rows, [&](size_t begin, size_t end)
     {
-        auto it = normal_map.find(vertex.pos);
-        if (it != normal_map.end())
+        size_t const quads = grid.columns - 1;
+        QuadRowNormals above(quads);
+        QuadRowNormals below(quads);
+
+        if (begin > 0)
         {
-            auto const& normals = it->second;
-            auto normal = glm::normalize(std::accumulate(normals.begin(), normals.end(), glm::vec3(0,0,0)));
-            vertex.normal = normal;
+            quadRowNormals(grid, heights, begin - 1, above);
         }
-    }
-
-    for (int i = 0; i < m.vertices.size(); ++i)
-    {
-        auto &p1 = m.vertices[i];
 
-        glm::vec3 init_vec;
+        alignas(16) float out[9][4];
 
-        if (std::abs(p1.normal.x) < std::abs(p1.normal.y))
+        for (size_t row = begin; row < end; ++row)
         {
-            if (std::abs(p1.normal.x) < std::abs(p1.normal.z))
+            if (row + 1 < grid.rows)
             {
-                init_vec = glm::cross(p1.normal, glm::vec3(1,0,0));
+                quadRowNormals(grid, heights, row, below);
             }
             else
             {
-                init_vec = glm::cross(p1.normal, glm::vec3(0,0,1));
+                below.clear();
             }
-        }
-        else
-        {
-            if (std::abs(p1.normal.y) < std::abs(p1.normal.z))
-            {
-                init_vec = glm::cross(p1.normal, glm::vec3(0,1,0));
-            }
-            else
+
+            for (size_t column = 0; column < grid.columns; column += 4)
             {
-                init_vec = glm::cross(p1.normal, glm::vec3(0,0,1));
+                // A point is a corner of up to six triangles. They are always summed
+                // in row major quad order: the bottom right corner of the quad above
+                // left, both triangles of the quad above, both triangles of the quad
+                // to the left and the top left corner of its own quad.
+                auto const left = column;
+                auto const right = column + 1;
+                auto load = [](std::vector<float> const& x, std::vector<float> const& y, std::vector<float> const& z, size_t i)
+                {
+                    return Vec3x4{load4(x.data() + i), load4(y.data() + i), load4(z.data() + i)};
+                };
+
+                Vec3x4 sum = splat4(glm::vec3(0.0f));
+                sum = sum + load(above.x1, above.y1, above.z1, left);
+                sum = sum + load(above.x1, above.y1, above.z1, right);
+                sum = sum + load(above.x2, above.y2, above.z2, right);
+                sum = sum + load(below.x1, below.y1, below.z1, left);
+                sum = sum + load(below.x2, below.y2, below.z2, left);
+                sum = sum + load(below.x2, below.y2, below.z2, right);
+
+                auto const normal = normalize4(sum);
+
+                // Start from the axis the normal is the least aligned with.
+                auto const ax = abs4(normal.x);
+                auto const ay = abs4(normal.y);
+                auto const az = abs4(normal.z);
+                auto const x_less_y = less4(ax, ay);
+                auto const use_x = and4(x_less_y, less4(ax, az));
+                auto const use_y = andNot4(x_less_y, less4(ay, az));
+
+                auto const init = select4(use_x, cross4(normal, splat4(glm::vec3(1, 0, 0))),
+                                  select4(use_y, cross4(normal, splat4(glm::vec3(0, 1, 0))),
+                                                 cross4(normal, splat4(glm::vec3(0, 0, 1)))));
+
+                auto const d = dot4(normal, init);
+                auto const tangent = normalize4(init - Vec3x4{d * normal.x, d * normal.y, d * normal.z});
+                auto const bitangent = normalize4(cross4(normal, tangent));
+
+                Float4 const* lanes[9] = {&normal.x, &normal.y, &normal.z,
+                                          &tangent.x, &tangent.y, &tangent.z,
+                                          &bitangent.x, &bitangent.y, &bitangent.z};
+                for (size_t k = 0; k < 9; ++k)
+                {
+                    store4(out[k], *lanes[k]);
+                }
+
+                size_t const count = std::min<size_t>(4, grid.columns - column);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    size_t const point = row * grid.columns + column + i;
+                    frames.normals[point] = glm::vec3(out[0][i], out[1][i], out[2][i]);
+                    frames.tangents[point] = glm::vec3(out[3][i], out[4][i], out[5][i]);
+                    frames.bitangents[point] = glm::vec3(out[6][i], out[7][i], out[8][i]);
+                }
             }
+
+            std::swap(above, below);
+        }
+    }, 16);
+
+    return frames;
+}
+
+size_t gridPoint(GridLayout const& grid, glm::vec3 const& pos)
+{
+    auto const x = std::lround((pos.x - grid.x_left)/grid.x_interval);
+    auto const y = std::lround((pos.z - grid.z_top)/grid.z_interval);
+    return size_t(std::clamp<long>(y, 0, long(grid.rows) - 1)) * grid.columns + size_t(std::clamp<long>(x, 0, long(grid.columns) - 1));
+}
+
+GridLayout flatGroundLayout(size_t size, float length)
+{
+    return GridLayout{
+        .columns = size + 1,
+        .rows = size + 1,
+        .x_left = 0.0f - (length/2),
+        .x_interval = float(length)/size,
+        .z_top = 0.0f - (length/2),
+        .z_interval = float(length)/size
+    };
+}
+
+Model createModelFromHeights(std::span<unsigned char const> pixels, size_t width, float size, float max_height)
+{
+    auto m = createFlatGround(width-1, size, 8);
+    auto const grid = flatGroundLayout(width-1, size);
+
+    std::vector<float> heights(width * width);
+    for (size_t i = 0; i < heights.size(); ++i)
+    {
+        heights[i] = float(pixels[i])/256*max_height;
+    }
+
+    auto const frames = computeGridFrames(grid, heights);
+
+    jobSystem().parallelFor(m.vertices.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            auto& vertex = m.vertices[i];
+            auto const point = gridPoint(grid, vertex.pos);
+
+            vertex.pos.y = heights[point];
+            vertex.normal = frames.normals[point];
+            vertex.tangent = frames.tangents[point];
+            vertex.bitangent = frames.bitangents[point];
         }
+    }, 4096);
+
+    m.bounds = computeBounds(m.vertices);
 
-        glm::vec3 tangent = glm::normalize(init_vec - glm::dot(p1.normal, init_vec) * p1.normal);
-        glm::vec3 bitangent = glm::normalize(glm::cross(p1.normal, tangent));
-        p1.tangent = tangent;
-        p1.bitangent = bitangent;
+    return m;
+}
+
+Model createModelFromHeightMap(std::string const& height_map_path, float size, float max_height)
+{
+    int width, height, channels {};
+    auto pixels = stbi_load(height_map_path.c_str(), &width, &height, &channels, STBI_grey);
+
+    if (!pixels || width != height)
+    {
+        stbi_image_free(pixels);
+        return {};
     }
 
+    auto m = createModelFromHeights({pixels, size_t(width) * height}, width, size, max_height);
+
     stbi_image_free(pixels);
 
     return m;
-
 }
@@ -1,8 +1,46 @@
 #pragma once
 
+#include <span>
 #include <string>
+#include <vector>
 
 #include "Model.h"
 
+// Flat grid of size x size quads with the texture repeated every texture_size + 1
+// quads. Vertices are shared between quads and the grid is split into tiles of
+// at most 0x10000 vertices with local indices, so it is drawn with 16 bit indices.
 Model createFlatGround(std::size_t size, float length, std::size_t texture_size);
 Model createModelFromHeightMap(std::string const& height_map_path, float size, float max_height);
+
+// Builds the terrain from a square 8 bit height raster, one grid point per pixel.
+Model createModelFromHeights(std::span<unsigned char const> pixels, std::size_t width, float size, float max_height);
+
+// Regular grid of points in the xz plane, row major from the top left corner.
+struct GridLayout
+{
+    std::size_t columns{};
+    std::size_t rows{};
+    float x_left{};
+    float x_interval{};
+    float z_top{};
+    float z_interval{};
+};
+
+// The grid createFlatGround(size, length, ...) places its vertices on.
+GridLayout flatGroundLayout(std::size_t size, float length);
+
+// Grid point closest to pos in the xz plane.
+std::size_t gridPoint(GridLayout const& grid, glm::vec3 const& pos);
+
+struct GridFrames
+{
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> tangents;
+    std::vector<glm::vec3> bitangents;
+};
+
+// Normal, tangent and bitangent of every grid point for one height per point, in
+// linear time straight from the raster. The normal averages the face normals of
+// the triangles of createFlatGround around the point. Rows are split across the
+// job system and four points are processed at a time with SSE.
+GridFrames computeGridFrames(GridLayout const& grid, std::span<float const> heights);
@@ -60,11 +60,14 @@
 #include "Model.h"
 #include "Mesh.h"
 #include "height_map.h"
+#include "HeightField.h"
+#include "HeightPyramid.h"
 #include "utilities.h"
 #include "Scene.h"
 #include "Program.h"
 #include "Object.h"
 #include "Textures.h"
+#include "JobSystem.h"
 #include "TypeLayer.h"
 #include "Renderer.h"
 #include "Application.h"
@@ -97,11 +100,6 @@ void recordCommandBuffer(RenderingState const& state, uint32_t image_index, Appl
 {
     Application& app = render_system;
 
-    // Write all buffer data used by the render passes.
-    shadowPassWriteBuffers(state, render_system.scene, app.shadow_map, state.current_frame);
-    sceneWriteBuffers(render_system.scene, state.current_frame);
-    postProcessingWriteBuffers(app.ppp, state.current_frame);
-
     vk::raii::CommandBuffer const& command_buffer = state.command_buffer[state.current_frame];
 
     vk::CommandBufferBeginInfo begin_info{};
@@ -111,6 +109,28 @@ void recordCommandBuffer(RenderingState const& state, uint32_t image_index, Appl
 
     command_buffer.begin(begin_info);
 
+    // Before the buffers are written, the material of a baked object is written without displacement.
+    recordDisplacementBakes(state, *command_buffer, app.displacement_bake, app.scene, state.current_frame);
+
+    // Write all buffer data used by the render passes.
+    shadowPassWriteBuffers(state, render_system.scene, app.shadow_map, state.current_frame);
+    sceneWriteBuffers(render_system.scene, state.current_frame, state.swap_chain.extent);
+    postProcessingWriteBuffers(app.ppp, state.current_frame);
+
+    // Texture levels for the objects as they are placed this frame, and the
+    // textures that finished loading. The fence of the frame is waited for, the
+    // textures retired two frames ago are no longer used.
+    collectRetiredTextures(app.textures);
+    updateTextureStream(app.texture_stream, app.textures, app.scene, state.swap_chain.extent);
+    recordTextureStreamUploads(state, *command_buffer, app.texture_stream, app.textures, state.current_frame);
+
+    // Height field tiles that finished loading, before anything samples them.
+    auto* height_field_stream = app.scene.height_field_stream ? &*app.scene.height_field_stream : nullptr;
+    recordHeightFieldUploads(*command_buffer, app.scene.height_field_texture, height_field_stream, state.current_frame);
+
+    // Blades and the indirect draw of the grass, drawn in the scene render pass.
+    recordGrassScatter(*command_buffer, app.grass_scatter, app.scene, state.current_frame);
+
     shadowMapRenderPass(state, app.shadow_map, app.scene, command_buffer);
     sceneRenderPass(command_buffer, state, render_system.scene_render_pass, render_system.scene, image_index);
     postProcessingRenderPass(state, app.ppp, command_buffer, render_system.scene, image_index);
@@ -253,6 +273,27 @@ bool processEvent(Event const& event, App& app)
     return true;
 }
 
+// Heights of the displacement map of the terrain for queries on the CPU.
+static std::optional<HeightPyramid> loadHeightPyramid(std::string const& path, float terrain_size, float max_height)
+{
+    int width, height, channels;
+    auto pixels = stbi_load_16(path.c_str(), &width, &height, &channels, STBI_grey);
+    if (!pixels)
+    {
+        spdlog::warn("Could not load height map {} for the height pyramid", path);
+        return std::nullopt;
+    }
+
+    std::vector<float> heights(size_t(width) * height);
+    for (size_t i = 0; i < heights.size(); ++i)
+    {
+        heights[i] = pixels[i] / 65535.0f;
+    }
+    stbi_image_free(pixels);
+
+    return createHeightPyramid(heights, width, height, terrain_size, max_height);
+}
+
 void updateCameraFront(Camera& camera)
 {
     glm::vec3 direction;
@@ -352,9 +393,38 @@ int main()
 
     RenderingState& core = *out;
 
-    spdlog::info("Loading textures");
-    Textures textures = createTextures(core,
-        { 
+    auto const load_start = std::chrono::high_resolution_clock::now();
+
+    // Textures are decoded and models imported on the job system, only the upload
+    // to the GPU happens on this thread.
+    spdlog::info("Loading textures and models on {} threads", jobSystem().size());
+
+    // auto landscape_job = jobSystem().submit([]{ return importModelAssimp("./models/canyon_low_res.fbx"); });
+    auto sphere_job = jobSystem().submit([]{ return importModelAssimp("./models/sky_sphere.fbx"); });
+    // auto dune_job = jobSystem().submit([]{ return importModelAssimp("./models/dune.fbx"); });
+    auto tree_job = jobSystem().submit([]{ return importModelAssimp("./textures/tree/Dead_Tree_qlEtl_High.fbx"); });
+
+    // The textures of the materials, they find their slots with the handles
+    // acquired for them.
+    TextureInput const dune_height{"./textures/dune3_height.png", TextureType::Map, vk::Format::eR8G8B8A8Unorm};
+    TextureInput const dune_normals{"./textures/dune3_normals.png", TextureType::Map, vk::Format::eR8G8B8A8Unorm};
+    TextureInput const sand_color{"./textures/GroundSand005_COL_2K.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Srgb};
+    TextureInput const sand_normal{"./textures/GroundSand005_NRM_2K.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm};
+    TextureInput const sand_ao{"./textures/GroundSand005_AO_2K.jpg", TextureType::MipMap, vk::Format::eR8Unorm};
+    TextureInput const dune_color{"./textures/Rippled_Sand_Dune_vd3mbbus_4K_BaseColor.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Srgb};
+    TextureInput const dune_normal{"./textures/Rippled_Sand_Dune_vd3mbbus_4K_Normal.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm};
+    TextureInput const dune_roughness{"./textures/Rippled_Sand_Dune_vd3mbbus_4K_Roughness.jpg", TextureType::MipMap, vk::Format::eR8Unorm};
+    TextureInput const dune_ao{"./textures/Rippled_Sand_Dune_vd3mbbus_4K_AO.jpg", TextureType::MipMap, vk::Format::eR8Unorm};
+    TextureInput const tree_color{"./textures/tree/Dead_Tree_qlEtl_High_4K_BaseColor.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Srgb};
+    TextureInput const tree_normal{"./textures/tree/Dead_Tree_qlEtl_High_4K_Normal.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm};
+    TextureInput const tree_roughness{"./textures/tree/Dead_Tree_qlEtl_High_4K_Roughness.jpg", TextureType::MipMap, vk::Format::eR8Unorm};
+    TextureInput const tree_ao{"./textures/tree/Dead_Tree_qlEtl_High_4K_AO.jpg", TextureType::MipMap, vk::Format::eR8Unorm};
+
+    // Cooked textures start with their smallest levels, the rest is streamed in.
+    // The same image asked for twice is loaded once. The handles are kept by the
+    // application, the Gui releases and acquires them again to reload a texture.
+    Textures textures = createTextures(core);
+    std::vector<TextureInput> const texture_inputs{
           //{"./textures/canyon2_height.png", TextureType::Map, vk::Format::eR8G8B8A8Unorm},
           //{"./textures/canyon2_normals.png", TextureType::Map, vk::Format::eR8G8B8A8Unorm},
           {"./textures/terrain.png", TextureType::Map, vk::Format::eR8G8B8A8Unorm},
@@ -367,12 +437,12 @@ int main()
           {"./textures/forest_normal.png", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
           {"./textures/forest_diff.png", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
           {"./textures/forest_diff.png", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
-          {"./textures/dune3_height.png", TextureType::Map, vk::Format::eR8G8B8A8Unorm},
-          {"./textures/dune3_normals.png", TextureType::Map, vk::Format::eR8G8B8A8Unorm},
+          dune_height,
+          dune_normals,
           //{"./textures/cylinder.png", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
-          {"./textures/GroundSand005_COL_2K.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Srgb},
-          {"./textures/GroundSand005_NRM_2K.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
-          {"./textures/GroundSand005_AO_2K.jpg", TextureType::MipMap, vk::Format::eR8Unorm},
+          sand_color,
+          sand_normal,
+          sand_ao,
           {"./textures/brown_mud_03_diff_1k.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
           {"./textures/brown_mud_03_nor_gl_1k.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
 
@@ -387,28 +457,40 @@ int main()
           //{"./textures/canyon/Canyon_Sandstone_Rock_vimldgeg_4K_Roughness.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
           //{"./textures/canyon/Canyon_Sandstone_Rock_vimldgeg_4K_AO.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
 
-          {"./textures/Rippled_Sand_Dune_vd3mbbus_4K_BaseColor.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Srgb},
-          {"./textures/Rippled_Sand_Dune_vd3mbbus_4K_Normal.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
-          {"./textures/Rippled_Sand_Dune_vd3mbbus_4K_Roughness.jpg", TextureType::MipMap, vk::Format::eR8Unorm},
-          {"./textures/Rippled_Sand_Dune_vd3mbbus_4K_AO.jpg", TextureType::MipMap, vk::Format::eR8Unorm},
-          {"./textures/tree/Dead_Tree_qlEtl_High_4K_BaseColor.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Srgb},
-          {"./textures/tree/Dead_Tree_qlEtl_High_4K_Normal.jpg", TextureType::MipMap, vk::Format::eR8G8B8A8Unorm},
-          {"./textures/tree/Dead_Tree_qlEtl_High_4K_Roughness.jpg", TextureType::MipMap, vk::Format::eR8Unorm},
-          {"./textures/tree/Dead_Tree_qlEtl_High_4K_AO.jpg", TextureType::MipMap, vk::Format::eR8Unorm},
-        });
-
-    spdlog::info("Loading models");
+          dune_color,
+          dune_normal,
+          dune_roughness,
+          dune_ao,
+          tree_color,
+          tree_normal,
+          tree_roughness,
+          tree_ao,
+        };
+    auto texture_handles = acquireTextures(core, textures, texture_inputs, true);
+
+    // Handle of one of texture_inputs.
+    auto textureHandle = [&](TextureInput const& input)
+    {
+        auto const key = textureKey(input);
+        auto const found = std::ranges::find_if(texture_inputs, [&key](auto const& other) { return textureKey(other) == key; });
+        return texture_handles[found - texture_inputs.begin()];
+    };
+
     Models models;
-    // int landscape_fbx = models.loadModelAssimp("./models/canyon_low_res.fbx");
-    int sphere_fbx = models.loadModelAssimp("./models/sky_sphere.fbx");
-    // int dune_id = models.loadModelAssimp("./models/dune.fbx");
-    
-    int tree_fbx = models.loadModelAssimp("./textures/tree/Dead_Tree_qlEtl_High.fbx");
+    // Imported models are only needed for the upload, the mesh cache has them if
+    // they are needed again.
+    auto addModel = [&models](std::optional<Model> model)
+    {
+        return model ? models.addModel(std::move(*model), Residency::EvictAfterUpload) : -1;
+    };
+
+    int sphere_fbx = addModel(sphere_job.get());
+    int tree_fbx = addModel(tree_job.get());
 
     // int cylinder_id = models.loadModel("./models/cylinder.obj");
 
-    auto height_map_1_model = createFlatGround(512, 100, 4);
-    models.models.insert({height_map_1_model.id, height_map_1_model});
+    spdlog::info("Loaded textures and models in {} ms",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - load_start).count());
     //auto height_map_1_model = createFlatGround(2047, 500, 4);
 
     //models.models.insert({height_map_1_model.id, height_map_1_model});
@@ -421,6 +503,19 @@ int main()
     scene.model_buffer = createStorageBuffers<ModelBufferObject>(core, 10);
     scene.material_buffer = createStorageBuffers<MaterialShaderData>(core, 10);
     scene.atmosphere_data = createUniformBuffers<Atmosphere>(core);
+    scene.terrain_patch_buffer = createStorageBuffers<TerrainPatch>(core, max_terrain_patches);
+    scene.terrain_tessellation_buffer = createUniformBuffers<TerrainTessellationBufferObject>(core);
+    scene.grass = createGrassField(core);
+
+    // Cooked from the height map with height-field-cooker. Without it the terrain
+    // uses the displacement map of the material only.
+    if (auto height_field = mapHeightField("./textures/dune3_height.hfield"))
+    {
+        auto const& header = height_field->header;
+        spdlog::info("Streaming {}x{} height field in {}x{} tiles", header.width, header.height, header.tiles_x, header.tiles_y);
+        scene.height_field_stream = createHeightFieldStream(std::move(*height_field));
+    }
+    scene.height_field_texture = createHeightFieldTexture(core, scene.height_field_stream ? &*scene.height_field_stream : nullptr);
 
     auto shadow_map = createCascadedShadowMap(core, scene);
     auto scene_render_pass = createSceneRenderPass(core, textures, scene, shadow_map);
@@ -441,11 +536,11 @@ int main()
                                 | MaterialFeatureFlag::NormalMap,
             .sampling_mode = SamplingMode::TriplanarSampling,
             .shade_mode = ReflectionShadeMode::Pbr,
-            .displacement_map_texture = 10,
-            .normal_map_texture = 11,
-            .base_color_texture = 12,
-            .base_color_normal_texture = 13,
-            .ao_texture = 14,
+            .displacement_map_texture = textureSlot(textures, textureHandle(dune_height)),
+            .normal_map_texture = textureSlot(textures, textureHandle(dune_normals)),
+            .base_color_texture = textureSlot(textures, textureHandle(sand_color)),
+            .base_color_normal_texture = textureSlot(textures, textureHandle(sand_normal)),
+            .ao_texture = textureSlot(textures, textureHandle(sand_ao)),
             .scaling_factor = 0.3f,
             .roughness = 0.402,
             .metallic = 0.922,
@@ -464,10 +559,10 @@ int main()
                                 | MaterialFeatureFlag::RoughnessMap,
             .sampling_mode = SamplingMode::UvSampling,
             .shade_mode = ReflectionShadeMode::Pbr,
-            .base_color_texture = 21,
-            .base_color_normal_texture = 22,
-            .roughness_texture = 23,
-            .ao_texture = 24,
+            .base_color_texture = textureSlot(textures, textureHandle(tree_color)),
+            .base_color_normal_texture = textureSlot(textures, textureHandle(tree_normal)),
+            .roughness_texture = textureSlot(textures, textureHandle(tree_roughness)),
+            .ao_texture = textureSlot(textures, textureHandle(tree_ao)),
             .scaling_factor = 1.0f,
             .roughness = 0.402,
             .metallic = 0,
@@ -487,13 +582,13 @@ int main()
                                 | MaterialFeatureFlag::NormalMap,
             .sampling_mode = SamplingMode::TriplanarSampling,
             .shade_mode = ReflectionShadeMode::Phong,
-            .displacement_map_texture = 10,
-            .normal_map_texture = 11,
+            .displacement_map_texture = textureSlot(textures, textureHandle(dune_height)),
+            .normal_map_texture = textureSlot(textures, textureHandle(dune_normals)),
             .displacement_y = 6.4f,
-            .base_color_texture = 17,
-            .base_color_normal_texture = 18,
-            .roughness_texture = 19,
-            .ao_texture = 20,
+            .base_color_texture = textureSlot(textures, textureHandle(dune_color)),
+            .base_color_normal_texture = textureSlot(textures, textureHandle(dune_normal)),
+            .roughness_texture = textureSlot(textures, textureHandle(dune_roughness)),
+            .ao_texture = textureSlot(textures, textureHandle(dune_ao)),
             .scaling_factor = 0.1f,
             .roughness = 0,
             .metallic = 0,
@@ -503,7 +598,7 @@ int main()
 
     Material landscape_flat_dune{
         .name = {"Landscape"},
-        .program = 0,
+        .program = 3,
         .shader_data = {
             .material_features =  MaterialFeatureFlag::DisplacementMap
                                 | MaterialFeatureFlag::DisplacementNormalMap
@@ -513,13 +608,13 @@ int main()
                                 | MaterialFeatureFlag::NormalMap,
             .sampling_mode = SamplingMode::TriplanarSampling,
             .shade_mode = ReflectionShadeMode::Pbr,
-            .displacement_map_texture = 10,
-            .normal_map_texture = 11,
+            .displacement_map_texture = textureSlot(textures, textureHandle(dune_height)),
+            .normal_map_texture = textureSlot(textures, textureHandle(dune_normals)),
             .displacement_y = 7.0f,
-            .base_color_texture = 17,
-            .base_color_normal_texture = 18,
-            .roughness_texture = 19,
-            .ao_texture = 20,
+            .base_color_texture = textureSlot(textures, textureHandle(dune_color)),
+            .base_color_normal_texture = textureSlot(textures, textureHandle(dune_normal)),
+            .roughness_texture = textureSlot(textures, textureHandle(dune_roughness)),
+            .ao_texture = textureSlot(textures, textureHandle(dune_ao)),
             .scaling_factor = 0.1f,
             .roughness = 0,
             .metallic = 0,
@@ -538,10 +633,10 @@ int main()
                                 | MaterialFeatureFlag::NormalMap,
             .sampling_mode = SamplingMode::TriplanarSampling,
             .shade_mode = ReflectionShadeMode::Pbr,
-            .base_color_texture = 17,
-            .base_color_normal_texture = 18,
-            .roughness_texture = 19,
-            .ao_texture = 20,
+            .base_color_texture = textureSlot(textures, textureHandle(dune_color)),
+            .base_color_normal_texture = textureSlot(textures, textureHandle(dune_normal)),
+            .roughness_texture = textureSlot(textures, textureHandle(dune_roughness)),
+            .ao_texture = textureSlot(textures, textureHandle(dune_ao)),
             .scaling_factor = 0.1f,
             .roughness = 0,
             .metallic = 0,
@@ -561,12 +656,30 @@ int main()
     auto box = createBox();
 
     Meshes meshes;
-    auto landscape_flat_id = meshes.loadMesh(core, models.models.at(height_map_1_model.id), "height_map_1");
-    auto sphere_id = meshes.loadMesh(core, models.models.at(sphere_fbx), "sphere fbx");
-    auto tree_id = meshes.loadMesh(core, models.models.at(tree_fbx), "sphere fbx");
+    auto sphere_id = meshes.loadMesh(core, models, sphere_fbx, "sphere fbx");
+    auto tree_id = meshes.loadMesh(core, models, tree_fbx, "sphere fbx", VertexFormat::Packed);
+
+    spdlog::info("CPU mesh data after upload: {} KB", models.residentMemory() / 1024);
 
     auto box_id = meshes.loadMesh(core, box, "box");
 
+    auto grass_blade = createGrassBlade();
+    auto grass_blade_id = meshes.loadMesh(core, grass_blade, "grass blade");
+
+    scene.terrain_quadtree.size = 100;
+    scene.terrain_quadtree.max_height = landscape_flat_dune.shader_data.displacement_y;
+    auto height_pyramid_job = jobSystem().submit([size = scene.terrain_quadtree.size, max_height = scene.terrain_quadtree.max_height]
+    {
+        return loadHeightPyramid("./textures/dune3_height.png", size, max_height);
+    });
+    auto terrain_patch = createTerrainPatch(scene.terrain_quadtree.patch_resolution);
+    auto terrain_patch_id = meshes.loadMesh(core, terrain_patch, "terrain patch");
+
+    // The same terrain tessellated on the GPU from a coarse grid instead, switched in the gui.
+    auto terrain_grid = createFlatGround(64, scene.terrain_quadtree.size, 4);
+    scene.terrain_tessellation_corners = triangleCorners(terrain_grid);
+    auto terrain_grid_id = meshes.loadMesh(core, terrain_grid, "terrain grid");
+
     scene.camera = camera;
     scene.light.position = glm::vec3(450000,0,0);
     scene.light.light_color = glm::vec3(1,1,1);
@@ -587,10 +700,15 @@ int main()
     //auto object = createObject(meshes.meshes.at(mesh_id));
     //object.material = 1;
 
-    auto landscape_flat = createObject(meshes.meshes.at(landscape_flat_id));
+    auto landscape_flat = createObject(meshes.meshes.at(terrain_patch_id));
     landscape_flat.material = landscape_flat_dune;
-    landscape_flat.shadow = true;
-    // landscape_flat.shadow = true;
+    landscape_flat.object_type = ObjectType::TERRAIN;
+
+    auto landscape_tessellated = createObject(meshes.meshes.at(terrain_grid_id));
+    landscape_tessellated.material = landscape_flat_dune;
+    landscape_tessellated.material.program = 4;
+    landscape_tessellated.object_type = ObjectType::TESSELLATED_TERRAIN;
+    landscape_tessellated.visible = false;
 
     auto sky_box = createObject(meshes.meshes.at(sphere_id));
     sky_box.material = sky_box_material;
@@ -599,9 +717,11 @@ int main()
 
     auto tree = createObject(meshes.meshes.at(tree_id));
     tree.material = tree_material;
+    tree.material.program = generalPurposeProgram(meshes.meshes.at(tree_id).vertex_format);
     tree.position = glm::vec3(2,3.3,0);
     tree.shadow = true;
     tree.scale = 0.004;
+    tree.lod = Lod{};
     addObject(scene, tree);
 
 
@@ -611,6 +731,7 @@ int main()
 
     //addObject(scene, dune_object);
     addObject(scene, landscape_flat);
+    addObject(scene, landscape_tessellated);
     addObject(scene, sky_box);
 
     auto fbx = createObject(meshes.meshes.at(sphere_id));
@@ -632,18 +753,34 @@ int main()
     box_fbx.shadow = true;
     addObject(scene, box_fbx);
 
+    auto grass = createObject(meshes.meshes.at(grass_blade_id));
+    grass.material = base_material;
+    grass.material.program = 5;
+    grass.object_type = ObjectType::GRASS;
+    addObject(scene, grass);
+
     //addObject(scene, box_object);
 
+    scene.height_pyramid = height_pyramid_job.get();
+    scene.camera_ground_clearance = 1.0f;
+
     auto ppp = createPostProcessing(core, scene_render_pass, scene.world_buffer);
+    auto displacement_bake = createDisplacementBake(core, textures);
+    auto grass_scatter = createGrassScatter(core, textures, scene.grass);
+    auto texture_stream = createTextureStream(textures, core.command_buffer.size());
     Application application{
         .textures = std::move(textures),
+        .texture_handles = std::move(texture_handles),
         .models = std::move(models),
         .meshes = std::move(meshes),
         .programs = {},
         .scene = std::move(scene),
         .scene_render_pass = std::move(scene_render_pass),
         .ppp = std::move(ppp),
-        .shadow_map = std::move(shadow_map)
+        .shadow_map = std::move(shadow_map),
+        .displacement_bake = std::move(displacement_bake),
+        .grass_scatter = std::move(grass_scatter),
+        .texture_stream = std::move(texture_stream)
     };
 
     initImgui(core.device, core.physical_device, core.instance, core.graphics_queue, application.ppp.render_pass, core, core.window, core.msaa);
@@ -695,6 +832,7 @@ int main()
         if (!first_frame)
         {
             updateCamera(delta, camera_speed, core.swap_chain.extent, application.scene.camera, app, core.window);
+            clampCameraToGround(application.scene);
         }
 
 /*
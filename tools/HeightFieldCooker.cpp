@@ -0,0 +1,69 @@
+// Cooks a height map image into a tiled height field for streaming, see
+// HeightField.h, with the overview the terrain uses until the tiles are loaded.
+//
+//   height-field-cooker [height_map.png] [height_field.hfield] [tile_size]
+//
+// The height map defaults to ./textures/dune3_height.png and the output to the
+// same path with the .hfield extension, where the demo looks for it. Heights
+// are read as 16 bit, 8 bit maps are scaled up. Tiles default to 256 samples.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "HeightField.h"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <filesystem>
+#include <span>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    std::string const path = argc > 1 ? argv[1] : "./textures/dune3_height.png";
+    std::string const out_path = argc > 2 ? argv[2] : std::filesystem::path(path).replace_extension(".hfield").string();
+    uint32_t const tile_size = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : 256;
+
+    if (tile_size == 0)
+    {
+        spdlog::error("The tile size has to be larger than 0");
+        return 1;
+    }
+
+    auto const start = std::chrono::high_resolution_clock::now();
+
+    int width, height, channels {};
+    auto pixels = stbi_load_16(path.c_str(), &width, &height, &channels, STBI_grey);
+    if (!pixels)
+    {
+        spdlog::error("Could not load a height map from {}", path);
+        return 1;
+    }
+
+    auto const written = writeHeightField(out_path,
+                                          std::span<uint16_t const>(pixels, size_t(width) * height),
+                                          width, height, tile_size);
+    stbi_image_free(pixels);
+
+    if (!written)
+    {
+        spdlog::error("Could not write {}", out_path);
+        return 1;
+    }
+
+    auto const height_field = mapHeightField(out_path);
+    if (!height_field)
+    {
+        spdlog::error("Could not read back {}", out_path);
+        return 1;
+    }
+
+    auto const& header = height_field->header;
+    spdlog::info("{} ({}x{}) to {}, {}x{} tiles of {} samples, {} KB in {} ms",
+                 path, width, height, out_path, header.tiles_x, header.tiles_y, header.tile_size,
+                 height_field->file.size / 1024,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count());
+
+    return 0;
+}
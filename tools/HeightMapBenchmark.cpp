@@ -0,0 +1,310 @@
+// Terrain normal generation from a height map, the grid based generator compared
+// to the old one that collected face normals in a map keyed on position.
+//
+//   height-map-benchmark [height_map.png] [crop]
+//
+// The height map defaults to ./textures/dune3_height.png. The old generator
+// builds six vertices per quad and keys its map on their positions, give a crop
+// to only use the top left crop x crop pixels when the full map takes too long.
+// Both generators run on the same heights and every vertex of the old result is
+// compared field by field, within a tolerance, with the vertex of the new one on
+// the same grid point. The old ground computes the right and bottom edges of a
+// quad as offsets, which can round a shared corner into two map keys with part
+// of the faces each. Expect large differences when the quad size is not exact in
+// a float, a 513 pixel map over the default 200 units has none. Elsewhere the
+// face normals are summed in a different order, which only changes the last bits.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "height_map.h"
+#include "JobSystem.h"
+
+#include <spdlog/spdlog.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct LegacyBtn
+{
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    glm::vec3 normal;
+};
+
+static LegacyBtn legacyBtn(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, glm::vec2 uv1, glm::vec2 uv2, glm::vec2 uv3)
+{
+    glm::vec3 edge1 = p1 - p3;
+    glm::vec3 edge2 = p2 - p3;
+
+    glm::vec2 delta_uv1 = uv1 - uv3;
+    glm::vec2 delta_uv2 = uv2 - uv3;
+
+    float f = 1.0f / (delta_uv1.x * delta_uv2.y - delta_uv2.x * delta_uv2.y);
+
+    glm::vec3 tangent;
+    tangent.x = f * (delta_uv2.y * edge1.x - delta_uv1.y * edge2.x);
+    tangent.y = f * (delta_uv2.y * edge1.y - delta_uv1.y * edge2.y);
+    tangent.z = f * (delta_uv2.y * edge1.z - delta_uv1.y * edge2.z);
+
+    glm::vec3 bitangent;
+    bitangent.x = f * (-delta_uv2.x * edge1.x + delta_uv1.x * edge2.x);
+    bitangent.y = f * (-delta_uv2.x * edge1.y + delta_uv1.x * edge2.y);
+    bitangent.z = f * (-delta_uv2.x * edge1.z + delta_uv1.x * edge2.z);
+
+    glm::vec3 normal(0,1,0);
+
+    return LegacyBtn{glm::normalize(tangent), glm::normalize(bitangent), glm::normalize(normal)};
+
+}
+
+// Frozen copy of createFlatGround from before the grid based generator, six
+// vertices per quad and no sharing. Kept here so the baseline does not change
+// when the ground in height_map.cpp does.
+static Model legacyFlatGround(std::size_t size, float length, size_t texture_size)
+{
+    size_t x_size = size;
+    size_t y_size = size;
+
+    float x_interval = float(length)/x_size;
+    float y_interval = float(length)/y_size;
+
+    float x_left = 0.0f - (length/2);
+    float y_left = 0.0f - (length/2);
+
+    Model model{};
+    size_t count = 0;
+
+    for (size_t y = 0; y < y_size; ++y)
+    {
+        float y_top_left = y_left  + y_interval*(y%y_size);
+        for (size_t x = 0; x < x_size; ++x)
+        {
+            float x_top_left = x_left + x_interval*(x%x_size);
+
+            glm::vec3 top_left  (x_top_left, 0, y_top_left);                             // 2      3 
+            glm::vec3 top_right (x_top_left+x_interval, 0, y_top_left);                  // 1
+            glm::vec3 bottom_left (x_top_left, 0, y_top_left+y_interval);                //        4
+            glm::vec3 bottom_right (x_top_left+x_interval, 0, y_top_left+y_interval);    // 0      5
+
+            glm::vec2 norm_top_left((float)x/(x_size+1), 1.0-((float)y/(y_size+1)));
+            glm::vec2 norm_top_right((float)(x+1)/(x_size+1), 1.0-((float)y/(y_size+1)));
+            glm::vec2 norm_bottom_left((float)x/(x_size+1), 1.0-(float(y+1)/(y_size+1)));
+            glm::vec2 norm_bottom_right((float)(x+1)/(x_size+1), 1.0-(float(y+1)/(y_size+1)));
+
+            size_t x_texture = x % (texture_size+1);
+            size_t y_texture = y % (texture_size+1);
+
+            glm::vec2 tex_top_left((float)x_texture/(texture_size+1), 1.0-((float)y_texture/(texture_size+1)));
+            glm::vec2 tex_top_right((float)(x_texture+1)/(texture_size+1), 1.0-((float)y_texture/(texture_size+1)));
+            glm::vec2 tex_bottom_left((float)x_texture/(texture_size+1), 1.0-(float(y_texture+1)/(texture_size+1)));
+            glm::vec2 tex_bottom_right((float)(x_texture+1)/(texture_size+1), 1.0-(float(y_texture+1)/(texture_size+1)));
+
+            auto btn   = legacyBtn(top_right, top_left, bottom_right, norm_top_right, norm_top_left, norm_bottom_right);
+            auto btn_2 = legacyBtn(bottom_left, bottom_right, top_left, norm_bottom_left, norm_bottom_right, norm_top_left);
+
+            // TODO: Make BTN per triangle. I think we need two more vertices per quad
+
+            glm::vec3 normal(0,1,0);
+            model.vertices.push_back(Vertex{.pos=bottom_left,.tex_coord=tex_bottom_left, .normal=normal, .normal_coord=norm_bottom_left, .tangent=btn_2.tangent, .bitangent=btn_2.bitangent});
+            model.vertices.push_back(Vertex{.pos=bottom_right,.tex_coord=tex_bottom_right, .normal=normal, .normal_coord=norm_bottom_right, .tangent=btn_2.tangent, .bitangent=btn_2.bitangent});
+            model.vertices.push_back(Vertex{.pos=top_right,.tex_coord=tex_top_right, .normal=normal, .normal_coord=norm_top_right, .tangent=btn.tangent, .bitangent=btn.bitangent});
+            model.vertices.push_back(Vertex{.pos=top_right,.tex_coord=tex_top_right, .normal=normal, .normal_coord=norm_top_right, .tangent=btn.tangent, .bitangent=btn.bitangent});
+            model.vertices.push_back(Vertex{.pos=top_left,.tex_coord=tex_top_left, .normal=normal, .normal_coord=norm_top_left, .tangent=btn_2.tangent, .bitangent=btn_2.bitangent});
+            model.vertices.push_back(Vertex{.pos=bottom_left,.tex_coord=tex_bottom_left, .normal=normal, .normal_coord=norm_bottom_left, .tangent=btn_2.tangent, .bitangent=btn_2.bitangent});
+
+
+            model.indices.push_back(count+0);
+            model.indices.push_back(count+1);
+            model.indices.push_back(count+2);
+
+            model.indices.push_back(count+3);
+            model.indices.push_back(count+4);
+            model.indices.push_back(count+5);
+
+            count += 6;
+        }
+    }
+    model.bounds = computeBounds(model.vertices);
+    return model;
+}
+
+struct Comp
+{
+    bool operator()(glm::vec3 const& lhs, glm::vec3 const& rhs) const
+    {
+        return lhs.x < rhs.x ||
+           lhs.x == rhs.x && (lhs.y < rhs.y || lhs.y == rhs.y && lhs.z < rhs.z);
+    }
+};
+
+// Frozen copy of the generator createModelFromHeightMap used before the grid
+// based one. The only change is where the height is read: the original remapped
+// the position to width pixels, which skips pixels and reads past the raster on
+// the last row and column, so the height of the grid point is used like the new
+// generator does.
+static Model legacyModelFromHeights(std::span<unsigned char const> pixels, size_t width, float size, float max_height)
+{
+    auto m = legacyFlatGround(width-1, size, 8);
+    auto const grid = flatGroundLayout(width-1, size);
+
+    for (auto& vertex : m.vertices)
+    {
+        vertex.pos.y = float(pixels[gridPoint(grid, vertex.pos)])/256*max_height;
+    }
+
+    std::map<glm::vec3, std::vector<glm::vec3>, Comp> normal_map;
+    for (auto index = m.indices.begin(); index != m.indices.end(); index += 3)
+    {
+        auto v1 = m.vertices[*index].pos;
+        auto v2 = m.vertices[*(index+1)].pos;
+        auto v3 = m.vertices[*(index+2)].pos;
+
+        auto normal = glm::normalize(glm::cross(v2-v1, v3-v1));
+
+        normal_map[v1].push_back(normal);
+        normal_map[v2].push_back(normal);
+        normal_map[v3].push_back(normal);
+    }
+
+    for (auto& vertex : m.vertices)
+    {
+        auto it = normal_map.find(vertex.pos);
+        if (it != normal_map.end())
+        {
+            auto const& normals = it->second;
+            vertex.normal = glm::normalize(std::accumulate(normals.begin(), normals.end(), glm::vec3(0,0,0)));
+        }
+    }
+
+    for (auto& p1 : m.vertices)
+    {
+        glm::vec3 init_vec;
+
+        if (std::abs(p1.normal.x) < std::abs(p1.normal.y))
+        {
+            if (std::abs(p1.normal.x) < std::abs(p1.normal.z))
+            {
+                init_vec = glm::cross(p1.normal, glm::vec3(1,0,0));
+            }
+            else
+            {
+                init_vec = glm::cross(p1.normal, glm::vec3(0,0,1));
+            }
+        }
+        else
+        {
+            if (std::abs(p1.normal.y) < std::abs(p1.normal.z))
+            {
+                init_vec = glm::cross(p1.normal, glm::vec3(0,1,0));
+            }
+            else
+            {
+                init_vec = glm::cross(p1.normal, glm::vec3(0,0,1));
+            }
+        }
+
+        p1.tangent = glm::normalize(init_vec - glm::dot(p1.normal, init_vec) * p1.normal);
+        p1.bitangent = glm::normalize(glm::cross(p1.normal, p1.tangent));
+    }
+
+    m.bounds = computeBounds(m.vertices);
+
+    return m;
+}
+
+template<typename F>
+static double seconds(F const& run)
+{
+    auto const start = std::chrono::high_resolution_clock::now();
+    run();
+    auto const end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    std::string const path = argc > 1 ? argv[1] : "./textures/dune3_height.png";
+
+    int width, height, channels {};
+    auto pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_grey);
+    if (!pixels || width != height)
+    {
+        spdlog::error("Could not load a square height map from {}", path);
+        stbi_image_free(pixels);
+        return 1;
+    }
+
+    size_t size = width;
+    if (argc > 2)
+    {
+        size = std::clamp<size_t>(std::stoul(argv[2]), 2, width);
+    }
+
+    std::vector<unsigned char> heights(size * size);
+    for (size_t y = 0; y < size; ++y)
+    {
+        std::memcpy(heights.data() + y * size, pixels + y * width, size);
+    }
+    stbi_image_free(pixels);
+
+    float const length = 200.0f;
+    float const max_height = 10.0f;
+
+    spdlog::info("{} ({}x{} of {}x{}), {} worker threads", path, size, size, width, height, jobSystem().size());
+
+    std::optional<Model> legacy;
+    std::optional<Model> grid;
+    auto const legacy_seconds = seconds([&] { legacy.emplace(legacyModelFromHeights(heights, size, length, max_height)); });
+    auto const grid_seconds = seconds([&] { grid.emplace(createModelFromHeights(heights, size, length, max_height)); });
+
+    // The two generators lay out their vertices differently, so every vertex is
+    // compared with a vertex of the other model on the same grid point.
+    auto const layout = flatGroundLayout(size - 1, length);
+    std::vector<Vertex const*> at_point(size * size, nullptr);
+    for (auto const& vertex : grid->vertices)
+    {
+        at_point[gridPoint(layout, vertex.pos)] = &vertex;
+    }
+
+    float const tolerance = 1e-4f;
+    float max_position = 0.0f;
+    float max_normal = 0.0f;
+    float max_tangent = 0.0f;
+    size_t different = 0;
+    for (auto const& a : legacy->vertices)
+    {
+        auto const* b = at_point[gridPoint(layout, a.pos)];
+        if (!b)
+        {
+            ++different;
+            continue;
+        }
+
+        float const position = glm::length(a.pos - b->pos);
+        float const normal = glm::length(a.normal - b->normal);
+        float const tangent = std::max(glm::length(a.tangent - b->tangent), glm::length(a.bitangent - b->bitangent));
+        max_position = std::max(max_position, position);
+        max_normal = std::max(max_normal, normal);
+        max_tangent = std::max(max_tangent, tangent);
+        different += position > tolerance || normal > tolerance || tangent > tolerance;
+    }
+
+    spdlog::info("legacy {} vertices, grid {} vertices", legacy->vertices.size(), grid->vertices.size());
+    spdlog::info("legacy {:8.1f} ms", legacy_seconds * 1000.0);
+    spdlog::info("grid   {:8.1f} ms ({:.1f}x)", grid_seconds * 1000.0, legacy_seconds / grid_seconds);
+    spdlog::info("max position difference {}, max normal difference {}, max tangent difference {}",
+                 max_position, max_normal, max_tangent);
+    spdlog::info("{} of {} legacy vertices differ by more than {}", different, legacy->vertices.size(), tolerance);
+
+    return 0;
+}
@@ -0,0 +1,370 @@
+// Checks the height queries and ray casts of HeightPyramid.h on the CPU.
+//
+//   height-pyramid-check [rays]
+//
+// Builds a pyramid over a generated raster that is not a power of two and
+// compares terrainHeight with the bilinear surface computed straight from the
+// samples, and castRay with a brute force march over that surface in steps of a
+// fraction of a sample. Besides random rays from above it casts rays that miss:
+// upwards, straight up from just over the surface, away from the terrain,
+// outside of it and just over the highest point of a sample line, and rays that
+// run along the edges of the cells and of the coarser pyramid cells just under
+// such a point. A cast may find a touch the march steps over, it is counted as
+// a graze when the ray is within a tolerance of the surface there. Rays start
+// over the surface, castRay leaves out the half sample along the edges, so a
+// ray coming in under the surface from the side is no hit. Exits with 1 when a
+// check fails.
+
+#include "HeightPyramid.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Raster
+{
+    uint32_t width;
+    uint32_t height;
+    float terrain_size;
+    float max_height;
+    std::vector<float> heights;
+
+    float sample(uint32_t x, uint32_t z) const { return heights[size_t(z) * width + x] * max_height; }
+
+    glm::vec2 toSample(glm::vec2 xz) const
+    {
+        return glm::vec2(xz.x * width / terrain_size + width * 0.5f - 0.5f,
+                         -xz.y * height / terrain_size + height * 0.5f - 0.5f);
+    }
+
+    glm::vec2 toTerrain(glm::vec2 sample) const
+    {
+        return glm::vec2((sample.x + 0.5f - width * 0.5f) * terrain_size / width,
+                         -(sample.y + 0.5f - height * 0.5f) * terrain_size / height);
+    }
+
+    // The bilinear surface between the sample centers, in sample coordinates.
+    float surface(glm::vec2 point) const
+    {
+        auto const clamped = glm::clamp(point, glm::vec2(0.0f), glm::vec2(width - 1, height - 1));
+        uint32_t const x = std::min(uint32_t(clamped.x), width - 2);
+        uint32_t const z = std::min(uint32_t(clamped.y), height - 2);
+        float const u = clamped.x - x;
+        float const v = clamped.y - z;
+        return (1 - u) * (1 - v) * sample(x, z) + u * (1 - v) * sample(x + 1, z)
+             + (1 - u) * v * sample(x, z + 1) + u * v * sample(x + 1, z + 1);
+    }
+};
+
+struct March
+{
+    std::optional<float> hit;
+    // Lowest height of the ray over the surface before the hit, or along the
+    // whole ray without one.
+    float clearance;
+};
+
+// Walks the ray over the samples in small steps and bisects the first step
+// that ends under the surface.
+March march(Raster const& raster, glm::vec3 origin, glm::vec3 direction, float max_distance)
+{
+    auto const o = raster.toSample(glm::vec2(origin.x, origin.z));
+    auto const d = raster.toSample(glm::vec2(origin.x + direction.x, origin.z + direction.z)) - o;
+
+    // The part of the ray over the sample centers.
+    float begin = 0.0f;
+    float end = max_distance;
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        float const lo = 0.0f;
+        float const hi = axis == 0 ? raster.width - 1.0f : raster.height - 1.0f;
+        if (d[axis] == 0.0f)
+        {
+            if (o[axis] < lo || o[axis] > hi)
+            {
+                return {std::nullopt, std::numeric_limits<float>::max()};
+            }
+            continue;
+        }
+        float const a = (lo - o[axis]) / d[axis];
+        float const b = (hi - o[axis]) / d[axis];
+        begin = std::max(begin, std::min(a, b));
+        end = std::min(end, std::max(a, b));
+    }
+    if (begin > end)
+    {
+        return {std::nullopt, std::numeric_limits<float>::max()};
+    }
+
+    auto above = [&](float t)
+    {
+        return origin.y + direction.y * t - raster.surface(o + d * t);
+    };
+
+    float const length = glm::length(d) * (end - begin);
+    int const steps = std::max(4096, int(length * 64.0f));
+    float const step = (end - begin) / steps;
+
+    March result{std::nullopt, above(begin)};
+    if (result.clearance <= 0.0f)
+    {
+        result.hit = begin;
+        return result;
+    }
+
+    for (int i = 1; i <= steps; ++i)
+    {
+        float t1 = i == steps ? end : begin + step * i;
+        float const height = above(t1);
+        if (height <= 0.0f)
+        {
+            float t0 = begin + step * (i - 1);
+            for (int k = 0; k < 40; ++k)
+            {
+                float const mid = 0.5f * (t0 + t1);
+                (above(mid) > 0.0f ? t0 : t1) = mid;
+            }
+            result.hit = t1;
+            return result;
+        }
+        result.clearance = std::min(result.clearance, height);
+    }
+    return result;
+}
+
+struct Counts
+{
+    size_t hits{};
+    size_t misses{};
+    size_t grazes{};
+    size_t failed{};
+};
+
+void checkRay(Raster const& raster, HeightPyramid const& pyramid, glm::vec3 origin, glm::vec3 direction,
+              float max_distance, std::optional<bool> expect_hit, char const* kind, Counts& counts)
+{
+    auto const cast = castRay(pyramid, origin, direction, max_distance);
+    auto const reference = march(raster, origin, direction, max_distance);
+
+    // Heights are compared in the units of the terrain, distances in the
+    // units of the direction.
+    float const height_tolerance = 1e-3f * raster.max_height;
+    float const distance_tolerance = 1e-3f * raster.terrain_size / std::max(glm::length(direction), 1e-6f);
+
+    auto fail = [&](std::string const& what)
+    {
+        spdlog::error("{} ray ({}, {}, {}) + t ({}, {}, {}): {}", kind, origin.x, origin.y, origin.z,
+                      direction.x, direction.y, direction.z, what);
+        ++counts.failed;
+    };
+
+    if (expect_hit && *expect_hit != bool(reference.hit))
+    {
+        fail(fmt::format("the march {}, the ray was built to {}", reference.hit ? "hits" : "misses", *expect_hit ? "hit" : "miss"));
+        return;
+    }
+
+    if (cast)
+    {
+        auto const at = origin + direction * cast->distance;
+        float const gap = at.y - raster.surface(raster.toSample(glm::vec2(at.x, at.z)));
+        if (std::abs(gap) > height_tolerance)
+        {
+            fail(fmt::format("hit at t {} is {} off the surface", cast->distance, gap));
+            return;
+        }
+
+        float const surface_height = terrainHeight(pyramid, glm::vec2(at.x, at.z));
+        if (std::abs(surface_height - (at.y - gap)) > height_tolerance)
+        {
+            fail(fmt::format("terrainHeight at the hit is {}, the surface is at {}", surface_height, at.y - gap));
+            return;
+        }
+    }
+
+    if (!cast && !reference.hit)
+    {
+        ++counts.misses;
+        return;
+    }
+    if (!cast)
+    {
+        fail(fmt::format("missed, the march hits at t {}", *reference.hit));
+        return;
+    }
+    if (reference.hit && std::abs(cast->distance - *reference.hit) <= distance_tolerance)
+    {
+        ++counts.hits;
+        return;
+    }
+    if (reference.hit && cast->distance > *reference.hit)
+    {
+        fail(fmt::format("hit at t {}, the march hits earlier at t {}", cast->distance, *reference.hit));
+        return;
+    }
+
+    // The cast is earlier than the march or the march found nothing: a touch
+    // between two steps, the march passed within the tolerance of the surface.
+    if (reference.clearance <= height_tolerance)
+    {
+        ++counts.grazes;
+        return;
+    }
+    fail(fmt::format("hit at t {}, the march {} and stays {} over the surface", cast->distance,
+                     reference.hit ? fmt::format("hits at t {}", *reference.hit) : std::string("misses"), reference.clearance));
+}
+
+// Sum of a few waves and a sharp peak, in [0, 1].
+Raster createRaster(uint32_t width, uint32_t height)
+{
+    Raster raster{width, height, 100.0f, 7.0f, std::vector<float>(size_t(width) * height)};
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> noise(0.0f, 0.05f);
+    for (uint32_t z = 0; z < height; ++z)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            float const h = 0.45f + 0.2f * std::sin(x * 0.21f) * std::cos(z * 0.17f) + 0.15f * std::sin((x + 2 * z) * 0.05f);
+            raster.heights[size_t(z) * width + x] = std::clamp(h + noise(random), 0.0f, 1.0f);
+        }
+    }
+    raster.heights[size_t(height / 3) * width + width / 2] = 1.0f;
+    return raster;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t const random_rays = argc > 1 ? std::stoul(argv[1]) : 5000;
+
+    auto const raster = createRaster(97, 71);
+    auto const pyramid = createHeightPyramid(raster.heights, raster.width, raster.height, raster.terrain_size, raster.max_height);
+
+    int failed = 0;
+
+    // Heights at the sample centers and in between.
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> along(-0.5f * raster.terrain_size, 0.5f * raster.terrain_size);
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        glm::vec2 const xz = i < raster.heights.size()
+            ? raster.toTerrain(glm::vec2(i % raster.width, i / raster.width))
+            : glm::vec2(along(random), along(random));
+        float const expected = raster.surface(raster.toSample(xz));
+        float const height = terrainHeight(pyramid, xz);
+        if (std::abs(height - expected) > 1e-4f * raster.max_height)
+        {
+            spdlog::error("terrainHeight({}, {}) is {}, the surface is at {}", xz.x, xz.y, height, expected);
+            ++failed;
+        }
+    }
+
+    Counts counts;
+    float const top = raster.max_height * 1.5f;
+
+    // From above, down at any angle. The origins are over the sample centers and
+    // the highest point, so no ray comes in from the side.
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    auto const inner = raster.toTerrain(glm::vec2(0.0f));
+    std::uniform_real_distribution<float> inside_x(-std::abs(inner.x), std::abs(inner.x));
+    std::uniform_real_distribution<float> inside_z(-std::abs(inner.y), std::abs(inner.y));
+    for (size_t i = 0; i < random_rays; ++i)
+    {
+        float const y = raster.max_height + (top - raster.max_height) * std::abs(unit(random));
+        glm::vec3 const origin(inside_x(random), y, inside_z(random));
+        glm::vec3 const direction(unit(random), -std::abs(unit(random)) - 0.05f, unit(random));
+        checkRay(raster, pyramid, origin, direction, std::numeric_limits<float>::max(), std::nullopt, "random", counts);
+    }
+
+    // Upwards, away from the terrain, beside it and past the end of a short ray.
+    for (size_t i = 0; i < 200; ++i)
+    {
+        glm::vec3 const origin(along(random), top, along(random));
+        checkRay(raster, pyramid, origin, glm::vec3(unit(random), 0.5f, unit(random)), std::numeric_limits<float>::max(), false, "upwards", counts);
+
+        glm::vec3 const outside(raster.terrain_size, 0.0f, along(random));
+        checkRay(raster, pyramid, outside, glm::vec3(1.0f, -0.1f, unit(random)), std::numeric_limits<float>::max(), false, "away", counts);
+        checkRay(raster, pyramid, glm::vec3(outside.z, 1.0f, raster.terrain_size), glm::vec3(unit(random), -1.0f, 0.0f),
+                 std::numeric_limits<float>::max(), false, "beside", counts);
+
+        checkRay(raster, pyramid, origin, glm::vec3(unit(random), -1.0f, unit(random)), 1e-3f, false, "short", counts);
+
+        // Straight up from just over the surface, which is behind the ray.
+        glm::vec2 const ground(inside_x(random), inside_z(random));
+        float const ground_height = raster.surface(raster.toSample(ground)) + 1e-3f * raster.max_height;
+        checkRay(raster, pyramid, glm::vec3(ground.x, ground_height, ground.y), glm::vec3(0.0f, 1.0f, 0.0f),
+                 std::numeric_limits<float>::max(), false, "straight up", counts);
+    }
+
+    // Along the sample lines, over and under the highest sample of the line. The
+    // lines at multiples of 2, 4, 8 and so on are the edges of the coarser cells
+    // of the pyramid, the first and the last the edges of the terrain.
+    auto graze = [&](uint32_t line, bool along_x)
+    {
+        uint32_t const length = along_x ? raster.width : raster.height;
+        float highest = 0.0f;
+        uint32_t peak = 0;
+        for (uint32_t i = 0; i < length; ++i)
+        {
+            float const h = along_x ? raster.sample(i, line) : raster.sample(line, i);
+            if (h > highest)
+            {
+                highest = h;
+                peak = i;
+            }
+        }
+
+        auto const start = along_x ? glm::vec2(-1.0f, line) : glm::vec2(line, -1.0f);
+        auto const end = along_x ? glm::vec2(raster.width, line) : glm::vec2(line, raster.height);
+        auto const from = raster.toTerrain(start);
+        auto const to = raster.toTerrain(end);
+        glm::vec3 const direction(to.x - from.x, 0.0f, to.y - from.y);
+
+        float const offset = 2e-3f * raster.max_height;
+        checkRay(raster, pyramid, glm::vec3(from.x, highest + offset, from.y), direction, 1.0f, false, "over a line", counts);
+
+        // Under the peak the ray would come in from the side when the line starts with it.
+        float const first = along_x ? raster.sample(0, line) : raster.sample(line, 0);
+        if (first < highest - offset)
+        {
+            checkRay(raster, pyramid, glm::vec3(from.x, highest - offset, from.y), direction, 1.0f, true, "under a line", counts);
+        }
+
+        // Falling onto the peak from the side, through the corner of the cells.
+        auto const corner = raster.toTerrain(along_x ? glm::vec2(peak, line) : glm::vec2(line, peak));
+        glm::vec3 const target(corner.x, highest, corner.y);
+        glm::vec3 const source = target + glm::vec3(direction.x, 0.0f, direction.z) * -0.1f + glm::vec3(0.0f, 1.0f, 0.0f);
+        checkRay(raster, pyramid, source, target - source, 2.0f, true, "onto a corner", counts);
+    };
+
+    for (uint32_t line = 0; line < raster.height; line += line < 8 ? 1 : 8)
+    {
+        graze(line, true);
+    }
+    graze(raster.height - 1, true);
+    for (uint32_t line = 0; line < raster.width; line += line < 8 ? 1 : 8)
+    {
+        graze(line, false);
+    }
+    graze(raster.width - 1, false);
+
+    spdlog::info("{} rays hit like the march, {} missed like it, {} grazed, {} failed",
+                 counts.hits, counts.misses, counts.grazes, counts.failed);
+
+    failed += int(counts.failed);
+    if (failed > 0)
+    {
+        spdlog::error("{} checks failed", failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+// Checks the mesh optimization passes of Model.h on the CPU.
+//
+//   mesh-optimizer-check [file.obj...]
+//
+// Runs optimizeVertexCache, optimizeOverdraw and optimizeVertexFetch on a few
+// generated meshes and on every given OBJ, and checks that each pass only
+// reorders: the triangles after a pass are the triangles before it, with the
+// same winding, and every triangle still has the same vertex data after the
+// vertices are remapped. The ACMR after the cache pass and after all passes may
+// not be above the one of the input. Exits with 1 when a check fails.
+
+#include "Model.h"
+#include "ObjLoader.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+// Every attribute of a vertex, compared field by field instead of as bytes,
+// Vertex has padding.
+using VertexKey = std::array<float, 16>;
+
+static VertexKey vertexKey(Vertex const& v)
+{
+    return {v.pos.x, v.pos.y, v.pos.z, v.tex_coord.x, v.tex_coord.y,
+            v.normal.x, v.normal.y, v.normal.z, v.normal_coord.x, v.normal_coord.y,
+            v.tangent.x, v.tangent.y, v.tangent.z, v.bitangent.x, v.bitangent.y, v.bitangent.z};
+}
+
+// The triangles as sorted keys, each rotated to start with its smallest corner
+// so the winding is kept.
+template<typename Key, typename KeyOf>
+static std::vector<std::array<Key, 3>> triangleSet(std::span<uint32_t const> indices, KeyOf const& key_of)
+{
+    std::vector<std::array<Key, 3>> triangles;
+    triangles.reserve(indices.size() / 3);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        std::array<Key, 3> const corners{key_of(indices[t]), key_of(indices[t + 1]), key_of(indices[t + 2])};
+        auto const first = std::min_element(corners.begin(), corners.end()) - corners.begin();
+        triangles.push_back({corners[first], corners[(first + 1) % 3], corners[(first + 2) % 3]});
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+static auto indexTriangles(std::span<uint32_t const> indices)
+{
+    return triangleSet<uint32_t>(indices, [](uint32_t index) { return index; });
+}
+
+static auto vertexTriangles(std::span<Vertex const> vertices, std::span<uint32_t const> indices)
+{
+    return triangleSet<VertexKey>(indices, [vertices](uint32_t index) { return vertexKey(vertices[index]); });
+}
+
+static bool check(bool condition, std::string const& name, char const* what)
+{
+    if (!condition)
+    {
+        spdlog::error("{}: {}", name, what);
+    }
+    return condition;
+}
+
+static bool checkPasses(std::string const& name, std::vector<Vertex> vertices, std::vector<uint32_t> indices)
+{
+    auto const input_triangles = vertexTriangles(vertices, indices);
+    auto const input = analyzeVertexCache(indices, vertices.size());
+    bool ok = true;
+
+    auto before = indexTriangles(indices);
+    optimizeVertexCache(indices, vertices.size());
+    auto const cache = analyzeVertexCache(indices, vertices.size());
+    ok &= check(indexTriangles(indices) == before, name, "optimizeVertexCache changed the triangles");
+    ok &= check(cache.acmr <= input.acmr, name, "optimizeVertexCache increased the ACMR");
+
+    optimizeOverdraw(indices, vertices);
+    auto const overdraw = analyzeVertexCache(indices, vertices.size());
+    ok &= check(indexTriangles(indices) == before, name, "optimizeOverdraw changed the triangles");
+
+    optimizeVertexFetch(vertices, indices);
+    auto const fetch = analyzeVertexCache(indices, vertices.size());
+    ok &= check(vertexTriangles(vertices, indices) == input_triangles, name, "optimizeVertexFetch changed the vertex data of the triangles");
+    ok &= check(fetch.acmr == overdraw.acmr, name, "optimizeVertexFetch changed the ACMR");
+    ok &= check(fetch.acmr <= input.acmr, name, "the passes increased the ACMR");
+
+    spdlog::info("{:<24} {:>8} triangles, ACMR {:.3f} -> cache {:.3f} -> overdraw {:.3f}, ATVR {:.3f} -> {:.3f} {}",
+                 name, indices.size() / 3, input.acmr, cache.acmr, overdraw.acmr, input.atvr, fetch.atvr, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// A size x size grid of quads with its triangles in random order.
+static Model shuffledGrid(uint32_t size)
+{
+    Model model;
+    for (uint32_t y = 0; y <= size; ++y)
+    {
+        for (uint32_t x = 0; x <= size; ++x)
+        {
+            Vertex vertex{};
+            vertex.pos = glm::vec3(x, std::sin(x * 0.3f) * std::cos(y * 0.2f), y);
+            vertex.tex_coord = glm::vec2(x, y) / float(size);
+            vertex.normal = glm::vec3(0, 1, 0);
+            vertex.tangent = glm::vec3(1, 0, 0);
+            vertex.bitangent = glm::vec3(0, 0, 1);
+            model.vertices.push_back(vertex);
+        }
+    }
+
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            uint32_t const a = y * (size + 1) + x;
+            uint32_t const c = a + size + 1;
+            triangles.push_back({a, c, a + 1});
+            triangles.push_back({a + 1, c, c + 1});
+        }
+    }
+
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1));
+    for (auto const& triangle : triangles)
+    {
+        model.indices.insert(model.indices.end(), triangle.begin(), triangle.end());
+    }
+    return model;
+}
+
+// A closed sphere, so the overdraw pass has clusters facing every way. The
+// vertices are shuffled to give the fetch pass something to do.
+static Model shuffledSphere(uint32_t rings, uint32_t segments)
+{
+    Model model;
+    for (uint32_t r = 0; r <= rings; ++r)
+    {
+        float const theta = glm::pi<float>() * r / rings;
+        for (uint32_t s = 0; s <= segments; ++s)
+        {
+            float const phi = 2.0f * glm::pi<float>() * s / segments;
+            Vertex vertex{};
+            vertex.normal = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            vertex.pos = vertex.normal * 10.0f;
+            vertex.tex_coord = glm::vec2(float(s) / segments, float(r) / rings);
+            model.vertices.push_back(vertex);
+        }
+    }
+
+    for (uint32_t r = 0; r < rings; ++r)
+    {
+        for (uint32_t s = 0; s < segments; ++s)
+        {
+            uint32_t const a = r * (segments + 1) + s;
+            uint32_t const b = a + segments + 1;
+            model.indices.insert(model.indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+        }
+    }
+
+    std::vector<uint32_t> remap(model.vertices.size());
+    for (uint32_t v = 0; v < remap.size(); ++v)
+    {
+        remap[v] = v;
+    }
+    std::shuffle(remap.begin(), remap.end(), std::mt19937(2));
+
+    std::vector<Vertex> shuffled(model.vertices.size());
+    for (size_t v = 0; v < remap.size(); ++v)
+    {
+        shuffled[remap[v]] = model.vertices[v];
+    }
+    model.vertices = std::move(shuffled);
+    for (auto& index : model.indices)
+    {
+        index = remap[index];
+    }
+    return model;
+}
+
+int main(int argc, char** argv)
+{
+    int failed = 0;
+
+    auto grid = shuffledGrid(200);
+    failed += !checkPasses("shuffled grid", std::move(grid.vertices), std::move(grid.indices));
+
+    auto sphere = shuffledSphere(64, 128);
+    failed += !checkPasses("shuffled sphere", std::move(sphere.vertices), std::move(sphere.indices));
+
+    for (int i = 1; i < argc; ++i)
+    {
+        auto model = parseObj(argv[i]);
+        if (!model)
+        {
+            spdlog::error("Could not load {}", argv[i]);
+            ++failed;
+            continue;
+        }
+
+        // The passes run per submesh, on indices relative to the submesh.
+        auto submeshes = model->submeshes;
+        if (submeshes.empty())
+        {
+            submeshes.push_back(SubMesh{.vertex_count = static_cast<uint32_t>(model->vertices.size()),
+                                        .index_count = static_cast<uint32_t>(model->indices.size())});
+        }
+
+        for (size_t s = 0; s < submeshes.size(); ++s)
+        {
+            auto const& submesh = submeshes[s];
+            std::vector<Vertex> vertices(model->vertices.begin() + submesh.vertex_offset,
+                                         model->vertices.begin() + submesh.vertex_offset + submesh.vertex_count);
+            std::vector<uint32_t> indices(model->indices.begin() + submesh.index_offset,
+                                          model->indices.begin() + submesh.index_offset + submesh.index_count);
+            for (auto& index : indices)
+            {
+                index -= submesh.vertex_offset;
+            }
+
+            failed += !checkPasses(fmt::format("{} [{}]", argv[i], s), std::move(vertices), std::move(indices));
+        }
+    }
+
+    if (failed > 0)
+    {
+        spdlog::error("{} meshes failed", failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,251 @@
+// Checks the meshlets of Meshlet.h on the CPU.
+//
+//   meshlet-check [file.obj...]
+//
+// Runs buildMeshlets on a few generated meshes and on every given OBJ and checks
+// that every triangle of a submesh ends up in exactly one of its meshlets with
+// the same winding, that no meshlet is over meshlet_max_vertices or
+// meshlet_max_triangles, that the meshlet vertices stay in the submesh and that
+// the bounding spheres contain the vertices of their meshlet. Reports the fill
+// rate of each mesh. Exits with 1 when a check fails.
+
+#include "Meshlet.h"
+#include "Model.h"
+#include "ObjLoader.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+using Triangle = std::array<uint32_t, 3>;
+
+// Rotated to start with its smallest corner so the winding is kept.
+static Triangle rotated(uint32_t a, uint32_t b, uint32_t c)
+{
+    if (b < a && b < c)
+    {
+        return {b, c, a};
+    }
+    if (c < a && c < b)
+    {
+        return {c, a, b};
+    }
+    return {a, b, c};
+}
+
+static bool check(bool condition, std::string const& name, std::string const& what)
+{
+    if (!condition)
+    {
+        spdlog::error("{}: {}", name, what);
+    }
+    return condition;
+}
+
+static bool checkSubmesh(std::string const& name, Model const& model, SubMesh const& submesh,
+                         std::span<Meshlet const> meshlets)
+{
+    bool ok = true;
+
+    std::vector<Triangle> expected;
+    for (uint32_t i = 0; i + 2 < submesh.index_count; i += 3)
+    {
+        auto const* index = &model.indices[submesh.index_offset + i];
+        expected.push_back(rotated(index[0], index[1], index[2]));
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<Triangle> emitted;
+    for (size_t m = 0; m < meshlets.size(); ++m)
+    {
+        auto const& meshlet = meshlets[m];
+        if (!check(meshlet.vertex_count <= meshlet_max_vertices, name, fmt::format("meshlet {} has {} vertices", m, meshlet.vertex_count))
+         || !check(meshlet.triangle_count <= meshlet_max_triangles, name, fmt::format("meshlet {} has {} triangles", m, meshlet.triangle_count))
+         || !check(meshlet.vertex_offset + meshlet.vertex_count <= model.meshlet_vertices.size()
+                && meshlet.triangle_offset + meshlet.triangle_count * 3 <= model.meshlet_triangles.size(),
+                   name, fmt::format("meshlet {} is out of range", m)))
+        {
+            ok = false;
+            continue;
+        }
+
+        auto const vertices = std::span(model.meshlet_vertices).subspan(meshlet.vertex_offset, meshlet.vertex_count);
+        auto const triangles = std::span(model.meshlet_triangles).subspan(meshlet.triangle_offset, meshlet.triangle_count * 3);
+
+        float overshoot = 0.0f;
+        for (auto v : vertices)
+        {
+            ok &= check(v >= submesh.vertex_offset && v < submesh.vertex_offset + submesh.vertex_count,
+                        name, fmt::format("meshlet {} uses vertex {} outside of its submesh", m, v));
+            overshoot = std::max(overshoot, glm::distance(model.vertices[v].pos, meshlet.center) - meshlet.radius);
+        }
+        // A little slack for the rounding of the distances.
+        ok &= check(overshoot <= 1e-4f * std::max(meshlet.radius, 1.0f), name,
+                    fmt::format("a vertex of meshlet {} is {} outside of its bounding sphere", m, overshoot));
+
+        for (size_t t = 0; t < triangles.size(); t += 3)
+        {
+            if (!check(triangles[t] < vertices.size() && triangles[t + 1] < vertices.size() && triangles[t + 2] < vertices.size(),
+                       name, fmt::format("meshlet {} has a local index out of range", m)))
+            {
+                ok = false;
+                break;
+            }
+            emitted.push_back(rotated(vertices[triangles[t]], vertices[triangles[t + 1]], vertices[triangles[t + 2]]));
+        }
+    }
+    std::sort(emitted.begin(), emitted.end());
+
+    ok &= check(emitted == expected, name,
+                fmt::format("the meshlets have {} triangles, not every one of the {} triangles exactly once", emitted.size(), expected.size()));
+    return ok;
+}
+
+static bool checkMeshlets(std::string const& name, Model model)
+{
+    buildMeshlets(model);
+
+    auto submeshes = model.submeshes;
+    if (submeshes.empty())
+    {
+        submeshes.push_back(SubMesh{.vertex_count = static_cast<uint32_t>(model.vertices.size()),
+                                    .index_count = static_cast<uint32_t>(model.indices.size()),
+                                    .meshlet_count = static_cast<uint32_t>(model.meshlets.size())});
+    }
+
+    bool ok = true;
+    for (size_t s = 0; s < submeshes.size(); ++s)
+    {
+        auto const& submesh = submeshes[s];
+        auto const meshlets = std::span(model.meshlets).subspan(submesh.meshlet_offset, submesh.meshlet_count);
+        ok &= checkSubmesh(submeshes.size() > 1 ? fmt::format("{} [{}]", name, s) : name, model, submesh, meshlets);
+    }
+
+    auto const stats = analyzeMeshlets(model.meshlets);
+    spdlog::info("{:<24} {:>8} triangles, {:>6} meshlets, vertex fill {:.2f}, triangle fill {:.2f}, cullable {:.2f} {}",
+                 name, model.indices.size() / 3, stats.meshlet_count, stats.vertex_fill, stats.triangle_fill, stats.cullable,
+                 ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// A size x size grid of quads with its triangles in random order.
+static Model shuffledGrid(uint32_t size)
+{
+    Model model;
+    for (uint32_t y = 0; y <= size; ++y)
+    {
+        for (uint32_t x = 0; x <= size; ++x)
+        {
+            Vertex vertex{};
+            vertex.pos = glm::vec3(x, std::sin(x * 0.3f) * std::cos(y * 0.2f), y);
+            vertex.normal = glm::vec3(0, 1, 0);
+            model.vertices.push_back(vertex);
+        }
+    }
+
+    std::vector<Triangle> triangles;
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            uint32_t const a = y * (size + 1) + x;
+            uint32_t const c = a + size + 1;
+            triangles.push_back({a, c, a + 1});
+            triangles.push_back({a + 1, c, c + 1});
+        }
+    }
+
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1));
+    for (auto const& triangle : triangles)
+    {
+        model.indices.insert(model.indices.end(), triangle.begin(), triangle.end());
+    }
+    return model;
+}
+
+// A closed sphere, the poles have vertices with many triangles around them.
+static Model sphere(uint32_t rings, uint32_t segments)
+{
+    Model model;
+    for (uint32_t r = 0; r <= rings; ++r)
+    {
+        float const theta = glm::pi<float>() * r / rings;
+        for (uint32_t s = 0; s <= segments; ++s)
+        {
+            float const phi = 2.0f * glm::pi<float>() * s / segments;
+            Vertex vertex{};
+            vertex.normal = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            vertex.pos = vertex.normal * 10.0f;
+            model.vertices.push_back(vertex);
+        }
+    }
+
+    for (uint32_t r = 0; r < rings; ++r)
+    {
+        for (uint32_t s = 0; s < segments; ++s)
+        {
+            uint32_t const a = r * (segments + 1) + s;
+            uint32_t const b = a + segments + 1;
+            model.indices.insert(model.indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+        }
+    }
+    return model;
+}
+
+// A grid and a sphere as submeshes of one model, the sphere with its vertices
+// after the grid so the meshlets have to stay inside their vertex range.
+static Model twoSubmeshes()
+{
+    auto model = shuffledGrid(40);
+    auto second = sphere(16, 32);
+
+    auto const vertex_offset = static_cast<uint32_t>(model.vertices.size());
+    auto const index_offset = static_cast<uint32_t>(model.indices.size());
+    model.submeshes.push_back(SubMesh{.vertex_count = vertex_offset, .index_count = index_offset});
+    model.submeshes.push_back(SubMesh{.vertex_offset = vertex_offset,
+                                      .vertex_count = static_cast<uint32_t>(second.vertices.size()),
+                                      .index_offset = index_offset,
+                                      .index_count = static_cast<uint32_t>(second.indices.size())});
+
+    model.vertices.insert(model.vertices.end(), second.vertices.begin(), second.vertices.end());
+    for (auto index : second.indices)
+    {
+        model.indices.push_back(index + vertex_offset);
+    }
+    return model;
+}
+
+int main(int argc, char** argv)
+{
+    int failed = 0;
+
+    failed += !checkMeshlets("shuffled grid", shuffledGrid(200));
+    failed += !checkMeshlets("sphere", sphere(64, 128));
+    failed += !checkMeshlets("two submeshes", twoSubmeshes());
+
+    for (int i = 1; i < argc; ++i)
+    {
+        auto model = parseObj(argv[i]);
+        if (!model)
+        {
+            spdlog::error("Could not load {}", argv[i]);
+            ++failed;
+            continue;
+        }
+
+        failed += !checkMeshlets(argv[i], std::move(*model));
+    }
+
+    if (failed > 0)
+    {
+        spdlog::error("{} meshes failed", failed);
+        return 1;
+    }
+    return 0;
+}
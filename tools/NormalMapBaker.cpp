@@ -0,0 +1,120 @@
+// Bakes the normal map of a height map, so the normals the terrain samples with
+// DisplacementNormalMap always match the heights.
+//
+//   normal-map-baker <height_map.png> [normals.png] [terrain_size] [max_height] [curvature.png]
+//
+// The normal map defaults to the height map path with _height replaced by
+// _normals. terrain_size and max_height are the size and displacement of the
+// terrain the map is used on, 100 and 7 like the demo terrain. They set how
+// steep the normals are. A curvature map is written as well when a path is given.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
+#include "NormalMap.h"
+#include "JobSystem.h"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+static std::string normalsPath(std::string path)
+{
+    auto const suffix = path.rfind("_height");
+    if (suffix != std::string::npos)
+    {
+        return path.replace(suffix, 7, "_normals");
+    }
+    return path.insert(path.rfind('.') == std::string::npos ? path.size() : path.rfind('.'), "_normals");
+}
+
+template<typename F>
+static double seconds(F const& run)
+{
+    auto const start = std::chrono::high_resolution_clock::now();
+    run();
+    auto const end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        spdlog::error("Usage: normal-map-baker <height_map.png> [normals.png] [terrain_size] [max_height] [curvature.png]");
+        return 1;
+    }
+
+    std::string const path = argv[1];
+    std::string const out_path = argc > 2 ? argv[2] : normalsPath(path);
+
+    NormalMapSettings settings;
+    if (argc > 3)
+    {
+        settings.terrain_size = std::stof(argv[3]);
+    }
+    if (argc > 4)
+    {
+        settings.max_height = std::stof(argv[4]);
+    }
+    std::string const curvature_path = argc > 5 ? argv[5] : "";
+
+    // 16 bit so the slopes of smooth maps are not quantized, 8 bit maps are scaled up.
+    int width, height, channels {};
+    std::vector<float> heights;
+    auto const load_seconds = seconds([&]
+    {
+        auto pixels = stbi_load_16(path.c_str(), &width, &height, &channels, STBI_grey);
+        if (!pixels)
+        {
+            return;
+        }
+
+        heights.resize(size_t(width) * height);
+        for (size_t i = 0; i < heights.size(); ++i)
+        {
+            heights[i] = pixels[i] / 65535.0f;
+        }
+        stbi_image_free(pixels);
+    });
+
+    if (heights.empty())
+    {
+        spdlog::error("Could not load a height map from {}", path);
+        return 1;
+    }
+
+    BakedNormalMap map;
+    auto const bake_seconds = seconds([&] { map = bakeNormalMap(heights, width, height, settings, !curvature_path.empty()); });
+
+    auto const write_seconds = seconds([&]
+    {
+        if (!stbi_write_png(out_path.c_str(), width, height, 4, map.normals.data(), width * 4))
+        {
+            spdlog::error("Could not write {}", out_path);
+            map.normals.clear();
+        }
+
+        if (!curvature_path.empty() && !stbi_write_png(curvature_path.c_str(), width, height, 1, map.curvature.data(), width))
+        {
+            spdlog::error("Could not write {}", curvature_path);
+            map.normals.clear();
+        }
+    });
+
+    if (map.normals.empty())
+    {
+        return 1;
+    }
+
+    spdlog::info("{} ({}x{}) to {}, {} worker threads", path, width, height, out_path, jobSystem().size());
+    spdlog::info("load {:8.1f} ms", load_seconds * 1000.0);
+    spdlog::info("bake {:8.1f} ms", bake_seconds * 1000.0);
+    spdlog::info("write {:7.1f} ms", write_seconds * 1000.0);
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Parse throughput of the native OBJ loader compared to Assimp.
+//
+//   obj-benchmark [iterations] [file.obj...]
+//
+// Without files every OBJ in ./models is measured. Each loader runs the given
+// number of times per file and the fastest run is reported, so the numbers
+// reflect parsing with a warm page cache rather than disk speed.
+
+#include "ObjLoader.h"
+#include "JobSystem.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+static double bestSeconds(int iterations, std::function<bool()> const& run)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const start = std::chrono::high_resolution_clock::now();
+        if (!run())
+        {
+            return 0.0;
+        }
+        auto const end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = 5;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        if (i == 1 && std::all_of(arg.begin(), arg.end(), ::isdigit))
+        {
+            iterations = std::max(1, std::stoi(arg));
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.empty())
+    {
+        std::error_code ec;
+        for (auto const& entry : std::filesystem::directory_iterator("./models", ec))
+        {
+            if (entry.path().extension() == ".obj")
+            {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+    }
+
+    spdlog::info("{} iterations, {} worker threads", iterations, jobSystem().size());
+    spdlog::info("{:<32} {:>10} {:>12} {:>12} {:>8}", "file", "size (MB)", "native MB/s", "assimp MB/s", "speedup");
+
+    for (auto const& path : paths)
+    {
+        std::error_code ec;
+        auto const megabytes = std::filesystem::file_size(path, ec) / (1024.0 * 1024.0);
+        if (ec)
+        {
+            spdlog::warn("Could not open {}", path);
+            continue;
+        }
+
+        auto const native = bestSeconds(iterations, [&]
+        {
+            return parseObj(path).has_value();
+        });
+
+        // Welding and tangents are part of the native loader, ask Assimp for the same.
+        auto const assimp = bestSeconds(iterations, [&]
+        {
+            Assimp::Importer importer;
+            return importer.ReadFile(path,   aiProcess_Triangulate
+                                           | aiProcess_JoinIdenticalVertices
+                                           | aiProcess_GenSmoothNormals
+                                           | aiProcess_CalcTangentSpace) != nullptr;
+        });
+
+        if (native <= 0.0 || assimp <= 0.0)
+        {
+            spdlog::warn("Could not load {}", path);
+            continue;
+        }
+
+        spdlog::info("{:<32} {:>10.2f} {:>12.1f} {:>12.1f} {:>7.1f}x",
+                     std::filesystem::path(path).filename().string(),
+                     megabytes,
+                     megabytes / native,
+                     megabytes / assimp,
+                     assimp / native);
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Cooks images into block compressed KTX2 textures with all mip levels, see
+// Ktx2.h. The demo loads the .ktx2 next to a texture instead of decoding it.
+//
+//   texture-cooker <format> <image>...
+//
+// Every image is written to the same path with the .ktx2 extension. The format
+// is one of bc1, bc1-srgb, bc4, bc5, bc7 and bc7-srgb and has to match the
+// format the demo asks for: the -srgb variants for color textures loaded as
+// sRGB, bc4 for single channel textures like roughness and ambient occlusion.
+// Normal maps are bc7, the shaders read all three channels of them. bc5 keeps
+// only red and green and needs a shader that rebuilds the third.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "BlockCompression.h"
+#include "Ktx2.h"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+static std::map<std::string, std::pair<BlockFormat, bool>> const formats{
+    {"bc1", {BlockFormat::BC1, false}},
+    {"bc1-srgb", {BlockFormat::BC1, true}},
+    {"bc4", {BlockFormat::BC4, false}},
+    {"bc5", {BlockFormat::BC5, false}},
+    {"bc7", {BlockFormat::BC7, false}},
+    {"bc7-srgb", {BlockFormat::BC7, true}},
+};
+
+static bool cook(std::string const& path, BlockFormat format, bool srgb)
+{
+    auto const start = std::chrono::high_resolution_clock::now();
+
+    int width, height, channels {};
+    auto pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels)
+    {
+        spdlog::error("Could not load an image from {}", path);
+        return false;
+    }
+
+    auto const mips = generateMipChain(std::span<uint8_t const>(pixels, size_t(width) * height * 4), width, height, srgb);
+    stbi_image_free(pixels);
+
+    std::vector<std::vector<uint8_t>> levels;
+    for (size_t level = 0; level < mips.size(); ++level)
+    {
+        uint32_t const level_width = std::max(1, width >> level);
+        uint32_t const level_height = std::max(1, height >> level);
+        levels.push_back(compressImage(format, mips[level], level_width, level_height));
+    }
+
+    auto const out_path = std::filesystem::path(path).replace_extension(".ktx2").string();
+    if (!writeKtx2(out_path, format, srgb, width, height, levels))
+    {
+        spdlog::error("Could not write {}", out_path);
+        return false;
+    }
+
+    size_t size = 0;
+    for (auto const& level : levels)
+    {
+        size += level.size();
+    }
+
+    spdlog::info("{} ({}x{}) to {}, {} levels, {} KB instead of {} KB in {} ms",
+                 path, width, height, out_path, levels.size(), size / 1024,
+                 size_t(width) * height * 4 * 4 / 3 / 1024,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count());
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3 || !formats.contains(argv[1]))
+    {
+        spdlog::error("Usage: texture-cooker <bc1|bc1-srgb|bc4|bc5|bc7|bc7-srgb> <image>...");
+        return 1;
+    }
+
+    auto const [format, srgb] = formats.at(argv[1]);
+
+    int failed = 0;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (!cook(argv[i], format, srgb))
+        {
+            ++failed;
+        }
+    }
+
+    return failed == 0 ? 0 : 1;
+}